@@ -0,0 +1,508 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* A directory of downloaded description and SCPD documents.
+ *
+ * Every document is stored under the SHA-1 of its URL, as "<hash>.xml" for
+ * the body and "<hash>.meta" for a key file with the URL and the ETag and
+ * Last-Modified validators the server sent along. A request for a stored
+ * document is made conditional, so a server that still has the same
+ * document only answers with 304 Not Modified and the stored copy is used.
+ *
+ * Documents the server does not provide any validators for are not stored,
+ * since there would be no way to tell whether they are still current.
+ *
+ * The validators are read into memory once, so requests can be prepared
+ * right away. All disk access happens in a single worker thread, one job
+ * after the other, so a document is never read while it is half written.
+ */
+
+#define G_LOG_DOMAIN "gupnp-description-cache"
+
+#include <config.h>
+
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include "description-cache.h"
+
+#define META_GROUP "Document"
+
+typedef struct {
+        char *etag;
+        char *last_modified;
+} Validators;
+
+typedef enum {
+        JOB_SCAN,
+        JOB_STORE,
+        JOB_REMOVE,
+        JOB_LOAD,
+} JobKind;
+
+typedef struct {
+        JobKind kind;
+        char *url;
+        Validators *validators; /* JOB_STORE */
+        GBytes *body;           /* JOB_STORE */
+        GTask *task;            /* JOB_LOAD */
+} Job;
+
+struct _DescriptionCache {
+        char *path;
+        GThreadPool *worker;
+
+        GMutex lock;
+        GHashTable *validators; /* URL -> Validators, guarded by lock */
+};
+
+static Validators *
+validators_new (const char *etag, const char *last_modified)
+{
+        Validators *validators;
+
+        validators = g_new0 (Validators, 1);
+        validators->etag = g_strdup (etag);
+        validators->last_modified = g_strdup (last_modified);
+
+        return validators;
+}
+
+static void
+validators_free (Validators *validators)
+{
+        g_free (validators->etag);
+        g_free (validators->last_modified);
+        g_free (validators);
+}
+
+static Job *
+job_new (JobKind kind, const char *url)
+{
+        Job *job;
+
+        job = g_new0 (Job, 1);
+        job->kind = kind;
+        job->url = g_strdup (url);
+
+        return job;
+}
+
+static void
+job_free (Job *job)
+{
+        g_free (job->url);
+        g_clear_pointer (&job->validators, validators_free);
+        g_clear_pointer (&job->body, g_bytes_unref);
+        g_clear_object (&job->task);
+        g_free (job);
+}
+
+static char *
+entry_path (DescriptionCache *cache, const char *url, const char *suffix)
+{
+        char *hash;
+        char *name;
+        char *path;
+
+        hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, url, -1);
+        name = g_strconcat (hash, suffix, NULL);
+        path = g_build_filename (cache->path, name, NULL);
+
+        g_free (name);
+        g_free (hash);
+
+        return path;
+}
+
+static void
+entry_forget (DescriptionCache *cache, const char *url)
+{
+        g_mutex_lock (&cache->lock);
+        g_hash_table_remove (cache->validators, url);
+        g_mutex_unlock (&cache->lock);
+}
+
+static void
+entry_remove (DescriptionCache *cache, const char *url)
+{
+        char *path;
+
+        path = entry_path (cache, url, ".meta");
+        g_unlink (path);
+        g_free (path);
+
+        path = entry_path (cache, url, ".xml");
+        g_unlink (path);
+        g_free (path);
+}
+
+/* Read the validators of all stored documents */
+static void
+entries_scan (DescriptionCache *cache)
+{
+        GDir *dir;
+        const char *name;
+        GError *error = NULL;
+
+        if (g_mkdir_with_parents (cache->path, 0700) != 0) {
+                g_warning ("Failed to create description cache %s: %s",
+                           cache->path,
+                           g_strerror (errno));
+
+                return;
+        }
+
+        dir = g_dir_open (cache->path, 0, &error);
+        if (dir == NULL) {
+                g_warning ("Failed to read description cache %s: %s",
+                           cache->path,
+                           error->message);
+                g_error_free (error);
+
+                return;
+        }
+
+        while ((name = g_dir_read_name (dir)) != NULL) {
+                GKeyFile *meta;
+                char *path;
+                char *url;
+                char *etag;
+                char *last_modified;
+                gboolean loaded;
+
+                if (!g_str_has_suffix (name, ".meta"))
+                        continue;
+
+                meta = g_key_file_new ();
+                path = g_build_filename (cache->path, name, NULL);
+                loaded = g_key_file_load_from_file (meta,
+                                                    path,
+                                                    G_KEY_FILE_NONE,
+                                                    NULL);
+                g_free (path);
+
+                url = loaded ? g_key_file_get_string (meta,
+                                                      META_GROUP,
+                                                      "URL",
+                                                      NULL)
+                             : NULL;
+                if (url == NULL) {
+                        g_key_file_free (meta);
+
+                        continue;
+                }
+
+                etag = g_key_file_get_string (meta, META_GROUP, "ETag", NULL);
+                last_modified = g_key_file_get_string (meta,
+                                                       META_GROUP,
+                                                       "LastModified",
+                                                       NULL);
+
+                /* Whatever was downloaded since the start is newer */
+                g_mutex_lock (&cache->lock);
+                if (!g_hash_table_contains (cache->validators, url))
+                        g_hash_table_insert (cache->validators,
+                                             g_strdup (url),
+                                             validators_new (etag,
+                                                             last_modified));
+                g_mutex_unlock (&cache->lock);
+
+                g_free (last_modified);
+                g_free (etag);
+                g_free (url);
+                g_key_file_free (meta);
+        }
+
+        g_dir_close (dir);
+}
+
+static GBytes *
+entry_load_body (DescriptionCache *cache, const char *url)
+{
+        char *path;
+        char *contents = NULL;
+        gsize length;
+        GError *error = NULL;
+
+        path = entry_path (cache, url, ".xml");
+        if (!g_file_get_contents (path, &contents, &length, &error)) {
+                g_debug ("Failed to read cached copy of %s: %s",
+                         url,
+                         error->message);
+                g_error_free (error);
+        }
+        g_free (path);
+
+        if (contents == NULL)
+                return NULL;
+
+        return g_bytes_new_take (contents, length);
+}
+
+static void
+entry_store (DescriptionCache *cache,
+             const char       *url,
+             const Validators *validators,
+             GBytes           *body)
+{
+        GKeyFile *meta;
+        char *path;
+        char *data;
+        gsize length;
+        gconstpointer body_data;
+        gsize body_length;
+        GError *error = NULL;
+
+        /* Write the body first, so metadata never points to a missing or
+         * older body */
+        body_data = g_bytes_get_data (body, &body_length);
+        path = entry_path (cache, url, ".xml");
+        if (!g_file_set_contents (path, body_data, body_length, &error)) {
+                g_warning ("Failed to store %s in description cache: %s",
+                           url,
+                           error->message);
+                g_clear_error (&error);
+                g_free (path);
+                entry_forget (cache, url);
+                entry_remove (cache, url);
+
+                return;
+        }
+        g_free (path);
+
+        meta = g_key_file_new ();
+        g_key_file_set_string (meta, META_GROUP, "URL", url);
+        if (validators->etag != NULL)
+                g_key_file_set_string (meta,
+                                       META_GROUP,
+                                       "ETag",
+                                       validators->etag);
+        if (validators->last_modified != NULL)
+                g_key_file_set_string (meta,
+                                       META_GROUP,
+                                       "LastModified",
+                                       validators->last_modified);
+
+        data = g_key_file_to_data (meta, &length, NULL);
+        path = entry_path (cache, url, ".meta");
+        if (!g_file_set_contents (path, data, length, &error)) {
+                g_warning ("Failed to store %s in description cache: %s",
+                           url,
+                           error->message);
+                g_clear_error (&error);
+                entry_forget (cache, url);
+                entry_remove (cache, url);
+        }
+
+        g_free (path);
+        g_free (data);
+        g_key_file_free (meta);
+}
+
+/* Runs in the worker thread */
+static void
+job_run (Job *job, DescriptionCache *cache)
+{
+        GBytes *stored;
+
+        switch (job->kind) {
+        case JOB_SCAN:
+                entries_scan (cache);
+                break;
+        case JOB_STORE:
+                entry_store (cache, job->url, job->validators, job->body);
+                break;
+        case JOB_REMOVE:
+                entry_remove (cache, job->url);
+                break;
+        case JOB_LOAD:
+                stored = entry_load_body (cache, job->url);
+
+                /* Make sure the next attempt fetches the whole document */
+                if (stored == NULL) {
+                        entry_forget (cache, job->url);
+                        entry_remove (cache, job->url);
+                }
+
+                g_task_return_pointer (job->task,
+                                       stored,
+                                       (GDestroyNotify) g_bytes_unref);
+                break;
+        default:
+                g_assert_not_reached ();
+        }
+
+        job_free (job);
+}
+
+static void
+cache_push (DescriptionCache *cache, Job *job)
+{
+        g_thread_pool_push (cache->worker, job, NULL);
+}
+
+/* Creating the directory and reading what is stored happens in the
+ * background; until then, requests are not conditional. If the directory
+ * cannot be used, a warning is printed and nothing gets stored. */
+DescriptionCache *
+description_cache_new (const char *path)
+{
+        DescriptionCache *cache;
+
+        cache = g_new0 (DescriptionCache, 1);
+        cache->path = g_strdup (path);
+        g_mutex_init (&cache->lock);
+        cache->validators =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) validators_free);
+        cache->worker = g_thread_pool_new ((GFunc) job_run,
+                                           cache,
+                                           1,
+                                           FALSE,
+                                           NULL);
+
+        cache_push (cache, job_new (JOB_SCAN, NULL));
+
+        return cache;
+}
+
+void
+description_cache_free (DescriptionCache *cache)
+{
+        /* Pending writes are finished */
+        g_thread_pool_free (cache->worker, FALSE, TRUE);
+
+        g_hash_table_destroy (cache->validators);
+        g_mutex_clear (&cache->lock);
+        g_free (cache->path);
+        g_free (cache);
+}
+
+const char *
+description_cache_get_path (DescriptionCache *cache)
+{
+        return cache->path;
+}
+
+/* Make @message a conditional request if a copy of @url is stored */
+void
+description_cache_prepare_request (DescriptionCache *cache,
+                                   const char       *url,
+                                   SoupMessage      *message)
+{
+        SoupMessageHeaders *headers;
+        Validators *validators;
+
+        headers = soup_message_get_request_headers (message);
+
+        g_mutex_lock (&cache->lock);
+        validators = g_hash_table_lookup (cache->validators, url);
+        if (validators != NULL && validators->etag != NULL)
+                soup_message_headers_replace (headers,
+                                              "If-None-Match",
+                                              validators->etag);
+        if (validators != NULL && validators->last_modified != NULL)
+                soup_message_headers_replace (headers,
+                                              "If-Modified-Since",
+                                              validators->last_modified);
+        g_mutex_unlock (&cache->lock);
+}
+
+/* Make @message ask for the whole document again. Returns %FALSE if it
+ * already did, so there is no point in sending it again */
+gboolean
+description_cache_drop_conditions (SoupMessage *message)
+{
+        SoupMessageHeaders *headers;
+
+        headers = soup_message_get_request_headers (message);
+        if (soup_message_headers_get_one (headers, "If-None-Match") == NULL &&
+            soup_message_headers_get_one (headers, "If-Modified-Since") ==
+                    NULL)
+                return FALSE;
+
+        soup_message_headers_remove (headers, "If-None-Match");
+        soup_message_headers_remove (headers, "If-Modified-Since");
+
+        return TRUE;
+}
+
+/* Get the document @message retrieved for @url, either @body or the stored
+ * copy if the server answered 304. The result is %NULL if @message did not
+ * yield a document; if the stored copy went missing, the entry is dropped
+ * and description_cache_drop_conditions() tells whether to send @message
+ * again. */
+void
+description_cache_handle_response_async (DescriptionCache   *cache,
+                                         const char         *url,
+                                         SoupMessage        *message,
+                                         GBytes             *body,
+                                         GCancellable       *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer            user_data)
+{
+        SoupMessageHeaders *headers;
+        const char *etag;
+        const char *last_modified;
+        GTask *task;
+        Job *job;
+        guint status;
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, description_cache_handle_response_async);
+
+        status = soup_message_get_status (message);
+        if (status == SOUP_STATUS_NOT_MODIFIED) {
+                job = job_new (JOB_LOAD, url);
+                job->task = task;
+                cache_push (cache, job);
+
+                return;
+        }
+
+        if (!SOUP_STATUS_IS_SUCCESSFUL (status) || body == NULL) {
+                g_task_return_pointer (task, NULL, NULL);
+                g_object_unref (task);
+
+                return;
+        }
+
+        headers = soup_message_get_response_headers (message);
+        etag = soup_message_headers_get_one (headers, "ETag");
+        last_modified = soup_message_headers_get_one (headers,
+                                                      "Last-Modified");
+
+        if (etag == NULL && last_modified == NULL) {
+                entry_forget (cache, url);
+                cache_push (cache, job_new (JOB_REMOVE, url));
+        } else {
+                g_mutex_lock (&cache->lock);
+                g_hash_table_replace (cache->validators,
+                                      g_strdup (url),
+                                      validators_new (etag, last_modified));
+                g_mutex_unlock (&cache->lock);
+
+                job = job_new (JOB_STORE, url);
+                job->validators = validators_new (etag, last_modified);
+                job->body = g_bytes_ref (body);
+                cache_push (cache, job);
+        }
+
+        g_task_return_pointer (task,
+                               g_bytes_ref (body),
+                               (GDestroyNotify) g_bytes_unref);
+        g_object_unref (task);
+}
+
+GBytes *
+description_cache_handle_response_finish (GAsyncResult *res, GError **error)
+{
+        g_return_val_if_fail (g_task_is_valid (res, NULL), NULL);
+
+        return g_task_propagate_pointer (G_TASK (res), error);
+}
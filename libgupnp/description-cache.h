@@ -0,0 +1,48 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef GUPNP_DESCRIPTION_CACHE_H
+#define GUPNP_DESCRIPTION_CACHE_H
+
+#include <libsoup/soup.h>
+
+G_BEGIN_DECLS
+
+typedef struct _DescriptionCache DescriptionCache;
+
+G_GNUC_INTERNAL DescriptionCache *
+description_cache_new              (const char       *path);
+
+G_GNUC_INTERNAL void
+description_cache_free             (DescriptionCache *cache);
+
+G_GNUC_INTERNAL const char *
+description_cache_get_path         (DescriptionCache *cache);
+
+G_GNUC_INTERNAL void
+description_cache_prepare_request  (DescriptionCache *cache,
+                                    const char       *url,
+                                    SoupMessage      *message);
+
+G_GNUC_INTERNAL gboolean
+description_cache_drop_conditions  (SoupMessage      *message);
+
+G_GNUC_INTERNAL void
+description_cache_handle_response_async
+                                   (DescriptionCache   *cache,
+                                    const char         *url,
+                                    SoupMessage        *message,
+                                    GBytes             *body,
+                                    GCancellable       *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer            user_data);
+
+G_GNUC_INTERNAL GBytes *
+description_cache_handle_response_finish
+                                   (GAsyncResult       *res,
+                                    GError            **error);
+
+G_END_DECLS
+
+#endif /* GUPNP_DESCRIPTION_CACHE_H */
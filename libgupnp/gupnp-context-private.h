@@ -12,6 +12,9 @@
 #include <libsoup/soup.h>
 
 #include "gupnp-acl-private.h"
+#include "gupnp-service-introspection.h"
+#include "description-cache.h"
+#include "timer-wheel.h"
 
 G_BEGIN_DECLS
 
@@ -23,6 +26,58 @@ _gupnp_context_add_server_handler_with_data (GUPnPContext *context,
                                              const char *path,
                                              AclServerHandler *data);
 
+G_GNUC_INTERNAL TimerWheel *
+_gupnp_context_get_timer_wheel (GUPnPContext *context);
+
+/* All service proxies of a context receive their events below this path */
+#define GUPNP_CONTEXT_EVENT_PATH "/GUPnPEvents"
+
+typedef void (*GUPnPContextEventCallback) (SoupServerMessage *msg,
+                                           gpointer           user_data);
+
+G_GNUC_INTERNAL void
+_gupnp_context_add_event_receiver (GUPnPContext             *context,
+                                   const char               *path,
+                                   GUPnPContextEventCallback callback,
+                                   gpointer                  user_data);
+
+G_GNUC_INTERNAL void
+_gupnp_context_set_event_receiver_sid (GUPnPContext *context,
+                                       const char   *path,
+                                       const char   *sid);
+
+G_GNUC_INTERNAL void
+_gupnp_context_remove_event_receiver (GUPnPContext *context,
+                                      const char   *path);
+
+G_GNUC_INTERNAL void
+_gupnp_context_send_action_async (GUPnPContext       *context,
+                                  SoupMessage        *msg,
+                                  int                 priority,
+                                  GCancellable       *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer            user_data);
+
+G_GNUC_INTERNAL DescriptionCache *
+_gupnp_context_get_description_cache (GUPnPContext *context);
+
+G_GNUC_INTERNAL GUPnPServiceIntrospection *
+_gupnp_context_lookup_introspection (GUPnPContext *context, const char *key);
+
+G_GNUC_INTERNAL void
+_gupnp_context_add_introspection (GUPnPContext              *context,
+                                  const char                *key,
+                                  GUPnPServiceIntrospection *introspection);
+
+G_GNUC_INTERNAL gpointer
+_gupnp_context_lookup_introspection_fetch (GUPnPContext *context,
+                                           const char   *url);
+
+G_GNUC_INTERNAL void
+_gupnp_context_set_introspection_fetch (GUPnPContext *context,
+                                        const char   *url,
+                                        gpointer      fetch);
+
 G_GNUC_INTERNAL GUri *
 gupnp_context_rewrite_uri_to_uri (GUPnPContext *context, const char *uri);
 
@@ -50,9 +50,16 @@
 #include "gena-protocol.h"
 #include "http-headers.h"
 #include "gupnp-device.h"
+#include "description-cache.h"
+#include "timer-wheel.h"
 
 #define GUPNP_CONTEXT_DEFAULT_LANGUAGE "en"
 
+/* Connections libsoup may open to a single host. Actions are limited by
+ * max-actions-per-host below that */
+#define GUPNP_CONTEXT_MAX_CONNS_PER_HOST 16
+#define GUPNP_CONTEXT_DEFAULT_MAX_ACTIONS_PER_HOST 2
+
 static void
 gupnp_acl_server_handler (SoupServer *server,
                           SoupServerMessage *msg,
@@ -76,6 +83,24 @@ struct _GUPnPContextPrivate {
         GList       *host_path_datas;
 
         GUPnPAcl    *acl;
+
+        TimerWheel  *timer_wheel; /* Created on demand */
+
+        /* Receivers of GENA events below GUPNP_CONTEXT_EVENT_PATH */
+        GHashTable  *event_receivers; /* path -> EventReceiver */
+        GHashTable  *event_sids;      /* SID -> EventReceiver */
+
+        /* Action scheduling */
+        guint        max_actions_per_host;
+        GHashTable  *action_hosts;    /* host:port -> ActionHost */
+
+        DescriptionCache *description_cache;
+
+        /* Introspections shared by the services of this context */
+        GHashTable  *introspections;        /* key -> introspection */
+        GHashTable  *introspection_objects; /* set of weakly referenced
+                                             * introspections */
+        GHashTable  *introspection_fetches; /* SCPD URL -> pending fetch */
 };
 typedef struct _GUPnPContextPrivate GUPnPContextPrivate;
 
@@ -96,6 +121,8 @@ enum
         PROP_SUBSCRIPTION_TIMEOUT,
         PROP_DEFAULT_LANGUAGE,
         PROP_ACL,
+        PROP_MAX_ACTIONS_PER_HOST,
+        PROP_DESCRIPTION_CACHE_DIR,
 };
 
 typedef struct {
@@ -104,6 +131,37 @@ typedef struct {
         GRegex *regex;
 } UserAgent;
 
+/* Action calls to one remote host */
+typedef struct {
+        GQueue   queue;       /* ScheduledAction, ordered by priority */
+        guint    in_flight;
+
+        guint    max_queued;
+        guint64  completed;
+        gint64   total_wait;  /* In microseconds */
+        gint64   max_wait;
+} ActionHost;
+
+typedef struct {
+        GUPnPContext       *context;
+        char               *host;
+        SoupMessage        *msg;
+        int                 priority;
+        GCancellable       *cancellable;
+        gulong              cancelled_id;
+        GMainContext       *main_context;
+        GAsyncReadyCallback callback;
+        gpointer            user_data;
+        gint64              queued_at;
+} ScheduledAction;
+
+typedef struct {
+        char                     *path;
+        char                     *sid; /* NULL until subscribed */
+        GUPnPContextEventCallback callback;
+        gpointer                  user_data;
+} EventReceiver;
+
 typedef struct {
         char         *local_path;
         char         *server_path;
@@ -152,9 +210,30 @@ make_server_id (GSSDPUDAVersion uda_version)
                                 VERSION);
 #endif
 }
+static void
+action_host_free (ActionHost *host);
+
 static void
 gupnp_context_init (GUPnPContext *context)
 {
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+        priv->max_actions_per_host = GUPNP_CONTEXT_DEFAULT_MAX_ACTIONS_PER_HOST;
+        priv->action_hosts =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) action_host_free);
+        priv->introspections = g_hash_table_new_full (g_str_hash,
+                                                      g_str_equal,
+                                                      g_free,
+                                                      NULL);
+        priv->introspection_objects = g_hash_table_new (NULL, NULL);
+        priv->introspection_fetches = g_hash_table_new_full (g_str_hash,
+                                                             g_str_equal,
+                                                             g_free,
+                                                             NULL);
 }
 
 static gboolean
@@ -185,7 +264,10 @@ gupnp_context_initable_init (GInitable     *initable,
         gssdp_client_set_server_id (GSSDP_CLIENT (context), server_id);
         g_free (server_id);
 
-        priv->session = soup_session_new ();
+        priv->session = soup_session_new_with_options (
+                "max-conns-per-host",
+                GUPNP_CONTEXT_MAX_CONNS_PER_HOST,
+                NULL);
 
         user_agent = g_strdup_printf ("%s GUPnP/" VERSION " DLNADOC/1.50",
                                       g_get_prgname()? : "");
@@ -256,6 +338,16 @@ gupnp_context_set_property (GObject      *object,
                 gupnp_context_set_acl (context, g_value_get_object (value));
 
                 break;
+        case PROP_MAX_ACTIONS_PER_HOST:
+                gupnp_context_set_max_actions_per_host (
+                        context,
+                        g_value_get_uint (value));
+                break;
+        case PROP_DESCRIPTION_CACHE_DIR:
+                gupnp_context_set_description_cache_dir (
+                        context,
+                        g_value_get_string (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -296,12 +388,53 @@ gupnp_context_get_property (GObject    *object,
                                     gupnp_context_get_acl (context));
 
                 break;
+        case PROP_MAX_ACTIONS_PER_HOST:
+                g_value_set_uint (value,
+                                  gupnp_context_get_max_actions_per_host
+                                                                   (context));
+                break;
+        case PROP_DESCRIPTION_CACHE_DIR:
+                g_value_set_string (value,
+                                    gupnp_context_get_description_cache_dir
+                                                                   (context));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
         }
 }
 
+static gboolean
+is_introspection (G_GNUC_UNUSED gpointer key,
+                  gpointer               value,
+                  gpointer               user_data)
+{
+        return value == user_data;
+}
+
+/* A shared introspection was finalized */
+static void
+introspection_finalized (gpointer user_data, GObject *where_the_object_was)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (GUPNP_CONTEXT (user_data));
+
+        g_hash_table_remove (priv->introspection_objects,
+                             where_the_object_was);
+        g_hash_table_foreach_remove (priv->introspections,
+                                     is_introspection,
+                                     where_the_object_was);
+}
+
+static void
+introspection_weak_unref (gpointer               key,
+                          G_GNUC_UNUSED gpointer value,
+                          gpointer               user_data)
+{
+        g_object_weak_unref (G_OBJECT (key), introspection_finalized, user_data);
+}
+
 static void
 gupnp_context_dispose (GObject *object)
 {
@@ -322,9 +455,22 @@ gupnp_context_dispose (GObject *object)
                 gupnp_context_unhost_path (context, data->server_path);
         }
 
+        if (priv->event_receivers != NULL && priv->server != NULL)
+                soup_server_remove_handler (priv->server,
+                                            GUPNP_CONTEXT_EVENT_PATH);
+        g_clear_pointer (&priv->event_sids, g_hash_table_destroy);
+        g_clear_pointer (&priv->event_receivers, g_hash_table_destroy);
+
         g_clear_object (&priv->server);
         g_clear_object (&priv->acl);
 
+        /* Shared introspections may outlive the context */
+        g_hash_table_foreach (priv->introspection_objects,
+                              introspection_weak_unref,
+                              context);
+        g_hash_table_remove_all (priv->introspection_objects);
+        g_hash_table_remove_all (priv->introspections);
+
         /* Call super */
         object_class = G_OBJECT_CLASS (gupnp_context_parent_class);
         object_class->dispose (object);
@@ -345,6 +491,18 @@ gupnp_context_finalize (GObject *object)
         if (priv->server_uri)
                 g_uri_unref (priv->server_uri);
 
+        g_clear_pointer (&priv->timer_wheel, timer_wheel_free);
+
+        /* Every scheduled action holds a reference, so nothing is queued */
+        g_clear_pointer (&priv->action_hosts, g_hash_table_destroy);
+
+        g_clear_pointer (&priv->description_cache, description_cache_free);
+
+        /* Every pending fetch holds a reference, so none are left */
+        g_clear_pointer (&priv->introspections, g_hash_table_destroy);
+        g_clear_pointer (&priv->introspection_objects, g_hash_table_destroy);
+        g_clear_pointer (&priv->introspection_fetches, g_hash_table_destroy);
+
         /* Call super */
         object_class = G_OBJECT_CLASS (gupnp_context_parent_class);
         object_class->finalize (object);
@@ -418,6 +576,30 @@ gupnp_context_class_init (GUPnPContextClass *klass)
                                     G_PARAM_STATIC_NAME |
                                     G_PARAM_STATIC_NICK |
                                     G_PARAM_STATIC_BLURB));
+        /**
+         * GUPnPContext:max-actions-per-host:(attributes org.gtk.Property.get=gupnp_context_get_max_actions_per_host org.gtk.Property.set=gupnp_context_set_max_actions_per_host)
+         *
+         * The maximum number of action calls that are sent to a single
+         * remote host at the same time. Further calls wait in a queue,
+         * ordered by [method@GUPnP.ServiceProxyAction.set_priority] and
+         * otherwise by the order they were made in. 0 means no limit.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_MAX_ACTIONS_PER_HOST,
+                 g_param_spec_uint ("max-actions-per-host",
+                                    "Maximum actions per host",
+                                    "Maximum number of concurrent action "
+                                    "calls to a remote host",
+                                    0,
+                                    G_MAXUINT,
+                                    GUPNP_CONTEXT_DEFAULT_MAX_ACTIONS_PER_HOST,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_EXPLICIT_NOTIFY |
+                                    G_PARAM_STATIC_STRINGS));
+
         /**
          * GUPnPContext:default-language:(attributes org.gtk.Property.get=gupnp_context_get_default_language org.gtk.Property.set=gupnp_context_set_default_language)
          *
@@ -457,6 +639,35 @@ gupnp_context_class_init (GUPnPContextClass *klass)
                                       G_PARAM_CONSTRUCT |
                                       G_PARAM_READWRITE |
                                       G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPContext:description-cache-dir:(attributes org.gtk.Property.get=gupnp_context_get_description_cache_dir org.gtk.Property.set=gupnp_context_set_description_cache_dir)
+         *
+         * A directory to keep downloaded description and SCPD documents in.
+         *
+         * Documents are stored together with the ETag and Last-Modified
+         * headers of their response. Later downloads, also by processes
+         * started later with the same directory, ask the device whether
+         * the document changed and take the stored copy if it did not.
+         * Documents served without either header are not stored.
+         *
+         * The directory is created and read in the background. If that
+         * fails, a warning is printed and documents are downloaded as if
+         * no directory was set.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_DESCRIPTION_CACHE_DIR,
+                 g_param_spec_string ("description-cache-dir",
+                                      "Description cache directory",
+                                      "Directory to keep downloaded "
+                                      "description documents in",
+                                      NULL,
+                                      G_PARAM_READWRITE |
+                                      G_PARAM_EXPLICIT_NOTIFY |
+                                      G_PARAM_STATIC_STRINGS));
 }
 
 /**
@@ -590,6 +801,689 @@ _gupnp_context_get_server_uri (GUPnPContext *context)
         return NULL;
 }
 
+/* The timer wheel that drives the subscription timeouts of all services and
+ * service proxies using @context */
+TimerWheel *
+_gupnp_context_get_timer_wheel (GUPnPContext *context)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+        if (priv->timer_wheel == NULL) {
+                GMainContext *main_context;
+
+                main_context = g_main_context_ref_thread_default ();
+                priv->timer_wheel = timer_wheel_new (main_context);
+                g_main_context_unref (main_context);
+        }
+
+        return priv->timer_wheel;
+}
+
+static void
+event_receiver_free (EventReceiver *receiver)
+{
+        g_free (receiver->path);
+        g_free (receiver->sid);
+
+        g_slice_free (EventReceiver, receiver);
+}
+
+/* Single entry point for all NOTIFY requests. Known subscriptions are looked
+ * up by SID. Events arriving before the SUBSCRIBE response told us the SID
+ * are matched by the callback path that was handed out instead; once the
+ * SID is known, events with any other SID are refused */
+static void
+event_server_handler (G_GNUC_UNUSED SoupServer *server,
+                      SoupServerMessage        *msg,
+                      const char               *path,
+                      G_GNUC_UNUSED GHashTable *query,
+                      gpointer                  user_data)
+{
+        GUPnPContext *context = GUPNP_CONTEXT (user_data);
+        GUPnPContextPrivate *priv;
+        EventReceiver *receiver = NULL;
+        const char *sid;
+
+        priv = gupnp_context_get_instance_private (context);
+        sid = soup_message_headers_get_one (
+                soup_server_message_get_request_headers (msg),
+                "SID");
+
+        if (sid != NULL)
+                receiver = g_hash_table_lookup (priv->event_sids, sid);
+
+        if (receiver == NULL) {
+                receiver = g_hash_table_lookup (priv->event_receivers, path);
+                if (receiver != NULL && receiver->sid != NULL)
+                        receiver = NULL;
+        }
+
+        if (receiver == NULL) {
+                soup_server_message_set_status (msg,
+                                                SOUP_STATUS_PRECONDITION_FAILED,
+                                                "Unknown subscription");
+
+                return;
+        }
+
+        receiver->callback (msg, receiver->user_data);
+}
+
+/* Route events sent to @path, a path below GUPNP_CONTEXT_EVENT_PATH, to
+ * @callback */
+void
+_gupnp_context_add_event_receiver (GUPnPContext             *context,
+                                   const char               *path,
+                                   GUPnPContextEventCallback callback,
+                                   gpointer                  user_data)
+{
+        GUPnPContextPrivate *priv;
+        EventReceiver *receiver;
+
+        g_return_if_fail (GUPNP_IS_CONTEXT (context));
+        g_return_if_fail (g_str_has_prefix (path, GUPNP_CONTEXT_EVENT_PATH));
+
+        priv = gupnp_context_get_instance_private (context);
+        if (priv->event_receivers == NULL) {
+                priv->event_receivers =
+                        g_hash_table_new_full (g_str_hash,
+                                               g_str_equal,
+                                               NULL,
+                                               (GDestroyNotify)
+                                                       event_receiver_free);
+                priv->event_sids = g_hash_table_new_full (g_str_hash,
+                                                          g_str_equal,
+                                                          g_free,
+                                                          NULL);
+
+                soup_server_add_handler (gupnp_context_get_server (context),
+                                         GUPNP_CONTEXT_EVENT_PATH,
+                                         event_server_handler,
+                                         context,
+                                         NULL);
+        }
+
+        /* Replace a stale registration for the same path */
+        _gupnp_context_remove_event_receiver (context, path);
+
+        receiver = g_slice_new0 (EventReceiver);
+        receiver->path = g_strdup (path);
+        receiver->callback = callback;
+        receiver->user_data = user_data;
+
+        g_hash_table_insert (priv->event_receivers, receiver->path, receiver);
+}
+
+/* Associate the receiver for @path with the subscription @sid, or with none
+ * if @sid is %NULL */
+void
+_gupnp_context_set_event_receiver_sid (GUPnPContext *context,
+                                       const char   *path,
+                                       const char   *sid)
+{
+        GUPnPContextPrivate *priv;
+        EventReceiver *receiver;
+
+        g_return_if_fail (GUPNP_IS_CONTEXT (context));
+
+        priv = gupnp_context_get_instance_private (context);
+        if (priv->event_receivers == NULL)
+                return;
+
+        receiver = g_hash_table_lookup (priv->event_receivers, path);
+        if (receiver == NULL)
+                return;
+
+        if (receiver->sid != NULL) {
+                /* Only drop the SID if it still points to us */
+                if (g_hash_table_lookup (priv->event_sids, receiver->sid) ==
+                    receiver)
+                        g_hash_table_remove (priv->event_sids, receiver->sid);
+                g_clear_pointer (&receiver->sid, g_free);
+        }
+
+        if (sid != NULL) {
+                /* The table keeps its own copy, another receiver might take
+                 * the SID over */
+                receiver->sid = g_strdup (sid);
+                g_hash_table_replace (priv->event_sids,
+                                      g_strdup (sid),
+                                      receiver);
+        }
+}
+
+void
+_gupnp_context_remove_event_receiver (GUPnPContext *context,
+                                      const char   *path)
+{
+        GUPnPContextPrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_CONTEXT (context));
+
+        priv = gupnp_context_get_instance_private (context);
+        if (priv->event_receivers == NULL)
+                return;
+
+        _gupnp_context_set_event_receiver_sid (context, path, NULL);
+        g_hash_table_remove (priv->event_receivers, path);
+}
+
+static void
+scheduled_action_free (ScheduledAction *action)
+{
+        if (action->cancelled_id != 0)
+                g_cancellable_disconnect (action->cancellable,
+                                          action->cancelled_id);
+        g_main_context_unref (action->main_context);
+        g_object_unref (action->context);
+        g_free (action->host);
+        g_object_unref (action->msg);
+        g_clear_object (&action->cancellable);
+
+        g_slice_free (ScheduledAction, action);
+}
+
+static void
+action_host_free (ActionHost *host)
+{
+        g_queue_clear_full (&host->queue,
+                            (GDestroyNotify) scheduled_action_free);
+
+        g_slice_free (ActionHost, host);
+}
+
+static gboolean
+action_host_has_room (GUPnPContextPrivate *priv, ActionHost *host)
+{
+        return priv->max_actions_per_host == 0 ||
+               host->in_flight < priv->max_actions_per_host;
+}
+
+static void
+action_host_start (GUPnPContext *context,
+                   ActionHost   *host,
+                   ScheduledAction *action);
+
+/* Start queued actions while @host has room for them */
+static void
+action_host_dispatch (GUPnPContext *context, ActionHost *host)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+        while (!g_queue_is_empty (&host->queue) &&
+               action_host_has_room (priv, host))
+                action_host_start (context,
+                                   host,
+                                   g_queue_pop_head (&host->queue));
+}
+
+static void
+on_scheduled_action_sent (GObject      *source,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+        ScheduledAction *action = user_data;
+        GUPnPContextPrivate *priv;
+        ActionHost *host;
+
+        priv = gupnp_context_get_instance_private (action->context);
+        host = g_hash_table_lookup (priv->action_hosts, action->host);
+        host->in_flight--;
+        host->completed++;
+
+        action->callback (source, res, action->user_data);
+
+        /* The callback might have queued a retry already; that is fine, it
+         * went to the end of its priority */
+        action_host_dispatch (action->context, host);
+
+        if (host->in_flight == 0 && g_queue_is_empty (&host->queue))
+                g_hash_table_remove (priv->action_hosts, action->host);
+
+        scheduled_action_free (action);
+}
+
+static void
+action_host_start (GUPnPContext    *context,
+                   ActionHost      *host,
+                   ScheduledAction *action)
+{
+        GUPnPContextPrivate *priv;
+        gint64 wait;
+
+        priv = gupnp_context_get_instance_private (context);
+
+        /* Cancelling is up to the session from now on */
+        if (action->cancelled_id != 0) {
+                g_cancellable_disconnect (action->cancellable,
+                                          action->cancelled_id);
+                action->cancelled_id = 0;
+        }
+
+        wait = g_get_monotonic_time () - action->queued_at;
+        host->total_wait += wait;
+        host->max_wait = MAX (host->max_wait, wait);
+        host->in_flight++;
+
+        /* Connections to the host are kept alive by the session, so the
+         * limit also makes the calls reuse them */
+        soup_session_send_and_read_async (priv->session,
+                                          action->msg,
+                                          action->priority,
+                                          action->cancellable,
+                                          on_scheduled_action_sent,
+                                          action);
+}
+
+/* Complete the waiting actions of @host that were cancelled and return
+ * whether @host has nothing left to do */
+static gboolean
+action_host_purge_cancelled (GUPnPContext *context, ActionHost *host)
+{
+        GUPnPContextPrivate *priv;
+        GList *link;
+
+        priv = gupnp_context_get_instance_private (context);
+
+        link = host->queue.head;
+        while (link != NULL) {
+                ScheduledAction *action = link->data;
+                GList *next = link->next;
+                GTask *task;
+
+                if (g_cancellable_is_cancelled (action->cancellable)) {
+                        g_queue_delete_link (&host->queue, link);
+
+                        /* Finishes like the session would have */
+                        task = g_task_new (priv->session,
+                                           NULL,
+                                           action->callback,
+                                           action->user_data);
+                        g_task_return_new_error (task,
+                                                 G_IO_ERROR,
+                                                 G_IO_ERROR_CANCELLED,
+                                                 "Action call was cancelled");
+                        g_object_unref (task);
+
+                        scheduled_action_free (action);
+                }
+
+                link = next;
+        }
+
+        return host->in_flight == 0 && g_queue_is_empty (&host->queue);
+}
+
+static gboolean
+on_purge_cancelled_actions (gpointer user_data)
+{
+        GUPnPContext *context = user_data;
+        GUPnPContextPrivate *priv;
+        GHashTableIter iter;
+        gpointer value;
+
+        priv = gupnp_context_get_instance_private (context);
+        if (priv->action_hosts == NULL)
+                return G_SOURCE_REMOVE;
+
+        g_hash_table_iter_init (&iter, priv->action_hosts);
+        while (g_hash_table_iter_next (&iter, NULL, &value))
+                if (action_host_purge_cancelled (context, value))
+                        g_hash_table_iter_remove (&iter);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Might run in any thread, and must not disconnect itself, so the waiting
+ * action is taken out of its queue from an idle on its main context */
+static void
+on_scheduled_action_cancelled (G_GNUC_UNUSED GCancellable *cancellable,
+                               gpointer                    user_data)
+{
+        ScheduledAction *action = user_data;
+        GSource *source;
+
+        source = g_idle_source_new ();
+        g_source_set_callback (source,
+                               on_purge_cancelled_actions,
+                               g_object_ref (action->context),
+                               g_object_unref);
+        g_source_attach (source, action->main_context);
+        g_source_unref (source);
+}
+
+static gint
+scheduled_action_compare (gconstpointer a,
+                          gconstpointer b,
+                          G_GNUC_UNUSED gpointer user_data)
+{
+        const ScheduledAction *action_a = a;
+        const ScheduledAction *action_b = b;
+
+        if (action_a->priority != action_b->priority)
+                return action_a->priority < action_b->priority ? -1 : 1;
+
+        /* Keep the order of calls with the same priority */
+        return action_a->queued_at <= action_b->queued_at ? -1 : 1;
+}
+
+/* Send the action call @msg like soup_session_send_and_read_async(), as soon
+ * as the limit of concurrent calls to its host allows it. Calls with a lower
+ * @priority value are sent first. Cancelling a waiting call completes it with
+ * %G_IO_ERROR_CANCELLED without waiting for its turn */
+void
+_gupnp_context_send_action_async (GUPnPContext       *context,
+                                  SoupMessage        *msg,
+                                  int                 priority,
+                                  GCancellable       *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer            user_data)
+{
+        GUPnPContextPrivate *priv;
+        ScheduledAction *action;
+        ActionHost *host;
+        GUri *uri;
+        int port;
+
+        g_return_if_fail (GUPNP_IS_CONTEXT (context));
+        g_return_if_fail (SOUP_IS_MESSAGE (msg));
+
+        priv = gupnp_context_get_instance_private (context);
+        uri = soup_message_get_uri (msg);
+
+        action = g_slice_new0 (ScheduledAction);
+        action->context = g_object_ref (context);
+        port = g_uri_get_port (uri);
+        if (port == -1)
+                port = g_str_equal (g_uri_get_scheme (uri), "https") ? 443
+                                                                     : 80;
+        action->host = g_strdup_printf ("%s:%d", g_uri_get_host (uri), port);
+        action->msg = g_object_ref (msg);
+        action->priority = priority;
+        action->cancellable =
+                cancellable != NULL ? g_object_ref (cancellable) : NULL;
+        action->main_context = g_main_context_ref_thread_default ();
+        action->callback = callback;
+        action->user_data = user_data;
+        action->queued_at = g_get_monotonic_time ();
+
+        host = g_hash_table_lookup (priv->action_hosts, action->host);
+        if (host == NULL) {
+                host = g_slice_new0 (ActionHost);
+                g_queue_init (&host->queue);
+                g_hash_table_insert (priv->action_hosts,
+                                     g_strdup (action->host),
+                                     host);
+        }
+
+        if (g_queue_is_empty (&host->queue) &&
+            action_host_has_room (priv, host)) {
+                action_host_start (context, host, action);
+
+                return;
+        }
+
+        g_queue_insert_sorted (&host->queue,
+                               action,
+                               scheduled_action_compare,
+                               NULL);
+        if (action->cancellable != NULL)
+                action->cancelled_id =
+                        g_cancellable_connect (action->cancellable,
+                                               G_CALLBACK (on_scheduled_action_cancelled),
+                                               action,
+                                               NULL);
+        host->max_queued = MAX (host->max_queued, host->queue.length);
+}
+
+/**
+ * gupnp_context_set_max_actions_per_host:(attributes org.gtk.Method.set_property=max-actions-per-host)
+ * @context: A #GUPnPContext
+ * @max_actions: The maximum number of concurrent action calls to a single
+ * host, or 0 for no limit
+ *
+ * Limits how many action calls are sent to a remote host at the same time.
+ * See [property@GUPnP.Context:max-actions-per-host].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_context_set_max_actions_per_host (GUPnPContext *context,
+                                        guint         max_actions)
+{
+        GUPnPContextPrivate *priv;
+        GHashTableIter iter;
+        gpointer value;
+
+        g_return_if_fail (GUPNP_IS_CONTEXT (context));
+
+        priv = gupnp_context_get_instance_private (context);
+        if (priv->max_actions_per_host == max_actions)
+                return;
+
+        priv->max_actions_per_host = max_actions;
+
+        /* A higher limit lets waiting calls go */
+        g_hash_table_iter_init (&iter, priv->action_hosts);
+        while (g_hash_table_iter_next (&iter, NULL, &value))
+                action_host_dispatch (context, value);
+
+        g_object_notify (G_OBJECT (context), "max-actions-per-host");
+}
+
+/**
+ * gupnp_context_get_max_actions_per_host:(attributes org.gtk.Method.get_property=max-actions-per-host)
+ * @context: A #GUPnPContext
+ *
+ * Get the maximum number of concurrent action calls to a single host.
+ *
+ * Return value: The limit, or 0 if there is none.
+ *
+ * Since: 1.6.10
+ **/
+guint
+gupnp_context_get_max_actions_per_host (GUPnPContext *context)
+{
+        GUPnPContextPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTEXT (context), 0);
+
+        priv = gupnp_context_get_instance_private (context);
+
+        return priv->max_actions_per_host;
+}
+
+/**
+ * gupnp_context_get_action_stats:
+ * @context: A #GUPnPContext
+ * @host: The remote host as "address:port"
+ * @in_flight: (out)(optional): Location for the number of calls being sent
+ * @queued: (out)(optional): Location for the number of waiting calls
+ * @max_queued: (out)(optional): Location for the highest number of waiting
+ * calls seen
+ * @completed: (out)(optional): Location for the number of finished calls
+ * @average_wait: (out)(optional): Location for the average time calls
+ * waited in the queue, in microseconds
+ * @max_wait: (out)(optional): Location for the longest time a call waited
+ * in the queue, in microseconds
+ *
+ * Get statistics about the action calls to @host. They cover the time since
+ * the last moment there were no calls to @host at all.
+ *
+ * Return value: %FALSE if there are no calls to @host.
+ *
+ * Since: 1.6.10
+ **/
+gboolean
+gupnp_context_get_action_stats (GUPnPContext *context,
+                                const char   *host,
+                                guint        *in_flight,
+                                guint        *queued,
+                                guint        *max_queued,
+                                guint64      *completed,
+                                gint64       *average_wait,
+                                gint64       *max_wait)
+{
+        GUPnPContextPrivate *priv;
+        ActionHost *data;
+        guint64 started;
+
+        g_return_val_if_fail (GUPNP_IS_CONTEXT (context), FALSE);
+        g_return_val_if_fail (host != NULL, FALSE);
+
+        priv = gupnp_context_get_instance_private (context);
+        data = g_hash_table_lookup (priv->action_hosts, host);
+        if (data == NULL)
+                return FALSE;
+
+        started = data->completed + data->in_flight;
+
+        if (in_flight != NULL)
+                *in_flight = data->in_flight;
+        if (queued != NULL)
+                *queued = data->queue.length;
+        if (max_queued != NULL)
+                *max_queued = data->max_queued;
+        if (completed != NULL)
+                *completed = data->completed;
+        if (average_wait != NULL)
+                *average_wait = started > 0 ? data->total_wait / (gint64) started
+                                            : 0;
+        if (max_wait != NULL)
+                *max_wait = data->max_wait;
+
+        return TRUE;
+}
+
+/**
+ * gupnp_context_set_description_cache_dir:(attributes org.gtk.Method.set_property=description-cache-dir)
+ * @context: A #GUPnPContext
+ * @path: (nullable): The directory to keep documents in, or %NULL
+ *
+ * Keeps the description and SCPD documents downloaded through @context in
+ * @path, so they do not need to be transferred again after a restart. See
+ * [property@GUPnP.Context:description-cache-dir].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_context_set_description_cache_dir (GUPnPContext *context,
+                                         const char   *path)
+{
+        GUPnPContextPrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_CONTEXT (context));
+
+        priv = gupnp_context_get_instance_private (context);
+        if (g_strcmp0 (path, gupnp_context_get_description_cache_dir (context))
+            == 0)
+                return;
+
+        g_clear_pointer (&priv->description_cache, description_cache_free);
+        if (path != NULL)
+                priv->description_cache = description_cache_new (path);
+
+        g_object_notify (G_OBJECT (context), "description-cache-dir");
+}
+
+/**
+ * gupnp_context_get_description_cache_dir:(attributes org.gtk.Method.get_property=description-cache-dir)
+ * @context: A #GUPnPContext
+ *
+ * Get the directory description documents are kept in.
+ *
+ * Return value: (nullable): The directory, or %NULL if documents are not
+ * kept on disk.
+ *
+ * Since: 1.6.10
+ **/
+const char *
+gupnp_context_get_description_cache_dir (GUPnPContext *context)
+{
+        GUPnPContextPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTEXT (context), NULL);
+
+        priv = gupnp_context_get_instance_private (context);
+        if (priv->description_cache == NULL)
+                return NULL;
+
+        return description_cache_get_path (priv->description_cache);
+}
+
+DescriptionCache *
+_gupnp_context_get_description_cache (GUPnPContext *context)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+
+        return priv->description_cache;
+}
+
+/* Look up the introspection that was shared as @key. The context keeps no
+ * reference, so an introspection is only found while a service uses it. */
+GUPnPServiceIntrospection *
+_gupnp_context_lookup_introspection (GUPnPContext *context, const char *key)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+
+        return g_hash_table_lookup (priv->introspections, key);
+}
+
+void
+_gupnp_context_add_introspection (GUPnPContext              *context,
+                                  const char                *key,
+                                  GUPnPServiceIntrospection *introspection)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+
+        if (g_hash_table_add (priv->introspection_objects, introspection))
+                g_object_weak_ref (G_OBJECT (introspection),
+                                   introspection_finalized,
+                                   context);
+
+        g_hash_table_insert (priv->introspections,
+                             g_strdup (key),
+                             introspection);
+}
+
+gpointer
+_gupnp_context_lookup_introspection_fetch (GUPnPContext *context,
+                                           const char   *url)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+
+        return g_hash_table_lookup (priv->introspection_fetches, url);
+}
+
+/* Register @fetch as the pending download of @url, or forget about it if
+ * @fetch is %NULL */
+void
+_gupnp_context_set_introspection_fetch (GUPnPContext *context,
+                                        const char   *url,
+                                        gpointer      fetch)
+{
+        GUPnPContextPrivate *priv;
+
+        priv = gupnp_context_get_instance_private (context);
+
+        if (fetch != NULL)
+                g_hash_table_insert (priv->introspection_fetches,
+                                     g_strdup (url),
+                                     fetch);
+        else
+                g_hash_table_remove (priv->introspection_fetches, url);
+}
+
 /**
  * gupnp_context_new:
  * @iface: (nullable): The network interface to use, or %NULL to
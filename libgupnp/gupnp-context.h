@@ -74,6 +74,30 @@ gupnp_context_set_subscription_timeout (GUPnPContext *context,
 guint
 gupnp_context_get_subscription_timeout (GUPnPContext *context);
 
+void
+gupnp_context_set_max_actions_per_host (GUPnPContext *context,
+                                        guint         max_actions);
+
+guint
+gupnp_context_get_max_actions_per_host (GUPnPContext *context);
+
+gboolean
+gupnp_context_get_action_stats         (GUPnPContext *context,
+                                        const char   *host,
+                                        guint        *in_flight,
+                                        guint        *queued,
+                                        guint        *max_queued,
+                                        guint64      *completed,
+                                        gint64       *average_wait,
+                                        gint64       *max_wait);
+
+void
+gupnp_context_set_description_cache_dir (GUPnPContext *context,
+                                         const char   *path);
+
+const char *
+gupnp_context_get_description_cache_dir (GUPnPContext *context);
+
 void
 gupnp_context_set_default_language     (GUPnPContext *context,
                                         const char   *language);
@@ -37,6 +37,8 @@
 
 #define GUPNP_MAX_DESCRIPTION_DOWNLOAD_RETRIES 4
 #define GUPNP_INITIAL_DESCRIPTION_RETRY_TIMEOUT 5
+#define GUPNP_DEFAULT_MAX_DESCRIPTION_FETCHES 16
+#define GUPNP_DEFAULT_MAX_DESCRIPTION_FETCHES_PER_HOST 2
 
 struct _GUPnPControlPointPrivate {
         GUPnPResourceFactory *factory;
@@ -44,9 +46,29 @@ struct _GUPnPControlPointPrivate {
         GList *devices;
         GList *services;
 
+        /* Proxy registry */
+        GHashTable *device_nodes;       /* UDN -> node in devices */
+        GHashTable *service_nodes;      /* UDN::type -> node in services */
+        GHashTable *devices_by_type;    /* device type -> set of proxies */
+        GHashTable *services_by_type;   /* service type -> set of proxies */
+        GHashTable *devices_by_location;
+        GHashTable *services_by_location;
+
         GHashTable *doc_cache;
 
         GList *pending_gets;
+
+        /* Description downloads */
+        guint max_fetches;
+        guint max_fetches_per_host;
+        guint running_fetches;
+        GHashTable *fetches;       /* URL -> DescriptionFetch */
+        GHashTable *fetch_hosts;   /* host:port -> running fetches */
+        GQueue fetch_queue;        /* DescriptionFetch waiting to start */
+
+        /* Introspection prefetch */
+        char **prefetch_types;
+        GHashTable *prefetching;   /* UDN::type -> DescriptionFetch */
 };
 typedef struct _GUPnPControlPointPrivate GUPnPControlPointPrivate;
 
@@ -57,6 +79,9 @@ G_DEFINE_TYPE_WITH_PRIVATE (GUPnPControlPoint,
 enum {
         PROP_0,
         PROP_RESOURCE_FACTORY,
+        PROP_MAX_DESCRIPTION_FETCHES,
+        PROP_MAX_DESCRIPTION_FETCHES_PER_HOST,
+        PROP_INTROSPECTION_PREFETCH,
 };
 
 enum {
@@ -69,6 +94,26 @@ enum {
 
 static guint signals[SIGNAL_LAST];
 
+/* A download of a description document. All USNs announced for the same
+ * description URL wait for the same download.
+ *
+ * Prefetching the introspection of a new service proxy is scheduled the same
+ * way. Then @proxy is set, @url is the UDN::type key of the proxy and there
+ * are no waiters. */
+typedef struct {
+        GUPnPControlPoint *control_point; /* NULL once abandoned */
+
+        char *url;
+        char *host;
+        GUPnPServiceProxy *proxy;
+
+        SoupMessage *message;
+        GCancellable *cancellable;
+        gboolean running;
+
+        GList *waiters; /* GetDescriptionURLData */
+} DescriptionFetch;
+
 typedef struct {
         GUPnPControlPoint *control_point;
 
@@ -76,9 +121,8 @@ typedef struct {
         char *service_type;
         char *description_url;
 
-        SoupMessage *message;
+        DescriptionFetch *fetch;
         GSource *timeout_source;
-        GCancellable *cancellable;
         int tries;
         int timeout;
 } GetDescriptionURLData;
@@ -87,6 +131,9 @@ static void
 gupnp_control_point_remove_pending_get (GUPnPControlPoint     *control_point,
                                         GetDescriptionURLData *data);
 
+static void
+description_fetch_abandon (DescriptionFetch *fetch);
+
 static void
 get_description_url_data_free (GetDescriptionURLData *data)
 {
@@ -97,16 +144,19 @@ get_description_url_data_free (GetDescriptionURLData *data)
                 g_source_unref (data->timeout_source);
         }
 
-        /* Cancel any pending description file GETs */
-        if (!g_cancellable_is_cancelled (data->cancellable)) {
-                g_cancellable_cancel (data->cancellable);
+        /* Stop the download if nobody else waits for it */
+        if (data->fetch != NULL) {
+                DescriptionFetch *fetch = data->fetch;
+
+                fetch->waiters = g_list_remove (fetch->waiters, data);
+                if (fetch->waiters == NULL)
+                        description_fetch_abandon (fetch);
         }
 
         g_free (data->udn);
         g_free (data->service_type);
         g_free (data->description_url);
         g_object_unref (data->control_point);
-        g_object_unref (data->cancellable);
 
         g_slice_free (GetDescriptionURLData, data);
 }
@@ -145,6 +195,46 @@ gupnp_control_point_init (GUPnPControlPoint *control_point)
                                                  g_str_equal,
                                                  g_free,
                                                  NULL);
+
+        priv->max_fetches = GUPNP_DEFAULT_MAX_DESCRIPTION_FETCHES;
+        priv->max_fetches_per_host =
+                GUPNP_DEFAULT_MAX_DESCRIPTION_FETCHES_PER_HOST;
+        priv->fetches = g_hash_table_new (g_str_hash, g_str_equal);
+        priv->fetch_hosts = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   NULL);
+        g_queue_init (&priv->fetch_queue);
+        priv->prefetching = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   NULL);
+
+        priv->device_nodes = g_hash_table_new (g_str_hash, g_str_equal);
+        priv->service_nodes = g_hash_table_new_full (g_str_hash,
+                                                     g_str_equal,
+                                                     g_free,
+                                                     NULL);
+        priv->devices_by_type =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) g_hash_table_destroy);
+        priv->services_by_type =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) g_hash_table_destroy);
+        priv->devices_by_location =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) g_hash_table_destroy);
+        priv->services_by_location =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) g_hash_table_destroy);
 }
 
 /* Return TRUE if value == user_data */
@@ -197,6 +287,22 @@ gupnp_control_point_dispose (GObject *object)
 
         g_clear_object (&priv->factory);
 
+        /* Drop the downloads that did not start yet first, so they are not
+         * started while the running ones get cancelled */
+        while (!g_queue_is_empty (&priv->fetch_queue)) {
+                DescriptionFetch *fetch;
+
+                fetch = g_queue_peek_head (&priv->fetch_queue);
+                if (fetch->proxy != NULL)
+                        description_fetch_abandon (fetch);
+                else
+                        get_description_url_data_free (fetch->waiters->data);
+        }
+
+        /* Drop the proxies that still wait for their introspection */
+        g_list_free_full (g_hash_table_get_values (priv->prefetching),
+                          (GDestroyNotify) description_fetch_abandon);
+
         /* Cancel any pending description file GETs */
         while (priv->pending_gets) {
                 GetDescriptionURLData *data;
@@ -227,34 +333,91 @@ gupnp_control_point_finalize (GObject *object)
 
         g_hash_table_destroy (priv->doc_cache);
 
+        /* Freeing the last waiter abandons a download, so none are left */
+        g_hash_table_destroy (priv->fetches);
+        g_hash_table_destroy (priv->fetch_hosts);
+        g_hash_table_destroy (priv->prefetching);
+        g_strfreev (priv->prefetch_types);
+
+        g_hash_table_destroy (priv->device_nodes);
+        g_hash_table_destroy (priv->service_nodes);
+        g_hash_table_destroy (priv->devices_by_type);
+        g_hash_table_destroy (priv->services_by_type);
+        g_hash_table_destroy (priv->devices_by_location);
+        g_hash_table_destroy (priv->services_by_location);
+
         /* Call super */
         object_class = G_OBJECT_CLASS (gupnp_control_point_parent_class);
         object_class->finalize (object);
 }
 
+/* Secondary indexes map a key to the set of proxies sharing it */
+static void
+proxy_index_add (GHashTable *index, const char *key, gpointer proxy)
+{
+        GHashTable *set;
+
+        if (key == NULL)
+                return;
+
+        set = g_hash_table_lookup (index, key);
+        if (set == NULL) {
+                set = g_hash_table_new (NULL, NULL);
+                g_hash_table_insert (index, g_strdup (key), set);
+        }
+
+        g_hash_table_add (set, proxy);
+}
+
+static void
+proxy_index_remove (GHashTable *index, const char *key, gpointer proxy)
+{
+        GHashTable *set;
+
+        if (key == NULL)
+                return;
+
+        set = g_hash_table_lookup (index, key);
+        if (set == NULL)
+                return;
+
+        g_hash_table_remove (set, proxy);
+        if (g_hash_table_size (set) == 0)
+                g_hash_table_remove (index, key);
+}
+
+static GList *
+proxy_index_list (GHashTable *index, const char *key)
+{
+        GHashTable *set;
+
+        set = g_hash_table_lookup (index, key);
+        if (set == NULL)
+                return NULL;
+
+        return g_hash_table_get_keys (set);
+}
+
+static char *
+service_node_key (const char *udn, const char *service_type)
+{
+        return g_strconcat (udn, "::", service_type, NULL);
+}
+
 static GList *
 find_service_node (GUPnPControlPoint *control_point,
                    const char        *udn,
                    const char        *service_type)
 {
-        GList *l;
         GUPnPControlPointPrivate *priv;
+        GList *l;
+        char *key;
 
         priv = gupnp_control_point_get_instance_private (control_point);
-        l = priv->services;
-
-        while (l) {
-                GUPnPServiceInfo *info;
 
-                info = GUPNP_SERVICE_INFO (l->data);
-
-                if ((strcmp (gupnp_service_info_get_udn (info), udn) == 0) &&
-                    (strcmp (gupnp_service_info_get_service_type (info),
-                             service_type) == 0))
-                        break;
-
-                l = l->next;
-        }
+        key = service_node_key (udn, service_type);
+        l = g_hash_table_lookup (priv->service_nodes, key);
+        g_free (key);
 
         return l;
 }
@@ -263,26 +426,113 @@ static GList *
 find_device_node (GUPnPControlPoint *control_point,
                   const char        *udn)
 {
-        GList *l;
         GUPnPControlPointPrivate *priv;
 
         priv = gupnp_control_point_get_instance_private (control_point);
-        l = priv->devices;
 
-        while (l) {
-                GUPnPDeviceInfo *info;
+        return g_hash_table_lookup (priv->device_nodes, udn);
+}
 
-                info = GUPNP_DEVICE_INFO (l->data);
+static void
+register_service_proxy (GUPnPControlPoint *control_point,
+                        GUPnPServiceProxy *proxy)
+{
+        GUPnPControlPointPrivate *priv;
+        GUPnPServiceInfo *info = GUPNP_SERVICE_INFO (proxy);
 
-                if (strcmp (udn, gupnp_device_info_get_udn (info)) == 0)
-                        break;
+        priv = gupnp_control_point_get_instance_private (control_point);
 
-                l = l->next;
-        }
+        priv->services = g_list_prepend (priv->services, proxy);
+        g_hash_table_insert (
+                priv->service_nodes,
+                service_node_key (gupnp_service_info_get_udn (info),
+                                  gupnp_service_info_get_service_type (info)),
+                priv->services);
+        proxy_index_add (priv->services_by_type,
+                         gupnp_service_info_get_service_type (info),
+                         proxy);
+        proxy_index_add (priv->services_by_location,
+                         gupnp_service_info_get_location (info),
+                         proxy);
+}
 
-        return l;
+/* Returns the proxy of @node, which the caller has to unref */
+static GUPnPServiceProxy *
+unregister_service_proxy (GUPnPControlPoint *control_point, GList *node)
+{
+        GUPnPControlPointPrivate *priv;
+        GUPnPServiceProxy *proxy = GUPNP_SERVICE_PROXY (node->data);
+        GUPnPServiceInfo *info = GUPNP_SERVICE_INFO (proxy);
+        char *key;
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        key = service_node_key (gupnp_service_info_get_udn (info),
+                                gupnp_service_info_get_service_type (info));
+        g_hash_table_remove (priv->service_nodes, key);
+        g_free (key);
+
+        proxy_index_remove (priv->services_by_type,
+                            gupnp_service_info_get_service_type (info),
+                            proxy);
+        proxy_index_remove (priv->services_by_location,
+                            gupnp_service_info_get_location (info),
+                            proxy);
+        priv->services = g_list_delete_link (priv->services, node);
+
+        return proxy;
 }
 
+static void
+register_device_proxy (GUPnPControlPoint *control_point,
+                       GUPnPDeviceProxy  *proxy)
+{
+        GUPnPControlPointPrivate *priv;
+        GUPnPDeviceInfo *info = GUPNP_DEVICE_INFO (proxy);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        priv->devices = g_list_prepend (priv->devices, proxy);
+
+        /* The UDN is owned by the proxy, which outlives its node */
+        g_hash_table_insert (priv->device_nodes,
+                             (gpointer) gupnp_device_info_get_udn (info),
+                             priv->devices);
+        proxy_index_add (priv->devices_by_type,
+                         gupnp_device_info_get_device_type (info),
+                         proxy);
+        proxy_index_add (priv->devices_by_location,
+                         gupnp_device_info_get_location (info),
+                         proxy);
+}
+
+/* Returns the proxy of @node, which the caller has to unref */
+static GUPnPDeviceProxy *
+unregister_device_proxy (GUPnPControlPoint *control_point, GList *node)
+{
+        GUPnPControlPointPrivate *priv;
+        GUPnPDeviceProxy *proxy = GUPNP_DEVICE_PROXY (node->data);
+        GUPnPDeviceInfo *info = GUPNP_DEVICE_INFO (proxy);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        g_hash_table_remove (priv->device_nodes,
+                             gupnp_device_info_get_udn (info));
+        proxy_index_remove (priv->devices_by_type,
+                            gupnp_device_info_get_device_type (info),
+                            proxy);
+        proxy_index_remove (priv->devices_by_location,
+                            gupnp_device_info_get_location (info),
+                            proxy);
+        priv->devices = g_list_delete_link (priv->devices, node);
+
+        return proxy;
+}
+
+static gboolean
+introspection_prefetch (GUPnPControlPoint *control_point,
+                        GUPnPServiceProxy *proxy);
+
 static void
 create_and_report_service_proxy (GUPnPControlPoint *control_point,
                                  GUPnPXMLDoc *doc,
@@ -296,12 +546,21 @@ create_and_report_service_proxy (GUPnPControlPoint *control_point,
         GUPnPResourceFactory *factory;
         GUPnPContext *context;
         GUPnPControlPointPrivate *priv;
+        char *key;
+        gboolean known;
 
         if (find_service_node (control_point, udn, service_type) != NULL)
                 /* We already have a proxy for this service */
                 return;
 
+        /* ... or will have once it is introspected */
         priv = gupnp_control_point_get_instance_private (control_point);
+        key = service_node_key (udn, service_type);
+        known = g_hash_table_contains (priv->prefetching, key);
+        g_free (key);
+        if (known)
+                return;
+
         factory = gupnp_control_point_get_resource_factory (control_point);
         context = gupnp_control_point_get_context (control_point);
 
@@ -315,7 +574,11 @@ create_and_report_service_proxy (GUPnPControlPoint *control_point,
                                                              description_url,
                                                              url_base);
 
-        priv->services = g_list_prepend (priv->services, proxy);
+        /* Announced once the introspection is ready */
+        if (introspection_prefetch (control_point, proxy))
+                return;
+
+        register_service_proxy (control_point, proxy);
 
         g_signal_emit (control_point,
                        signals[SERVICE_PROXY_AVAILABLE],
@@ -334,13 +597,11 @@ create_and_report_device_proxy (GUPnPControlPoint *control_point,
         GUPnPDeviceProxy *proxy;
         GUPnPResourceFactory *factory;
         GUPnPContext *context;
-        GUPnPControlPointPrivate *priv;
 
         if (find_device_node (control_point, udn) != NULL)
                 /* We already have a proxy for this device */
                 return;
 
-        priv = gupnp_control_point_get_instance_private (control_point);
         factory = gupnp_control_point_get_resource_factory (control_point);
         context = gupnp_control_point_get_context (control_point);
 
@@ -352,7 +613,7 @@ create_and_report_device_proxy (GUPnPControlPoint *control_point,
                                                             description_url,
                                                             url_base);
 
-        priv->devices = g_list_prepend (priv->devices, proxy);
+        register_device_proxy (control_point, proxy);
 
         g_signal_emit (control_point,
                        signals[DEVICE_PROXY_AVAILABLE],
@@ -571,29 +832,118 @@ description_loaded (GUPnPControlPoint *control_point,
 static gboolean
 description_url_retry_timeout (gpointer user_data);
 
+static void
+description_fetch_free (DescriptionFetch *fetch)
+{
+        g_clear_object (&fetch->message);
+        g_clear_object (&fetch->cancellable);
+        g_clear_object (&fetch->proxy);
+        g_free (fetch->url);
+        g_free (fetch->host);
+
+        g_slice_free (DescriptionFetch, fetch);
+}
+
+static guint
+description_fetch_host_running (GUPnPControlPointPrivate *priv,
+                                const char               *host)
+{
+        return GPOINTER_TO_UINT (g_hash_table_lookup (priv->fetch_hosts,
+                                                      host));
+}
+
+/* Take @fetch out of the bookkeeping of its control point */
+static void
+description_fetch_detach (DescriptionFetch *fetch)
+{
+        GUPnPControlPointPrivate *priv;
+
+        priv = gupnp_control_point_get_instance_private (fetch->control_point);
+
+        if (fetch->proxy != NULL)
+                g_hash_table_remove (priv->prefetching, fetch->url);
+        else
+                g_hash_table_remove (priv->fetches, fetch->url);
+
+        if (fetch->running) {
+                guint running;
+
+                priv->running_fetches--;
+
+                running = description_fetch_host_running (priv, fetch->host);
+                if (running > 1)
+                        g_hash_table_insert (priv->fetch_hosts,
+                                             g_strdup (fetch->host),
+                                             GUINT_TO_POINTER (running - 1));
+                else
+                        g_hash_table_remove (priv->fetch_hosts, fetch->host);
+        } else {
+                g_queue_remove (&priv->fetch_queue, fetch);
+        }
+
+        fetch->control_point = NULL;
+}
+
+static void
+description_fetch_dispatch (GUPnPControlPoint *control_point);
+
+/* Nobody waits for @fetch anymore */
+static void
+description_fetch_abandon (DescriptionFetch *fetch)
+{
+        GUPnPControlPoint *control_point = fetch->control_point;
+        gboolean running = fetch->running;
+
+        /* Already finished and being reported */
+        if (control_point == NULL)
+                return;
+
+        description_fetch_detach (fetch);
+
+        /* A running download is freed once it reports the cancellation */
+        if (running) {
+                g_cancellable_cancel (fetch->cancellable);
+                description_fetch_dispatch (control_point);
+        } else {
+                description_fetch_free (fetch);
+        }
+}
+
 /*
- * Description URL downloaded.
+ * Description document of @fetch retrieved. @document is %NULL if the
+ * download failed, with @error set unless the server answered with an
+ * error. Takes @document and @error.
  */
 static void
-got_description_url (GObject *source,
-                     GAsyncResult *res,
-                     GetDescriptionURLData *data)
+description_fetch_finish (DescriptionFetch *fetch,
+                          GBytes           *document,
+                          GError           *error)
 {
-        GUPnPXMLDoc *doc;
+        GUPnPControlPoint *control_point;
+        GUPnPXMLDoc *doc = NULL;
         GUPnPControlPointPrivate *priv;
-        GError *error = NULL;
         gboolean retry = FALSE;
-        SoupMessage *message =
-                soup_session_get_async_result_message (SOUP_SESSION (source),
-                                                       res);
-
-        GBytes *body = soup_session_send_and_read_finish (SOUP_SESSION (source),
-                                                          res,
-                                                          &error);
+        GList *waiters;
+        GList *l;
 
-        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        /* Abandoned by all waiters */
+        control_point = fetch->control_point;
+        if (control_point == NULL)
                 goto out;
 
+        g_object_ref (control_point);
+        priv = gupnp_control_point_get_instance_private (control_point);
+        description_fetch_detach (fetch);
+
+        /* The waiters are served from here on */
+        waiters = fetch->waiters;
+        fetch->waiters = NULL;
+        for (l = waiters; l != NULL; l = l->next) {
+                GetDescriptionURLData *data = l->data;
+
+                data->fetch = NULL;
+        }
+
         if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT)) {
                 g_clear_error (&error);
                 retry = TRUE;
@@ -603,33 +953,26 @@ got_description_url (GObject *source,
         if (error != NULL) {
                 g_warning ("Retrieving the description document failed: %s",
                            error->message);
-                goto out;
+                g_list_free_full (waiters,
+                                  (GDestroyNotify)
+                                  get_description_url_data_free);
+                goto done;
         }
 
-        priv = gupnp_control_point_get_instance_private (data->control_point);
-
         /* Now, make sure again this document is not already cached. If it is,
          * we re-use the cached one. */
-        doc = g_hash_table_lookup (priv->doc_cache, data->description_url);
+        doc = g_hash_table_lookup (priv->doc_cache, fetch->url);
         if (doc) {
                 /* Doc was cached */
-                description_loaded (data->control_point,
-                                    doc,
-                                    data->udn,
-                                    data->service_type,
-                                    data->description_url);
-
-                goto out;
+                g_object_ref (doc);
         }
 
-        /* Not cached */
-        if (!retry &&
-            SOUP_STATUS_IS_SUCCESSFUL (soup_message_get_status (message))) {
+        if (doc == NULL && document != NULL) {
                 xmlDoc *xml_doc;
                 gsize length;
                 gconstpointer body_data;
 
-                body_data = g_bytes_get_data (body, &length);
+                body_data = g_bytes_get_data (document, &length);
 
                 /* Parse response */
                 xml_doc = xmlReadMemory (body_data,
@@ -640,63 +983,388 @@ got_description_url (GObject *source,
                 if (xml_doc) {
                         doc = gupnp_xml_doc_new (xml_doc);
 
-                        description_loaded (data->control_point,
-                                            doc,
-                                            data->udn,
-                                            data->service_type,
-                                            data->description_url);
+                        /* Insert into document cache */
+                        g_hash_table_insert (priv->doc_cache,
+                                             g_strdup (fetch->url),
+                                             doc);
+
+                        /* Make sure the document is removed from the cache
+                         * once finalized. */
+                        g_object_weak_ref (G_OBJECT (doc),
+                                           doc_finalized,
+                                           control_point);
+                } else {
+                        g_warning ("Failed to parse %s", fetch->url);
+                        g_list_free_full (waiters,
+                                          (GDestroyNotify)
+                                          get_description_url_data_free);
+                        goto done;
+                }
+        }
+
+        for (l = waiters; l != NULL; l = l->next) {
+                GetDescriptionURLData *data = l->data;
+                GMainContext *async_context;
+
+                if (doc != NULL) {
+                        description_loaded (control_point,
+                                            doc,
+                                            data->udn,
+                                            data->service_type,
+                                            data->description_url);
+                        get_description_url_data_free (data);
+
+                        continue;
+                }
+
+                /* Retry GET after a timeout */
+                data->tries--;
+
+                if (data->tries <= 0) {
+                        g_warning ("Maximum number of retries failed, not trying again");
+                        get_description_url_data_free (data);
+
+                        continue;
+                }
+
+                g_warning ("Failed to GET %s: %s, retrying in %d seconds",
+                           data->description_url,
+                           !retry ? soup_message_get_reason_phrase (
+                                            fetch->message)
+                                  : "Timed out",
+                           data->timeout);
+
+                async_context = g_main_context_get_thread_default ();
+                data->timeout_source =
+                        g_timeout_source_new_seconds (data->timeout);
+                g_source_set_callback (data->timeout_source,
+                                       description_url_retry_timeout,
+                                       data,
+                                       NULL);
+                g_source_attach (data->timeout_source, async_context);
+                data->timeout <<= 1;
+        }
+        g_list_free (waiters);
+
+done:
+        /* If no proxy was created, make sure doc is freed. */
+        g_clear_object (&doc);
+        description_fetch_dispatch (control_point);
+        g_object_unref (control_point);
+
+out:
+        g_clear_error (&error);
+        g_clear_pointer (&document, g_bytes_unref);
+        description_fetch_free (fetch);
+}
+
+static void
+got_description_url (GObject *source,
+                     GAsyncResult *res,
+                     DescriptionFetch *fetch);
+
+static void
+got_description_document (G_GNUC_UNUSED GObject *source,
+                          GAsyncResult          *res,
+                          DescriptionFetch      *fetch)
+{
+        GError *error = NULL;
+        GBytes *document;
+
+        document = description_cache_handle_response_finish (res, &error);
+
+        /* The stored copy is gone, ask for the whole document */
+        if (document == NULL && error == NULL &&
+            fetch->control_point != NULL &&
+            soup_message_get_status (fetch->message) ==
+                    SOUP_STATUS_NOT_MODIFIED &&
+            description_cache_drop_conditions (fetch->message)) {
+                soup_session_send_and_read_async (
+                        gupnp_context_get_session (
+                                gupnp_control_point_get_context (
+                                        fetch->control_point)),
+                        fetch->message,
+                        G_PRIORITY_DEFAULT,
+                        fetch->cancellable,
+                        (GAsyncReadyCallback) got_description_url,
+                        fetch);
+
+                return;
+        }
+
+        description_fetch_finish (fetch, document, error);
+}
+
+/*
+ * Description URL downloaded.
+ */
+static void
+got_description_url (GObject *source,
+                     GAsyncResult *res,
+                     DescriptionFetch *fetch)
+{
+        DescriptionCache *disk_cache = NULL;
+        GError *error = NULL;
+
+        GBytes *body = soup_session_send_and_read_finish (SOUP_SESSION (source),
+                                                          res,
+                                                          &error);
+
+        if (fetch->control_point != NULL && error == NULL)
+                disk_cache = _gupnp_context_get_description_cache (
+                        gupnp_control_point_get_context (fetch->control_point));
+
+        /* The stored copy is read off the main loop */
+        if (disk_cache != NULL) {
+                description_cache_handle_response_async (
+                        disk_cache,
+                        fetch->url,
+                        fetch->message,
+                        body,
+                        fetch->cancellable,
+                        (GAsyncReadyCallback) got_description_document,
+                        fetch);
+                g_bytes_unref (body);
+
+                return;
+        }
+
+        if (error != NULL ||
+            !SOUP_STATUS_IS_SUCCESSFUL (soup_message_get_status (fetch->message)))
+                g_clear_pointer (&body, g_bytes_unref);
+
+        description_fetch_finish (fetch, body, error);
+}
+
+static void
+introspection_prefetched (GObject      *source,
+                          GAsyncResult *res,
+                          gpointer      user_data);
+
+static void
+description_fetch_start (GUPnPControlPoint *control_point,
+                         DescriptionFetch  *fetch)
+{
+        GUPnPControlPointPrivate *priv;
+        GUPnPContext *context;
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+        context = gupnp_control_point_get_context (control_point);
+
+        fetch->running = TRUE;
+        priv->running_fetches++;
+        g_hash_table_insert (
+                priv->fetch_hosts,
+                g_strdup (fetch->host),
+                GUINT_TO_POINTER (
+                        description_fetch_host_running (priv, fetch->host) +
+                        1));
+
+        if (fetch->proxy != NULL) {
+                gupnp_service_info_introspect_async (
+                        GUPNP_SERVICE_INFO (fetch->proxy),
+                        fetch->cancellable,
+                        introspection_prefetched,
+                        fetch);
+
+                return;
+        }
+
+        soup_session_send_and_read_async (
+                gupnp_context_get_session (context),
+                fetch->message,
+                G_PRIORITY_DEFAULT,
+                fetch->cancellable,
+                (GAsyncReadyCallback) got_description_url,
+                fetch);
+}
+
+/* Start waiting downloads as far as the limits allow, in the order they
+ * were requested */
+static void
+description_fetch_dispatch (GUPnPControlPoint *control_point)
+{
+        GUPnPControlPointPrivate *priv;
+        GList *l;
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        l = priv->fetch_queue.head;
+        while (l != NULL) {
+                DescriptionFetch *fetch = l->data;
+                GList *next = l->next;
+
+                if (priv->max_fetches != 0 &&
+                    priv->running_fetches >= priv->max_fetches)
+                        break;
+
+                if (priv->max_fetches_per_host == 0 ||
+                    description_fetch_host_running (priv, fetch->host) <
+                    priv->max_fetches_per_host) {
+                        g_queue_delete_link (&priv->fetch_queue, l);
+                        description_fetch_start (control_point, fetch);
+                }
+
+                l = next;
+        }
+}
+
+/*
+ * Introspection of a new service proxy finished.
+ */
+static void
+introspection_prefetched (GObject      *source,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+        DescriptionFetch *fetch = user_data;
+        GUPnPControlPoint *control_point = fetch->control_point;
+        GUPnPServiceIntrospection *introspection;
+        GUPnPServiceProxy *proxy;
+        GError *error = NULL;
+
+        introspection =
+                gupnp_service_info_introspect_finish (GUPNP_SERVICE_INFO (source),
+                                                      res,
+                                                      &error);
+
+        /* The service went away in the meantime */
+        if (control_point == NULL)
+                goto out;
+
+        /* The application can still introspect the proxy itself */
+        if (error != NULL)
+                g_debug ("Failed to prefetch introspection of %s: %s",
+                         fetch->url,
+                         error->message);
+
+        g_object_ref (control_point);
+        description_fetch_detach (fetch);
+
+        proxy = g_steal_pointer (&fetch->proxy);
+        register_service_proxy (control_point, proxy);
+
+        g_signal_emit (control_point,
+                       signals[SERVICE_PROXY_AVAILABLE],
+                       0,
+                       proxy);
+
+        description_fetch_dispatch (control_point);
+        g_object_unref (control_point);
+
+out:
+        g_clear_object (&introspection);
+        g_clear_error (&error);
+        description_fetch_free (fetch);
+}
+
+/* Queue fetching the introspection of @proxy, if its type is prefetched.
+ * The control point then owns @proxy. */
+static gboolean
+introspection_prefetch (GUPnPControlPoint *control_point,
+                        GUPnPServiceProxy *proxy)
+{
+        GUPnPControlPointPrivate *priv;
+        GUPnPServiceInfo *info = GUPNP_SERVICE_INFO (proxy);
+        DescriptionFetch *fetch;
+        const char *service_type;
+        char *scpd_url;
+        GUri *uri;
+        char **type;
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+        if (priv->prefetch_types == NULL)
+                return FALSE;
+
+        service_type = gupnp_service_info_get_service_type (info);
+        for (type = priv->prefetch_types; *type != NULL; type++) {
+                if (compare_service_types_versioned (*type, service_type))
+                        break;
+        }
+
+        if (*type == NULL)
+                return FALSE;
+
+        scpd_url = gupnp_service_info_get_scpd_url (info);
+        if (scpd_url == NULL)
+                return FALSE;
+
+        uri = g_uri_parse (scpd_url, G_URI_FLAGS_NONE, NULL);
+        g_free (scpd_url);
+        if (uri == NULL)
+                return FALSE;
+
+        fetch = g_slice_new0 (DescriptionFetch);
+        fetch->control_point = control_point;
+        fetch->url = service_node_key (gupnp_service_info_get_udn (info),
+                                       service_type);
+        fetch->host = g_strdup_printf ("%s:%d",
+                                       g_uri_get_host (uri),
+                                       g_uri_get_port (uri));
+        fetch->proxy = proxy;
+        fetch->cancellable = g_cancellable_new ();
+        g_uri_unref (uri);
+
+        g_hash_table_insert (priv->prefetching, g_strdup (fetch->url), fetch);
+        g_queue_push_tail (&priv->fetch_queue, fetch);
+        description_fetch_dispatch (control_point);
+
+        return TRUE;
+}
+
+/* Find or queue the download of @description_url */
+static DescriptionFetch *
+description_fetch_get (GUPnPControlPoint *control_point,
+                       const char        *description_url)
+{
+        GUPnPControlPointPrivate *priv;
+        DescriptionFetch *fetch;
+        GUPnPContext *context;
+        DescriptionCache *disk_cache;
+        SoupMessage *message;
+        char *local_description;
+        GUri *uri;
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+        fetch = g_hash_table_lookup (priv->fetches, description_url);
+        if (fetch != NULL)
+                return fetch;
+
+        context = gupnp_control_point_get_context (control_point);
+        local_description = gupnp_context_rewrite_uri (context,
+                                                       description_url);
+        if (local_description == NULL)
+                return NULL;
 
-                        /* Insert into document cache */
-                        g_hash_table_insert (priv->doc_cache,
-                                             g_strdup (data->description_url),
-                                             doc);
+        message = soup_message_new (SOUP_METHOD_GET, local_description);
+        g_free (local_description);
 
-                        /* Make sure the document is removed from the cache
-                         * once finalized. */
-                        g_object_weak_ref (G_OBJECT (doc),
-                                           doc_finalized,
-                                           data->control_point);
+        if (message == NULL)
+                return NULL;
 
-                        /* If no proxy was created, make sure doc is freed. */
-                        g_object_unref (doc);
-                } else
-                        g_warning ("Failed to parse %s", data->description_url);
+        http_request_set_accept_language (message);
 
-        } else {
-                GMainContext *async_context =
-                        g_main_context_get_thread_default ();
+        disk_cache = _gupnp_context_get_description_cache (context);
+        if (disk_cache != NULL)
+                description_cache_prepare_request (disk_cache,
+                                                   description_url,
+                                                   message);
 
-                /* Retry GET after a timeout */
-                data->tries--;
+        uri = soup_message_get_uri (message);
 
-                if (data->tries > 0) {
-                        g_warning (
-                                "Failed to GET %s: %s, retrying in %d seconds",
-                                data->description_url,
-                                !retry ? soup_message_get_reason_phrase (
-                                                 message)
-                                       : "Timed out",
-                                data->timeout);
-
-                        data->timeout_source = g_timeout_source_new_seconds
-                                        (data->timeout);
-                        g_source_set_callback (data->timeout_source,
-                                               description_url_retry_timeout,
-                                               data,
-                                               NULL);
-                        g_source_attach (data->timeout_source, async_context);
-                        data->timeout <<= 1;
-                        return;
-                } else {
-                        g_warning ("Maximum number of retries failed, not trying again");
-                }
-        }
+        fetch = g_slice_new0 (DescriptionFetch);
+        fetch->control_point = control_point;
+        fetch->url = g_strdup (description_url);
+        fetch->host = g_strdup_printf ("%s:%d",
+                                       g_uri_get_host (uri),
+                                       g_uri_get_port (uri));
+        fetch->message = message;
+        fetch->cancellable = g_cancellable_new ();
 
-out:
-        g_clear_error (&error);
-        get_description_url_data_free (data);
-        g_bytes_unref (body);
-        g_object_unref (message);
+        g_hash_table_insert (priv->fetches, fetch->url, fetch);
+        g_queue_push_tail (&priv->fetch_queue, fetch);
+
+        return fetch;
 }
 
 /*
@@ -731,62 +1399,35 @@ load_description (GUPnPControlPoint *control_point,
                                     service_type,
                                     description_url);
         } else {
-                /* Asynchronously download doc */
-                GUPnPContext *context;
-                SoupSession *session;
+                /* Asynchronously download doc, together with everybody
+                 * else waiting for it */
                 GetDescriptionURLData *data;
-                char *local_description = NULL;
-
-                context = gupnp_control_point_get_context (control_point);
-
-                session = gupnp_context_get_session (context);
-
-                data = g_slice_new (GetDescriptionURLData);
-
-                data->tries = max_tries;
-                data->timeout = timeout;
-                local_description = gupnp_context_rewrite_uri (context,
-                                                               description_url);
-                if (local_description == NULL) {
-                        g_warning ("Invalid description URL: %s",
-                                   description_url);
-
-                        g_slice_free (GetDescriptionURLData, data);
-
-                        return;
-                }
-
-                data->message = soup_message_new (SOUP_METHOD_GET,
-                                                  local_description);
-                g_free (local_description);
+                DescriptionFetch *fetch;
 
-                if (data->message == NULL) {
+                fetch = description_fetch_get (control_point,
+                                               description_url);
+                if (fetch == NULL) {
                         g_warning ("Invalid description URL: %s",
                                    description_url);
 
-                        g_slice_free (GetDescriptionURLData, data);
-
                         return;
                 }
 
-                http_request_set_accept_language (data->message);
+                data = g_slice_new (GetDescriptionURLData);
 
+                data->tries = max_tries;
+                data->timeout = timeout;
                 data->control_point = g_object_ref (control_point);
-                data->cancellable = g_cancellable_new ();
                 data->udn             = g_strdup (udn);
                 data->service_type    = g_strdup (service_type);
                 data->description_url = g_strdup (description_url);
                 data->timeout_source  = NULL;
+                data->fetch           = fetch;
                 priv->pending_gets = g_list_prepend (priv->pending_gets,
                                                      data);
 
-                soup_session_send_and_read_async (
-                        session,
-                        data->message,
-                        G_PRIORITY_DEFAULT,
-                        data->cancellable,
-                        (GAsyncReadyCallback) got_description_url,
-                        data);
+                fetch->waiters = g_list_append (fetch->waiters, data);
+                description_fetch_dispatch (control_point);
         }
 }
 
@@ -931,10 +1572,8 @@ gupnp_control_point_resource_unavailable
         GUPnPControlPoint *control_point;
         char *udn, *service_type;
         GetDescriptionURLData *get_data;
-        GUPnPControlPointPrivate *priv;
 
         control_point = GUPNP_CONTROL_POINT (resource_browser);
-        priv = gupnp_control_point_get_instance_private (control_point);
 
         /* Parse USN */
         if (!parse_usn (usn, &udn, &service_type))
@@ -948,10 +1587,7 @@ gupnp_control_point_resource_unavailable
                         GUPnPServiceProxy *proxy;
 
                         /* Remove proxy */
-                        proxy = GUPNP_SERVICE_PROXY (l->data);
-
-                        priv->services = g_list_delete_link (priv->services,
-                                                             l);
+                        proxy = unregister_service_proxy (control_point, l);
 
                         g_signal_emit (control_point,
                                        signals[SERVICE_PROXY_UNAVAILABLE],
@@ -959,6 +1595,20 @@ gupnp_control_point_resource_unavailable
                                        proxy);
 
                         g_object_unref (proxy);
+                } else {
+                        GUPnPControlPointPrivate *priv;
+                        DescriptionFetch *prefetch;
+                        char *key;
+
+                        /* Never announced, so just drop it */
+                        priv = gupnp_control_point_get_instance_private (
+                                control_point);
+                        key = service_node_key (udn, service_type);
+                        prefetch = g_hash_table_lookup (priv->prefetching, key);
+                        g_free (key);
+
+                        if (prefetch != NULL)
+                                description_fetch_abandon (prefetch);
                 }
         } else {
                 GList *l = find_device_node (control_point, udn);
@@ -967,10 +1617,7 @@ gupnp_control_point_resource_unavailable
                         GUPnPDeviceProxy *proxy;
 
                         /* Remove proxy */
-                        proxy = GUPNP_DEVICE_PROXY (l->data);
-
-                        priv->devices = g_list_delete_link (priv->devices,
-                                                            l);
+                        proxy = unregister_device_proxy (control_point, l);
 
                         g_signal_emit (control_point,
                                        signals[DEVICE_PROXY_UNAVAILABLE],
@@ -987,10 +1634,8 @@ gupnp_control_point_resource_unavailable
                                                   udn,
                                                   service_type);
 
-        if (get_data) {
-                if (!g_cancellable_is_cancelled (get_data->cancellable))
-                        g_cancellable_cancel (get_data->cancellable);
-        }
+        if (get_data)
+                get_description_url_data_free (get_data);
 
         g_free (udn);
         g_free (service_type);
@@ -1013,6 +1658,21 @@ gupnp_control_point_set_property (GObject      *object,
                 priv->factory =
                         GUPNP_RESOURCE_FACTORY (g_value_dup_object (value));
                 break;
+        case PROP_MAX_DESCRIPTION_FETCHES:
+                gupnp_control_point_set_max_description_fetches (
+                        control_point,
+                        g_value_get_uint (value));
+                break;
+        case PROP_MAX_DESCRIPTION_FETCHES_PER_HOST:
+                gupnp_control_point_set_max_description_fetches_per_host (
+                        control_point,
+                        g_value_get_uint (value));
+                break;
+        case PROP_INTROSPECTION_PREFETCH:
+                gupnp_control_point_set_introspection_prefetch (
+                        control_point,
+                        g_value_get_boxed (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -1034,6 +1694,24 @@ gupnp_control_point_get_property (GObject    *object,
                 g_value_set_object (value,
                                     gupnp_control_point_get_resource_factory (control_point));
                 break;
+        case PROP_MAX_DESCRIPTION_FETCHES:
+                g_value_set_uint (
+                        value,
+                        gupnp_control_point_get_max_description_fetches (
+                                control_point));
+                break;
+        case PROP_MAX_DESCRIPTION_FETCHES_PER_HOST:
+                g_value_set_uint (
+                        value,
+                        gupnp_control_point_get_max_description_fetches_per_host (
+                                control_point));
+                break;
+        case PROP_INTROSPECTION_PREFETCH:
+                g_value_set_boxed (
+                        value,
+                        gupnp_control_point_get_introspection_prefetch (
+                                control_point));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -1071,6 +1749,81 @@ gupnp_control_point_class_init (GUPnPControlPointClass *klass)
         browser_class->resource_unavailable =
                 gupnp_control_point_resource_unavailable;
 
+        /**
+         * GUPnPControlPoint:max-description-fetches:(attributes org.gtk.Property.get=gupnp_control_point_get_max_description_fetches org.gtk.Property.set=gupnp_control_point_set_max_description_fetches)
+         *
+         * The maximum number of description documents that are downloaded
+         * at the same time. Further downloads wait until one finishes, in
+         * the order the devices were discovered. 0 means no limit.
+         *
+         * All announcements that point to the same description document
+         * share a single download.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_MAX_DESCRIPTION_FETCHES,
+                 g_param_spec_uint ("max-description-fetches",
+                                    "Maximum description fetches",
+                                    "Maximum number of concurrent "
+                                    "description downloads",
+                                    0,
+                                    G_MAXUINT,
+                                    GUPNP_DEFAULT_MAX_DESCRIPTION_FETCHES,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_EXPLICIT_NOTIFY |
+                                    G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPControlPoint:max-description-fetches-per-host:(attributes org.gtk.Property.get=gupnp_control_point_get_max_description_fetches_per_host org.gtk.Property.set=gupnp_control_point_set_max_description_fetches_per_host)
+         *
+         * The maximum number of description documents that are downloaded
+         * from a single host at the same time. 0 means no limit.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_MAX_DESCRIPTION_FETCHES_PER_HOST,
+                 g_param_spec_uint ("max-description-fetches-per-host",
+                                    "Maximum description fetches per host",
+                                    "Maximum number of concurrent "
+                                    "description downloads from a host",
+                                    0,
+                                    G_MAXUINT,
+                                    GUPNP_DEFAULT_MAX_DESCRIPTION_FETCHES_PER_HOST,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_EXPLICIT_NOTIFY |
+                                    G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPControlPoint:introspection-prefetch:(attributes org.gtk.Property.get=gupnp_control_point_get_introspection_prefetch org.gtk.Property.set=gupnp_control_point_set_introspection_prefetch)
+         *
+         * The service types to introspect as soon as they are discovered.
+         *
+         * Service proxies of these types, or of later versions of them, are
+         * only announced through
+         * [signal@GUPnP.ControlPoint::service-proxy-available] once their
+         * SCPD was downloaded. The proxy keeps the introspection, so
+         * [method@GUPnP.ServiceInfo.introspect_async] then completes without
+         * downloading the SCPD again, unless the download failed. The
+         * downloads share the limits of the description downloads.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_INTROSPECTION_PREFETCH,
+                 g_param_spec_boxed ("introspection-prefetch",
+                                     "Introspection prefetch",
+                                     "Service types to introspect on "
+                                     "discovery",
+                                     G_TYPE_STRV,
+                                     G_PARAM_READWRITE |
+                                     G_PARAM_EXPLICIT_NOTIFY |
+                                     G_PARAM_STATIC_STRINGS));
+
         /**
          * GUPnPControlPoint:resource-factory:(attributes org.gtk.Property.get=gupnp_control_point_get_resource_factory)
          *
@@ -1314,6 +2067,174 @@ gupnp_control_point_list_service_proxies (GUPnPControlPoint *control_point)
         return (const GList *) priv->services;
 }
 
+/**
+ * gupnp_control_point_find_device_proxy:
+ * @control_point: A #GUPnPControlPoint
+ * @udn: The UDN of the device
+ *
+ * Look up the discovered #GUPnPDeviceProxy for the device @udn.
+ *
+ * Return value: (nullable) (transfer none): The device proxy, or %NULL if the
+ * device is not known.
+ *
+ * Since: 1.6.10
+ **/
+GUPnPDeviceProxy *
+gupnp_control_point_find_device_proxy (GUPnPControlPoint *control_point,
+                                       const char        *udn)
+{
+        GList *l;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), NULL);
+        g_return_val_if_fail (udn != NULL, NULL);
+
+        l = find_device_node (control_point, udn);
+
+        return l != NULL ? GUPNP_DEVICE_PROXY (l->data) : NULL;
+}
+
+/**
+ * gupnp_control_point_find_service_proxy:
+ * @control_point: A #GUPnPControlPoint
+ * @udn: The UDN of the device providing the service
+ * @service_type: The service type the proxy was discovered as
+ *
+ * Look up the discovered #GUPnPServiceProxy for the service @service_type of
+ * the device @udn.
+ *
+ * Return value: (nullable) (transfer none): The service proxy, or %NULL if
+ * the service is not known.
+ *
+ * Since: 1.6.10
+ **/
+GUPnPServiceProxy *
+gupnp_control_point_find_service_proxy (GUPnPControlPoint *control_point,
+                                        const char        *udn,
+                                        const char        *service_type)
+{
+        GList *l;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), NULL);
+        g_return_val_if_fail (udn != NULL, NULL);
+        g_return_val_if_fail (service_type != NULL, NULL);
+
+        l = find_service_node (control_point, udn, service_type);
+
+        return l != NULL ? GUPNP_SERVICE_PROXY (l->data) : NULL;
+}
+
+/**
+ * gupnp_control_point_list_device_proxies_by_type:
+ * @control_point: A #GUPnPControlPoint
+ * @device_type: A device type
+ *
+ * Get the discovered device proxies of type @device_type, in no particular
+ * order.
+ *
+ * Return value: (element-type GUPnP.DeviceProxy) (transfer container): The
+ * device proxies. Free the list with g_list_free().
+ *
+ * Since: 1.6.10
+ **/
+GList *
+gupnp_control_point_list_device_proxies_by_type (
+        GUPnPControlPoint *control_point,
+        const char        *device_type)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), NULL);
+        g_return_val_if_fail (device_type != NULL, NULL);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        return proxy_index_list (priv->devices_by_type, device_type);
+}
+
+/**
+ * gupnp_control_point_list_service_proxies_by_type:
+ * @control_point: A #GUPnPControlPoint
+ * @service_type: The service type the proxies were discovered as
+ *
+ * Get the discovered service proxies of type @service_type, in no
+ * particular order.
+ *
+ * Return value: (element-type GUPnP.ServiceProxy) (transfer container): The
+ * service proxies. Free the list with g_list_free().
+ *
+ * Since: 1.6.10
+ **/
+GList *
+gupnp_control_point_list_service_proxies_by_type (
+        GUPnPControlPoint *control_point,
+        const char        *service_type)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), NULL);
+        g_return_val_if_fail (service_type != NULL, NULL);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        return proxy_index_list (priv->services_by_type, service_type);
+}
+
+/**
+ * gupnp_control_point_list_device_proxies_by_location:
+ * @control_point: A #GUPnPControlPoint
+ * @location: The URL of a description document
+ *
+ * Get the discovered device proxies described by the document at
+ * @location, in no particular order.
+ *
+ * Return value: (element-type GUPnP.DeviceProxy) (transfer container): The
+ * device proxies. Free the list with g_list_free().
+ *
+ * Since: 1.6.10
+ **/
+GList *
+gupnp_control_point_list_device_proxies_by_location (
+        GUPnPControlPoint *control_point,
+        const char        *location)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), NULL);
+        g_return_val_if_fail (location != NULL, NULL);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        return proxy_index_list (priv->devices_by_location, location);
+}
+
+/**
+ * gupnp_control_point_list_service_proxies_by_location:
+ * @control_point: A #GUPnPControlPoint
+ * @location: The URL of a description document
+ *
+ * Get the discovered service proxies described by the document at
+ * @location, in no particular order.
+ *
+ * Return value: (element-type GUPnP.ServiceProxy) (transfer container): The
+ * service proxies. Free the list with g_list_free().
+ *
+ * Since: 1.6.10
+ **/
+GList *
+gupnp_control_point_list_service_proxies_by_location (
+        GUPnPControlPoint *control_point,
+        const char        *location)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), NULL);
+        g_return_val_if_fail (location != NULL, NULL);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        return proxy_index_list (priv->services_by_location, location);
+}
+
 /**
  * gupnp_control_point_get_resource_factory:(attributes org.gtk.Method.get_property=resource-factory)
  * @control_point: A #GUPnPControlPoint
@@ -1339,3 +2260,164 @@ gupnp_control_point_get_resource_factory (GUPnPControlPoint *control_point)
         return gupnp_resource_factory_get_default ();
 }
 
+/**
+ * gupnp_control_point_set_max_description_fetches:(attributes org.gtk.Method.set_property=max-description-fetches)
+ * @control_point: A #GUPnPControlPoint
+ * @max_fetches: The maximum number of concurrent description downloads, or 0
+ * for no limit
+ *
+ * Limits how many description documents are downloaded at the same time.
+ * See [property@GUPnP.ControlPoint:max-description-fetches].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_control_point_set_max_description_fetches (
+        GUPnPControlPoint *control_point,
+        guint              max_fetches)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_CONTROL_POINT (control_point));
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+        if (priv->max_fetches == max_fetches)
+                return;
+
+        priv->max_fetches = max_fetches;
+        description_fetch_dispatch (control_point);
+
+        g_object_notify (G_OBJECT (control_point), "max-description-fetches");
+}
+
+/**
+ * gupnp_control_point_get_max_description_fetches:(attributes org.gtk.Method.get_property=max-description-fetches)
+ * @control_point: A #GUPnPControlPoint
+ *
+ * Get the maximum number of concurrent description downloads.
+ *
+ * Return value: The limit, or 0 if there is none.
+ *
+ * Since: 1.6.10
+ **/
+guint
+gupnp_control_point_get_max_description_fetches (
+        GUPnPControlPoint *control_point)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), 0);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        return priv->max_fetches;
+}
+
+/**
+ * gupnp_control_point_set_max_description_fetches_per_host:(attributes org.gtk.Method.set_property=max-description-fetches-per-host)
+ * @control_point: A #GUPnPControlPoint
+ * @max_fetches: The maximum number of concurrent description downloads from
+ * a single host, or 0 for no limit
+ *
+ * Limits how many description documents are downloaded from a single host
+ * at the same time.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_control_point_set_max_description_fetches_per_host (
+        GUPnPControlPoint *control_point,
+        guint              max_fetches)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_CONTROL_POINT (control_point));
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+        if (priv->max_fetches_per_host == max_fetches)
+                return;
+
+        priv->max_fetches_per_host = max_fetches;
+        description_fetch_dispatch (control_point);
+
+        g_object_notify (G_OBJECT (control_point),
+                         "max-description-fetches-per-host");
+}
+
+/**
+ * gupnp_control_point_get_max_description_fetches_per_host:(attributes org.gtk.Method.get_property=max-description-fetches-per-host)
+ * @control_point: A #GUPnPControlPoint
+ *
+ * Get the maximum number of concurrent description downloads from a single
+ * host.
+ *
+ * Return value: The limit, or 0 if there is none.
+ *
+ * Since: 1.6.10
+ **/
+guint
+gupnp_control_point_get_max_description_fetches_per_host (
+        GUPnPControlPoint *control_point)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), 0);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        return priv->max_fetches_per_host;
+}
+
+/**
+ * gupnp_control_point_set_introspection_prefetch:(attributes org.gtk.Method.set_property=introspection-prefetch)
+ * @control_point: A #GUPnPControlPoint
+ * @service_types: (array zero-terminated=1) (nullable): The service types to
+ * introspect on discovery, or %NULL
+ *
+ * Sets the service types whose service proxies are introspected before they
+ * are announced. See [property@GUPnP.ControlPoint:introspection-prefetch].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_control_point_set_introspection_prefetch (
+        GUPnPControlPoint  *control_point,
+        const char * const *service_types)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_CONTROL_POINT (control_point));
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        g_strfreev (priv->prefetch_types);
+        priv->prefetch_types = NULL;
+        if (service_types != NULL && service_types[0] != NULL)
+                priv->prefetch_types = g_strdupv ((char **) service_types);
+
+        g_object_notify (G_OBJECT (control_point), "introspection-prefetch");
+}
+
+/**
+ * gupnp_control_point_get_introspection_prefetch:(attributes org.gtk.Method.get_property=introspection-prefetch)
+ * @control_point: A #GUPnPControlPoint
+ *
+ * Get the service types that are introspected on discovery.
+ *
+ * Return value: (array zero-terminated=1) (transfer none) (nullable): The
+ * service types, or %NULL if none are.
+ *
+ * Since: 1.6.10
+ **/
+const char * const *
+gupnp_control_point_get_introspection_prefetch (
+        GUPnPControlPoint *control_point)
+{
+        GUPnPControlPointPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_CONTROL_POINT (control_point), NULL);
+
+        priv = gupnp_control_point_get_instance_private (control_point);
+
+        return (const char * const *) priv->prefetch_types;
+}
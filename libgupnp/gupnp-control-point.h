@@ -67,9 +67,65 @@ gupnp_control_point_list_device_proxies  (GUPnPControlPoint    *control_point);
 const GList *
 gupnp_control_point_list_service_proxies (GUPnPControlPoint    *control_point);
 
+GUPnPDeviceProxy *
+gupnp_control_point_find_device_proxy    (GUPnPControlPoint    *control_point,
+                                          const char           *udn);
+
+GUPnPServiceProxy *
+gupnp_control_point_find_service_proxy   (GUPnPControlPoint    *control_point,
+                                          const char           *udn,
+                                          const char           *service_type);
+
+GList *
+gupnp_control_point_list_device_proxies_by_type (
+        GUPnPControlPoint *control_point,
+        const char        *device_type);
+
+GList *
+gupnp_control_point_list_service_proxies_by_type (
+        GUPnPControlPoint *control_point,
+        const char        *service_type);
+
+GList *
+gupnp_control_point_list_device_proxies_by_location (
+        GUPnPControlPoint *control_point,
+        const char        *location);
+
+GList *
+gupnp_control_point_list_service_proxies_by_location (
+        GUPnPControlPoint *control_point,
+        const char        *location);
+
 GUPnPResourceFactory *
 gupnp_control_point_get_resource_factory (GUPnPControlPoint    *control_point);
 
+void
+gupnp_control_point_set_max_description_fetches (
+        GUPnPControlPoint *control_point,
+        guint              max_fetches);
+
+guint
+gupnp_control_point_get_max_description_fetches (
+        GUPnPControlPoint *control_point);
+
+void
+gupnp_control_point_set_max_description_fetches_per_host (
+        GUPnPControlPoint *control_point,
+        guint              max_fetches);
+
+guint
+gupnp_control_point_get_max_description_fetches_per_host (
+        GUPnPControlPoint *control_point);
+
+void
+gupnp_control_point_set_introspection_prefetch (
+        GUPnPControlPoint  *control_point,
+        const char * const *service_types);
+
+const char * const *
+gupnp_control_point_get_introspection_prefetch (
+        GUPnPControlPoint *control_point);
+
 G_END_DECLS
 
 #endif /* GUPNP_CONTROL_POINT_H */
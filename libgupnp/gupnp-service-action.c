@@ -7,12 +7,69 @@
 #include "gupnp-error.h"
 #include "gupnp-service-private.h"
 #include "gupnp-service.h"
-#include "gupnp-xml-doc.h"
 #include "gvalue-util.h"
 #include "http-headers.h"
 #include "xml-util.h"
 
 #include <gobject/gvaluecollector.h>
+#include <libxml/parser.h>
+
+/* Depth of the action element in Envelope/Body/action */
+#define ACTION_DEPTH 3
+
+/* Streamed data is handed to libsoup in chunks of this size. An offloaded
+ * action writing faster than the client reads blocks once this many chunks
+ * are waiting to be sent */
+#define STREAM_CHUNK_SIZE 16384
+#define STREAM_WINDOW_CHUNKS 4
+
+/* A blocked offloaded action gives up on a client that did not read
+ * anything for this many seconds */
+#define STREAM_STALL_TIMEOUT 30
+
+#define SOAP_ENVELOPE_START                                                    \
+        "<?xml version=\"1.0\"?>"                                              \
+        "<s:Envelope xmlns:s="                                                 \
+        "\"http://schemas.xmlsoap.org/soap/envelope/\" "                       \
+        "s:encodingStyle="                                                     \
+        "\"http://schemas.xmlsoap.org/soap/encoding/\">"                       \
+        "<s:Body>"
+
+#define SOAP_ENVELOPE_END "</s:Body></s:Envelope>"
+
+struct _GUPnPServiceActionStream {
+        char       *argument;   /* Argument currently streamed, or NULL */
+        GConverter *compressor; /* NULL without gzip */
+
+        GMutex      lock;
+        GCond       drained;
+        gsize       pending;    /* Bytes handed to libsoup, not sent yet */
+        gboolean    aborted;    /* The client went away */
+        gboolean    closing;    /* The connection is about to be closed */
+
+        gulong      wrote_id;
+        gulong      finished_id;
+};
+
+static void
+action_stream_free (GUPnPServiceAction *action)
+{
+        GUPnPServiceActionStream *stream = action->stream;
+
+        if (stream->wrote_id != 0)
+                g_signal_handler_disconnect (action->msg, stream->wrote_id);
+        if (stream->finished_id != 0)
+                g_signal_handler_disconnect (action->msg,
+                                             stream->finished_id);
+
+        g_clear_object (&stream->compressor);
+        g_free (stream->argument);
+        g_mutex_clear (&stream->lock);
+        g_cond_clear (&stream->drained);
+
+        g_slice_free (GUPnPServiceActionStream, stream);
+        action->stream = NULL;
+}
 
 GUPnPServiceAction *
 gupnp_service_action_new ()
@@ -28,13 +85,39 @@ gupnp_service_action_ref (GUPnPServiceAction *action)
         return g_atomic_rc_box_acquire (action);
 }
 
+static gboolean
+unref_message_cb (gpointer user_data)
+{
+        g_object_unref (user_data);
+
+        return G_SOURCE_REMOVE;
+}
+
 static void
 action_dispose (GUPnPServiceAction *action)
 {
         g_free (action->name);
-        g_object_unref (action->msg);
+
+        /* An offloaded action may be released in a worker thread, but its
+         * message belongs to the context that received it */
+        if (action->offloaded)
+                g_main_context_invoke (action->owner_context,
+                                       unref_message_cb,
+                                       action->msg);
+        else
+                g_object_unref (action->msg);
+
+        g_clear_pointer (&action->request_headers,
+                         soup_message_headers_unref);
         g_object_unref (action->context);
-        g_object_unref (action->doc);
+        g_clear_pointer (&action->owner_context, g_main_context_unref);
+        if (action->stream != NULL)
+                action_stream_free (action);
+        g_clear_pointer (&action->argument_index, g_hash_table_destroy);
+        if (action->arguments != NULL)
+                g_array_unref (action->arguments);
+        if (action->strings != NULL)
+                g_string_chunk_free (action->strings);
         if (action->response_str)
                 g_string_free (action->response_str, TRUE);
 }
@@ -68,17 +151,558 @@ gupnp_service_action_get_type (void)
         return our_type;
 }
 
+/* State of the SAX parser reading the arguments of an action */
+typedef struct {
+        GUPnPServiceAction *action;
+        xmlParserCtxt      *ctxt;
+
+        guint               depth;    /* Depth of the current element */
+        guint               matched;  /* Number of matched Envelope, Body
+                                         and action elements */
+        gboolean            has_root;
+        gboolean            done;
+
+        const char         *argument; /* Name of the current argument */
+        GString            *content;  /* Text content of the argument */
+} ActionParser;
+
+static const char *
+action_parser_expected_element (ActionParser *parser)
+{
+        switch (parser->matched) {
+        case 0:
+                return "Envelope";
+        case 1:
+                return "Body";
+        default:
+                return parser->action->name;
+        }
+}
+
+static void
+action_parser_add_argument (ActionParser *parser)
+{
+        GUPnPServiceActionArgument argument;
+
+        argument.name = parser->argument;
+        argument.value = g_string_chunk_insert_len (parser->action->strings,
+                                                    parser->content->str,
+                                                    parser->content->len);
+        g_array_append_val (parser->action->arguments, argument);
+
+        parser->argument = NULL;
+}
+
+static void
+action_parser_start_element (void           *user_data,
+                             const xmlChar  *localname,
+                             G_GNUC_UNUSED const xmlChar  *prefix,
+                             G_GNUC_UNUSED const xmlChar  *uri,
+                             G_GNUC_UNUSED int             nb_namespaces,
+                             G_GNUC_UNUSED const xmlChar **namespaces,
+                             G_GNUC_UNUSED int             nb_attributes,
+                             G_GNUC_UNUSED int             nb_defaulted,
+                             G_GNUC_UNUSED const xmlChar **attributes)
+{
+        ActionParser *parser = user_data;
+
+        parser->has_root = TRUE;
+        parser->depth++;
+
+        if (parser->done)
+                return;
+
+        if (parser->matched == ACTION_DEPTH) {
+                /* Direct children of the action are its arguments */
+                if (parser->depth == ACTION_DEPTH + 1) {
+                        parser->argument = g_string_chunk_insert (
+                                parser->action->strings,
+                                (const char *) localname);
+                        g_string_truncate (parser->content, 0);
+                }
+
+                return;
+        }
+
+        /* Like xml_util_get_element(), only the first match on each level
+         * is considered */
+        if (parser->depth == parser->matched + 1 &&
+            strcmp ((const char *) localname,
+                    action_parser_expected_element (parser)) == 0)
+                parser->matched++;
+}
+
+static void
+action_parser_end_element (void          *user_data,
+                           G_GNUC_UNUSED const xmlChar *localname,
+                           G_GNUC_UNUSED const xmlChar *prefix,
+                           G_GNUC_UNUSED const xmlChar *uri)
+{
+        ActionParser *parser = user_data;
+
+        if (!parser->done) {
+                if (parser->matched == ACTION_DEPTH &&
+                    parser->depth == ACTION_DEPTH + 1)
+                        action_parser_add_argument (parser);
+
+                /* Leaving the action, or an Envelope or Body without it. The
+                 * rest of the document does not matter */
+                if (parser->depth == parser->matched) {
+                        parser->done = TRUE;
+                        xmlStopParser (parser->ctxt);
+                }
+        }
+
+        parser->depth--;
+}
+
+static void
+action_parser_characters (void          *user_data,
+                          const xmlChar *ch,
+                          int            len)
+{
+        ActionParser *parser = user_data;
+
+        /* Same as xmlNodeGetContent(): all text below the argument */
+        if (!parser->done &&
+            parser->matched == ACTION_DEPTH &&
+            parser->depth > ACTION_DEPTH)
+                g_string_append_len (parser->content, (const char *) ch, len);
+}
+
+/* Read the arguments of @action from the SOAP request @body in a single
+ * streaming pass, without building a document tree.
+ *
+ * Returns: %SOUP_STATUS_OK, or the status to reject the request with */
+guint
+gupnp_service_action_parse_body (GUPnPServiceAction *action,
+                                 const char         *body,
+                                 gsize               length)
+{
+        xmlSAXHandler sax = { 0, };
+        ActionParser parser = { 0, };
+        guint i;
+
+        g_return_val_if_fail (action != NULL, SOUP_STATUS_BAD_REQUEST);
+        g_return_val_if_fail (action->name != NULL, SOUP_STATUS_BAD_REQUEST);
+
+        if (length > G_MAXINT)
+                return SOUP_STATUS_BAD_REQUEST;
+
+        sax.initialized = XML_SAX2_MAGIC;
+        sax.startElementNs = action_parser_start_element;
+        sax.endElementNs = action_parser_end_element;
+        sax.characters = action_parser_characters;
+        sax.cdataBlock = action_parser_characters;
+
+        action->strings = g_string_chunk_new (MAX (length, 64));
+        action->arguments =
+                g_array_new (FALSE, FALSE, sizeof (GUPnPServiceActionArgument));
+
+        parser.action = action;
+        parser.content = g_string_new (NULL);
+        parser.ctxt = xmlCreatePushParserCtxt (&sax, &parser, NULL, 0, NULL);
+        xmlCtxtUseOptions (parser.ctxt, XML_PARSE_NONET | XML_PARSE_RECOVER);
+
+        xmlParseChunk (parser.ctxt, body, (int) length, 1);
+
+        /* A truncated document still yields what was read of the action */
+        if (!parser.done &&
+            parser.matched == ACTION_DEPTH &&
+            parser.argument != NULL)
+                action_parser_add_argument (&parser);
+
+        xmlFreeParserCtxt (parser.ctxt);
+        g_string_free (parser.content, TRUE);
+
+        if (!parser.has_root)
+                return SOUP_STATUS_BAD_REQUEST;
+
+        if (parser.matched < ACTION_DEPTH)
+                return SOUP_STATUS_PRECONDITION_FAILED;
+
+        action->argument_count = action->arguments->len;
+
+        /* Index the arguments. Walk backwards so the first one wins for
+         * duplicate names */
+        action->argument_index = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = action->arguments->len; i > 0; i--) {
+                GUPnPServiceActionArgument *argument;
+
+                argument = &g_array_index (action->arguments,
+                                           GUPnPServiceActionArgument,
+                                           i - 1);
+                g_hash_table_insert (action->argument_index,
+                                     (gpointer) argument->name,
+                                     argument);
+        }
+
+        return SOUP_STATUS_OK;
+}
+
+static void
+action_unpause_message (GUPnPServiceAction *action)
+{
+#if SOUP_CHECK_VERSION(3,1,2)
+        soup_server_message_unpause (action->msg);
+#else
+        SoupServer *server = gupnp_context_get_server (action->context);
+        soup_server_unpause_message (server, action->msg);
+#endif
+}
+
+static void
+action_set_response_headers (GUPnPServiceAction *action)
+{
+        SoupMessageHeaders *headers =
+                soup_server_message_get_response_headers (action->msg);
+
+        soup_message_headers_replace (headers,
+                                      "Content-Type",
+                                      "text/xml; charset=\"utf-8\"");
+
+        soup_message_headers_append (headers, "Ext", "");
+
+        /* Server header on response */
+        soup_message_headers_append (
+                headers,
+                "Server",
+                gssdp_client_get_server_id (GSSDP_CLIENT (action->context)));
+}
+
+typedef enum {
+        STREAM_OP_START,
+        STREAM_OP_DATA,
+        STREAM_OP_ABORT,
+        STREAM_OP_END
+} StreamOpType;
+
+typedef struct {
+        GUPnPServiceAction *action;
+        StreamOpType        type;
+        GBytes             *bytes;
+} StreamOp;
+
+static void
+on_stream_wrote_body_data (G_GNUC_UNUSED SoupServerMessage *msg,
+                           guint              chunk_size,
+                           gpointer           user_data)
+{
+        GUPnPServiceActionStream *stream = user_data;
+
+        g_mutex_lock (&stream->lock);
+        stream->pending -= MIN (stream->pending, chunk_size);
+        g_cond_broadcast (&stream->drained);
+        g_mutex_unlock (&stream->lock);
+}
+
+static void
+on_stream_finished (G_GNUC_UNUSED SoupServerMessage *msg, gpointer user_data)
+{
+        GUPnPServiceActionStream *stream = user_data;
+
+        g_mutex_lock (&stream->lock);
+        stream->aborted = TRUE;
+        g_cond_broadcast (&stream->drained);
+        g_mutex_unlock (&stream->lock);
+}
+
+static gboolean
+close_connection_cb (gpointer user_data)
+{
+        GIOStream *connection;
+
+        connection = soup_server_message_steal_connection (user_data);
+        if (connection != NULL) {
+                g_io_stream_close (connection, NULL, NULL);
+                g_object_unref (connection);
+        }
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Runs on the owner context of the action */
+static void
+stream_op_run (StreamOp *op)
+{
+        GUPnPServiceAction *action = op->action;
+        GUPnPServiceActionStream *stream = action->stream;
+        SoupMessageHeaders *headers =
+                soup_server_message_get_response_headers (action->msg);
+        SoupMessageBody *body =
+                soup_server_message_get_response_body (action->msg);
+        GSource *source;
+        gboolean aborted;
+
+        g_mutex_lock (&stream->lock);
+        aborted = stream->aborted;
+        g_mutex_unlock (&stream->lock);
+
+        /* Nobody is listening anymore; just release the action */
+        if (aborted && op->type != STREAM_OP_END)
+                return;
+
+        switch (op->type) {
+        case STREAM_OP_START:
+                soup_server_message_set_status (action->msg,
+                                                SOUP_STATUS_OK,
+                                                NULL);
+                action_set_response_headers (action);
+                if (stream->compressor != NULL)
+                        soup_message_headers_append (headers,
+                                                     "Content-Encoding",
+                                                     "gzip");
+                soup_message_headers_set_encoding (headers,
+                                                   SOUP_ENCODING_CHUNKED);
+                soup_message_body_set_accumulate (body, FALSE);
+
+                stream->wrote_id =
+                        g_signal_connect (action->msg,
+                                          "wrote-body-data",
+                                          G_CALLBACK (on_stream_wrote_body_data),
+                                          stream);
+                stream->finished_id =
+                        g_signal_connect (action->msg,
+                                          "finished",
+                                          G_CALLBACK (on_stream_finished),
+                                          stream);
+                break;
+        case STREAM_OP_DATA:
+                soup_message_body_append_bytes (body, op->bytes);
+                action_unpause_message (action);
+                break;
+        case STREAM_OP_ABORT:
+                /* The status line is gone already, so a truncated chunked
+                 * body is the only way to tell the client that the action
+                 * failed. Not from within the server handler, though */
+                source = g_idle_source_new ();
+                g_source_set_callback (source,
+                                       close_connection_cb,
+                                       g_object_ref (action->msg),
+                                       g_object_unref);
+                g_source_attach (source, action->owner_context);
+                g_source_unref (source);
+
+                g_mutex_lock (&stream->lock);
+                stream->aborted = TRUE;
+                g_cond_broadcast (&stream->drained);
+                g_mutex_unlock (&stream->lock);
+                break;
+        case STREAM_OP_END:
+                if (!aborted) {
+                        soup_message_body_complete (body);
+                        action_unpause_message (action);
+                }
+
+                /* The action might be released in a worker thread */
+                g_clear_signal_handler (&stream->wrote_id, action->msg);
+                g_clear_signal_handler (&stream->finished_id, action->msg);
+
+                /* Cleanup */
+                gupnp_service_action_unref (action);
+                break;
+        default:
+                g_assert_not_reached ();
+        }
+}
+
+static void
+stream_op_free (StreamOp *op)
+{
+        g_clear_pointer (&op->bytes, g_bytes_unref);
+        g_slice_free (StreamOp, op);
+}
+
+static gboolean
+stream_op_idle (gpointer user_data)
+{
+        stream_op_run (user_data);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Run a streaming operation on the context owning the message, in the order
+ * of the calls. Takes ownership of @bytes */
+static void
+action_stream_queue (GUPnPServiceAction *action,
+                     StreamOpType        type,
+                     GBytes             *bytes)
+{
+        GUPnPServiceActionStream *stream = action->stream;
+        StreamOp *op;
+        GSource *source;
+
+        op = g_slice_new0 (StreamOp);
+        op->action = action;
+        op->type = type;
+        op->bytes = bytes;
+
+        if (bytes != NULL) {
+                g_mutex_lock (&stream->lock);
+                stream->pending += g_bytes_get_size (bytes);
+                g_mutex_unlock (&stream->lock);
+        }
+
+        if (!action->offloaded) {
+                stream_op_run (op);
+                stream_op_free (op);
+
+                return;
+        }
+
+        source = g_idle_source_new ();
+        g_source_set_callback (source,
+                               stream_op_idle,
+                               op,
+                               (GDestroyNotify) stream_op_free);
+        g_source_attach (source, action->owner_context);
+        g_source_unref (source);
+}
+
+/* Hand the buffered response data to libsoup. With @finish, the response
+ * is complete */
+static void
+action_stream_flush (GUPnPServiceAction *action, gboolean finish)
+{
+        GUPnPServiceActionStream *stream = action->stream;
+        GBytes *bytes;
+
+        if (stream->compressor != NULL) {
+                bytes = http_gzip_convert (stream->compressor,
+                                           action->response_str->str,
+                                           action->response_str->len,
+                                           finish);
+                g_string_truncate (action->response_str, 0);
+        } else {
+                /* Pass the buffer on without copying */
+                bytes = g_string_free_to_bytes (action->response_str);
+                action->response_str =
+                        g_string_sized_new (STREAM_CHUNK_SIZE + 1024);
+        }
+
+        if (g_bytes_get_size (bytes) > 0)
+                action_stream_queue (action, STREAM_OP_DATA, bytes);
+        else
+                g_bytes_unref (bytes);
+
+        if (finish)
+                action_stream_queue (action, STREAM_OP_END, NULL);
+}
+
+/* Close the connection of a streamed response, unless that already
+ * happened */
+static void
+action_stream_abort (GUPnPServiceAction *action)
+{
+        GUPnPServiceActionStream *stream = action->stream;
+        gboolean closing;
+
+        g_mutex_lock (&stream->lock);
+        closing = stream->aborted || stream->closing;
+        stream->closing = TRUE;
+        g_mutex_unlock (&stream->lock);
+
+        if (!closing)
+                action_stream_queue (action, STREAM_OP_ABORT, NULL);
+}
+
+static gboolean
+action_stream_is_closed (GUPnPServiceActionStream *stream)
+{
+        gboolean closed;
+
+        g_mutex_lock (&stream->lock);
+        closed = stream->aborted || stream->closing;
+        g_mutex_unlock (&stream->lock);
+
+        return closed;
+}
+
+/* Block an offloaded action while too much data is waiting to be sent. A
+ * client that stops reading gets its connection closed */
+static void
+action_stream_wait (GUPnPServiceAction *action)
+{
+        GUPnPServiceActionStream *stream = action->stream;
+        gboolean stalled = FALSE;
+        gint64 end_time;
+
+        if (!action->offloaded)
+                return;
+
+        end_time = g_get_monotonic_time () +
+                   STREAM_STALL_TIMEOUT * G_TIME_SPAN_SECOND;
+
+        g_mutex_lock (&stream->lock);
+        while (!stream->aborted && !stream->closing &&
+               stream->pending > STREAM_CHUNK_SIZE * STREAM_WINDOW_CHUNKS) {
+                gsize pending = stream->pending;
+
+                if (!g_cond_wait_until (&stream->drained,
+                                        &stream->lock,
+                                        end_time) &&
+                    stream->pending >= pending) {
+                        stalled = TRUE;
+
+                        break;
+                }
+
+                /* Some data went out, so the client is still reading */
+                if (stream->pending < pending)
+                        end_time = g_get_monotonic_time () +
+                                   STREAM_STALL_TIMEOUT * G_TIME_SPAN_SECOND;
+        }
+        g_mutex_unlock (&stream->lock);
+
+        if (stalled) {
+                g_debug ("Client of action %s stopped reading, closing the "
+                         "connection",
+                         action->name);
+                action_stream_abort (action);
+        }
+}
+
+static void
+action_stream_maybe_flush (GUPnPServiceAction *action)
+{
+        if (action->stream == NULL ||
+            action->response_str->len < STREAM_CHUNK_SIZE)
+                return;
+
+        action_stream_flush (action, FALSE);
+        action_stream_wait (action);
+}
+
+static void
+finalize_streamed_action (GUPnPServiceAction *action)
+{
+        /* Nothing left to send */
+        if (action_stream_is_closed (action->stream)) {
+                action_stream_queue (action, STREAM_OP_END, NULL);
+
+                return;
+        }
+
+        if (action->stream->argument != NULL) {
+                g_warning ("Action %s returned while streaming argument %s",
+                           action->name,
+                           action->stream->argument);
+                gupnp_service_action_stream_end (action);
+        }
+
+        g_string_append (action->response_str, "</u:");
+        g_string_append (action->response_str, action->name);
+        g_string_append (action->response_str, "Response>");
+        g_string_append (action->response_str, SOAP_ENVELOPE_END);
+
+        action_stream_flush (action, TRUE);
+}
+
 static void
 finalize_action (GUPnPServiceAction *action)
 {
         /* Embed action->response_str in a SOAP document */
-        g_string_prepend (action->response_str,
-                          "<?xml version=\"1.0\"?>"
-                          "<s:Envelope xmlns:s="
-                          "\"http://schemas.xmlsoap.org/soap/envelope/\" "
-                          "s:encodingStyle="
-                          "\"http://schemas.xmlsoap.org/soap/encoding/\">"
-                          "<s:Body>");
+        g_string_prepend (action->response_str, SOAP_ENVELOPE_START);
 
         if (soup_server_message_get_status (action->msg) !=
             SOUP_STATUS_INTERNAL_SERVER_ERROR) {
@@ -87,20 +711,12 @@ finalize_action (GUPnPServiceAction *action)
                 g_string_append (action->response_str, "Response>");
         }
 
-        g_string_append (action->response_str,
-                         "</s:Body>"
-                         "</s:Envelope>");
+        g_string_append (action->response_str, SOAP_ENVELOPE_END);
 
-        SoupMessageHeaders *headers =
-                soup_server_message_get_response_headers (action->msg);
+        action_set_response_headers (action);
 
-        soup_message_headers_replace (headers,
-                                      "Content-Type",
-                                      "text/xml; charset=\"utf-8\"");
-
-        if (action->accept_gzip && action->response_str->len > 1024) {
-                // Fixme: Probably easier to use an output stream converter
-                // instead
+        if (action->accept_gzip &&
+            action->response_str->len >= HTTP_GZIP_THRESHOLD) {
                 http_response_set_body_gzip (action->msg,
                                              action->response_str->str,
                                              action->response_str->len);
@@ -114,26 +730,60 @@ finalize_action (GUPnPServiceAction *action)
         }
         action->response_str = NULL;
 
-        soup_message_headers_append (headers, "Ext", "");
-
-        /* Server header on response */
-        soup_message_headers_append (
-                headers,
-                "Server",
-                gssdp_client_get_server_id (GSSDP_CLIENT (action->context)));
-
         /* Tell soup server that response is now ready */
-#if SOUP_CHECK_VERSION(3,1,2)
-        soup_server_message_unpause (action->msg);
-#else
-        SoupServer *server = gupnp_context_get_server (action->context);
-        soup_server_unpause_message (server, action->msg);
-#endif
+        action_unpause_message (action);
 
         /* Cleanup */
         gupnp_service_action_unref (action);
 }
 
+static gboolean
+complete_action_in_owner (gpointer user_data)
+{
+        GUPnPServiceAction *action = user_data;
+
+        soup_server_message_set_status (action->msg,
+                                        action->status,
+                                        action->reason);
+        finalize_action (action);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Set the final status of @action and send the response. The message
+ * belongs to the main context that received it, so offloaded actions are
+ * completed there */
+static void
+complete_action (GUPnPServiceAction *action,
+                 guint               status,
+                 const char         *reason)
+{
+        GSource *source;
+
+        /* The status went out with the headers. The rest of the stream is
+         * still written by the caller, which may block */
+        if (action->stream != NULL) {
+                finalize_streamed_action (action);
+
+                return;
+        }
+
+        if (!action->offloaded) {
+                soup_server_message_set_status (action->msg, status, reason);
+                finalize_action (action);
+
+                return;
+        }
+
+        action->status = status;
+        action->reason = reason;
+
+        source = g_idle_source_new ();
+        g_source_set_callback (source, complete_action_in_owner, action, NULL);
+        g_source_attach (source, action->owner_context);
+        g_source_unref (source);
+}
+
 /**
  * gupnp_service_action_get_name:
  * @action: A #GUPnPServiceAction
@@ -165,6 +815,11 @@ gupnp_service_action_get_locales (GUPnPServiceAction *action)
 {
         g_return_val_if_fail (action != NULL, NULL);
 
+        /* Offloaded actions must not touch the message */
+        if (action->request_headers != NULL)
+                return http_request_get_accept_locales (
+                        action->request_headers);
+
         return http_request_get_accept_locales (
                 soup_server_message_get_request_headers (action->msg));
 }
@@ -276,7 +931,7 @@ gupnp_service_action_get_value (GUPnPServiceAction *action,
                                 const char *argument,
                                 GValue *value)
 {
-        xmlNode *node;
+        GUPnPServiceActionArgument *arg;
         gboolean found;
 
         g_return_if_fail (action != NULL);
@@ -284,14 +939,9 @@ gupnp_service_action_get_value (GUPnPServiceAction *action,
         g_return_if_fail (value != NULL);
 
         found = FALSE;
-        for (node = action->node->children; node; node = node->next) {
-                if (strcmp ((char *) node->name, argument) != 0)
-                        continue;
-
-                found = gvalue_util_set_value_from_xml_node (value, node);
-
-                break;
-        }
+        arg = g_hash_table_lookup (action->argument_index, argument);
+        if (arg != NULL)
+                found = gvalue_util_set_value_from_string (value, arg->value);
 
         if (!found)
                 g_warning ("Failed to retrieve '%s' argument of '%s' action",
@@ -420,8 +1070,7 @@ gupnp_service_action_set_values (GUPnPServiceAction *action,
         g_return_if_fail (g_list_length (arg_names) ==
                           g_list_length (arg_values));
 
-        if (soup_server_message_get_status (action->msg) ==
-            SOUP_STATUS_INTERNAL_SERVER_ERROR) {
+        if (action->failed) {
                 g_warning ("Calling gupnp_service_action_set_value() after "
                            "having called gupnp_service_action_return_error() "
                            "is not allowed.");
@@ -463,8 +1112,7 @@ gupnp_service_action_set_value (GUPnPServiceAction *action,
         g_return_if_fail (argument != NULL);
         g_return_if_fail (value != NULL);
 
-        if (soup_server_message_get_status (action->msg) ==
-            SOUP_STATUS_INTERNAL_SERVER_ERROR) {
+        if (action->failed) {
                 g_warning ("Calling gupnp_service_action_set_value() after "
                            "having called gupnp_service_action_return_error() "
                            "is not allowed.");
@@ -472,10 +1120,144 @@ gupnp_service_action_set_value (GUPnPServiceAction *action,
                 return;
         }
 
+        if (action->stream != NULL && action->stream->argument != NULL) {
+                g_warning ("Calling gupnp_service_action_set_value() while "
+                           "streaming argument %s is not allowed.",
+                           action->stream->argument);
+
+                return;
+        }
+
         /* Append to response */
         xml_util_start_element (action->response_str, argument);
         gvalue_util_value_append_to_xml_string (value, action->response_str);
         xml_util_end_element (action->response_str, argument);
+
+        action_stream_maybe_flush (action);
+}
+
+/**
+ * gupnp_service_action_stream_begin:
+ * @action: A #GUPnPServiceAction
+ * @argument: The name of the out-argument to stream
+ *
+ * Start writing the value of @argument in pieces using
+ * gupnp_service_action_stream_write(), for out-arguments too large to
+ * build in memory, such as a big DIDL-Lite `Result`.
+ *
+ * The first call sends the response headers and switches the response to
+ * chunked transfer encoding, so a SOAP fault can no longer be sent after
+ * it. Calling gupnp_service_action_return_error() then closes the
+ * connection instead, so the client sees a truncated response and the
+ * call fails without the error code. Other
+ * out-arguments can still be set with gupnp_service_action_set_value()
+ * outside of gupnp_service_action_stream_begin() and
+ * gupnp_service_action_stream_end(), in the order of the action's
+ * argument list.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_action_stream_begin (GUPnPServiceAction *action,
+                                   const char         *argument)
+{
+        g_return_if_fail (action != NULL);
+        g_return_if_fail (argument != NULL);
+        g_return_if_fail (action->stream == NULL ||
+                          action->stream->argument == NULL);
+
+        if (action->failed) {
+                g_warning ("Calling gupnp_service_action_stream_begin() "
+                           "after having called "
+                           "gupnp_service_action_return_error() is not "
+                           "allowed.");
+
+                return;
+        }
+
+        if (action->stream == NULL) {
+                action->stream = g_slice_new0 (GUPnPServiceActionStream);
+                g_mutex_init (&action->stream->lock);
+                g_cond_init (&action->stream->drained);
+
+                if (action->accept_gzip)
+                        action->stream->compressor = G_CONVERTER (
+                                g_zlib_compressor_new (
+                                        G_ZLIB_COMPRESSOR_FORMAT_GZIP,
+                                        -1));
+
+                g_string_prepend (action->response_str, SOAP_ENVELOPE_START);
+                action_stream_queue (action, STREAM_OP_START, NULL);
+        }
+
+        action->stream->argument = g_strdup (argument);
+        xml_util_start_element (action->response_str, argument);
+}
+
+/**
+ * gupnp_service_action_stream_write:
+ * @action: A #GUPnPServiceAction
+ * @data: (array length=length) (element-type guint8): Text to append to the
+ * argument value
+ * @length: The length of @data in bytes, or -1 if it is nul-terminated
+ *
+ * Append @data to the value of the argument started with
+ * gupnp_service_action_stream_begin(). @data is escaped as needed, so
+ * a DIDL-Lite fragment is written as is.
+ *
+ * Data is sent to the client as soon as enough of it is collected. If
+ * the action is invoked in a worker thread (see
+ * gupnp_service_set_action_offload()), this function blocks while the
+ * client is not reading fast enough. If the client does not read anything
+ * for 30 seconds, the connection is closed and further data is discarded.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_action_stream_write (GUPnPServiceAction *action,
+                                   const char         *data,
+                                   gssize              length)
+{
+        g_return_if_fail (action != NULL);
+        g_return_if_fail (action->stream != NULL);
+        g_return_if_fail (action->stream->argument != NULL);
+        g_return_if_fail (data != NULL || length == 0);
+
+        if (length < 0)
+                length = strlen (data);
+
+        while (length > 0 && !action_stream_is_closed (action->stream)) {
+                gssize n = MIN (length, STREAM_CHUNK_SIZE);
+
+                xml_util_add_content_len (action->response_str, data, n);
+                data += n;
+                length -= n;
+
+                action_stream_maybe_flush (action);
+        }
+}
+
+/**
+ * gupnp_service_action_stream_end:
+ * @action: A #GUPnPServiceAction
+ *
+ * Finish the argument started with gupnp_service_action_stream_begin().
+ * The response is completed as usual with
+ * gupnp_service_action_return_success().
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_action_stream_end (GUPnPServiceAction *action)
+{
+        g_return_if_fail (action != NULL);
+        g_return_if_fail (action->stream != NULL);
+        g_return_if_fail (action->stream->argument != NULL);
+
+        xml_util_end_element (action->response_str, action->stream->argument);
+        g_clear_pointer (&action->stream->argument, g_free);
+
+        action_stream_maybe_flush (action);
 }
 
 /**
@@ -491,9 +1273,7 @@ gupnp_service_action_return_success (GUPnPServiceAction *action)
 {
         g_return_if_fail (action != NULL);
 
-        soup_server_message_set_status (action->msg, SOUP_STATUS_OK, NULL);
-
-        finalize_action (action);
+        complete_action (action, SOUP_STATUS_OK, NULL);
 }
 
 /**
@@ -507,6 +1287,11 @@ gupnp_service_action_return_success (GUPnPServiceAction *action)
  * provided automatically.
  *
  * Return @error_code.
+ *
+ * If gupnp_service_action_stream_begin() was already called, the response
+ * headers were sent with a success status. The connection is then closed
+ * without completing the response, and the client only learns that the
+ * call failed.
  **/
 void
 gupnp_service_action_return_error (GUPnPServiceAction *action,
@@ -541,6 +1326,15 @@ gupnp_service_action_return_error (GUPnPServiceAction *action,
                 break;
         }
 
+        /* Too late for a SOAP fault */
+        if (action->stream != NULL) {
+                action->failed = TRUE;
+                action_stream_abort (action);
+                action_stream_queue (action, STREAM_OP_END, NULL);
+
+                return;
+        }
+
         /* Replace response_str with a SOAP Fault */
         g_string_erase (action->response_str, 0, -1);
 
@@ -573,11 +1367,10 @@ gupnp_service_action_return_error (GUPnPServiceAction *action,
 
         xml_util_end_element (action->response_str, "s:Fault");
 
-        soup_server_message_set_status (action->msg,
-                                        SOUP_STATUS_INTERNAL_SERVER_ERROR,
-                                        "Internal server error");
-
-        finalize_action (action);
+        action->failed = TRUE;
+        complete_action (action,
+                         SOUP_STATUS_INTERNAL_SERVER_ERROR,
+                         "Internal server error");
 }
 
 /**
@@ -587,6 +1380,10 @@ gupnp_service_action_return_error (GUPnPServiceAction *action,
  * Get the #SoupMessage associated with @action. Mainly intended for
  * applications to be able to read HTTP headers received from clients.
  *
+ * The message is not thread-safe. If @action is invoked in a worker thread
+ * (see [method@GUPnP.Service.set_action_offload]), it may only be used on
+ * the main context that received the action.
+ *
  * Return value: (transfer full): #SoupServerMessage associated with @action.
  *Unref after using it.
  *
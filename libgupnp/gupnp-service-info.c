@@ -534,72 +534,321 @@ gupnp_service_info_get_event_subscription_url (GUPnPServiceInfo *info)
                                                        priv->url_base);
 }
 
+/* A download of a SCPD. All introspections of the same SCPD URL wait for
+ * the same download. */
+typedef struct {
+        GUPnPContext *context;
+        char *url;
+        char *key; /* Shares the introspection without download, or NULL */
+        SoupMessage *message;
+        GCancellable *cancellable;
+        GList *waiters; /* GTask */
+} IntrospectionFetch;
+
+/* Task data of an introspection call */
+typedef struct {
+        IntrospectionFetch *fetch;
+        gulong cancelled_id;
+} IntrospectionWaiter;
+
 static void
-get_scpd_document_finished (GObject *source,
-                            GAsyncResult *res,
-                            gpointer user_data)
+introspection_fetch_free (IntrospectionFetch *fetch)
 {
+        g_object_unref (fetch->context);
+        g_free (fetch->url);
+        g_free (fetch->key);
+        g_object_unref (fetch->message);
+        g_object_unref (fetch->cancellable);
+
+        g_free (fetch);
+}
+
+/* Complete the introspection @task with @introspection or @error */
+static void
+introspection_task_return (GTask                     *task,
+                           GUPnPServiceIntrospection *introspection,
+                           const GError              *error)
+{
+        GUPnPServiceInfo *info = g_task_get_source_object (task);
+        GUPnPServiceInfoPrivate *priv =
+                gupnp_service_info_get_instance_private (info);
+        IntrospectionWaiter *waiter = g_task_get_task_data (task);
+
+        if (waiter->cancelled_id != 0) {
+                g_cancellable_disconnect (g_task_get_cancellable (task),
+                                          waiter->cancelled_id);
+                waiter->cancelled_id = 0;
+        }
+        waiter->fetch = NULL;
+
+        if (introspection != NULL) {
+                if (priv->introspection == NULL)
+                        priv->introspection = g_object_ref (introspection);
+
+                g_task_return_pointer (task,
+                                       g_object_ref (introspection),
+                                       g_object_unref);
+        } else {
+                g_task_return_error (task, g_error_copy (error));
+        }
+
+        g_object_unref (task);
+}
+
+static gboolean
+introspection_task_cancelled_idle (gpointer user_data)
+{
+        GTask *task = G_TASK (user_data);
+        IntrospectionWaiter *waiter = g_task_get_task_data (task);
+        IntrospectionFetch *fetch = waiter->fetch;
         GError *error = NULL;
+
+        /* The download might have finished in the meantime */
+        if (fetch == NULL)
+                return G_SOURCE_REMOVE;
+
+        /* Stop the download if nobody else waits for it */
+        fetch->waiters = g_list_remove (fetch->waiters, task);
+        if (fetch->waiters == NULL) {
+                if (_gupnp_context_lookup_introspection_fetch (fetch->context,
+                                                               fetch->url) ==
+                    fetch)
+                        _gupnp_context_set_introspection_fetch (fetch->context,
+                                                                fetch->url,
+                                                                NULL);
+                g_cancellable_cancel (fetch->cancellable);
+        }
+
+        g_cancellable_set_error_if_cancelled (g_task_get_cancellable (task),
+                                              &error);
+        introspection_task_return (task, NULL, error);
+        g_error_free (error);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Might run in any thread and must not disconnect itself, so the task
+ * leaves the download from an idle in its own context */
+static void
+introspection_task_cancelled (G_GNUC_UNUSED GCancellable *cancellable,
+                              gpointer user_data)
+{
         GTask *task = G_TASK (user_data);
+        GSource *source;
+
+        source = g_idle_source_new ();
+        g_source_set_callback (source,
+                               introspection_task_cancelled_idle,
+                               g_object_ref (task),
+                               g_object_unref);
+        g_source_attach (source, g_task_get_context (task));
+        g_source_unref (source);
+}
+
+static void
+introspection_fetch_add_waiter (IntrospectionFetch *fetch, GTask *task)
+{
+        IntrospectionWaiter *waiter = g_task_get_task_data (task);
+        GCancellable *cancellable = g_task_get_cancellable (task);
+
+        waiter->fetch = fetch;
+        if (cancellable != NULL)
+                waiter->cancelled_id =
+                        g_cancellable_connect (cancellable,
+                                               G_CALLBACK (
+                                                       introspection_task_cancelled),
+                                               task,
+                                               NULL);
+
+        fetch->waiters = g_list_append (fetch->waiters, task);
+}
+
+/* Turn the SCPD @document downloaded by @fetch into the introspection and
+ * hand it to the waiters. @document is %NULL if the download failed, with
+ * @error set unless the server answered with an error. Takes @error. */
+static void
+introspection_fetch_finish (IntrospectionFetch *fetch,
+                            GBytes             *document,
+                            GError             *error)
+{
+        GUPnPServiceIntrospection *introspection = NULL;
         xmlDoc *scpd = NULL;
+        char *hash = NULL;
 
-        GBytes *bytes =
-                soup_session_send_and_read_finish (SOUP_SESSION (source),
-                                                   res,
-                                                   &error);
+        /* Abandoned by everybody waiting for it */
+        if (fetch->waiters == NULL)
+                goto out;
 
-        if (error != NULL) {
-                g_task_return_error (task, error);
+        _gupnp_context_set_introspection_fetch (fetch->context,
+                                                fetch->url,
+                                                NULL);
 
+        if (error != NULL)
                 goto out;
-        }
 
-        SoupMessage *message =
-                soup_session_get_async_result_message (SOUP_SESSION (source),
-                                                       res);
-        if (!SOUP_STATUS_IS_SUCCESSFUL (soup_message_get_status (message))) {
-                g_task_return_error (task,
-                                     _gupnp_error_new_server_error (message));
+        if (document == NULL) {
+                error = _gupnp_error_new_server_error (fetch->message);
 
                 goto out;
         }
 
+        /* Identical SCPDs share one introspection */
+        hash = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, document);
+        introspection = _gupnp_context_lookup_introspection (fetch->context,
+                                                             hash);
+        if (introspection != NULL) {
+                g_object_ref (introspection);
+
+                goto share;
+        }
+
         gsize length;
-        gconstpointer data = g_bytes_get_data (bytes, &length);
+        gconstpointer data = g_bytes_get_data (document, &length);
         scpd = xmlReadMemory (data,
                               length,
                               NULL,
                               NULL,
                               XML_PARSE_NONET | XML_PARSE_RECOVER);
         if (scpd == NULL) {
-                g_task_return_new_error (task,
-                                         GUPNP_SERVER_ERROR,
-                                         GUPNP_SERVER_ERROR_INVALID_RESPONSE,
-                                         "Could not parse SCPD");
+                g_set_error_literal (&error,
+                                     GUPNP_SERVER_ERROR,
+                                     GUPNP_SERVER_ERROR_INVALID_RESPONSE,
+                                     "Could not parse SCPD");
 
                 goto out;
         }
 
-        GUPnPServiceInfo *info =
-                GUPNP_SERVICE_INFO (g_task_get_source_object (task));
-        GUPnPServiceInfoPrivate *priv =
-                gupnp_service_info_get_instance_private (info);
-        priv->introspection = gupnp_service_introspection_new (scpd, &error);
-
-        if (error != NULL) {
-                g_task_return_error (task, error);
-
+        introspection = gupnp_service_introspection_new (scpd, &error);
+        if (error != NULL)
                 goto out;
-        }
 
-        g_task_return_pointer (task,
-                               g_object_ref (priv->introspection),
-                               g_object_unref);
+        _gupnp_context_add_introspection (fetch->context, hash, introspection);
+
+share:
+        if (fetch->key != NULL)
+                _gupnp_context_add_introspection (fetch->context,
+                                                  fetch->key,
+                                                  introspection);
 
 out:
+        while (fetch->waiters != NULL) {
+                GTask *task = fetch->waiters->data;
+
+                fetch->waiters = g_list_delete_link (fetch->waiters,
+                                                     fetch->waiters);
+                introspection_task_return (task, introspection, error);
+        }
+
+        g_clear_object (&introspection);
+        g_clear_error (&error);
+        g_free (hash);
         g_clear_pointer (&scpd, xmlFreeDoc);
+        introspection_fetch_free (fetch);
+}
+
+static void
+get_scpd_document_finished (GObject *source,
+                            GAsyncResult *res,
+                            gpointer user_data);
+
+static void
+on_scpd_document_cached (G_GNUC_UNUSED GObject *source,
+                         GAsyncResult          *res,
+                         gpointer               user_data)
+{
+        IntrospectionFetch *fetch = user_data;
+        GError *error = NULL;
+        GBytes *document;
+
+        document = description_cache_handle_response_finish (res, &error);
+
+        /* The stored copy is gone, ask for the whole document */
+        if (document == NULL && error == NULL && fetch->waiters != NULL &&
+            soup_message_get_status (fetch->message) ==
+                    SOUP_STATUS_NOT_MODIFIED &&
+            description_cache_drop_conditions (fetch->message)) {
+                GUPnPContext *context = fetch->context;
+
+                soup_session_send_and_read_async (
+                        gupnp_context_get_session (context),
+                        fetch->message,
+                        G_PRIORITY_DEFAULT,
+                        fetch->cancellable,
+                        get_scpd_document_finished,
+                        fetch);
+
+                return;
+        }
+
+        introspection_fetch_finish (fetch, document, error);
+        g_clear_pointer (&document, g_bytes_unref);
+}
+
+static void
+get_scpd_document_finished (GObject *source,
+                            GAsyncResult *res,
+                            gpointer user_data)
+{
+        GError *error = NULL;
+        IntrospectionFetch *fetch = user_data;
+        DescriptionCache *disk_cache;
+        GBytes *document = NULL;
+
+        GBytes *bytes =
+                soup_session_send_and_read_finish (SOUP_SESSION (source),
+                                                   res,
+                                                   &error);
+
+        disk_cache = _gupnp_context_get_description_cache (fetch->context);
+        if (error == NULL && fetch->waiters != NULL && disk_cache != NULL) {
+                /* The stored copy is read off the main loop */
+                description_cache_handle_response_async (disk_cache,
+                                                         fetch->url,
+                                                         fetch->message,
+                                                         bytes,
+                                                         fetch->cancellable,
+                                                         on_scpd_document_cached,
+                                                         fetch);
+                g_bytes_unref (bytes);
+
+                return;
+        }
+
+        if (error == NULL &&
+            SOUP_STATUS_IS_SUCCESSFUL (soup_message_get_status (fetch->message)))
+                document = bytes;
+
+        introspection_fetch_finish (fetch, document, error);
         g_clear_pointer (&bytes, g_bytes_unref);
-        g_object_unref (task);
+}
+
+/* The key an introspection of @info can be shared under without fetching the
+ * SCPD, or %NULL. Devices announce changes to any of their documents through
+ * the configId of their description. */
+static char *
+get_introspection_key (GUPnPServiceInfo *info, const char *scpd_url)
+{
+        GUPnPServiceInfoPrivate *priv =
+                gupnp_service_info_get_instance_private (info);
+        xmlNode *root;
+        xmlChar *config_id;
+        char *key;
+
+        if (priv->doc == NULL)
+                return NULL;
+
+        root = xmlDocGetRootElement (gupnp_xml_doc_get_doc (priv->doc));
+        if (root == NULL)
+                return NULL;
+
+        config_id = xmlGetProp (root, (const xmlChar *) "configId");
+        if (config_id == NULL)
+                return NULL;
+
+        key = g_strconcat (scpd_url, "#", (char *) config_id, NULL);
+        xmlFree (config_id);
+
+        return key;
 }
 
 /**
@@ -613,6 +862,10 @@ out:
  * description document (SCPD) provided by the service so it can not be created
  * if the service does not provide a SCPD.
  *
+ * Services of the same context share the introspection object if their SCPDs
+ * are identical, and concurrent calls for the same SCPD URL wait for a single
+ * download. The introspection object must therefore not be modified.
+ *
  * If @cancellable is used to cancel the call, @callback will be called with
  * error code %G_IO_ERROR_CANCELLED.
  *
@@ -640,6 +893,12 @@ gupnp_service_info_introspect_async           (GUPnPServiceInfo    *info,
                 return;
         }
 
+        if (g_task_return_error_if_cancelled (task)) {
+                g_object_unref (task);
+
+                return;
+        }
+
         char *scpd_url = gupnp_service_info_get_scpd_url (info);
         if (scpd_url == NULL) {
                 g_task_return_new_error (task,
@@ -653,41 +912,82 @@ gupnp_service_info_introspect_async           (GUPnPServiceInfo    *info,
         }
 
         GUPnPContext *context = gupnp_service_info_get_context (info);
-        GUri *scpd = gupnp_context_rewrite_uri_to_uri (context, scpd_url);
-        g_free (scpd_url);
+        char *key = get_introspection_key (info, scpd_url);
+
+        // Another service of the same device configuration was introspected
+        if (key != NULL) {
+                GUPnPServiceIntrospection *shared =
+                        _gupnp_context_lookup_introspection (context, key);
+
+                if (shared != NULL) {
+                        priv->introspection = g_object_ref (shared);
+                        g_task_return_pointer (task,
+                                               g_object_ref (shared),
+                                               g_object_unref);
+                        g_object_unref (task);
+                        g_free (scpd_url);
+                        g_free (key);
+
+                        return;
+                }
+        }
+
+        IntrospectionWaiter *waiter = g_new0 (IntrospectionWaiter, 1);
+        g_task_set_task_data (task, waiter, g_free);
+
+        // Wait for a download of the same SCPD that is already running
+        IntrospectionFetch *fetch =
+                _gupnp_context_lookup_introspection_fetch (context, scpd_url);
+        if (fetch != NULL) {
+                introspection_fetch_add_waiter (fetch, task);
+                g_free (scpd_url);
+                g_free (key);
 
+                return;
+        }
+
+        GUri *scpd = gupnp_context_rewrite_uri_to_uri (context, scpd_url);
         SoupMessage *message = soup_message_new_from_uri (SOUP_METHOD_GET, scpd);
         g_uri_unref (scpd);
 
         if (message == NULL) {
-                g_task_return_new_error (task,
-                                         GUPNP_SERVER_ERROR,
-                                         GUPNP_SERVER_ERROR_INVALID_URL,
-                                         "%s",
-                                         "No valid SCPD URL defined");
-                g_object_unref (task);
+                GError *error = g_error_new_literal (
+                        GUPNP_SERVER_ERROR,
+                        GUPNP_SERVER_ERROR_INVALID_URL,
+                        "No valid SCPD URL defined");
+
+                introspection_task_return (task, NULL, error);
+                g_error_free (error);
+                g_free (scpd_url);
+                g_free (key);
 
                 return;
         }
 
-        GCancellable *internal_cancellable = g_cancellable_new ();
-        if (cancellable != NULL) {
-                g_cancellable_connect (cancellable,
-                                       G_CALLBACK (g_cancellable_cancel),
-                                       internal_cancellable,
-                                       NULL);
-        }
+        DescriptionCache *disk_cache =
+                _gupnp_context_get_description_cache (context);
+        if (disk_cache != NULL)
+                description_cache_prepare_request (disk_cache,
+                                                   scpd_url,
+                                                   message);
+
+        fetch = g_new0 (IntrospectionFetch, 1);
+        fetch->context = g_object_ref (context);
+        fetch->url = scpd_url;
+        fetch->key = key;
+        fetch->message = message;
+        fetch->cancellable = g_cancellable_new ();
+        _gupnp_context_set_introspection_fetch (context, scpd_url, fetch);
+        introspection_fetch_add_waiter (fetch, task);
 
         /* Send off the message */
         soup_session_send_and_read_async (
                 gupnp_context_get_session (priv->context),
                 message,
                 G_PRIORITY_DEFAULT,
-                internal_cancellable,
+                fetch->cancellable,
                 get_scpd_document_finished,
-                task);
-        g_object_unref (message);
-        g_object_unref (internal_cancellable);
+                fetch);
 }
 
 /**
@@ -10,27 +10,50 @@
 #define GUPNP_SERVICE_PRIVATE_H
 
 #include "gupnp-context.h"
-#include "gupnp-xml-doc.h"
 
 #include <libsoup/soup.h>
 
+typedef struct {
+        const char *name;
+        const char *value;
+} GUPnPServiceActionArgument;
+
+typedef struct _GUPnPServiceActionStream GUPnPServiceActionStream;
+
 struct _GUPnPServiceAction {
         GUPnPContext *context;
+        GMainContext *owner_context; /* Context that received the action */
 
         char         *name;
 
-        SoupServerMessage *msg;
+        SoupServerMessage *msg;       /* Only used on owner_context */
+        SoupMessageHeaders *request_headers; /* Copy of the request headers
+                                                of an offloaded action */
         gboolean      accept_gzip;
 
-        GUPnPXMLDoc  *doc;
-        xmlNode      *node;
+        GStringChunk *strings;        /* Argument names and values */
+        GArray       *arguments;      /* GUPnPServiceActionArgument, in
+                                         document order */
+        GHashTable   *argument_index; /* Name -> first argument with it */
 
         GString      *response_str;
 
         guint         argument_count;
+
+        GUPnPServiceActionStream *stream; /* Set once streaming started */
+
+        gboolean      offloaded;     /* Invoked in a worker thread */
+        gboolean      failed;        /* return_error() was called */
+        guint         status;        /* Final status of an offloaded action */
+        const char   *reason;
 };
 
 void
 gupnp_service_action_unref (struct _GUPnPServiceAction *action);
 
+G_GNUC_INTERNAL guint
+gupnp_service_action_parse_body (struct _GUPnPServiceAction *action,
+                                 const char                 *body,
+                                 gsize                       length);
+
 #endif
@@ -132,14 +132,24 @@ G_BEGIN_DECLS
                 } \
         } G_STMT_END
 
+/* The parts of an action call that only depend on the service and the
+ * action name, shared by all calls of that action on a proxy */
+typedef struct {
+        char *prefix;      /* Up to and including the action element start */
+        char *suffix;      /* From the action element end */
+        char *soap_action; /* Value of the (s-)SOAPAction header */
+} GUPnPServiceProxyActionTemplate;
+
 struct _GUPnPServiceProxyAction {
         GUPnPServiceProxy *proxy;
         char *name;
-        gint header_pos;
 
         SoupMessage *msg;
         GBytes *response;
-        GString *msg_str;
+
+        /* Request body, kept while the arguments do not change */
+        GBytes *body;
+        GUPnPServiceProxyActionTemplate *body_template;
 
         gulong cancellable_connection_id;
 
@@ -150,6 +160,13 @@ struct _GUPnPServiceProxyAction {
         GPtrArray *args;
         GHashTable *arg_map;
         gboolean pending;
+        int priority;
+        gboolean method_retried; /* Already fell back to the other of
+                                    POST or M-POST */
+        gboolean coalesce;
+        GBytes *coalesce_key; /* Body of the call identical calls wait for */
+        GBytes *joined_key;   /* Body of the call this one waits for */
+        gulong joined_cancelled_id;
         xmlDocPtr doc;
         xmlNodePtr params;
 };
@@ -162,9 +179,19 @@ gupnp_service_proxy_action_get_result_valist (GUPnPServiceProxyAction *action,
                                               GError                 **error,
                                               va_list                  var_args);
 
+G_GNUC_INTERNAL GUPnPServiceProxyActionTemplate *
+gupnp_service_proxy_action_template_new (const char *service_type,
+                                         const char *action_name);
+
+G_GNUC_INTERNAL GUPnPServiceProxyActionTemplate *
+gupnp_service_proxy_action_template_ref (GUPnPServiceProxyActionTemplate *self);
+
 G_GNUC_INTERNAL void
+gupnp_service_proxy_action_template_unref (GUPnPServiceProxyActionTemplate *self);
+
+G_GNUC_INTERNAL GBytes *
 gupnp_service_proxy_action_serialize (GUPnPServiceProxyAction *action,
-                                      const char *service_type);
+                                      GUPnPServiceProxyActionTemplate *tmpl);
 
 G_GNUC_INTERNAL void
 gupnp_service_proxy_action_check_response (GUPnPServiceProxyAction *action);
@@ -173,4 +200,7 @@ G_END_DECLS
 G_GNUC_INTERNAL void
 gupnp_service_proxy_action_reset (GUPnPServiceProxyAction *action);
 
+G_GNUC_INTERNAL GUPnPServiceProxyAction *
+gupnp_service_proxy_action_copy (GUPnPServiceProxyAction *action);
+
 #endif /* GUPNP_SERVICE_PROXY_ACTION_H */
@@ -9,6 +9,9 @@
 
 #include <config.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <libxml/parser.h>
 
 #include "gupnp-error.h"
@@ -240,6 +243,7 @@ gupnp_service_proxy_action_iter_get_value_as (GUPnPServiceProxyActionIter *self,
 struct _ActionArgument {
         char *name;
         GValue value;
+        GString *xml; /* Serialized argument, NULL after a change */
 };
 typedef struct _ActionArgument ActionArgument;
 
@@ -248,6 +252,8 @@ action_argument_free (ActionArgument* arg)
 {
         g_free (arg->name);
         g_value_unset (&arg->value);
+        if (arg->xml != NULL)
+                g_string_free (arg->xml, TRUE);
         g_free (arg);
 }
 
@@ -337,11 +343,6 @@ gupnp_service_proxy_action_reset (GUPnPServiceProxyAction *action)
         g_clear_weak_pointer (&action->proxy);
         g_clear_error (&action->error);
         g_clear_object (&action->msg);
-
-        if (action->msg_str != NULL) {
-                g_string_free (action->msg_str, TRUE);
-                action->msg_str = NULL;
-        }
         g_clear_pointer (&action->response, g_bytes_unref);
         action->params = NULL;
         g_clear_pointer (&action->doc, xmlFreeDoc);
@@ -351,12 +352,52 @@ static void
 action_dispose (GUPnPServiceProxyAction *action)
 {
         gupnp_service_proxy_action_reset (action);
+        g_clear_pointer (&action->body, g_bytes_unref);
+        g_clear_pointer (&action->body_template,
+                         gupnp_service_proxy_action_template_unref);
+        g_clear_pointer (&action->coalesce_key, g_bytes_unref);
+        g_clear_pointer (&action->joined_key, g_bytes_unref);
         g_hash_table_destroy (action->arg_map);
         g_ptr_array_unref (action->args);
 
         g_free (action->name);
 }
 
+/* Create an unsent action with the same arguments as @action. Serialized
+ * arguments and body are shared with @action. */
+GUPnPServiceProxyAction *
+gupnp_service_proxy_action_copy (GUPnPServiceProxyAction *action)
+{
+        GUPnPServiceProxyAction *copy;
+        guint i;
+
+        copy = gupnp_service_proxy_action_new_plain (action->name);
+        copy->priority = action->priority;
+        copy->coalesce = action->coalesce;
+
+        for (i = 0; i < action->args->len; i++) {
+                ActionArgument *arg = g_ptr_array_index (action->args, i);
+                ActionArgument *copy_arg;
+
+                gupnp_service_proxy_action_add_argument (copy,
+                                                         arg->name,
+                                                         &arg->value);
+                if (arg->xml == NULL)
+                        continue;
+
+                copy_arg = g_ptr_array_index (copy->args, i);
+                copy_arg->xml = g_string_new_len (arg->xml->str, arg->xml->len);
+        }
+
+        if (action->body != NULL) {
+                copy->body = g_bytes_ref (action->body);
+                copy->body_template = gupnp_service_proxy_action_template_ref (
+                        action->body_template);
+        }
+
+        return copy;
+}
+
 /**
  * gupnp_service_proxy_action_unref:
  * @action: an action
@@ -390,17 +431,17 @@ write_in_parameter (ActionArgument *arg,
         xml_util_end_element (msg_str, arg->name);
 }
 
+/* Forget the serialized form of @arg after its value changed */
 static void
-write_footer (GUPnPServiceProxyAction *action)
+action_argument_changed (GUPnPServiceProxyAction *action,
+                         ActionArgument          *arg)
 {
-        /* Finish message */
-        g_string_append (action->msg_str, "</u:");
-        g_string_append (action->msg_str, action->name);
-        g_string_append_c (action->msg_str, '>');
-
-        g_string_append (action->msg_str,
-                         "</s:Body>"
-                         "</s:Envelope>");
+        if (arg->xml != NULL) {
+                g_string_free (arg->xml, TRUE);
+                arg->xml = NULL;
+        }
+
+        g_clear_pointer (&action->body, g_bytes_unref);
 }
 
 /**
@@ -592,43 +633,118 @@ gupnp_service_proxy_action_add_argument (GUPnPServiceProxyAction *action,
                              arg->name,
                              GUINT_TO_POINTER (action->args->len));
         g_ptr_array_add (action->args, arg);
+        action_argument_changed (action, arg);
 
         return action;
 }
 
+GUPnPServiceProxyActionTemplate *
+gupnp_service_proxy_action_template_new (const char *service_type,
+                                         const char *action_name)
+{
+        GUPnPServiceProxyActionTemplate *self;
+
+        self = g_atomic_rc_box_new0 (GUPnPServiceProxyActionTemplate);
+        self->prefix = g_strconcat ("<?xml version=\"1.0\"?>"
+                                    "<s:Envelope xmlns:s="
+                                    "\"http://schemas.xmlsoap.org/soap/envelope/\" "
+                                    "s:encodingStyle="
+                                    "\"http://schemas.xmlsoap.org/soap/encoding/\">"
+                                    "<s:Body>"
+                                    "<u:",
+                                    action_name,
+                                    " xmlns:u=\"",
+                                    service_type,
+                                    "\">",
+                                    NULL);
+        self->suffix = g_strconcat ("</u:",
+                                    action_name,
+                                    ">"
+                                    "</s:Body>"
+                                    "</s:Envelope>",
+                                    NULL);
+        self->soap_action = g_strdup_printf ("\"%s#%s\"",
+                                             service_type,
+                                             action_name);
+
+        return self;
+}
+
+GUPnPServiceProxyActionTemplate *
+gupnp_service_proxy_action_template_ref (GUPnPServiceProxyActionTemplate *self)
+{
+        return g_atomic_rc_box_acquire (self);
+}
+
+static void
+action_template_clear (GUPnPServiceProxyActionTemplate *self)
+{
+        g_free (self->prefix);
+        g_free (self->suffix);
+        g_free (self->soap_action);
+}
+
 void
+gupnp_service_proxy_action_template_unref (GUPnPServiceProxyActionTemplate *self)
+{
+        g_atomic_rc_box_release_full (self,
+                                      (GDestroyNotify) action_template_clear);
+}
+
+/* Returns the request body of @action for the service and action described
+ * by @tmpl. Only arguments that changed since the last call are serialized
+ * again; if none did, the previous body is returned as is. */
+GBytes *
 gupnp_service_proxy_action_serialize (GUPnPServiceProxyAction *action,
-                                      const char *service_type)
+                                      GUPnPServiceProxyActionTemplate *tmpl)
 {
-        if (action->msg_str != NULL) {
-                g_string_free (action->msg_str, TRUE);
+        GString *msg_str;
+        gsize prefix_len;
+        gsize suffix_len;
+        gsize length;
+        guint i;
+
+        /* Services of the same type share the body, even if they use
+         * different templates */
+        if (action->body != NULL &&
+            (action->body_template == tmpl ||
+             (g_str_equal (action->body_template->prefix, tmpl->prefix) &&
+              g_str_equal (action->body_template->suffix, tmpl->suffix))))
+                return g_bytes_ref (action->body);
+
+        prefix_len = strlen (tmpl->prefix);
+        suffix_len = strlen (tmpl->suffix);
+        length = prefix_len + suffix_len;
+
+        for (i = 0; i < action->args->len; i++) {
+                ActionArgument *arg = g_ptr_array_index (action->args, i);
+
+                if (arg->xml == NULL) {
+                        arg->xml = g_string_new (NULL);
+                        write_in_parameter (arg, arg->xml);
+                }
+
+                length += arg->xml->len;
+        }
+
+        msg_str = g_string_sized_new (length);
+        g_string_append_len (msg_str, tmpl->prefix, prefix_len);
+        for (i = 0; i < action->args->len; i++) {
+                ActionArgument *arg = g_ptr_array_index (action->args, i);
+
+                g_string_append_len (msg_str, arg->xml->str, arg->xml->len);
         }
-        action->msg_str = xml_util_new_string ();
-
-        g_string_append (action->msg_str,
-                         "<?xml version=\"1.0\"?>"
-                         "<s:Envelope xmlns:s="
-                         "\"http://schemas.xmlsoap.org/soap/envelope/\" "
-                         "s:encodingStyle="
-                         "\"http://schemas.xmlsoap.org/soap/encoding/\">"
-                         "<s:Body>");
-        action->header_pos = action->msg_str->len;
-
-        g_ptr_array_foreach (action->args,
-                             (GFunc) write_in_parameter,
-                             action->msg_str);
-
-        write_footer (action);
-
-        g_string_insert (action->msg_str, action->header_pos, "<u:");
-        action->header_pos += strlen ("<u:");
-        g_string_insert (action->msg_str, action->header_pos, action->name);
-        action->header_pos += strlen (action->name);
-        g_string_insert (action->msg_str, action->header_pos, " xmlns:u=\"");
-        action->header_pos += strlen (" xmlns:u=\"");
-        g_string_insert (action->msg_str, action->header_pos, service_type);
-        action->header_pos += strlen (service_type);
-        g_string_insert (action->msg_str, action->header_pos, "\">");
+        g_string_append_len (msg_str, tmpl->suffix, suffix_len);
+
+        g_clear_pointer (&action->body, g_bytes_unref);
+        action->body = g_string_free_to_bytes (msg_str);
+
+        gupnp_service_proxy_action_template_ref (tmpl);
+        g_clear_pointer (&action->body_template,
+                         gupnp_service_proxy_action_template_unref);
+        action->body_template = tmpl;
+
+        return g_bytes_ref (action->body);
 }
 
 /* Checks an action response for errors and returns the parsed
@@ -1097,6 +1213,572 @@ gupnp_service_proxy_action_set (GUPnPServiceProxyAction *action,
         }
 
         g_value_copy (value, &arg->value);
+        action_argument_changed (action, arg);
+
+        return TRUE;
+}
+
+/**
+ * gupnp_service_proxy_action_set_priority:
+ * @action: the action to modify
+ * @priority: The I/O priority of the call, like %G_PRIORITY_DEFAULT
+ *
+ * Set the priority of @action. If the calls to a host are limited by
+ * [property@GUPnP.Context:max-actions-per-host], waiting calls with a lower
+ * priority value are sent first.
+ *
+ * Takes effect the next time @action is sent.
+ *
+ * Since: 1.6.10
+ */
+void
+gupnp_service_proxy_action_set_priority (GUPnPServiceProxyAction *action,
+                                         int priority)
+{
+        g_return_if_fail (action != NULL);
+
+        action->priority = priority;
+}
+
+/**
+ * gupnp_service_proxy_action_get_priority:
+ * @action: an action
+ *
+ * Get the priority of @action, see
+ * gupnp_service_proxy_action_set_priority().
+ *
+ * Returns: The I/O priority of @action
+ * Since: 1.6.10
+ */
+int
+gupnp_service_proxy_action_get_priority (GUPnPServiceProxyAction *action)
+{
+        g_return_val_if_fail (action != NULL, G_PRIORITY_DEFAULT);
+
+        return action->priority;
+}
+
+/**
+ * gupnp_service_proxy_action_set_coalesce:
+ * @action: the action to modify
+ * @coalesce: Whether @action may share a call with identical actions
+ *
+ * Let asynchronous calls of @action share the request of an identical
+ * call on the same proxy that is still running, instead of sending their
+ * own. Calls are identical if they have the same action name and argument
+ * values. All of them receive the response of the one request.
+ *
+ * Only use this for actions without side effects, like GetVolume or
+ * GetTransportInfo.
+ *
+ * Since: 1.6.10
+ */
+void
+gupnp_service_proxy_action_set_coalesce (GUPnPServiceProxyAction *action,
+                                         gboolean coalesce)
+{
+        g_return_if_fail (action != NULL);
+
+        action->coalesce = coalesce;
+}
+
+/**
+ * gupnp_service_proxy_action_get_coalesce:
+ * @action: an action
+ *
+ * See gupnp_service_proxy_action_set_coalesce().
+ *
+ * Returns: %TRUE if calls of @action may be shared
+ * Since: 1.6.10
+ */
+gboolean
+gupnp_service_proxy_action_get_coalesce (GUPnPServiceProxyAction *action)
+{
+        g_return_val_if_fail (action != NULL, FALSE);
+
+        return action->coalesce;
+}
+
+typedef enum {
+        READER_FIELD_BOOLEAN,
+        READER_FIELD_CHAR,
+        READER_FIELD_UCHAR,
+        READER_FIELD_INT,
+        READER_FIELD_UINT,
+        READER_FIELD_LONG,
+        READER_FIELD_ULONG,
+        READER_FIELD_INT64,
+        READER_FIELD_UINT64,
+        READER_FIELD_FLOAT,
+        READER_FIELD_DOUBLE,
+        READER_FIELD_STRING,
+} ReaderFieldKind;
+
+typedef struct {
+        char *name;
+        GType type;
+        ReaderFieldKind kind;
+        gsize offset;
+        guint index;         /* Position in the reader's fields */
+} ReaderField;
+
+struct _GUPnPServiceProxyResultReader {
+        GPtrArray *fields;   /* ReaderField, in the order they were added */
+        GHashTable *by_name; /* Argument name -> ReaderField */
+};
+
+static void
+reader_field_free (ReaderField *field)
+{
+        g_free (field->name);
+        g_free (field);
+}
+
+static gboolean
+reader_field_kind_for_type (GType type, ReaderFieldKind *kind)
+{
+        switch (type) {
+        case G_TYPE_BOOLEAN:
+                *kind = READER_FIELD_BOOLEAN;
+                break;
+        case G_TYPE_CHAR:
+                *kind = READER_FIELD_CHAR;
+                break;
+        case G_TYPE_UCHAR:
+                *kind = READER_FIELD_UCHAR;
+                break;
+        case G_TYPE_INT:
+                *kind = READER_FIELD_INT;
+                break;
+        case G_TYPE_UINT:
+                *kind = READER_FIELD_UINT;
+                break;
+        case G_TYPE_LONG:
+                *kind = READER_FIELD_LONG;
+                break;
+        case G_TYPE_ULONG:
+                *kind = READER_FIELD_ULONG;
+                break;
+        case G_TYPE_INT64:
+                *kind = READER_FIELD_INT64;
+                break;
+        case G_TYPE_UINT64:
+                *kind = READER_FIELD_UINT64;
+                break;
+        case G_TYPE_FLOAT:
+                *kind = READER_FIELD_FLOAT;
+                break;
+        case G_TYPE_DOUBLE:
+                *kind = READER_FIELD_DOUBLE;
+                break;
+        case G_TYPE_STRING:
+                *kind = READER_FIELD_STRING;
+                break;
+        default:
+                /* The GUPnP string types like GUPNP_TYPE_URI are plain
+                 * strings in a boxed type */
+                if (G_TYPE_IS_BOXED (type) &&
+                    g_value_type_transformable (G_TYPE_STRING, type) &&
+                    g_value_type_transformable (type, G_TYPE_STRING)) {
+                        *kind = READER_FIELD_STRING;
+                        break;
+                }
+
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/* Parse @str like the other getters do and store it in the struct member */
+static void
+reader_field_set (const ReaderField *field, gpointer result, const char *str)
+{
+        gpointer member = G_STRUCT_MEMBER_P (result, field->offset);
+        GValue value = G_VALUE_INIT;
+
+        /* Nothing to convert, skip the GValue */
+        if (field->kind == READER_FIELD_STRING) {
+                g_free (*(char **) member);
+                *(char **) member = g_strdup (str);
+
+                return;
+        }
+
+        g_value_init (&value, field->type);
+        gvalue_util_set_value_from_string (&value, str);
+
+        switch (field->kind) {
+        case READER_FIELD_BOOLEAN:
+                *(gboolean *) member = g_value_get_boolean (&value);
+                break;
+        case READER_FIELD_CHAR:
+                *(gchar *) member = g_value_get_schar (&value);
+                break;
+        case READER_FIELD_UCHAR:
+                *(guchar *) member = g_value_get_uchar (&value);
+                break;
+        case READER_FIELD_INT:
+                *(gint *) member = g_value_get_int (&value);
+                break;
+        case READER_FIELD_UINT:
+                *(guint *) member = g_value_get_uint (&value);
+                break;
+        case READER_FIELD_LONG:
+                *(glong *) member = g_value_get_long (&value);
+                break;
+        case READER_FIELD_ULONG:
+                *(gulong *) member = g_value_get_ulong (&value);
+                break;
+        case READER_FIELD_INT64:
+                *(gint64 *) member = g_value_get_int64 (&value);
+                break;
+        case READER_FIELD_UINT64:
+                *(guint64 *) member = g_value_get_uint64 (&value);
+                break;
+        case READER_FIELD_FLOAT:
+                *(gfloat *) member = g_value_get_float (&value);
+                break;
+        case READER_FIELD_DOUBLE:
+                *(gdouble *) member = g_value_get_double (&value);
+                break;
+        default:
+                g_assert_not_reached ();
+        }
+
+        g_value_unset (&value);
+}
+
+/**
+ * gupnp_service_proxy_result_reader_new:
+ *
+ * Create a reader that copies the out arguments of finished actions into
+ * the members of a C struct, see
+ * gupnp_service_proxy_action_read_result().
+ *
+ * Add the arguments to read with gupnp_service_proxy_result_reader_add()
+ * or gupnp_service_proxy_result_reader_add_from_introspection(). The reader
+ * can then be used for any number of action responses.
+ *
+ * ```c
+ * typedef struct {
+ *         char *track_uri;
+ *         guint track;
+ * } PositionInfo;
+ *
+ * GUPnPServiceProxyResultReader *reader =
+ *         gupnp_service_proxy_result_reader_new ();
+ * gupnp_service_proxy_result_reader_add (reader,
+ *                                        "TrackURI",
+ *                                        G_TYPE_STRING,
+ *                                        G_STRUCT_OFFSET (PositionInfo,
+ *                                                         track_uri));
+ * gupnp_service_proxy_result_reader_add (reader,
+ *                                        "Track",
+ *                                        G_TYPE_UINT,
+ *                                        G_STRUCT_OFFSET (PositionInfo, track));
+ * ```
+ *
+ * Returns: (transfer full): A new #GUPnPServiceProxyResultReader
+ * Since: 1.6.10
+ */
+GUPnPServiceProxyResultReader *
+gupnp_service_proxy_result_reader_new (void)
+{
+        GUPnPServiceProxyResultReader *reader;
+
+        reader = g_atomic_rc_box_new0 (GUPnPServiceProxyResultReader);
+        reader->fields =
+                g_ptr_array_new_with_free_func ((GDestroyNotify) reader_field_free);
+        reader->by_name = g_hash_table_new (g_str_hash, g_str_equal);
+
+        return reader;
+}
+
+/**
+ * gupnp_service_proxy_result_reader_ref:
+ * @reader: A #GUPnPServiceProxyResultReader
+ *
+ * Increases the reference count of @reader.
+ *
+ * Returns: @reader
+ * Since: 1.6.10
+ */
+GUPnPServiceProxyResultReader *
+gupnp_service_proxy_result_reader_ref (GUPnPServiceProxyResultReader *reader)
+{
+        g_return_val_if_fail (reader != NULL, NULL);
+
+        return g_atomic_rc_box_acquire (reader);
+}
+
+static void
+result_reader_clear (GUPnPServiceProxyResultReader *reader)
+{
+        g_hash_table_destroy (reader->by_name);
+        g_ptr_array_unref (reader->fields);
+}
+
+/**
+ * gupnp_service_proxy_result_reader_unref:
+ * @reader: A #GUPnPServiceProxyResultReader
+ *
+ * Decreases the reference count of @reader, freeing it when it drops to 0.
+ *
+ * Since: 1.6.10
+ */
+void
+gupnp_service_proxy_result_reader_unref (GUPnPServiceProxyResultReader *reader)
+{
+        g_return_if_fail (reader != NULL);
+
+        g_atomic_rc_box_release_full (reader,
+                                      (GDestroyNotify) result_reader_clear);
+}
+
+G_DEFINE_BOXED_TYPE (GUPnPServiceProxyResultReader,
+                     gupnp_service_proxy_result_reader,
+                     gupnp_service_proxy_result_reader_ref,
+                     gupnp_service_proxy_result_reader_unref)
+
+/**
+ * gupnp_service_proxy_result_reader_add:
+ * @reader: A #GUPnPServiceProxyResultReader
+ * @name: The name of the out argument
+ * @type: The type of the struct member
+ * @offset: The offset of the struct member, from G_STRUCT_OFFSET()
+ * @error: (nullable): Return location for an error
+ *
+ * Read the out argument @name into the struct member at @offset.
+ *
+ * The member has to be of the C type that belongs to @type, for example
+ * `guint` for %G_TYPE_UINT or `gboolean` for %G_TYPE_BOOLEAN. Numeric
+ * types, booleans and strings are supported. String members, including the
+ * GUPnP string types like %GUPNP_TYPE_URI, are `char *` and receive a
+ * newly allocated copy; a previous value in the member is freed.
+ *
+ * Returns: %FALSE if @type is not supported or @name was already added.
+ * Since: 1.6.10
+ */
+gboolean
+gupnp_service_proxy_result_reader_add (GUPnPServiceProxyResultReader *reader,
+                                       const char *name,
+                                       GType type,
+                                       gsize offset,
+                                       GError **error)
+{
+        ReaderFieldKind kind;
+        ReaderField *field;
+
+        g_return_val_if_fail (reader != NULL, FALSE);
+        g_return_val_if_fail (name != NULL, FALSE);
+
+        if (g_hash_table_contains (reader->by_name, name)) {
+                g_set_error (error,
+                             GUPNP_SERVER_ERROR,
+                             GUPNP_SERVER_ERROR_OTHER,
+                             "Argument %s was already added",
+                             name);
+
+                return FALSE;
+        }
+
+        if (!reader_field_kind_for_type (type, &kind)) {
+                g_set_error (error,
+                             GUPNP_SERVER_ERROR,
+                             GUPNP_SERVER_ERROR_OTHER,
+                             "Cannot read argument %s into a %s",
+                             name,
+                             g_type_name (type));
+
+                return FALSE;
+        }
+
+        field = g_new0 (ReaderField, 1);
+        field->name = g_strdup (name);
+        field->type = type;
+        field->kind = kind;
+        field->offset = offset;
+        field->index = reader->fields->len;
+
+        g_ptr_array_add (reader->fields, field);
+        g_hash_table_insert (reader->by_name, field->name, field);
+
+        return TRUE;
+}
+
+/**
+ * gupnp_service_proxy_result_reader_add_from_introspection:
+ * @reader: A #GUPnPServiceProxyResultReader
+ * @introspection: The introspection of the service
+ * @action_name: The name of the action
+ * @name: The name of the out argument
+ * @offset: The offset of the struct member, from G_STRUCT_OFFSET()
+ * @error: (nullable): Return location for an error
+ *
+ * Like gupnp_service_proxy_result_reader_add(), but takes the type of the
+ * argument from the related state variable in @introspection.
+ *
+ * Returns: %FALSE if @name is not an out argument of @action_name or its
+ * type is not supported.
+ * Since: 1.6.10
+ */
+gboolean
+gupnp_service_proxy_result_reader_add_from_introspection (
+        GUPnPServiceProxyResultReader *reader,
+        GUPnPServiceIntrospection *introspection,
+        const char *action_name,
+        const char *name,
+        gsize offset,
+        GError **error)
+{
+        const GUPnPServiceActionInfo *action_info;
+        const GUPnPServiceActionArgInfo *arg = NULL;
+        const GUPnPServiceStateVariableInfo *info = NULL;
+        GList *result;
+
+        g_return_val_if_fail (reader != NULL, FALSE);
+        g_return_val_if_fail (GUPNP_IS_SERVICE_INTROSPECTION (introspection),
+                              FALSE);
+        g_return_val_if_fail (action_name != NULL, FALSE);
+        g_return_val_if_fail (name != NULL, FALSE);
+
+        action_info = gupnp_service_introspection_get_action (introspection,
+                                                              action_name);
+        if (action_info != NULL) {
+                result = g_list_find_custom (action_info->arguments,
+                                             name,
+                                             find_argument);
+                if (result != NULL)
+                        arg = result->data;
+        }
+
+        if (arg == NULL || arg->direction != GUPNP_SERVICE_ACTION_ARG_DIRECTION_OUT) {
+                g_set_error (error,
+                             GUPNP_SERVER_ERROR,
+                             GUPNP_SERVER_ERROR_OTHER,
+                             "%s is not an out argument of %s",
+                             name,
+                             action_name);
+
+                return FALSE;
+        }
+
+        info = gupnp_service_introspection_get_state_variable (
+                introspection,
+                arg->related_state_variable);
+        if (info == NULL) {
+                g_set_error (error,
+                             GUPNP_SERVER_ERROR,
+                             GUPNP_SERVER_ERROR_OTHER,
+                             "No state variable for %s",
+                             name);
+
+                return FALSE;
+        }
+
+        return gupnp_service_proxy_result_reader_add (reader,
+                                                      name,
+                                                      info->type,
+                                                      offset,
+                                                      error);
+}
+
+/**
+ * gupnp_service_proxy_action_read_result:
+ * @action: A finished #GUPnPServiceProxyAction
+ * @reader: A #GUPnPServiceProxyResultReader
+ * @result: (not nullable): The struct to fill
+ * @error: (nullable): Return location for an error
+ *
+ * Copy the out arguments of @action that were added to @reader into
+ * @result, going over the response once. Unlike
+ * gupnp_service_proxy_action_get_result(), no intermediate #GValue or list
+ * is created.
+ *
+ * Members of arguments missing in the response are left untouched.
+ *
+ * Returns: %TRUE on success.
+ * Since: 1.6.10
+ */
+gboolean
+gupnp_service_proxy_action_read_result (GUPnPServiceProxyAction *action,
+                                        GUPnPServiceProxyResultReader *reader,
+                                        gpointer result,
+                                        GError **error)
+{
+        xmlNode *node;
+        gboolean *seen;
+        guint missing;
+        guint i;
+
+        g_return_val_if_fail (action != NULL, FALSE);
+        g_return_val_if_fail (reader != NULL, FALSE);
+        g_return_val_if_fail (result != NULL, FALSE);
+
+        /* Check for saved error from begin_action() */
+        if (action->error) {
+                g_propagate_error (error, g_error_copy (action->error));
+
+                return FALSE;
+        }
+
+        /* Check response for errors and do initial parsing */
+        gupnp_service_proxy_action_check_response (action);
+        if (action->error != NULL) {
+                g_propagate_error (error, g_error_copy (action->error));
+
+                return FALSE;
+        }
+
+        /* A repeated argument must not hide a missing one */
+        seen = g_new0 (gboolean, reader->fields->len);
+        missing = reader->fields->len;
+
+        for (node = action->params->children; node != NULL; node = node->next) {
+                const ReaderField *field;
+                xmlNode *text = node->children;
+
+                if (node->type != XML_ELEMENT_NODE)
+                        continue;
+
+                field = g_hash_table_lookup (reader->by_name, node->name);
+                if (field == NULL)
+                        continue;
+
+                if (!seen[field->index]) {
+                        seen[field->index] = TRUE;
+                        missing--;
+                }
+
+                /* Arguments usually are a single text node, use that in
+                 * place */
+                if (text == NULL) {
+                        reader_field_set (field, result, "");
+                } else if (text->next == NULL && text->type == XML_TEXT_NODE) {
+                        reader_field_set (field,
+                                          result,
+                                          (const char *) text->content);
+                } else {
+                        xmlChar *content = xmlNodeGetContent (node);
+
+                        reader_field_set (field, result, (const char *) content);
+                        xmlFree (content);
+                }
+        }
+
+        /* Same as for the other getters */
+        for (i = 0; missing > 0 && i < reader->fields->len; i++) {
+                const ReaderField *field = g_ptr_array_index (reader->fields, i);
+
+                if (!seen[i]) {
+                        g_warning ("Could not find variable \"%s\" in response",
+                                   field->name);
+                        missing--;
+                }
+        }
+
+        g_free (seen);
 
         return TRUE;
 }
@@ -17,6 +17,7 @@
 #include <errno.h>
 
 #include <libxml/globals.h>
+#include <libxml/parser.h>
 
 #include "gena-protocol.h"
 #include "gupnp-context-private.h"
@@ -39,11 +40,13 @@ struct _GUPnPServiceProxyPrivate {
         char *password;
 
         char *sid; /* Subscription ID */
-        GSource *subscription_timeout_src;
+        TimerWheelEntry *subscription_timeout;
 
         guint32 seq; /* Event sequence number */
 
         GHashTable *notify_hash;
+        GHashTable *last_change_hash; /* Like notify_hash, but holding
+                                       * LastChange callbacks */
 
         // GCancellable that is used to all SoupMessages that are neither
         // notifies nor proxy calls
@@ -51,6 +54,19 @@ struct _GUPnPServiceProxyPrivate {
 
         GQueue *pending_notifies; /* Pending notifications to be sent (xmlDoc) */
         GSource *notify_idle_src; /* Idle handler src of notification emiter */
+
+        gboolean use_m_post; /* Last action call only worked with M-POST */
+
+        GUri *control_uri;           /* Resolved and rewritten control URL */
+        GHashTable *action_templates; /* Action name ->
+                                         GUPnPServiceProxyActionTemplate */
+        GHashTable *coalesced_calls; /* Request body -> GPtrArray of the
+                                        GTasks waiting for that call */
+
+        gboolean cache_state;
+        GHashTable *state_cache;    /* Variable -> last evented value */
+        GHashTable *cached_actions; /* Action name -> ActionCacheConfig */
+        GHashTable *action_results; /* Request body -> CachedActionResult */
 };
 typedef struct _GUPnPServiceProxyPrivate GUPnPServiceProxyPrivate;
 
@@ -68,7 +84,8 @@ G_DEFINE_TYPE_WITH_PRIVATE (GUPnPServiceProxy,
 
 enum {
         PROP_0,
-        PROP_SUBSCRIBED
+        PROP_SUBSCRIBED,
+        PROP_CACHE_STATE
 };
 
 enum {
@@ -91,13 +108,47 @@ typedef struct {
         gpointer user_data;
 } NotifyCallbackData;
 
+typedef struct {
+        char *name;
+        char *value;
+} EventProperty;
+
 typedef struct {
         char *sid;
         guint32 seq;
 
-        xmlDoc *doc;
+        xmlDoc *doc;           /* Only parsed for raw notify listeners */
+        GPtrArray *properties; /* EventProperty, otherwise */
 } EmitNotifyData;
 
+typedef struct {
+        guint timeout;    /* In milliseconds, 0 for none */
+        char **variables; /* Evented variables that invalidate results */
+} ActionCacheConfig;
+
+typedef struct {
+        char *action_name;
+        SoupMessage *msg;
+        GBytes *response;
+        gint64 expires; /* Monotonic time, 0 for never */
+} CachedActionResult;
+
+static void
+action_cache_config_free (ActionCacheConfig *config)
+{
+        g_strfreev (config->variables);
+        g_free (config);
+}
+
+static void
+cached_action_result_free (CachedActionResult *result)
+{
+        g_free (result->action_name);
+        g_object_unref (result->msg);
+        g_bytes_unref (result->response);
+        g_free (result);
+}
+
 static void
 subscribe_got_response (GObject *source, GAsyncResult *res, gpointer user_data);
 
@@ -106,6 +157,19 @@ subscribe (GUPnPServiceProxy *proxy);
 static void
 unsubscribe (GUPnPServiceProxy *proxy);
 
+static gboolean
+notify_hash_add (GHashTable                     *notify_hash,
+                 const char                     *variable,
+                 GType                           type,
+                 GUPnPServiceProxyNotifyCallback callback,
+                 gpointer                        user_data,
+                 GDestroyNotify                  notify);
+static gboolean
+notify_hash_remove (GHashTable                     *notify_hash,
+                    const char                     *variable,
+                    GUPnPServiceProxyNotifyCallback callback,
+                    gpointer                        user_data);
+
 static void
 callback_data_free (NotifyCallbackData *data)
 {
@@ -124,11 +188,21 @@ notify_data_free (NotifyData *data)
         g_slice_free (NotifyData, data);
 }
 
-/* Steals doc reference */
+static void
+event_property_free (EventProperty *property)
+{
+        g_free (property->name);
+        g_free (property->value);
+
+        g_slice_free (EventProperty, property);
+}
+
+/* Steals doc and properties reference */
 static EmitNotifyData *
 emit_notify_data_new (const char *sid,
                       guint32     seq,
-                      xmlDoc     *doc)
+                      xmlDoc     *doc,
+                      GPtrArray  *properties)
 {
         EmitNotifyData *data;
 
@@ -137,6 +211,7 @@ emit_notify_data_new (const char *sid,
         data->sid = g_strdup (sid);
         data->seq = seq;
         data->doc = doc;
+        data->properties = properties;
 
         return data;
 }
@@ -145,7 +220,8 @@ static void
 emit_notify_data_free (EmitNotifyData *data)
 {
         g_free (data->sid);
-        xmlFreeDoc (data->doc);
+        g_clear_pointer (&data->doc, xmlFreeDoc);
+        g_clear_pointer (&data->properties, g_ptr_array_unref);
 
         g_slice_free (EmitNotifyData, data);
 }
@@ -158,7 +234,9 @@ gupnp_service_proxy_init (GUPnPServiceProxy *proxy)
 
         /* Generate unique path */
         priv = gupnp_service_proxy_get_instance_private (proxy);
-        priv->path = g_strdup_printf ("/ServiceProxy%d", proxy_counter);
+        priv->path = g_strdup_printf (GUPNP_CONTEXT_EVENT_PATH
+                                      "/ServiceProxy%d",
+                                      proxy_counter);
         proxy_counter++;
 
         /* Set up notify hash */
@@ -167,9 +245,40 @@ gupnp_service_proxy_init (GUPnPServiceProxy *proxy)
                                        g_str_equal,
                                        g_free,
                                        (GDestroyNotify) notify_data_free);
+        priv->last_change_hash =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) notify_data_free);
 
         priv->pending_messages = g_cancellable_new ();
         priv->pending_notifies = g_queue_new ();
+
+        priv->action_templates = g_hash_table_new_full (
+                g_str_hash,
+                g_str_equal,
+                g_free,
+                (GDestroyNotify) gupnp_service_proxy_action_template_unref);
+        priv->coalesced_calls =
+                g_hash_table_new_full (g_bytes_hash,
+                                       g_bytes_equal,
+                                       (GDestroyNotify) g_bytes_unref,
+                                       (GDestroyNotify) g_ptr_array_unref);
+
+        priv->state_cache = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   g_free);
+        priv->cached_actions = g_hash_table_new_full (
+                g_str_hash,
+                g_str_equal,
+                g_free,
+                (GDestroyNotify) action_cache_config_free);
+        priv->action_results = g_hash_table_new_full (
+                g_bytes_hash,
+                g_bytes_equal,
+                (GDestroyNotify) g_bytes_unref,
+                (GDestroyNotify) cached_action_result_free);
 }
 
 static void
@@ -187,6 +296,10 @@ gupnp_service_proxy_set_property (GObject      *object,
                 gupnp_service_proxy_set_subscribed
                                 (proxy, g_value_get_boolean (value));
                 break;
+        case PROP_CACHE_STATE:
+                gupnp_service_proxy_set_cache_state
+                                (proxy, g_value_get_boolean (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -209,6 +322,9 @@ gupnp_service_proxy_get_property (GObject    *object,
         case PROP_SUBSCRIBED:
                 g_value_set_boolean (value, priv->subscribed);
                 break;
+        case PROP_CACHE_STATE:
+                g_value_set_boolean (value, priv->cache_state);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -236,13 +352,9 @@ gupnp_service_proxy_dispose (GObject *object)
 
         context = gupnp_service_info_get_context (GUPNP_SERVICE_INFO (proxy));
 
-        /* Remove server handler */
-        if (context) {
-            SoupServer *server;
-
-            server = gupnp_context_get_server (context);
-            soup_server_remove_handler (server, priv->path);
-        }
+        /* Stop receiving events */
+        if (context)
+                _gupnp_context_remove_event_receiver (context, priv->path);
 
         if (priv->pending_messages)
                 g_cancellable_cancel (priv->pending_messages);
@@ -272,6 +384,13 @@ gupnp_service_proxy_finalize (GObject *object)
         g_free (priv->path);
 
         g_hash_table_destroy (priv->notify_hash);
+        g_hash_table_destroy (priv->last_change_hash);
+        g_hash_table_destroy (priv->action_templates);
+        g_hash_table_destroy (priv->coalesced_calls);
+        g_hash_table_destroy (priv->state_cache);
+        g_hash_table_destroy (priv->action_results);
+        g_hash_table_destroy (priv->cached_actions);
+        g_clear_pointer (&priv->control_uri, g_uri_unref);
 
         g_clear_pointer (&priv->user, g_free);
         g_clear_pointer (&priv->password, g_free);
@@ -311,6 +430,26 @@ gupnp_service_proxy_class_init (GUPnPServiceProxyClass *klass)
                                        G_PARAM_STATIC_NICK |
                                        G_PARAM_STATIC_BLURB));
 
+        /**
+         * GUPnPServiceProxy:cache-state:(attributes org.gtk.Property.get=gupnp_service_proxy_get_cache_state org.gtk.Property.set=gupnp_service_proxy_set_cache_state)
+         *
+         * Whether to keep the last evented value of every state variable,
+         * see gupnp_service_proxy_get_cached_state().
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_CACHE_STATE,
+                 g_param_spec_boolean ("cache-state",
+                                       "Cache state",
+                                       "Whether to keep the evented state "
+                                       "variables",
+                                       FALSE,
+                                       G_PARAM_READWRITE |
+                                       G_PARAM_EXPLICIT_NOTIFY |
+                                       G_PARAM_STATIC_STRINGS));
+
         /**
          * GUPnPServiceProxy::subscription-lost:
          * @proxy: The #GUPnPServiceProxy that received the signal
@@ -358,29 +497,29 @@ on_restarted (SoupMessage *msg, gpointer user_data)
 {
         GUPnPServiceProxyAction *action = user_data;
         g_autoptr (GBytes) body = NULL;
-        const char *service_type;
 
-        service_type = gupnp_service_info_get_service_type
-                                        (GUPNP_SERVICE_INFO (action->proxy));
-        gupnp_service_proxy_action_serialize (action, service_type);
-        body = g_string_free_to_bytes (action->msg_str);
+        body = gupnp_service_proxy_action_serialize (action,
+                                                     action->body_template);
         soup_message_set_request_body_from_bytes (msg,
                                                   "text/xml; charset=\"utf-8\"",
                                                   body);
-        action->msg_str = NULL;
 }
 
-/* Begins a basic action message */
-static gboolean
-prepare_action_msg (GUPnPServiceProxy *proxy,
-                    GUPnPServiceProxyAction *action,
-                    const char *method,
-                    GError **error)
+/* Get the parts of the call to @action_name that are the same for every
+ * call, creating them on first use */
+static GUPnPServiceProxyActionTemplate *
+get_action_template (GUPnPServiceProxy *proxy,
+                     const char        *action_name,
+                     GError           **error)
 {
-        char *control_url, *full_action;
+        GUPnPServiceProxyPrivate *priv;
+        GUPnPServiceProxyActionTemplate *tmpl;
         const char *service_type;
 
-        gupnp_service_proxy_action_reset (action);
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        tmpl = g_hash_table_lookup (priv->action_templates, action_name);
+        if (tmpl != NULL)
+                return tmpl;
 
         /* Make sure we have a service type */
         service_type = gupnp_service_info_get_service_type
@@ -391,57 +530,95 @@ prepare_action_msg (GUPnPServiceProxy *proxy,
                                                 GUPNP_SERVER_ERROR_OTHER,
                                                 "No service type defined"));
 
-                return FALSE;
+                return NULL;
         }
 
-        /* Create message */
+        tmpl = gupnp_service_proxy_action_template_new (service_type,
+                                                        action_name);
+        g_hash_table_insert (priv->action_templates,
+                             g_strdup (action_name),
+                             tmpl);
+
+        return tmpl;
+}
+
+/* Get the control URL of @proxy, resolved and rewritten for the context */
+static GUri *
+get_control_uri (GUPnPServiceProxy *proxy, GError **error)
+{
+        GUPnPServiceProxyPrivate *priv;
+        GUPnPContext *context;
+        char *control_url;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        if (priv->control_uri != NULL)
+                return priv->control_uri;
+
         control_url = gupnp_service_info_get_control_url
                                         (GUPNP_SERVICE_INFO (proxy));
+        if (control_url != NULL) {
+                context = gupnp_service_info_get_context
+                                        (GUPNP_SERVICE_INFO (proxy));
+                priv->control_uri =
+                        gupnp_context_rewrite_uri_to_uri (context,
+                                                          control_url);
+                g_free (control_url);
+        }
 
-        if (control_url == NULL) {
+        if (priv->control_uri == NULL) {
                 g_propagate_error (
                         error,
                         g_error_new (GUPNP_SERVER_ERROR,
                                      GUPNP_SERVER_ERROR_INVALID_URL,
                                      "No valid control URL defined"));
-
-                return FALSE;
         }
 
-        GUPnPContext *context = NULL;
-        char *local_control_url = NULL;
+        return priv->control_uri;
+}
 
-        context = gupnp_service_info_get_context (GUPNP_SERVICE_INFO (proxy));
+/* Begins a basic action message */
+static gboolean
+prepare_action_msg (GUPnPServiceProxy *proxy,
+                    GUPnPServiceProxyAction *action,
+                    const char *method,
+                    GError **error)
+{
+        GUPnPServiceProxyActionTemplate *tmpl;
+        GUri *control_uri;
+
+        gupnp_service_proxy_action_reset (action);
 
-        local_control_url = gupnp_context_rewrite_uri (context, control_url);
-        g_free (control_url);
+        tmpl = get_action_template (proxy, action->name, error);
+        if (tmpl == NULL)
+                return FALSE;
+
+        /* Create message */
+        control_uri = get_control_uri (proxy, error);
+        if (control_uri == NULL)
+                return FALSE;
 
-        action->msg = soup_message_new (method, local_control_url);
+        action->msg = soup_message_new_from_uri (method, control_uri);
         g_signal_connect_object (G_OBJECT (action->msg), "authenticate", G_CALLBACK (on_authenticate), G_OBJECT (proxy), 0);
         g_signal_connect (G_OBJECT (action->msg), "restarted", G_CALLBACK (on_restarted), action);
-        g_free (local_control_url);
 
         SoupMessageHeaders *headers =
                 soup_message_get_request_headers (action->msg);
 
         /* Specify action */
-        full_action = g_strdup_printf ("\"%s#%s\"", service_type, action->name);
-
         // This is internal API, it should either be that constant or the string "M-POST"
         if (method == SOUP_METHOD_POST) {
                 soup_message_headers_append (headers,
                                              "SOAPAction",
-                                             full_action);
+                                             tmpl->soap_action);
         } else {
                 soup_message_headers_append (headers,
                                              "s-SOAPAction",
-                                             full_action);
+                                             tmpl->soap_action);
                 soup_message_headers_append (
                         headers,
                         "Man",
                         "\"http://schemas.xmlsoap.org/soap/envelope/\"; ns=s");
         }
-        g_free (full_action);
 
         /* Specify language */
         http_request_set_accept_language (action->msg);
@@ -449,15 +626,12 @@ prepare_action_msg (GUPnPServiceProxy *proxy,
         /* Accept gzip encoding */
         soup_message_headers_append (headers, "Accept-Encoding", "gzip");
 
-        gupnp_service_proxy_action_serialize (action, service_type);
-
-        GBytes *body = g_string_free_to_bytes (action->msg_str);
+        GBytes *body = gupnp_service_proxy_action_serialize (action, tmpl);
 
         soup_message_set_request_body_from_bytes (action->msg,
                                                   "text/xml; charset=\"utf-8\"",
                                                   body);
         g_bytes_unref (body);
-        action->msg_str = NULL;
 
         action->proxy = proxy;
         g_object_add_weak_pointer (G_OBJECT (proxy),
@@ -466,9 +640,325 @@ prepare_action_msg (GUPnPServiceProxy *proxy,
         return TRUE;
 }
 
+/* The method to start an action call with: whatever worked last time */
+static const char *
+action_method (GUPnPServiceProxy *proxy)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        return priv->use_m_post ? "M-POST" : SOUP_METHOD_POST;
+}
+
+/* Switch @action to the other method after it was refused with
+ * METHOD_NOT_ALLOWED. This is done once per call, so a stale choice
+ * from a previous call gets corrected */
+static gboolean
+action_retry_with_other_method (GUPnPServiceProxyAction *action,
+                                GError                 **error)
+{
+        const char *method;
+
+        if (action->method_retried || action->proxy == NULL)
+                return FALSE;
+
+        if (g_str_equal (soup_message_get_method (action->msg),
+                         SOUP_METHOD_POST))
+                method = "M-POST";
+        else
+                method = SOUP_METHOD_POST;
+
+        g_debug ("%s returned with METHOD_NOT_ALLOWED, trying with %s",
+                 soup_message_get_method (action->msg),
+                 method);
+
+        action->method_retried = TRUE;
+        g_clear_pointer (&action->response, g_bytes_unref);
+
+        return prepare_action_msg (action->proxy, action, method, error);
+}
+
+/* Remember which method the device accepted for the next calls */
+static void
+action_remember_method (GUPnPServiceProxyAction *action)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        if (action->proxy == NULL)
+                return;
+
+        priv = gupnp_service_proxy_get_instance_private (action->proxy);
+        priv->use_m_post = !g_str_equal (soup_message_get_method (action->msg),
+                                         SOUP_METHOD_POST);
+}
+
 static void
 gupnp_service_proxy_action_queue_task (GTask *task);
 
+static void
+action_task_start (GTask *task);
+
+/* The request body of the call of @task, which identifies the call */
+static GBytes *
+action_task_get_body (GTask *task)
+{
+        GUPnPServiceProxy *proxy = g_task_get_source_object (task);
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+        GUPnPServiceProxyActionTemplate *tmpl;
+
+        tmpl = get_action_template (proxy, action->name, NULL);
+        if (tmpl == NULL)
+                return NULL;
+
+        return gupnp_service_proxy_action_serialize (action, tmpl);
+}
+
+/* Prepare the action of @task to take its response from another call */
+static void
+action_task_borrow_response (GTask *task)
+{
+        GUPnPServiceProxy *proxy = g_task_get_source_object (task);
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+
+        gupnp_service_proxy_action_reset (action);
+        action->proxy = proxy;
+        g_object_add_weak_pointer (G_OBJECT (proxy),
+                                   (gpointer *) &(action->proxy));
+        action->pending = TRUE;
+}
+
+/* Answer the call of @task from the action cache. Returns %FALSE if there is
+ * no valid result for it */
+static gboolean
+action_task_answer_from_cache (GTask *task)
+{
+        GUPnPServiceProxy *proxy = g_task_get_source_object (task);
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+        GUPnPServiceProxyPrivate *priv;
+        CachedActionResult *result;
+        GBytes *body;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        if (g_hash_table_size (priv->action_results) == 0 ||
+            !g_hash_table_contains (priv->cached_actions, action->name))
+                return FALSE;
+
+        body = action_task_get_body (task);
+        if (body == NULL)
+                return FALSE;
+
+        result = g_hash_table_lookup (priv->action_results, body);
+        if (result != NULL && result->expires != 0 &&
+            result->expires <= g_get_monotonic_time ()) {
+                g_hash_table_remove (priv->action_results, body);
+                result = NULL;
+        }
+        g_bytes_unref (body);
+
+        if (result == NULL)
+                return FALSE;
+
+        action_task_borrow_response (task);
+        action->msg = g_object_ref (result->msg);
+        action->response = g_bytes_ref (result->response);
+
+        g_task_return_pointer (task, action, NULL);
+        g_object_unref (task);
+
+        return TRUE;
+}
+
+/* Keep the response of the finished call @action if its action is cached */
+static void
+action_cache_store (GUPnPServiceProxy *proxy, GUPnPServiceProxyAction *action)
+{
+        GUPnPServiceProxyPrivate *priv;
+        ActionCacheConfig *config;
+        CachedActionResult *result;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        config = g_hash_table_lookup (priv->cached_actions, action->name);
+        if (config == NULL ||
+            soup_message_get_status (action->msg) != SOUP_STATUS_OK ||
+            action->body == NULL)
+                return;
+
+        /* Nothing would tell us when the result becomes stale */
+        if (config->variables != NULL && priv->sid == NULL)
+                return;
+
+        result = g_new0 (CachedActionResult, 1);
+        result->action_name = g_strdup (action->name);
+        result->msg = g_object_ref (action->msg);
+        result->response = g_bytes_ref (action->response);
+        if (config->timeout > 0)
+                result->expires = g_get_monotonic_time () +
+                                  config->timeout * G_TIME_SPAN_MILLISECOND;
+
+        g_hash_table_replace (priv->action_results,
+                              g_bytes_ref (action->body),
+                              result);
+}
+
+/* Stop @task from waiting for the call it joined */
+static void
+action_task_leave (GTask *task)
+{
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+
+        g_clear_signal_handler (&action->joined_cancelled_id,
+                                g_task_get_cancellable (task));
+        g_clear_pointer (&action->joined_key, g_bytes_unref);
+}
+
+static gboolean
+on_joined_task_cancelled_idle (gpointer user_data)
+{
+        GTask *task = G_TASK (user_data);
+        GUPnPServiceProxy *proxy = g_task_get_source_object (task);
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+        GUPnPServiceProxyPrivate *priv;
+        GPtrArray *waiting;
+
+        /* The call it waited for might have finished in the meantime */
+        if (action->joined_key == NULL)
+                return G_SOURCE_REMOVE;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        waiting = g_hash_table_lookup (priv->coalesced_calls,
+                                       action->joined_key);
+        if (waiting == NULL || !g_ptr_array_remove (waiting, task))
+                return G_SOURCE_REMOVE;
+
+        action_task_leave (task);
+
+        action->error = g_error_new (G_IO_ERROR,
+                                     G_IO_ERROR_CANCELLED,
+                                     "Action message was cancelled");
+        g_task_return_error (task, g_error_copy (action->error));
+        g_object_unref (task);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Might run in any thread and must not disconnect itself, so the task
+ * leaves from an idle in its own context */
+static void
+on_joined_task_cancelled (G_GNUC_UNUSED GCancellable *cancellable,
+                          gpointer user_data)
+{
+        GTask *task = G_TASK (user_data);
+        GSource *source;
+
+        source = g_idle_source_new ();
+        g_source_set_callback (source,
+                               on_joined_task_cancelled_idle,
+                               g_object_ref (task),
+                               g_object_unref);
+        g_source_attach (source, g_task_get_context (task));
+        g_source_unref (source);
+}
+
+/* Let the call of @task wait for an identical one that is running.
+ * Returns %FALSE if there is none */
+static gboolean
+action_task_join (GTask *task)
+{
+        GUPnPServiceProxy *proxy = g_task_get_source_object (task);
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+        GUPnPServiceProxyPrivate *priv;
+        GCancellable *cancellable;
+        GPtrArray *waiting;
+        GBytes *body;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        if (g_hash_table_size (priv->coalesced_calls) == 0)
+                return FALSE;
+
+        body = action_task_get_body (task);
+        if (body == NULL)
+                return FALSE;
+
+        waiting = g_hash_table_lookup (priv->coalesced_calls, body);
+        if (waiting == NULL) {
+                g_bytes_unref (body);
+
+                return FALSE;
+        }
+
+        action_task_borrow_response (task);
+
+        g_ptr_array_add (waiting, task);
+        action->joined_key = body;
+
+        /* The call that is sent does not know about this cancellable */
+        cancellable = g_task_get_cancellable (task);
+        if (cancellable != NULL)
+                action->joined_cancelled_id =
+                        g_cancellable_connect (cancellable,
+                                               G_CALLBACK (on_joined_task_cancelled),
+                                               task,
+                                               NULL);
+
+        return TRUE;
+}
+
+/* Hand the outcome of the call of @task to the calls waiting for it. @error
+ * is set if the call failed */
+static void
+action_task_complete_waiting (GTask *task, const GError *error)
+{
+        GUPnPServiceProxy *proxy = g_task_get_source_object (task);
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+        GUPnPServiceProxyPrivate *priv;
+        GPtrArray *waiting;
+        guint i;
+
+        if (action->coalesce_key == NULL)
+                return;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        waiting = g_hash_table_lookup (priv->coalesced_calls,
+                                       action->coalesce_key);
+        g_ptr_array_ref (waiting);
+        g_hash_table_remove (priv->coalesced_calls, action->coalesce_key);
+        g_clear_pointer (&action->coalesce_key, g_bytes_unref);
+
+        for (i = 0; i < waiting->len; i++) {
+                GTask *waiting_task = g_ptr_array_index (waiting, i);
+                GUPnPServiceProxyAction *waiting_action =
+                        g_task_get_task_data (waiting_task);
+
+                action_task_leave (waiting_task);
+
+                /* Only the call that was cancelled gives up; the others
+                 * get sent on their own */
+                if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                        action_task_start (waiting_task);
+
+                        continue;
+                }
+
+                if (error != NULL) {
+                        waiting_action->error = g_error_copy (error);
+                        g_task_return_error (waiting_task,
+                                             g_error_copy (error));
+                } else {
+                        waiting_action->msg = g_object_ref (action->msg);
+                        waiting_action->response =
+                                g_bytes_ref (action->response);
+                        g_task_return_pointer (waiting_task,
+                                               waiting_action,
+                                               NULL);
+                }
+
+                g_object_unref (waiting_task);
+        }
+
+        g_ptr_array_unref (waiting);
+}
+
 static void
 action_task_got_response (GObject *source,
                           GAsyncResult *res,
@@ -487,6 +977,7 @@ action_task_got_response (GObject *source,
 
         if (error != NULL) {
                 action->error = g_error_copy (error);
+                action_task_complete_waiting (task, error);
                 g_task_return_error (task, error);
                 g_object_unref (task);
 
@@ -495,33 +986,26 @@ action_task_got_response (GObject *source,
 
         switch (soup_message_get_status (action->msg)) {
         case SOUP_STATUS_METHOD_NOT_ALLOWED:
-                if (g_str_equal (soup_message_get_method (action->msg),
-                                 "POST")) {
-                        g_debug ("POST returned with METHOD_NOT_ALLOWED, "
-                                 "trying with M-POST");
-                        g_clear_pointer (&action->response, g_bytes_unref);
-                        if (!prepare_action_msg (action->proxy,
-                                                 action,
-                                                 "M-POST",
-                                                 &error)) {
-
-                                g_task_return_error (task, error);
-
-                                g_object_unref (task);
-                        } else {
-                                gupnp_service_proxy_action_queue_task (task);
-                        }
+                if (action_retry_with_other_method (action, &error)) {
+                        gupnp_service_proxy_action_queue_task (task);
 
-                } else {
-                        g_task_return_new_error (task,
-                                                 GUPNP_SERVER_ERROR,
-                                                 GUPNP_SERVER_ERROR_OTHER,
-                                                 "Server does not allow any POST messages");
-                        g_object_unref (task);
+                        break;
                 }
+
+                if (error == NULL)
+                        error = g_error_new (GUPNP_SERVER_ERROR,
+                                             GUPNP_SERVER_ERROR_OTHER,
+                                             "Server does not allow any POST messages");
+                action_task_complete_waiting (task, error);
+                g_task_return_error (task, error);
+                g_object_unref (task);
+
                 break;
 
         default:
+                action_remember_method (action);
+                action_task_complete_waiting (task, NULL);
+                action_cache_store (g_task_get_source_object (task), action);
                 gupnp_service_proxy_action_check_response (action);
                 if (action->error != NULL) {
                         g_task_return_error (task,
@@ -538,26 +1022,59 @@ action_task_got_response (GObject *source,
         }
 }
 
+/* Send the call of @task, or attach it to an identical one */
 static void
-gupnp_service_proxy_action_queue_task (GTask *task)
+action_task_start (GTask *task)
 {
-        GUPnPContext *context;
-        SoupSession *session;
+        GUPnPServiceProxy *proxy = g_task_get_source_object (task);
         GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+        GUPnPServiceProxyPrivate *priv;
+        GError *error = NULL;
 
-        /* Send the message */
-        context = gupnp_service_info_get_context (
-                GUPNP_SERVICE_INFO (action->proxy));
-        session = gupnp_context_get_session (context);
+        action->method_retried = FALSE;
+        if (action_task_answer_from_cache (task))
+                return;
 
-        soup_session_send_and_read_async (
-                session,
-                action->msg,
-                G_PRIORITY_DEFAULT,
-                g_task_get_cancellable (task),
-                (GAsyncReadyCallback) action_task_got_response,
-                task);
-        action->pending = TRUE;
+        if (action->coalesce && action_task_join (task))
+                return;
+
+        if (!prepare_action_msg (proxy, action, action_method (proxy), &error)) {
+                g_task_return_error (task, error);
+                g_object_unref (task);
+
+                return;
+        }
+
+        if (action->coalesce) {
+                priv = gupnp_service_proxy_get_instance_private (proxy);
+                action->coalesce_key = g_bytes_ref (action->body);
+                g_hash_table_insert (priv->coalesced_calls,
+                                     g_bytes_ref (action->body),
+                                     g_ptr_array_new ());
+        }
+
+        gupnp_service_proxy_action_queue_task (task);
+}
+
+static void
+gupnp_service_proxy_action_queue_task (GTask *task)
+{
+        GUPnPContext *context;
+        GUPnPServiceProxyAction *action = g_task_get_task_data (task);
+
+        /* Send the message, once the context lets another call to the
+         * host go out */
+        context = gupnp_service_info_get_context (
+                GUPNP_SERVICE_INFO (action->proxy));
+
+        _gupnp_context_send_action_async (
+                context,
+                action->msg,
+                action->priority,
+                g_task_get_cancellable (task),
+                (GAsyncReadyCallback) action_task_got_response,
+                task);
+        action->pending = TRUE;
 }
 
 
@@ -614,8 +1131,6 @@ gupnp_service_proxy_add_notify_full (GUPnPServiceProxy              *proxy,
                                      gpointer                        user_data,
                                      GDestroyNotify                  notify)
 {
-        NotifyData *data;
-        NotifyCallbackData *callback_data;
         GUPnPServiceProxyPrivate *priv;
 
         g_return_val_if_fail (GUPNP_IS_SERVICE_PROXY (proxy), FALSE);
@@ -625,8 +1140,27 @@ gupnp_service_proxy_add_notify_full (GUPnPServiceProxy              *proxy,
 
         priv = gupnp_service_proxy_get_instance_private (proxy);
 
+        return notify_hash_add (priv->notify_hash,
+                                variable,
+                                type,
+                                callback,
+                                user_data,
+                                notify);
+}
+
+static gboolean
+notify_hash_add (GHashTable                     *notify_hash,
+                 const char                     *variable,
+                 GType                           type,
+                 GUPnPServiceProxyNotifyCallback callback,
+                 gpointer                        user_data,
+                 GDestroyNotify                  notify)
+{
+        NotifyData *data;
+        NotifyCallbackData *callback_data;
+
         /* See if we already have notifications set up for this variable */
-        data = g_hash_table_lookup (priv->notify_hash, variable);
+        data = g_hash_table_lookup (notify_hash, variable);
         if (data == NULL) {
                 /* No, create one */
                 data = g_slice_new (NotifyData);
@@ -635,7 +1169,7 @@ gupnp_service_proxy_add_notify_full (GUPnPServiceProxy              *proxy,
                 data->callbacks  = NULL;
                 data->next_emit   = NULL;
 
-                g_hash_table_insert (priv->notify_hash,
+                g_hash_table_insert (notify_hash,
                                      g_strdup (variable),
                                      data);
         } else {
@@ -720,9 +1254,6 @@ gupnp_service_proxy_remove_notify (GUPnPServiceProxy              *proxy,
                                    GUPnPServiceProxyNotifyCallback callback,
                                    gpointer                        user_data)
 {
-        NotifyData *data;
-        gboolean found;
-        GList *l;
         GUPnPServiceProxyPrivate *priv;
 
         g_return_val_if_fail (GUPNP_IS_SERVICE_PROXY (proxy), FALSE);
@@ -731,8 +1262,24 @@ gupnp_service_proxy_remove_notify (GUPnPServiceProxy              *proxy,
 
         priv = gupnp_service_proxy_get_instance_private (proxy);
 
+        return notify_hash_remove (priv->notify_hash,
+                                   variable,
+                                   callback,
+                                   user_data);
+}
+
+static gboolean
+notify_hash_remove (GHashTable                     *notify_hash,
+                    const char                     *variable,
+                    GUPnPServiceProxyNotifyCallback callback,
+                    gpointer                        user_data)
+{
+        NotifyData *data;
+        gboolean found;
+        GList *l;
+
         /* Look up NotifyData for variable */
-        data = g_hash_table_lookup (priv->notify_hash, variable);
+        data = g_hash_table_lookup (notify_hash, variable);
         if (data == NULL) {
                 g_warning ("No notifications found for variable %s",
                            variable);
@@ -761,8 +1308,7 @@ gupnp_service_proxy_remove_notify (GUPnPServiceProxy              *proxy,
                                 g_list_delete_link (data->callbacks, l);
                         if (data->callbacks == NULL) {
                                 /* No callbacks left: Remove from hash */
-                                g_hash_table_remove (priv->notify_hash,
-                                                     variable);
+                                g_hash_table_remove (notify_hash, variable);
                         }
 
                         found = TRUE;
@@ -802,30 +1348,367 @@ gupnp_service_proxy_remove_raw_notify (GUPnPServiceProxy              *proxy,
                                                   user_data);
 }
 
+/**
+ * gupnp_service_proxy_add_last_change_notify:
+ * @proxy: A #GUPnPServiceProxy
+ * @variable: The variable inside LastChange to add notification for
+ * @type: The type of the variable
+ * @callback: (scope notified): The callback to call when @variable changes
+ * @user_data: User data for @callback
+ * @notify: (nullable): Function to call when the notification is removed, or
+ * %NULL
+ *
+ * Sets up @callback to be called whenever a `LastChange` event of an
+ * AVTransport or RenderingControl service contains a change of @variable.
+ *
+ * The `LastChange` document is decoded in a single pass and only the
+ * variables that have a callback are converted to @type; @callback is called
+ * once for every instance and channel @variable changed on.
+ *
+ * Since: 1.6.10
+ *
+ * Return value: %TRUE on success.
+ **/
+gboolean
+gupnp_service_proxy_add_last_change_notify (
+        GUPnPServiceProxy                  *proxy,
+        const char                         *variable,
+        GType                               type,
+        GUPnPServiceProxyLastChangeCallback callback,
+        gpointer                            user_data,
+        GDestroyNotify                      notify)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE_PROXY (proxy), FALSE);
+        g_return_val_if_fail (variable, FALSE);
+        g_return_val_if_fail (type, FALSE);
+        g_return_val_if_fail (callback, FALSE);
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        return notify_hash_add (priv->last_change_hash,
+                                variable,
+                                type,
+                                (GUPnPServiceProxyNotifyCallback) callback,
+                                user_data,
+                                notify);
+}
+
+/**
+ * gupnp_service_proxy_remove_last_change_notify:
+ * @proxy: A #GUPnPServiceProxy
+ * @variable: The variable inside LastChange to remove notification for
+ * @callback: (scope call): The callback to remove
+ * @user_data: User data for @callback
+ *
+ * Cancels the notification set up with
+ * gupnp_service_proxy_add_last_change_notify() for @callback and @user_data.
+ *
+ * Since: 1.6.10
+ *
+ * Return value: %TRUE on success.
+ **/
+gboolean
+gupnp_service_proxy_remove_last_change_notify (
+        GUPnPServiceProxy                  *proxy,
+        const char                         *variable,
+        GUPnPServiceProxyLastChangeCallback callback,
+        gpointer                            user_data)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE_PROXY (proxy), FALSE);
+        g_return_val_if_fail (variable, FALSE);
+        g_return_val_if_fail (callback, FALSE);
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        return notify_hash_remove (priv->last_change_hash,
+                                   variable,
+                                   (GUPnPServiceProxyNotifyCallback) callback,
+                                   user_data);
+}
+
+/* State of the SAX parser decoding a LastChange document */
+typedef struct {
+        GUPnPServiceProxy *proxy;
+        GHashTable        *last_change_hash;
+
+        guint              depth;
+        gboolean           in_instance;
+        guint              instance_id;
+} LastChangeParser;
+
+/* Find attribute @name in the SAX2 attribute array and return a copy of its
+ * value */
+static char *
+last_change_parser_get_attribute (const xmlChar **attributes,
+                                  int             nb_attributes,
+                                  const char     *name)
+{
+        int i;
+
+        for (i = 0; i < nb_attributes; i++) {
+                const xmlChar **attribute = attributes + i * 5;
+                char *value;
+
+                if (strcmp ((const char *) attribute[0], name) != 0)
+                        continue;
+
+                value = g_strndup ((const char *) attribute[3],
+                                   attribute[4] - attribute[3]);
+
+                /* Without entity substitution, libxml2 keeps &amp; in
+                 * attribute values as a character reference */
+                if (strstr (value, "&#38;") != NULL) {
+                        GString *str = g_string_new (value);
+
+                        g_string_replace (str, "&#38;", "&", 0);
+                        g_free (value);
+                        value = g_string_free (str, FALSE);
+                }
+
+                return value;
+        }
+
+        return NULL;
+}
+
 static void
-emit_notification (GUPnPServiceProxy *proxy,
-                   xmlNode           *var_node)
+last_change_parser_start_element (void           *user_data,
+                                  const xmlChar  *localname,
+                                  G_GNUC_UNUSED const xmlChar  *prefix,
+                                  G_GNUC_UNUSED const xmlChar  *uri,
+                                  G_GNUC_UNUSED int             nb_namespaces,
+                                  G_GNUC_UNUSED const xmlChar **namespaces,
+                                  int                           nb_attributes,
+                                  G_GNUC_UNUSED int             nb_defaulted,
+                                  const xmlChar               **attributes)
 {
+        LastChangeParser *parser = user_data;
+        const char *name = (const char *) localname;
         NotifyData *data;
-        GValue value = {0, };
+        GValue value = G_VALUE_INIT;
+        char *val, *channel;
         GList *l;
-        GUPnPServiceProxyPrivate *priv;
 
-        priv = gupnp_service_proxy_get_instance_private (proxy);
+        parser->depth++;
+
+        if (parser->depth == 2) {
+                parser->in_instance = strcmp (name, "InstanceID") == 0;
+                if (parser->in_instance) {
+                        val = last_change_parser_get_attribute (attributes,
+                                                                nb_attributes,
+                                                                "val");
+                        parser->instance_id =
+                                val != NULL ? strtoul (val, NULL, 10) : 0;
+                        g_free (val);
+                }
 
-        data = g_hash_table_lookup (priv->notify_hash, var_node->name);
+                return;
+        }
+
+        if (parser->depth != 3 || !parser->in_instance)
+                return;
+
+        data = g_hash_table_lookup (parser->last_change_hash, name);
         if (data == NULL)
                 return;
 
-        /* Make a GValue of the desired type */
-        g_value_init (&value, data->type);
+        val = last_change_parser_get_attribute (attributes,
+                                                nb_attributes,
+                                                "val");
+        if (val == NULL)
+                return;
 
-        if (!gvalue_util_set_value_from_xml_node (&value, var_node)) {
+        g_value_init (&value, data->type);
+        if (!gvalue_util_set_value_from_string (&value, val)) {
                 g_value_unset (&value);
+                g_free (val);
 
                 return;
         }
 
+        channel = last_change_parser_get_attribute (attributes,
+                                                    nb_attributes,
+                                                    "channel");
+
+        /* Call callbacks. Note that data->next_emit may change if
+         * callback calls remove_last_change_notify() */
+        for (l = data->callbacks; l; l = data->next_emit) {
+                NotifyCallbackData *callback_data = l->data;
+                GUPnPServiceProxyLastChangeCallback callback;
+
+                data->next_emit = l->next;
+
+                callback = (GUPnPServiceProxyLastChangeCallback)
+                                   callback_data->callback;
+                callback (parser->proxy,
+                          parser->instance_id,
+                          name,
+                          channel,
+                          &value,
+                          callback_data->user_data);
+        }
+
+        g_free (channel);
+        g_free (val);
+        g_value_unset (&value);
+}
+
+static void
+last_change_parser_end_element (void          *user_data,
+                                G_GNUC_UNUSED const xmlChar *localname,
+                                G_GNUC_UNUSED const xmlChar *prefix,
+                                G_GNUC_UNUSED const xmlChar *uri)
+{
+        LastChangeParser *parser = user_data;
+
+        if (parser->depth == 2)
+                parser->in_instance = FALSE;
+
+        parser->depth--;
+}
+
+/* Decode the LastChange document @last_change and emit the changes of the
+ * variables somebody listens to */
+static void
+emit_last_change (GUPnPServiceProxy *proxy, const char *last_change)
+{
+        GUPnPServiceProxyPrivate *priv;
+        xmlSAXHandler sax = { 0, };
+        LastChangeParser parser = { 0, };
+        xmlParserCtxt *ctxt;
+        size_t length;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        if (last_change == NULL ||
+            g_hash_table_size (priv->last_change_hash) == 0)
+                return;
+
+        length = strlen (last_change);
+        if (length > G_MAXINT)
+                return;
+
+        sax.initialized = XML_SAX2_MAGIC;
+        sax.startElementNs = last_change_parser_start_element;
+        sax.endElementNs = last_change_parser_end_element;
+
+        parser.proxy = proxy;
+        parser.last_change_hash = priv->last_change_hash;
+
+        ctxt = xmlCreatePushParserCtxt (&sax, &parser, NULL, 0, NULL);
+        xmlCtxtUseOptions (ctxt, XML_PARSE_NONET | XML_PARSE_RECOVER);
+        xmlParseChunk (ctxt, last_change, (int) length, 1);
+        xmlFreeParserCtxt (ctxt);
+}
+
+/* Whether a cached action result becomes stale when @variable changes */
+static gboolean
+action_cache_depends_on (GUPnPServiceProxyPrivate *priv, const char *variable)
+{
+        GHashTableIter iter;
+        gpointer value;
+
+        g_hash_table_iter_init (&iter, priv->cached_actions);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                ActionCacheConfig *config = value;
+
+                if (config->variables != NULL &&
+                    g_strv_contains ((const char * const *) config->variables,
+                                     variable))
+                        return TRUE;
+        }
+
+        return FALSE;
+}
+
+/* Drop the cached action results that depend on @variable, or on any
+ * event if @variable is %NULL */
+static void
+action_cache_invalidate (GUPnPServiceProxy *proxy, const char *variable)
+{
+        GUPnPServiceProxyPrivate *priv;
+        GHashTableIter iter;
+        gpointer value;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        g_hash_table_iter_init (&iter, priv->action_results);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                CachedActionResult *result = value;
+                ActionCacheConfig *config;
+
+                config = g_hash_table_lookup (priv->cached_actions,
+                                              result->action_name);
+                if (config->variables == NULL)
+                        continue;
+
+                if (variable == NULL ||
+                    g_strv_contains ((const char * const *) config->variables,
+                                     variable))
+                        g_hash_table_iter_remove (&iter);
+        }
+}
+
+/* Record the evented @value of @variable */
+static void
+evented_state_update (GUPnPServiceProxy *proxy,
+                      const char        *variable,
+                      const char        *value)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        if (priv->cache_state)
+                g_hash_table_insert (priv->state_cache,
+                                     g_strdup (variable),
+                                     g_strdup (value));
+
+        action_cache_invalidate (proxy, variable);
+}
+
+/* Without events the cached state cannot be trusted anymore */
+static void
+evented_state_forget (GUPnPServiceProxy *proxy)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        g_hash_table_remove_all (priv->state_cache);
+        action_cache_invalidate (proxy, NULL);
+}
+
+/* Whether events need to provide the value of @variable */
+static gboolean
+variable_is_wanted (GUPnPServiceProxy *proxy, const char *variable)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        if (priv->cache_state ||
+            g_hash_table_contains (priv->notify_hash, variable))
+                return TRUE;
+
+        if (g_hash_table_size (priv->last_change_hash) > 0 &&
+            strcmp (variable, "LastChange") == 0)
+                return TRUE;
+
+        return action_cache_depends_on (priv, variable);
+}
+
+static void
+emit_notification_value (GUPnPServiceProxy *proxy,
+                         NotifyData        *data,
+                         const char        *variable,
+                         const GValue      *value)
+{
+        GList *l;
+
         /* Call callbacks. Note that data->next_emit may change if
          * callback calls remove_notify() or add_notify() */
         for (l = data->callbacks; l; l = data->next_emit) {
@@ -835,15 +1718,80 @@ emit_notification (GUPnPServiceProxy *proxy,
                 data->next_emit = l->next;
 
                 callback_data->callback (proxy,
-                                         (const char *) var_node->name,
-                                         &value,
+                                         variable,
+                                         value,
                                          callback_data->user_data);
         }
+}
+
+static void
+emit_notification (GUPnPServiceProxy *proxy,
+                   xmlNode           *var_node)
+{
+        NotifyData *data;
+        GValue value = {0, };
+        GUPnPServiceProxyPrivate *priv;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        data = g_hash_table_lookup (priv->notify_hash, var_node->name);
+        if (data == NULL)
+                return;
+
+        /* Make a GValue of the desired type */
+        g_value_init (&value, data->type);
+
+        if (!gvalue_util_set_value_from_xml_node (&value, var_node)) {
+                g_value_unset (&value);
+
+                return;
+        }
+
+        emit_notification_value (proxy,
+                                 data,
+                                 (const char *) var_node->name,
+                                 &value);
 
         /* Cleanup */
         g_value_unset (&value);
 }
 
+static void
+emit_notifications_for_properties (GUPnPServiceProxy *proxy,
+                                   GPtrArray         *properties)
+{
+        GUPnPServiceProxyPrivate *priv;
+        guint i;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        for (i = 0; i < properties->len; i++) {
+                EventProperty *property = g_ptr_array_index (properties, i);
+                NotifyData *data;
+                GValue value = G_VALUE_INIT;
+
+                evented_state_update (proxy, property->name, property->value);
+
+                if (strcmp (property->name, "LastChange") == 0)
+                        emit_last_change (proxy, property->value);
+
+                /* The listener might be gone since the event was parsed */
+                data = g_hash_table_lookup (priv->notify_hash, property->name);
+                if (data == NULL)
+                        continue;
+
+                g_value_init (&value, data->type);
+                if (gvalue_util_set_value_from_string (&value,
+                                                       property->value))
+                        emit_notification_value (proxy,
+                                                 data,
+                                                 property->name,
+                                                 &value);
+
+                g_value_unset (&value);
+        }
+}
+
 static void
 emit_notifications_for_doc (GUPnPServiceProxy *proxy,
                             xmlDoc            *doc)
@@ -866,8 +1814,32 @@ emit_notifications_for_doc (GUPnPServiceProxy *proxy,
                 for (var_node = node->children;
                      var_node;
                      var_node = var_node->next) {
-                        if (strcmp ((char *) node->name, "property") == 0)
-                                emit_notification (proxy, var_node);
+                        if (strcmp ((char *) node->name, "property") != 0)
+                                continue;
+
+                        if (var_node->type == XML_ELEMENT_NODE &&
+                            variable_is_wanted (proxy,
+                                                (const char *) var_node->name)) {
+                                xmlChar *content;
+
+                                content = xmlNodeGetContent (var_node);
+                                evented_state_update (proxy,
+                                                      (const char *) var_node->name,
+                                                      (const char *) content);
+                                xmlFree (content);
+                        }
+
+                        emit_notification (proxy, var_node);
+
+                        if (strcmp ((char *) var_node->name,
+                                    "LastChange") == 0) {
+                                xmlChar *content;
+
+                                content = xmlNodeGetContent (var_node);
+                                emit_last_change (proxy,
+                                                  (const char *) content);
+                                xmlFree (content);
+                        }
                 }
         }
 
@@ -916,66 +1888,233 @@ emit_notifications (gpointer user_data)
              pending_notify = pending_notify->next) {
                 EmitNotifyData *emit_notify_data;
 
-                emit_notify_data = pending_notify->data;
+                emit_notify_data = pending_notify->data;
+
+                if (emit_notify_data->seq > priv->seq) {
+                        /* Error procedure on missed event according to
+                         * UDA 1.0, section 4.2, §5:
+                         * Re-subscribe to get a new SID and SEQ */
+                        resubscribe = TRUE;
+
+                        break;
+                }
+
+                /* Increment our own event sequence number */
+                /* UDA 1.0, section 4.2, §3: To prevent overflow, SEQ is set to
+                 * 1, NOT 0, when encountering G_MAXUINT32. SEQ == 0 always
+                 * indicates the initial event message. */
+                if (priv->seq < G_MAXUINT32)
+                        priv->seq++;
+                else
+                        priv->seq = 1;
+
+                if (G_LIKELY (priv->sid != NULL &&
+                              strcmp (emit_notify_data->sid,
+                                      priv->sid) == 0)) {
+                        /* Our SID, entertain! */
+                        if (emit_notify_data->doc != NULL)
+                                emit_notifications_for_doc (
+                                        proxy,
+                                        emit_notify_data->doc);
+                        else
+                                emit_notifications_for_properties (
+                                        proxy,
+                                        emit_notify_data->properties);
+                }
+        }
+
+        /* Cleanup */
+        g_queue_clear_full (priv->pending_notifies,
+                            (GDestroyNotify) emit_notify_data_free);
+
+        if (resubscribe) {
+                unsubscribe (proxy);
+                subscribe (proxy);
+        }
+
+        priv->notify_idle_src = NULL;
+
+        return FALSE;
+}
+
+/* State of the SAX parser picking the watched variables from an event */
+typedef struct {
+        GUPnPServiceProxy *proxy;
+        GPtrArray  *properties;
+
+        guint       depth;
+        gboolean    has_root;
+        gboolean    is_property_set;
+        gboolean    in_property;
+
+        char       *variable; /* Watched variable being read, or NULL */
+        GString    *content;
+} PropertySetParser;
+
+static void
+property_set_parser_start_element (void           *user_data,
+                                   const xmlChar  *localname,
+                                   G_GNUC_UNUSED const xmlChar  *prefix,
+                                   G_GNUC_UNUSED const xmlChar  *uri,
+                                   G_GNUC_UNUSED int             nb_namespaces,
+                                   G_GNUC_UNUSED const xmlChar **namespaces,
+                                   G_GNUC_UNUSED int             nb_attributes,
+                                   G_GNUC_UNUSED int             nb_defaulted,
+                                   G_GNUC_UNUSED const xmlChar **attributes)
+{
+        PropertySetParser *parser = user_data;
+        const char *name = (const char *) localname;
+
+        parser->depth++;
+
+        switch (parser->depth) {
+        case 1:
+                parser->has_root = TRUE;
+                parser->is_property_set = strcmp (name, "propertyset") == 0;
+                break;
+        case 2:
+                parser->in_property = parser->is_property_set &&
+                                      strcmp (name, "property") == 0;
+                break;
+        case 3:
+                /* Subtrees of variables nobody listens to are skipped */
+                if (parser->in_property &&
+                    variable_is_wanted (parser->proxy, name)) {
+                        parser->variable = g_strdup (name);
+                        g_string_truncate (parser->content, 0);
+                }
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+property_set_parser_end_element (void          *user_data,
+                                 G_GNUC_UNUSED const xmlChar *localname,
+                                 G_GNUC_UNUSED const xmlChar *prefix,
+                                 G_GNUC_UNUSED const xmlChar *uri)
+{
+        PropertySetParser *parser = user_data;
+
+        if (parser->depth == 3 && parser->variable != NULL) {
+                EventProperty *property = g_slice_new (EventProperty);
+
+                property->name = g_steal_pointer (&parser->variable);
+                property->value = g_strndup (parser->content->str,
+                                             parser->content->len);
+                g_ptr_array_add (parser->properties, property);
+        } else if (parser->depth == 2) {
+                parser->in_property = FALSE;
+        }
+
+        parser->depth--;
+}
+
+static void
+property_set_parser_characters (void          *user_data,
+                                const xmlChar *ch,
+                                int            len)
+{
+        PropertySetParser *parser = user_data;
+
+        /* Same as xmlNodeGetContent(): all text below the variable */
+        if (parser->variable != NULL)
+                g_string_append_len (parser->content, (const char *) ch, len);
+}
+
+/* Read the values of the variables @proxy is interested in from the property
+ * set @body, without building a document tree.
+ *
+ * Returns: %FALSE if @body is not a well-formed XML document, in which case
+ * nothing is read from it. @is_property_set tells whether the root element
+ * was a propertyset */
+static gboolean
+parse_property_set (GUPnPServiceProxy *proxy,
+                    const char  *body,
+                    gsize        length,
+                    gboolean    *is_property_set,
+                    GPtrArray  **properties)
+{
+        xmlSAXHandler sax = { 0, };
+        PropertySetParser parser = { 0, };
+        xmlParserCtxt *ctxt;
+        gboolean well_formed;
+
+        if (length > G_MAXINT)
+                return FALSE;
+
+        sax.initialized = XML_SAX2_MAGIC;
+        sax.startElementNs = property_set_parser_start_element;
+        sax.endElementNs = property_set_parser_end_element;
+        sax.characters = property_set_parser_characters;
+        sax.cdataBlock = property_set_parser_characters;
 
-                if (emit_notify_data->seq > priv->seq) {
-                        /* Error procedure on missed event according to
-                         * UDA 1.0, section 4.2, §5:
-                         * Re-subscribe to get a new SID and SEQ */
-                        resubscribe = TRUE;
+        parser.proxy = proxy;
+        parser.properties = g_ptr_array_new_with_free_func (
+                (GDestroyNotify) event_property_free);
+        parser.content = g_string_new (NULL);
 
-                        break;
-                }
+        ctxt = xmlCreatePushParserCtxt (&sax, &parser, NULL, 0, NULL);
+        xmlCtxtUseOptions (ctxt, XML_PARSE_NONET);
+        xmlParseChunk (ctxt, body, (int) length, 1);
+        well_formed = ctxt->wellFormed;
+        xmlFreeParserCtxt (ctxt);
 
-                /* Increment our own event sequence number */
-                /* UDA 1.0, section 4.2, §3: To prevent overflow, SEQ is set to
-                 * 1, NOT 0, when encountering G_MAXUINT32. SEQ == 0 always
-                 * indicates the initial event message. */
-                if (priv->seq < G_MAXUINT32)
-                        priv->seq++;
-                else
-                        priv->seq = 1;
+        g_free (parser.variable);
+        g_string_free (parser.content, TRUE);
 
-                if (G_LIKELY (priv->sid != NULL &&
-                              strcmp (emit_notify_data->sid,
-                                      priv->sid) == 0))
-                        /* Our SID, entertain! */
-                        emit_notifications_for_doc (proxy,
-                                                    emit_notify_data->doc);
+        /* The values read before the error are not trustworthy either */
+        if (!well_formed) {
+                g_ptr_array_unref (parser.properties);
+                *properties = NULL;
+
+                return FALSE;
         }
 
-        /* Cleanup */
-        g_queue_clear_full (priv->pending_notifies,
-                            (GDestroyNotify) emit_notify_data_free);
+        *is_property_set = parser.is_property_set;
+        *properties = parser.properties;
 
-        if (resubscribe) {
-                unsubscribe (proxy);
-                subscribe (proxy);
-        }
+        return parser.has_root;
+}
 
-        priv->notify_idle_src = NULL;
+/* Emit the queued notifications once we know our SID */
+static void
+schedule_notifications (GUPnPServiceProxy *proxy)
+{
+        GUPnPServiceProxyPrivate *priv;
 
-        return FALSE;
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        if (priv->notify_idle_src != NULL || priv->sid == NULL ||
+            g_queue_is_empty (priv->pending_notifies))
+                return;
+
+        priv->notify_idle_src = g_idle_source_new();
+        g_source_set_callback (priv->notify_idle_src,
+                               emit_notifications,
+                               proxy, NULL);
+        g_source_attach (priv->notify_idle_src,
+                         g_main_context_get_thread_default ());
+
+        g_source_unref (priv->notify_idle_src);
 }
 
 /*
- * HTTP server received a message. Handle, if this was a NOTIFY
- * message with our SID.
+ * The context received a NOTIFY message for this proxy, either with our SID
+ * or, while the subscription is in progress, on our callback path.
  */
 static void
-server_handler (G_GNUC_UNUSED SoupServer *soup_server,
-                SoupServerMessage *msg,
-                G_GNUC_UNUSED const char *server_path,
-                G_GNUC_UNUSED GHashTable *query,
-                gpointer user_data)
+notify_handler (SoupServerMessage *msg, gpointer user_data)
 {
         GUPnPServiceProxy *proxy;
         GUPnPServiceProxyPrivate *priv;
         const char *hdr, *nt, *nts;
         guint32 seq;
         guint64 seq_parsed;
-        xmlDoc *doc;
+        xmlDoc *doc = NULL;
         xmlNode *node;
+        GPtrArray *properties = NULL;
+        gboolean parsed, is_property_set;
         EmitNotifyData *emit_notify_data;
 
         proxy = GUPNP_SERVICE_PROXY (user_data);
@@ -1053,16 +2192,36 @@ server_handler (G_GNUC_UNUSED SoupServer *soup_server,
         SoupMessageBody *request_body =
                 soup_server_message_get_request_body (msg);
 
-        /* Parse the actual XML message content */
-        doc = xmlReadMemory (request_body->data,
-                             request_body->length,
-                             NULL,
-                             NULL,
-                             XML_PARSE_NONET | XML_PARSE_RECOVER);
-        if (doc == NULL) {
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        /* Parse the actual XML message content. A document tree is only
+         * needed for raw notify listeners; otherwise just the watched
+         * variables are picked from it */
+        if (g_hash_table_contains (priv->notify_hash, "*")) {
+                doc = xmlReadMemory (request_body->data,
+                                     request_body->length,
+                                     NULL,
+                                     NULL,
+                                     XML_PARSE_NONET | XML_PARSE_RECOVER);
+                parsed = doc != NULL;
+                node = parsed ? xmlDocGetRootElement (doc) : NULL;
+                is_property_set = node != NULL &&
+                                  strcmp ((char *) node->name,
+                                          "propertyset") == 0;
+        } else {
+                parsed = parse_property_set (proxy,
+                                             request_body->data,
+                                             request_body->length,
+                                             &is_property_set,
+                                             &properties);
+        }
+
+        if (!parsed) {
                 /* Failed */
                 g_warning ("Failed to parse NOTIFY message body");
 
+                g_clear_pointer (&doc, xmlFreeDoc);
+                g_clear_pointer (&properties, g_ptr_array_unref);
                 soup_server_message_set_status (
                         msg,
                         SOUP_STATUS_INTERNAL_SERVER_ERROR,
@@ -1071,12 +2230,10 @@ server_handler (G_GNUC_UNUSED SoupServer *soup_server,
                 return;
         }
 
-        priv = gupnp_service_proxy_get_instance_private (proxy);
-        /* Get root propertyset element */
-        node = xmlDocGetRootElement (doc);
-        if (node == NULL || strcmp ((char *) node->name, "propertyset") || priv->sid == NULL) {
+        if (!is_property_set || (priv->sid == NULL && !priv->subscribed)) {
                 /* Empty or unsupported */
-                xmlFreeDoc (doc);
+                g_clear_pointer (&doc, xmlFreeDoc);
+                g_clear_pointer (&properties, g_ptr_array_unref);
 
                 soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
 
@@ -1087,20 +2244,14 @@ server_handler (G_GNUC_UNUSED SoupServer *soup_server,
          * Some UPnP stacks (hello, myigd/1.0) block when sending a NOTIFY, so
          * call the callbacks in an idle handler so that if the client calls the
          * device in the notify callback the server can actually respond.
+         *
+         * The initial event might overtake the SUBSCRIBE response; it is
+         * then kept until the response tells us our SID.
          */
-        emit_notify_data = emit_notify_data_new (hdr, seq, doc);
+        emit_notify_data = emit_notify_data_new (hdr, seq, doc, properties);
 
         g_queue_push_tail (priv->pending_notifies, emit_notify_data);
-        if (!priv->notify_idle_src) {
-                priv->notify_idle_src = g_idle_source_new();
-                g_source_set_callback (priv->notify_idle_src,
-                                       emit_notifications,
-                                       proxy, NULL);
-                g_source_attach (priv->notify_idle_src,
-                                 g_main_context_get_thread_default ());
-
-                g_source_unref (priv->notify_idle_src);
-        }
+        schedule_notifications (proxy);
 
         /* Everything went OK */
         soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
@@ -1127,10 +2278,26 @@ typedef struct {
         SoupMessage *msg;
 } SubscriptionCallData;
 
+static void
+clear_subscription_timeout (GUPnPServiceProxy *proxy)
+{
+        GUPnPServiceProxyPrivate *priv;
+        GUPnPContext *context;
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        if (priv->subscription_timeout == NULL)
+                return;
+
+        context = gupnp_service_info_get_context (GUPNP_SERVICE_INFO (proxy));
+        timer_wheel_cancel (_gupnp_context_get_timer_wheel (context),
+                            priv->subscription_timeout);
+        priv->subscription_timeout = NULL;
+}
+
 /*
  * Subscription expired.
  */
-static gboolean
+static void
 subscription_expire (gpointer user_data)
 {
         GUPnPServiceProxy *proxy;
@@ -1144,9 +2311,9 @@ subscription_expire (gpointer user_data)
         priv = gupnp_service_proxy_get_instance_private (proxy);
 
         /* Reset timeout ID */
-        priv->subscription_timeout_src = NULL;
+        priv->subscription_timeout = NULL;
 
-        g_return_val_if_fail (priv->sid != NULL, FALSE);
+        g_return_if_fail (priv->sid != NULL);
 
         /* Send renewal message */
         context = gupnp_service_info_get_context (GUPNP_SERVICE_INFO (proxy));
@@ -1162,7 +2329,7 @@ subscription_expire (gpointer user_data)
         msg = soup_message_new (GENA_METHOD_SUBSCRIBE, local_sub_url);
         g_free (local_sub_url);
 
-        g_return_val_if_fail (msg != NULL, FALSE);
+        g_return_if_fail (msg != NULL);
 
         SoupMessageHeaders *request_headers =
                 soup_message_get_request_headers (msg);
@@ -1187,8 +2354,6 @@ subscription_expire (gpointer user_data)
                                  priv->pending_messages,
                                  subscribe_got_response,
                                  data);
-
-        return FALSE;
 }
 
 /*
@@ -1219,7 +2384,7 @@ subscribe_got_response (GObject *source, GAsyncResult *res, gpointer user_data)
         g_object_unref (is);
 
         /* Remove subscription timeout */
-        g_clear_pointer (&priv->subscription_timeout_src, g_source_destroy);
+        clear_subscription_timeout (data->proxy);
 
         /* Check whether the subscription is still wanted */
         if (!priv->subscribed) {
@@ -1251,6 +2416,12 @@ subscribe_got_response (GObject *source, GAsyncResult *res, gpointer user_data)
                 }
 
                 priv->sid = g_strdup (hdr);
+                _gupnp_context_set_event_receiver_sid (
+                        gupnp_service_info_get_context (
+                                GUPNP_SERVICE_INFO (data->proxy)),
+                        priv->path,
+                        priv->sid);
+                schedule_notifications (data->proxy);
 
                 /* Figure out when the subscription times out */
                 hdr = soup_message_headers_get_one (response_headers,
@@ -1288,21 +2459,20 @@ subscribe_got_response (GObject *source, GAsyncResult *res, gpointer user_data)
                                  hdr,
                                  timeout);
 
-                        /* Add actual timeout */
-                        priv->subscription_timeout_src =
-                                g_timeout_source_new_seconds (timeout);
-                        g_source_set_callback (priv->subscription_timeout_src,
-                                               subscription_expire,
-                                               data->proxy,
-                                               NULL);
-                        g_source_attach (priv->subscription_timeout_src,
-                                         g_main_context_get_thread_default ());
-
-                        g_source_unref (priv->subscription_timeout_src);
+                        /* Add actual timeout. The timer wheel has a
+                         * resolution of a second, so the jitter above also
+                         * spreads the renewals over different slots */
+                        priv->subscription_timeout = timer_wheel_add (
+                                _gupnp_context_get_timer_wheel (
+                                        gupnp_service_info_get_context (
+                                                GUPNP_SERVICE_INFO (
+                                                        data->proxy))),
+                                MAX (timeout, 1),
+                                subscription_expire,
+                                data->proxy);
                 }
         } else {
                 GUPnPContext *context;
-                SoupServer *server;
 
                 /* Subscription failed. */
                 error = g_error_new_literal (
@@ -1315,13 +2485,16 @@ hdr_err:
                 context = gupnp_service_info_get_context (
                         GUPNP_SERVICE_INFO (data->proxy));
 
-                server = gupnp_context_get_server (context);
-                soup_server_remove_handler (server, priv->path);
+                _gupnp_context_remove_event_receiver (context, priv->path);
+                g_queue_clear_full (priv->pending_notifies,
+                                    (GDestroyNotify) emit_notify_data_free);
 
                 priv->subscribed = FALSE;
 
                 g_object_notify (G_OBJECT (data->proxy), "subscribed");
 
+                evented_state_forget (data->proxy);
+
                 /* Emit subscription-lost */
                 g_signal_emit (data->proxy,
                                signals[SUBSCRIPTION_LOST],
@@ -1346,17 +2519,13 @@ subscribe (GUPnPServiceProxy *proxy)
         GUPnPServiceProxyPrivate *priv;
         SoupMessage *msg;
         SoupSession *session;
-        SoupServer *server;
         GUri *uri;
         char *uri_string;
         char *sub_url, *delivery_url, *timeout;
 
         /* Remove subscription timeout */
         priv = gupnp_service_proxy_get_instance_private (proxy);
-        if (priv->subscription_timeout_src) {
-                g_source_destroy (priv->subscription_timeout_src);
-                priv->subscription_timeout_src = NULL;
-        }
+        clear_subscription_timeout (proxy);
 
         context = gupnp_service_info_get_context (GUPNP_SERVICE_INFO (proxy));
 
@@ -1383,6 +2552,8 @@ subscribe (GUPnPServiceProxy *proxy)
 
                 g_object_notify (G_OBJECT (proxy), "subscribed");
 
+                evented_state_forget (proxy);
+
                 /* Emit subscription-lost */
                 error = g_error_new (GUPNP_SERVER_ERROR,
                                      GUPNP_SERVER_ERROR_INVALID_URL,
@@ -1422,13 +2593,10 @@ subscribe (GUPnPServiceProxy *proxy)
         g_free (timeout);
 
         /* Listen for events */
-        server = gupnp_context_get_server (context);
-
-        soup_server_add_handler (server,
-                                 priv->path,
-                                 server_handler,
-                                 proxy,
-                                 NULL);
+        _gupnp_context_add_event_receiver (context,
+                                           priv->path,
+                                           notify_handler,
+                                           proxy);
 
         /* And send our subscription message off */
         session = gupnp_context_get_session (context);
@@ -1455,14 +2623,12 @@ unsubscribe (GUPnPServiceProxy *proxy)
         GUPnPContext *context;
         GUPnPServiceProxyPrivate *priv;
         SoupSession *session;
-        SoupServer *server;
 
         context = gupnp_service_info_get_context (GUPNP_SERVICE_INFO (proxy));
         priv = gupnp_service_proxy_get_instance_private (proxy);
 
-        /* Remove server handler */
-        server = gupnp_context_get_server (context);
-        soup_server_remove_handler (server, priv->path);
+        /* Stop receiving events */
+        _gupnp_context_remove_event_receiver (context, priv->path);
 
         if (priv->sid != NULL) {
                 SoupMessage *msg;
@@ -1508,10 +2674,9 @@ unsubscribe (GUPnPServiceProxy *proxy)
         }
 
         /* Remove subscription timeout */
-        if (priv->subscription_timeout_src) {
-                g_source_destroy (priv->subscription_timeout_src);
-                priv->subscription_timeout_src = NULL;
-        }
+        clear_subscription_timeout (proxy);
+
+        evented_state_forget (proxy);
 }
 
 /**
@@ -1568,6 +2733,184 @@ gupnp_service_proxy_get_subscribed (GUPnPServiceProxy *proxy)
         return priv->subscribed;
 }
 
+/**
+ * gupnp_service_proxy_set_cache_state:(set-property cache-state)
+ * @proxy: A #GUPnPServiceProxy
+ * @cache_state: %TRUE to keep the evented state of the service
+ *
+ * Sets whether @proxy keeps the last evented value of every state variable,
+ * so it can be read with gupnp_service_proxy_get_cached_state() instead of
+ * calling an action on the remote service. The values are only received
+ * while @proxy is subscribed, and are dropped when the subscription ends.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_proxy_set_cache_state (GUPnPServiceProxy *proxy,
+                                     gboolean           cache_state)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE_PROXY (proxy));
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        cache_state = !!cache_state;
+        if (priv->cache_state == cache_state)
+                return;
+
+        priv->cache_state = cache_state;
+        if (!cache_state)
+                g_hash_table_remove_all (priv->state_cache);
+
+        g_object_notify (G_OBJECT (proxy), "cache-state");
+}
+
+/**
+ * gupnp_service_proxy_get_cache_state:(get-property cache-state)
+ * @proxy: A #GUPnPServiceProxy
+ *
+ * Returns whether @proxy keeps the evented state of the service.
+ *
+ * Return value: %TRUE if the evented state is kept, otherwise %FALSE.
+ *
+ * Since: 1.6.10
+ **/
+gboolean
+gupnp_service_proxy_get_cache_state (GUPnPServiceProxy *proxy)
+{
+        GUPnPServiceProxyPrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE_PROXY (proxy), FALSE);
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        return priv->cache_state;
+}
+
+/**
+ * gupnp_service_proxy_get_cached_state:
+ * @proxy: A #GUPnPServiceProxy
+ * @variable: The name of the state variable
+ * @value: (out caller-allocates): The #GValue to store the value in
+ *
+ * Reads the last evented value of @variable, if
+ * #GUPnPServiceProxy:cache-state is set. If @value is initialized, the value
+ * is converted to its type, otherwise it is initialized as a string.
+ *
+ * Return value: %TRUE if a value was known and could be converted,
+ * otherwise %FALSE.
+ *
+ * Since: 1.6.10
+ **/
+gboolean
+gupnp_service_proxy_get_cached_state (GUPnPServiceProxy *proxy,
+                                      const char        *variable,
+                                      GValue            *value)
+{
+        GUPnPServiceProxyPrivate *priv;
+        const char *cached;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE_PROXY (proxy), FALSE);
+        g_return_val_if_fail (variable != NULL, FALSE);
+        g_return_val_if_fail (value != NULL, FALSE);
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+        cached = g_hash_table_lookup (priv->state_cache, variable);
+        if (cached == NULL)
+                return FALSE;
+
+        if (!G_IS_VALUE (value)) {
+                g_value_init (value, G_TYPE_STRING);
+                g_value_set_string (value, cached);
+
+                return TRUE;
+        }
+
+        return gvalue_util_set_value_from_string (value, cached);
+}
+
+/**
+ * gupnp_service_proxy_set_action_cache:
+ * @proxy: A #GUPnPServiceProxy
+ * @action_name: The name of the action
+ * @timeout: How long a result stays valid, in milliseconds, or 0
+ * @variables: (array zero-terminated=1) (allow-none): The state variables the
+ * result depends on
+ *
+ * Lets asynchronous calls of @action_name be answered from the result of a
+ * previous call with identical arguments.
+ *
+ * A result is dropped after @timeout milliseconds, if @timeout is not 0, and
+ * as soon as an event changes one of @variables. For services that moderate
+ * their events, such as RenderingControl or AVTransport, list "LastChange".
+ * Results that depend on @variables are only kept while @proxy is
+ * subscribed. Setting neither a @timeout nor @variables keeps results until
+ * the cache is reconfigured.
+ *
+ * Synchronous calls always go to the remote service.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_proxy_set_action_cache (GUPnPServiceProxy  *proxy,
+                                      const char         *action_name,
+                                      guint               timeout,
+                                      const char * const *variables)
+{
+        GUPnPServiceProxyPrivate *priv;
+        ActionCacheConfig *config;
+
+        g_return_if_fail (GUPNP_IS_SERVICE_PROXY (proxy));
+        g_return_if_fail (action_name != NULL);
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        gupnp_service_proxy_unset_action_cache (proxy, action_name);
+
+        config = g_new0 (ActionCacheConfig, 1);
+        config->timeout = timeout;
+        if (variables != NULL && variables[0] != NULL)
+                config->variables = g_strdupv ((char **) variables);
+
+        g_hash_table_insert (priv->cached_actions,
+                             g_strdup (action_name),
+                             config);
+}
+
+/**
+ * gupnp_service_proxy_unset_action_cache:
+ * @proxy: A #GUPnPServiceProxy
+ * @action_name: The name of the action
+ *
+ * Stops caching the results of @action_name and drops the ones that are
+ * kept.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_proxy_unset_action_cache (GUPnPServiceProxy *proxy,
+                                        const char        *action_name)
+{
+        GUPnPServiceProxyPrivate *priv;
+        GHashTableIter iter;
+        gpointer value;
+
+        g_return_if_fail (GUPNP_IS_SERVICE_PROXY (proxy));
+        g_return_if_fail (action_name != NULL);
+
+        priv = gupnp_service_proxy_get_instance_private (proxy);
+
+        g_hash_table_iter_init (&iter, priv->action_results);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                CachedActionResult *result = value;
+
+                if (g_str_equal (result->action_name, action_name))
+                        g_hash_table_iter_remove (&iter);
+        }
+
+        g_hash_table_remove (priv->cached_actions, action_name);
+}
+
 /**
  * gupnp_service_proxy_call_action_async:
  * @proxy: (transfer none): A #GUPnPServiceProxy
@@ -1584,6 +2927,10 @@ gupnp_service_proxy_get_subscribed (GUPnPServiceProxy *proxy)
  * gupnp_service_proxy_action_get_result_hash() or
  * gupnp_service_proxy_action_get_result_list() to extract the result of the
  * remote call.
+ *
+ * If @action was marked with gupnp_service_proxy_action_set_coalesce(), the
+ * call may share the request of an identical call that is already running.
+ *
  * Since: 1.2.0
  */
 void
@@ -1594,7 +2941,6 @@ gupnp_service_proxy_call_action_async (GUPnPServiceProxy       *proxy,
                                        gpointer                user_data)
 {
         GTask *task;
-        GError *error = NULL;
 
         g_return_if_fail (GUPNP_IS_SERVICE_PROXY (proxy));
 
@@ -1607,14 +2953,7 @@ gupnp_service_proxy_call_action_async (GUPnPServiceProxy       *proxy,
                 gupnp_service_proxy_action_ref (action),
                 (GDestroyNotify) gupnp_service_proxy_action_unref);
 
-        prepare_action_msg (proxy, action, SOUP_METHOD_POST, &error);
-
-        if (error != NULL) {
-                g_task_return_error (task, error);
-                g_object_unref (task);
-        } else {
-                gupnp_service_proxy_action_queue_task (task);
-        }
+        action_task_start (task);
 }
 
 /**
@@ -1643,6 +2982,244 @@ gupnp_service_proxy_call_action_finish (GUPnPServiceProxy *proxy,
         return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+typedef struct {
+        GPtrArray *actions;          /* One per proxy */
+        guint pending;
+        GCancellable *cancellable;   /* Cancels the calls of the batch */
+        gulong cancelled_id;         /* On the caller's cancellable */
+        GSource *deadline_src;
+        gboolean timed_out;
+} BatchData;
+
+static void
+batch_data_free (BatchData *data)
+{
+        g_ptr_array_unref (data->actions);
+        g_object_unref (data->cancellable);
+        if (data->deadline_src != NULL) {
+                g_source_destroy (data->deadline_src);
+                g_source_unref (data->deadline_src);
+        }
+
+        g_free (data);
+}
+
+static gboolean
+on_batch_deadline (gpointer user_data)
+{
+        BatchData *data = user_data;
+
+        data->timed_out = TRUE;
+        g_cancellable_cancel (data->cancellable);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+on_batch_cancelled (G_GNUC_UNUSED GCancellable *cancellable,
+                    gpointer user_data)
+{
+        BatchData *data = user_data;
+
+        g_cancellable_cancel (data->cancellable);
+}
+
+static void
+batch_complete (GTask *task)
+{
+        BatchData *data = g_task_get_task_data (task);
+
+        g_clear_signal_handler (&data->cancelled_id,
+                                g_task_get_cancellable (task));
+        if (data->deadline_src != NULL)
+                g_source_destroy (data->deadline_src);
+        g_task_return_pointer (task,
+                               g_ptr_array_ref (data->actions),
+                               (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void
+on_batch_call_done (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        GTask *task = G_TASK (user_data);
+        BatchData *data = g_task_get_task_data (task);
+        GUPnPServiceProxyAction *action;
+        GError *error = NULL;
+
+        action = g_task_get_task_data (G_TASK (res));
+        gupnp_service_proxy_call_action_finish (GUPNP_SERVICE_PROXY (source),
+                                                res,
+                                                &error);
+
+        /* Calls cut off by the deadline report that instead of a
+         * cancellation */
+        if (data->timed_out &&
+            g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                g_clear_error (&action->error);
+                g_set_error_literal (&action->error,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_TIMED_OUT,
+                                     "Batch deadline expired");
+        }
+        g_clear_error (&error);
+
+        if (--data->pending == 0)
+                batch_complete (task);
+
+        g_object_unref (task);
+}
+
+/**
+ * gupnp_service_proxy_call_batch_async:
+ * @proxies: (element-type GUPnP.ServiceProxy): The proxies to call
+ * @actions: (element-type GUPnP.ServiceProxyAction): Either one action per
+ * proxy, or a single action to call on all of them
+ * @timeout: Time in milliseconds after which unfinished calls are given up,
+ * or 0 for no deadline
+ * @cancellable: (nullable): A #GCancellable to cancel the whole batch
+ * @callback: Function to call when all calls have finished
+ * @user_data: user data for @callback
+ *
+ * Call actions on many proxies at once, completing when all of them have
+ * finished. The calls are subject to the limit of
+ * [property@GUPnP.Context:max-actions-per-host] like any other.
+ *
+ * If @actions holds a single action, a copy of it is sent to every proxy.
+ * Its envelope is only serialized once for all services of the same type.
+ * Otherwise the actions of @actions are sent as they are, and must not be
+ * in use by another call.
+ *
+ * Calls that are still running when @timeout expires fail with
+ * %G_IO_ERROR_TIMED_OUT.
+ *
+ * Since: 1.6.10
+ */
+void
+gupnp_service_proxy_call_batch_async (GPtrArray          *proxies,
+                                      GPtrArray          *actions,
+                                      guint               timeout,
+                                      GCancellable       *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer            user_data)
+{
+        GTask *task;
+        BatchData *data;
+        GUPnPServiceProxyAction *prototype = NULL;
+        guint i;
+
+        g_return_if_fail (proxies != NULL);
+        g_return_if_fail (actions != NULL);
+        g_return_if_fail (actions->len == 1 || actions->len == proxies->len);
+
+        task = g_task_new (NULL, cancellable, callback, user_data);
+        g_task_set_source_tag (task, gupnp_service_proxy_call_batch_async);
+        g_task_set_name (task, "UPnP batch call");
+
+        data = g_new0 (BatchData, 1);
+        data->actions = g_ptr_array_new_full (
+                proxies->len,
+                (GDestroyNotify) gupnp_service_proxy_action_unref);
+        data->cancellable = g_cancellable_new ();
+        g_task_set_task_data (task, data, (GDestroyNotify) batch_data_free);
+
+        if (proxies->len == 0) {
+                batch_complete (task);
+                g_object_unref (task);
+
+                return;
+        }
+
+        if (actions->len == 1 && proxies->len > 1) {
+                GUPnPServiceProxyActionTemplate *tmpl;
+
+                /* Serialize the envelope once, the copies share it */
+                prototype = g_ptr_array_index (actions, 0);
+                tmpl = get_action_template (g_ptr_array_index (proxies, 0),
+                                            prototype->name,
+                                            NULL);
+                if (tmpl != NULL)
+                        g_bytes_unref (gupnp_service_proxy_action_serialize (
+                                prototype,
+                                tmpl));
+        }
+
+        for (i = 0; i < proxies->len; i++) {
+                GUPnPServiceProxyAction *action;
+
+                if (prototype != NULL)
+                        action = gupnp_service_proxy_action_copy (prototype);
+                else
+                        action = gupnp_service_proxy_action_ref (
+                                g_ptr_array_index (actions, i));
+
+                g_ptr_array_add (data->actions, action);
+        }
+
+        if (cancellable != NULL) {
+                if (g_cancellable_is_cancelled (cancellable))
+                        g_cancellable_cancel (data->cancellable);
+                else
+                        data->cancelled_id =
+                                g_signal_connect (cancellable,
+                                                  "cancelled",
+                                                  G_CALLBACK (on_batch_cancelled),
+                                                  data);
+        }
+
+        if (timeout > 0) {
+                data->deadline_src = g_timeout_source_new (timeout);
+                g_source_set_callback (data->deadline_src,
+                                       on_batch_deadline,
+                                       data,
+                                       NULL);
+                g_source_attach (data->deadline_src,
+                                 g_task_get_context (task));
+        }
+
+        /* Keep the batch from completing before every call is queued */
+        data->pending = proxies->len + 1;
+        for (i = 0; i < proxies->len; i++) {
+                gupnp_service_proxy_call_action_async (
+                        g_ptr_array_index (proxies, i),
+                        g_ptr_array_index (data->actions, i),
+                        data->cancellable,
+                        on_batch_call_done,
+                        g_object_ref (task));
+        }
+
+        if (--data->pending == 0)
+                batch_complete (task);
+
+        g_object_unref (task);
+}
+
+/**
+ * gupnp_service_proxy_call_batch_finish:
+ * @result: a #GAsyncResult
+ * @error: (inout)(optional)(nullable): Return location for a #GError, or %NULL
+ *
+ * Finish a batch of calls started with
+ * gupnp_service_proxy_call_batch_async().
+ *
+ * The outcome of every single call is kept in its action; use
+ * gupnp_service_proxy_action_get_result() and friends on them.
+ *
+ * Returns: (nullable)(transfer container)(element-type GUPnP.ServiceProxyAction):
+ * The actions of the batch in the order of the proxies, or %NULL if the batch
+ * was cancelled.
+ * Since: 1.6.10
+ */
+GPtrArray *
+gupnp_service_proxy_call_batch_finish (GAsyncResult *result, GError **error)
+{
+        g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+        g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+                                      gupnp_service_proxy_call_batch_async,
+                              NULL);
+
+        return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 /**
  * gupnp_service_proxy_call_action:
  * @proxy: (transfer none): A #GUPnPServiceProxy
@@ -1668,7 +3245,8 @@ gupnp_service_proxy_call_action (GUPnPServiceProxy       *proxy,
         g_return_val_if_fail (GUPNP_IS_SERVICE_PROXY (proxy), NULL);
         g_return_val_if_fail (!action->pending, NULL);
 
-        if (!prepare_action_msg (proxy, action, SOUP_METHOD_POST, error)) {
+        action->method_retried = FALSE;
+        if (!prepare_action_msg (proxy, action, action_method (proxy), error)) {
                 return NULL;
         }
 
@@ -1686,12 +3264,7 @@ gupnp_service_proxy_call_action (GUPnPServiceProxy       *proxy,
         /* If not allowed, try again */
         if (soup_message_get_status (action->msg) ==
             SOUP_STATUS_METHOD_NOT_ALLOWED) {
-                if (prepare_action_msg (proxy,
-                                        action,
-                                        "M-POST",
-                                        &action->error)) {
-                        g_clear_pointer (&action->response, g_bytes_unref);
-
+                if (action_retry_with_other_method (action, &action->error)) {
                         action->response =
                                 soup_session_send_and_read (session,
                                                             action->msg,
@@ -1700,8 +3273,14 @@ gupnp_service_proxy_call_action (GUPnPServiceProxy       *proxy,
                 }
         }
 
-        if (action->error == NULL)
-                gupnp_service_proxy_action_check_response (action);
+        if (action->error != NULL)
+                goto out;
+
+        if (soup_message_get_status (action->msg) !=
+            SOUP_STATUS_METHOD_NOT_ALLOWED)
+                action_remember_method (action);
+
+        gupnp_service_proxy_action_check_response (action);
 
 out:
 
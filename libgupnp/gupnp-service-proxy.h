@@ -128,6 +128,45 @@ gupnp_service_proxy_remove_raw_notify
                                     GUPnPServiceProxyNotifyCallback callback,
                                     gpointer                        user_data);
 
+/**
+ * GUPnPServiceProxyLastChangeCallback:
+ * @proxy: The #GUPnPServiceProxy the notification originates from
+ * @instance_id: The InstanceID the change belongs to
+ * @variable: The name of the variable being notified
+ * @channel: (nullable): The channel of the change, or %NULL
+ * @value: The #GValue of the variable being notified
+ * @user_data: User data
+ *
+ * Callback notifying that the state variable @variable of instance
+ * @instance_id on @proxy has changed to @value, as part of a `LastChange`
+ * event.
+ *
+ * Since: 1.6.10
+ **/
+typedef void (* GUPnPServiceProxyLastChangeCallback) (
+        GUPnPServiceProxy *proxy,
+        guint              instance_id,
+        const char        *variable,
+        const char        *channel,
+        GValue            *value,
+        gpointer           user_data);
+
+gboolean
+gupnp_service_proxy_add_last_change_notify (
+        GUPnPServiceProxy                  *proxy,
+        const char                         *variable,
+        GType                               type,
+        GUPnPServiceProxyLastChangeCallback callback,
+        gpointer                            user_data,
+        GDestroyNotify                      notify);
+
+gboolean
+gupnp_service_proxy_remove_last_change_notify (
+        GUPnPServiceProxy                  *proxy,
+        const char                         *variable,
+        GUPnPServiceProxyLastChangeCallback callback,
+        gpointer                            user_data);
+
 void
 gupnp_service_proxy_set_subscribed (GUPnPServiceProxy              *proxy,
                                     gboolean                        subscribed);
@@ -135,6 +174,28 @@ gupnp_service_proxy_set_subscribed (GUPnPServiceProxy              *proxy,
 gboolean
 gupnp_service_proxy_get_subscribed (GUPnPServiceProxy              *proxy);
 
+void
+gupnp_service_proxy_set_cache_state (GUPnPServiceProxy *proxy,
+                                     gboolean           cache_state);
+
+gboolean
+gupnp_service_proxy_get_cache_state (GUPnPServiceProxy *proxy);
+
+gboolean
+gupnp_service_proxy_get_cached_state (GUPnPServiceProxy *proxy,
+                                      const char        *variable,
+                                      GValue            *value);
+
+void
+gupnp_service_proxy_set_action_cache (GUPnPServiceProxy  *proxy,
+                                      const char         *action_name,
+                                      guint               timeout,
+                                      const char * const *variables);
+
+void
+gupnp_service_proxy_unset_action_cache (GUPnPServiceProxy *proxy,
+                                        const char        *action_name);
+
 /* New action API */
 
 GUPnPServiceProxyAction *
@@ -169,6 +230,20 @@ gupnp_service_proxy_action_set (GUPnPServiceProxyAction *action,
                                 const GValue *value,
                                 GError **error);
 
+void
+gupnp_service_proxy_action_set_priority (GUPnPServiceProxyAction *action,
+                                         int priority);
+
+int
+gupnp_service_proxy_action_get_priority (GUPnPServiceProxyAction *action);
+
+void
+gupnp_service_proxy_action_set_coalesce (GUPnPServiceProxyAction *action,
+                                         gboolean coalesce);
+
+gboolean
+gupnp_service_proxy_action_get_coalesce (GUPnPServiceProxyAction *action);
+
 GUPnPServiceProxyActionIter *
 gupnp_service_proxy_action_iterate (GUPnPServiceProxyAction *action,
                                     GError **error);
@@ -204,6 +279,56 @@ gupnp_service_proxy_action_get_result_hash (GUPnPServiceProxyAction *action,
                                             GHashTable              *out_hash,
                                             GError                 **error);
 
+/**
+ * GUPnPServiceProxyResultReader:
+ *
+ * Opaque structure describing how to copy the out arguments of an action
+ * into a C struct.
+ *
+ * Since: 1.6.10
+ **/
+typedef struct _GUPnPServiceProxyResultReader GUPnPServiceProxyResultReader;
+
+GType
+gupnp_service_proxy_result_reader_get_type (void) G_GNUC_CONST;
+
+#define GUPNP_TYPE_SERVICE_PROXY_RESULT_READER \
+                (gupnp_service_proxy_result_reader_get_type ())
+
+GUPnPServiceProxyResultReader *
+gupnp_service_proxy_result_reader_new (void);
+
+GUPnPServiceProxyResultReader *
+gupnp_service_proxy_result_reader_ref (GUPnPServiceProxyResultReader *reader);
+
+void
+gupnp_service_proxy_result_reader_unref (GUPnPServiceProxyResultReader *reader);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GUPnPServiceProxyResultReader,
+                               gupnp_service_proxy_result_reader_unref)
+
+gboolean
+gupnp_service_proxy_result_reader_add (GUPnPServiceProxyResultReader *reader,
+                                       const char *name,
+                                       GType type,
+                                       gsize offset,
+                                       GError **error);
+
+gboolean
+gupnp_service_proxy_result_reader_add_from_introspection (
+        GUPnPServiceProxyResultReader *reader,
+        GUPnPServiceIntrospection *introspection,
+        const char *action_name,
+        const char *name,
+        gsize offset,
+        GError **error);
+
+gboolean
+gupnp_service_proxy_action_read_result (GUPnPServiceProxyAction *action,
+                                        GUPnPServiceProxyResultReader *reader,
+                                        gpointer result,
+                                        GError **error);
+
 
 void
 gupnp_service_proxy_call_action_async (GUPnPServiceProxy       *proxy,
@@ -218,6 +343,18 @@ gupnp_service_proxy_call_action_finish (GUPnPServiceProxy *proxy,
                                         GAsyncResult      *result,
                                         GError           **error);
 
+void
+gupnp_service_proxy_call_batch_async (GPtrArray          *proxies,
+                                      GPtrArray          *actions,
+                                      guint               timeout,
+                                      GCancellable       *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer            user_data);
+
+GPtrArray *
+gupnp_service_proxy_call_batch_finish (GAsyncResult *result,
+                                       GError      **error);
+
 GUPnPServiceProxyAction *
 gupnp_service_proxy_call_action (GUPnPServiceProxy       *proxy,
                                  GUPnPServiceProxyAction *action,
@@ -18,6 +18,7 @@
 #include "gena-protocol.h"
 #include "gupnp-acl.h"
 #include "gupnp-context-private.h"
+#include "gupnp-enums.h"
 #include "gupnp-error.h"
 #include "gupnp-root-device.h"
 #include "gupnp-service-info-private.h"
@@ -28,6 +29,16 @@
 #include "xml-util.h"
 
 #define SUBSCRIPTION_TIMEOUT 300 /* DLNA (7.2.22.1) enforced */
+#define DEFAULT_MAX_NOTIFY_IN_FLIGHT 1
+
+/* AVTransport and RenderingControl limit LastChange to five events per
+ * second */
+#define DEFAULT_LAST_CHANGE_INTERVAL 200
+
+/* Trailing flush of a value that only the minimum delta held back */
+#define MODERATION_SETTLE_TIME 200
+
+typedef struct _PropertySet PropertySet;
 
 struct _GUPnPServicePrivate {
         GUPnPRootDevice           *root_device;
@@ -44,6 +55,34 @@ struct _GUPnPServicePrivate {
 
         gboolean                   notify_frozen;
 
+        gboolean                   notify_keep_alive;
+
+        guint                      max_notify_in_flight;
+
+        guint                      max_pending_notifications;
+
+        GUPnPServiceNotifyOverflowPolicy notify_overflow_policy;
+
+        GHashTable                *moderations;
+
+        GHashTable                *state_store;
+
+        PropertySet               *initial_state;
+
+        GHashTable                *action_handlers;
+
+        GHashTable                *offloaded_actions;
+
+        GThreadPool               *action_pool;
+
+        GPtrArray                 *last_change; /* LastChangeInstance */
+
+        GSource                   *last_change_src;
+
+        gint64                     last_change_sent;
+
+        guint                      last_change_interval;
+
         GList                     *pending_autoconnect;
 };
 typedef struct _GUPnPServicePrivate GUPnPServicePrivate;
@@ -69,25 +108,54 @@ G_DEFINE_TYPE_WITH_PRIVATE (GUPnPService,
 
 enum {
         PROP_0,
-        PROP_ROOT_DEVICE
+        PROP_ROOT_DEVICE,
+        PROP_NOTIFY_KEEP_ALIVE,
+        PROP_MAX_NOTIFY_IN_FLIGHT,
+        PROP_MAX_PENDING_NOTIFICATIONS,
+        PROP_NOTIFY_OVERFLOW_POLICY,
+        PROP_USE_STATE_STORE,
+        PROP_LAST_CHANGE_INTERVAL
 };
 
 enum {
         ACTION_INVOKED,
         QUERY_VARIABLE,
         NOTIFY_FAILED,
+        SUBSCRIBER_SHED,
         LAST_SIGNAL
 };
 
 static guint signals[LAST_SIGNAL];
 
-static GBytes *
-create_property_set (GQueue *queue);
+/* A serialized property set, shared by all subscribers it is sent to. The
+ * values are kept to be able to merge pending property sets of a subscriber
+ * whose queue overflows */
+struct _PropertySet {
+        GBytes    *body;
+        GPtrArray *values; /* NotifyData, in document order */
+};
+
+static void
+property_set_clear (PropertySet *set)
+{
+        g_bytes_unref (set->body);
+        g_ptr_array_unref (set->values);
+}
+
+static PropertySet *
+property_set_ref (PropertySet *set)
+{
+        return g_atomic_rc_box_acquire (set);
+}
 
 static void
-notify_subscriber   (gpointer key,
-                     gpointer value,
-                     gpointer user_data);
+property_set_unref (PropertySet *set)
+{
+        g_atomic_rc_box_release_full (set, (GDestroyNotify) property_set_clear);
+}
+
+static PropertySet *
+create_property_set (GQueue *queue);
 
 GUPnPServiceAction *
 gupnp_service_action_new ();
@@ -106,10 +174,12 @@ typedef struct {
 
         int           seq;
 
-        GSource      *timeout_src;
+        TimerWheelEntry *timeout;
 
-        GList        *pending_messages; /* Pending SoupMessages from this
-                                           subscription */
+        GQueue       *pending_messages; /* Pending NotifySubscriberData from
+                                           this subscription, in SEQ order */
+        guint         in_flight;        /* Number of pending messages
+                                           currently being sent */
         gboolean      initial_state_sent;
         gboolean      to_delete;
         GCancellable *cancellable;
@@ -118,18 +188,54 @@ typedef struct {
 typedef struct {
         SubscriptionData *data;
         SoupMessage *msg;
-        GBytes *property_set;
+        PropertySet *property_set;
+        int seq;            /* -1 until the message is sent for the first time */
+        gboolean in_flight;
 } NotifySubscriberData;
 
+static NotifySubscriberData *
+notify_subscriber_data_new (SubscriptionData *subscription, PropertySet *set)
+{
+        NotifySubscriberData *data = g_new0 (NotifySubscriberData, 1);
+
+        data->data = subscription;
+        data->property_set = property_set_ref (set);
+        data->seq = -1;
+
+        return data;
+}
+
+static void
+notify_subscriber_data_free (NotifySubscriberData *data)
+{
+        g_clear_object (&data->msg);
+        property_set_unref (data->property_set);
+        g_free (data);
+}
+
 static gboolean
 subscription_data_can_delete (SubscriptionData *data) {
     return data->initial_state_sent && data->to_delete;
 }
 
 
-static void
+static gboolean
+notify_subscriber (SubscriptionData *subscription, PropertySet *set);
+
+static gboolean
 send_initial_state (SubscriptionData *data);
 
+static void
+emit_subscriber_shed (GUPnPService *service, GList *shed);
+
+static GList *
+subscription_data_copy_callbacks (SubscriptionData *data)
+{
+        return g_list_copy_deep (g_list_first (data->callbacks),
+                                 (GCopyFunc) g_uri_ref,
+                                 NULL);
+}
+
 static void
 gupnp_service_remove_subscription (GUPnPService *service,
                                    const char *sid)
@@ -151,7 +257,8 @@ gupnp_service_get_session (GUPnPService *service)
                 /* Create a dedicated session for this service to
                  * ensure that notifications are sent in the proper
                  * order. The session from GUPnPContext may use
-                 * multiple connections.
+                 * multiple connections. With keep-alive enabled, this also
+                 * means a single reusable connection per subscriber.
                  */
                 priv->session =
                         soup_session_new_with_options ("max-conns-per-host",
@@ -178,24 +285,21 @@ subscription_data_free (SubscriptionData *data)
         // session = gupnp_service_get_session (data->service);
 
         /* Cancel pending messages */
-        while (data->pending_messages) {
-                NotifySubscriberData *d = data->pending_messages->data;
-                g_object_unref (d->msg);
-                g_bytes_unref (d->property_set);
-                g_free (d);
-
-                data->pending_messages =
-                        g_list_delete_link (data->pending_messages,
-                                            data->pending_messages);
-        }
-       
+        g_queue_free_full (data->pending_messages,
+                           (GDestroyNotify) notify_subscriber_data_free);
+
         /* Further cleanup */
         g_list_free_full (data->callbacks, (GDestroyNotify) g_uri_unref);
 
         g_free (data->sid);
 
-        if (data->timeout_src)
-                g_source_destroy (data->timeout_src);
+        if (data->timeout) {
+                GUPnPContext *context = gupnp_service_info_get_context (
+                        GUPNP_SERVICE_INFO (data->service));
+
+                timer_wheel_cancel (_gupnp_context_get_timer_wheel (context),
+                                    data->timeout);
+        }
 
         g_slice_free (SubscriptionData, data);
 }
@@ -214,6 +318,54 @@ notify_data_free (NotifyData *data)
         g_slice_free (NotifyData, data);
 }
 
+/* Handler registered with gupnp_service_set_action_handler() */
+typedef struct {
+        GUPnPServiceActionHandler handler;
+        gpointer                  user_data;
+        GDestroyNotify            destroy;
+} ActionHandlerData;
+
+static void
+action_handler_data_free (ActionHandlerData *data)
+{
+        if (data->destroy != NULL)
+                data->destroy (data->user_data);
+
+        g_slice_free (ActionHandlerData, data);
+}
+
+/* Event moderation policy of a single state variable */
+typedef struct {
+        GUPnPService *service;
+        char         *variable;
+
+        guint         max_rate;       /* Minimum time between events, in ms */
+        double        min_delta;      /* Minimum change for numeric values */
+        gboolean      flush_trailing;
+
+        GValue        last_value;     /* Last value that was evented */
+        gint64        last_sent;      /* Monotonic time of last_value */
+        GValue        pending_value;  /* Latest value held back */
+        GSource      *flush_src;
+} ModerationData;
+
+static void
+moderation_data_free (ModerationData *data)
+{
+        if (data->flush_src != NULL)
+                g_source_destroy (data->flush_src);
+
+        if (G_IS_VALUE (&data->last_value))
+                g_value_unset (&data->last_value);
+
+        if (G_IS_VALUE (&data->pending_value))
+                g_value_unset (&data->pending_value);
+
+        g_free (data->variable);
+
+        g_slice_free (ModerationData, data);
+}
+
 static void
 gupnp_service_init (GUPnPService *service)
 {
@@ -228,6 +380,23 @@ gupnp_service_init (GUPnPService *service)
                                        (GDestroyNotify) subscription_data_free);
 
         priv->notify_queue = g_queue_new ();
+        priv->max_notify_in_flight = DEFAULT_MAX_NOTIFY_IN_FLIGHT;
+        priv->last_change_interval = DEFAULT_LAST_CHANGE_INTERVAL;
+
+        priv->moderations =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       NULL,
+                                       (GDestroyNotify) moderation_data_free);
+
+        priv->action_handlers =
+                g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify) action_handler_data_free);
+
+        priv->offloaded_actions =
+                g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 /* Generate a new action response node for @action_name */
@@ -257,62 +426,196 @@ new_action_response_str (const char   *action_name,
         return str;
 }
 
+/* Store a copy of @value as the current value of @variable */
+static void
+state_store_set (GUPnPService *service,
+                 const char   *variable,
+                 const GValue *value)
+{
+        GUPnPServicePrivate *priv;
+        GValue *stored;
+
+        priv = gupnp_service_get_instance_private (service);
+
+        stored = g_new0 (GValue, 1);
+        g_value_init (stored, G_VALUE_TYPE (value));
+        g_value_copy (value, stored);
+
+        g_hash_table_replace (priv->state_store, g_strdup (variable), stored);
+}
+
+/* Get the current value of @variable into the uninitialized @value, from the
+ * state store if possible, else by emitting 'query-variable'. Returns %TRUE
+ * if the value came from the state store */
+static gboolean
+query_value (GUPnPService *service, const char *variable, GValue *value)
+{
+        GUPnPServicePrivate *priv;
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (priv->state_store != NULL) {
+                const GValue *stored;
+
+                stored = g_hash_table_lookup (priv->state_store, variable);
+                if (stored != NULL) {
+                        g_value_init (value, G_VALUE_TYPE (stored));
+                        g_value_copy (stored, value);
+
+                        return TRUE;
+                }
+        }
+
+        g_signal_emit (service,
+                       signals[QUERY_VARIABLE],
+                       g_quark_from_string (variable),
+                       variable,
+                       value);
+
+        return FALSE;
+}
+
 /* Handle QueryStateVariable action */
 static void
 query_state_variable (GUPnPService       *service,
                       GUPnPServiceAction *action)
 {
-        xmlNode *node;
+        guint i;
 
         /* Iterate requested variables */
-        for (node = action->node->children; node; node = node->next) {
-                xmlChar *var_name;
+        for (i = 0; i < action->arguments->len; i++) {
+                GUPnPServiceActionArgument *argument;
+                const char *var_name;
                 GValue value = {0,};
 
-                if (strcmp ((char *) node->name, "varName") != 0)
+                argument = &g_array_index (action->arguments,
+                                           GUPnPServiceActionArgument,
+                                           i);
+                if (strcmp (argument->name, "varName") != 0)
                         continue;
 
                 /* varName */
-                var_name = xmlNodeGetContent (node);
-                if (!var_name) {
-                        gupnp_service_action_return_error (action,
-                                                           402,
-                                                           "Invalid Args");
-
-                        return;
-                }
+                var_name = argument->value;
 
                 /* Query variable */
-                g_signal_emit (service,
-                               signals[QUERY_VARIABLE],
-                               g_quark_from_string ((char *) var_name),
-                               (char *) var_name,
-                               &value);
+                query_value (service, var_name, &value);
 
                 if (!G_IS_VALUE (&value)) {
                         gupnp_service_action_return_error (action,
                                                            402,
                                                            "Invalid Args");
 
-                        xmlFree (var_name);
-
                         return;
                 }
 
                 /* Add variable to response */
-                gupnp_service_action_set_value (action,
-                                                (char *) var_name,
-                                                &value);
+                gupnp_service_action_set_value (action, var_name, &value);
 
                 /* Cleanup */
                 g_value_unset (&value);
-
-                xmlFree (var_name);
         }
 
         gupnp_service_action_return_success (action);
 }
 
+/* An action handed to the worker threads of a service */
+typedef struct {
+        GUPnPService             *service;
+        GUPnPServiceAction       *action;
+        GUPnPServiceActionHandler handler;
+        gpointer                  user_data;
+} OffloadedAction;
+
+static gboolean
+unref_service_cb (gpointer user_data)
+{
+        g_object_unref (user_data);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Runs in a worker thread */
+static void
+run_offloaded_action (gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+        OffloadedAction *offloaded = data;
+        GSource *source;
+        GMainContext *context;
+
+        /* The response is marshaled back to the owner context by
+         * gupnp_service_action_return_success() or _return_error() */
+        context = g_main_context_ref (offloaded->action->owner_context);
+
+        if (offloaded->handler != NULL)
+                offloaded->handler (offloaded->service,
+                                    offloaded->action,
+                                    offloaded->user_data);
+        else
+                g_signal_emit (offloaded->service,
+                               signals[ACTION_INVOKED],
+                               g_quark_from_string (offloaded->action->name),
+                               offloaded->action);
+
+        /* Make sure the service is never disposed in a worker thread */
+        source = g_idle_source_new ();
+        g_source_set_callback (source,
+                               unref_service_cb,
+                               offloaded->service,
+                               NULL);
+        g_source_attach (source, context);
+        g_source_unref (source);
+
+        g_main_context_unref (context);
+        g_slice_free (OffloadedAction, offloaded);
+}
+
+static void
+copy_request_header (const char *name, const char *value, gpointer user_data)
+{
+        soup_message_headers_append (user_data, name, value);
+}
+
+/* Invoke @action in one of the worker threads of @service */
+static void
+offload_action (GUPnPService       *service,
+                GUPnPServiceAction *action,
+                ActionHandlerData  *handler)
+{
+        GUPnPServicePrivate *priv;
+        OffloadedAction *offloaded;
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (priv->action_pool == NULL) {
+                priv->action_pool =
+                        g_thread_pool_new (run_offloaded_action,
+                                           NULL,
+                                           (int) g_get_num_processors (),
+                                           FALSE,
+                                           NULL);
+        }
+
+        offloaded = g_slice_new0 (OffloadedAction);
+        offloaded->service = g_object_ref (service);
+        offloaded->action = action;
+        if (handler != NULL) {
+                offloaded->handler = handler->handler;
+                offloaded->user_data = handler->user_data;
+        }
+
+        /* The worker must not touch the message, so give it a copy of what it
+         * might read */
+        action->request_headers =
+                soup_message_headers_new (SOUP_MESSAGE_HEADERS_REQUEST);
+        soup_message_headers_foreach (
+                soup_server_message_get_request_headers (action->msg),
+                copy_request_header,
+                action->request_headers);
+        action->offloaded = TRUE;
+
+        g_thread_pool_push (priv->action_pool, offloaded, NULL);
+}
+
 /* controlURL handler */
 static void
 control_server_handler (SoupServer *server,
@@ -323,15 +626,17 @@ control_server_handler (SoupServer *server,
 {
         GUPnPService *service;
         GUPnPContext *context;
-        xmlDoc *doc;
-        xmlNode *action_node, *node;
         const char *soap_action;
         const char *accept_encoding;
         char *action_name;
         char *end;
+        guint status;
         GUPnPServiceAction *action;
+        GUPnPServicePrivate *priv;
+        ActionHandlerData *handler;
 
         service = GUPNP_SERVICE (user_data);
+        priv = gupnp_service_get_instance_private (service);
 
         if (soup_server_message_get_method (msg) != SOUP_METHOD_POST) {
                 soup_server_message_set_status (msg,
@@ -414,48 +719,35 @@ control_server_handler (SoupServer *server,
         if (end)
                 *end = '\0';
 
-        /* Parse action_node */
-        doc = xmlReadMemory (request_body->data,
-                             request_body->length,
-                             NULL,
-                             NULL,
-                             XML_PARSE_NONET | XML_PARSE_RECOVER);
-        if (doc == NULL) {
+        /* Create action structure */
+        action                 = gupnp_service_action_new ();
+        action->name           = g_strdup (action_name);
+        action->msg            = g_object_ref (msg);
+        action->response_str   = new_action_response_str (action_name,
+                                                          soap_action);
+        action->context        = g_object_ref (context);
+        action->owner_context  = g_main_context_ref_thread_default ();
+
+        /* Parse arguments */
+        status = gupnp_service_action_parse_body (action,
+                                                  request_body->data,
+                                                  request_body->length);
+        if (status == SOUP_STATUS_BAD_REQUEST) {
                 soup_server_message_set_status (msg,
                                                 SOUP_STATUS_BAD_REQUEST,
                                                 "Unable to parse action");
+                gupnp_service_action_unref (action);
 
                 return;
-        }
-
-        action_node = xml_util_get_element ((xmlNode *) doc,
-                                            "Envelope",
-                                            "Body",
-                                            action_name,
-                                            NULL);
-        if (!action_node) {
+        } else if (status != SOUP_STATUS_OK) {
                 soup_server_message_set_status (msg,
                                                 SOUP_STATUS_PRECONDITION_FAILED,
                                                 "Missing <action>");
+                gupnp_service_action_unref (action);
 
                 return;
         }
 
-        /* Create action structure */
-        action                 = gupnp_service_action_new ();
-        action->name           = g_strdup (action_name);
-        action->msg            = g_object_ref (msg);
-        action->doc            = gupnp_xml_doc_new(doc);
-        action->node           = action_node;
-        action->response_str   = new_action_response_str (action_name,
-                                                          soap_action);
-        action->context        = g_object_ref (context);
-        action->argument_count = 0;
-
-        for (node = action->node->children; node; node = node->next)
-                if (node->type == XML_ELEMENT_NODE)
-                        action->argument_count++;
-
         /* Get accepted encodings */
         accept_encoding = soup_message_headers_get_list (request_headers,
                                                          "Accept-Encoding");
@@ -481,30 +773,34 @@ control_server_handler (SoupServer *server,
         soup_server_pause_message (server, msg);
 #endif
 
+        handler = g_hash_table_lookup (priv->action_handlers, action_name);
+
         /* QueryStateVariable? */
         if (strcmp (action_name, "QueryStateVariable") == 0)
                 query_state_variable (service, action);
-        else {
-                GQuark action_name_quark;
-
-                action_name_quark = g_quark_from_string (action_name);
-                if (GUPNP_SERVICE_GET_CLASS (service)->action_invoked != NULL ||
-                    g_signal_has_handler_pending (service,
-                                                  signals[ACTION_INVOKED],
-                                                  action_name_quark,
-                                                  FALSE)) {
-                        /* Emit signal. Handler parses request and fills in
-                         * response. */
-                        g_signal_emit (service,
-                                       signals[ACTION_INVOKED],
-                                       action_name_quark,
-                                       action);
-                } else {
-                        /* No handlers attached. */
-                        gupnp_service_action_return_error (action,
-                                                           401,
-                                                           "Invalid Action");
-                }
+        else if (handler == NULL &&
+                 GUPNP_SERVICE_GET_CLASS (service)->action_invoked == NULL &&
+                 !g_signal_has_handler_pending (
+                         service,
+                         signals[ACTION_INVOKED],
+                         g_quark_from_string (action_name),
+                         FALSE)) {
+                /* No handlers attached. */
+                gupnp_service_action_return_error (action,
+                                                   401,
+                                                   "Invalid Action");
+        } else if (g_hash_table_contains (priv->offloaded_actions,
+                                          action_name)) {
+                offload_action (service, action, handler);
+        } else if (handler != NULL) {
+                handler->handler (service, action, handler->user_data);
+        } else {
+                /* Emit signal. Handler parses request and fills in
+                 * response. */
+                g_signal_emit (service,
+                               signals[ACTION_INVOKED],
+                               g_quark_from_string (action_name),
+                               action);
         }
 }
 
@@ -575,40 +871,40 @@ generate_sid (void)
 }
 
 /* Subscription expired */
-static gboolean
+static void
 subscription_timeout (gpointer user_data)
 {
         SubscriptionData *data;
 
         data = user_data;
+        data->timeout = NULL;
 
         gupnp_service_remove_subscription (data->service, data->sid);
-
-        return FALSE;
 }
 
-static void
-send_initial_state (SubscriptionData *data)
+/* Create a property set holding the current value of all evented
+ * variables. @from_store is set to whether all of them came from the state
+ * store */
+static PropertySet *
+create_initial_state (GUPnPService *service, gboolean *from_store)
 {
         GQueue *queue;
         GList *l;
         GUPnPServicePrivate *priv;
+        PropertySet *property_set;
 
-        priv = gupnp_service_get_instance_private (data->service);
+        priv = gupnp_service_get_instance_private (service);
 
-        /* Send initial event message */
         queue = g_queue_new ();
+        *from_store = TRUE;
 
         for (l = priv->state_variables; l; l = l->next) {
                 NotifyData *ndata;
 
                 ndata = g_slice_new0 (NotifyData);
 
-                g_signal_emit (data->service,
-                               signals[QUERY_VARIABLE],
-                               g_quark_from_string (l->data),
-                               l->data,
-                               &ndata->value);
+                if (!query_value (service, l->data, &ndata->value))
+                        *from_store = FALSE;
 
                 if (!G_IS_VALUE (&ndata->value)) {
                         g_slice_free (NotifyData, ndata);
@@ -621,13 +917,42 @@ send_initial_state (SubscriptionData *data)
                 g_queue_push_tail (queue, ndata);
         }
 
-        GBytes *property_set = create_property_set (queue);
-        notify_subscriber (data->sid, data, property_set);
+        property_set = create_property_set (queue);
 
         /* Cleanup */
         g_queue_free (queue);
 
-        g_bytes_unref (property_set);
+        return property_set;
+}
+
+/* Returns %FALSE if the subscriber's notification queue overflowed */
+static gboolean
+send_initial_state (SubscriptionData *data)
+{
+        GUPnPServicePrivate *priv;
+        PropertySet *property_set;
+        gboolean from_store;
+        gboolean ret;
+
+        priv = gupnp_service_get_instance_private (data->service);
+
+        /* Send initial event message. If all values are stored, all
+         * subscribers share the same snapshot until the state changes */
+        if (priv->initial_state != NULL) {
+                property_set = property_set_ref (priv->initial_state);
+        } else {
+                property_set = create_initial_state (data->service,
+                                                    &from_store);
+                if (priv->state_store != NULL && from_store)
+                        priv->initial_state = property_set_ref (property_set);
+        }
+
+        ret = notify_subscriber (data, property_set);
+
+        /* Cleanup */
+        property_set_unref (property_set);
+
+        return ret;
 }
 
 static GList *
@@ -673,6 +998,7 @@ subscribe (GUPnPService *service, SoupServerMessage *msg, const char *callback)
 
         data = g_slice_new0 (SubscriptionData);
         data->cancellable = g_cancellable_new ();
+        data->pending_messages = g_queue_new ();
 
         /* Parse callback list */
         start = (char *) callback;
@@ -713,6 +1039,8 @@ subscribe (GUPnPService *service, SoupServerMessage *msg, const char *callback)
                                                 SOUP_STATUS_PRECONDITION_FAILED,
                                                 "No valid callbacks found");
 
+                g_object_unref (data->cancellable);
+                g_queue_free (data->pending_messages);
                 g_slice_free (SubscriptionData, data);
 
                 return;
@@ -723,16 +1051,11 @@ subscribe (GUPnPService *service, SoupServerMessage *msg, const char *callback)
         data->sid     = generate_sid ();
 
         /* Add timeout */
-        data->timeout_src = g_timeout_source_new_seconds (SUBSCRIPTION_TIMEOUT);
-        g_source_set_callback (data->timeout_src,
-                               subscription_timeout,
-                               data,
-                               NULL);
-
-        g_source_attach (data->timeout_src,
-                         g_main_context_get_thread_default ());
-
-        g_source_unref (data->timeout_src);
+        data->timeout =
+                timer_wheel_add (_gupnp_context_get_timer_wheel (context),
+                                 SUBSCRIPTION_TIMEOUT,
+                                 subscription_timeout,
+                                 data);
 
         /* Add to hash */
         g_hash_table_insert (priv->subscriptions,
@@ -745,7 +1068,18 @@ subscribe (GUPnPService *service, SoupServerMessage *msg, const char *callback)
         // FIXME: Should we only send this if we priv->inspection is not NULL?
         // There might not be any useful data in the notification if there is no
         // introspection yet
-        send_initial_state (data);
+        if (!send_initial_state (data)) {
+                GList *shed;
+
+                shed = g_list_prepend (NULL,
+                                       subscription_data_copy_callbacks (data));
+
+                if (priv->notify_overflow_policy ==
+                    GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE)
+                        g_hash_table_remove (priv->subscriptions, data->sid);
+
+                emit_subscriber_shed (service, shed);
+        }
 }
 
 /* Resubscription request */
@@ -754,6 +1088,7 @@ resubscribe (GUPnPService *service, SoupServerMessage *msg, const char *sid)
 {
         SubscriptionData *data;
         GUPnPServicePrivate *priv;
+        TimerWheel *wheel;
 
         priv = gupnp_service_get_instance_private (service);
 
@@ -768,21 +1103,16 @@ resubscribe (GUPnPService *service, SoupServerMessage *msg, const char *sid)
         }
 
         /* Update timeout */
-        if (data->timeout_src) {
-                g_source_destroy (data->timeout_src);
-                data->timeout_src = NULL;
-        }
+        wheel = _gupnp_context_get_timer_wheel (
+                gupnp_service_info_get_context (GUPNP_SERVICE_INFO (service)));
 
-        data->timeout_src = g_timeout_source_new_seconds (SUBSCRIPTION_TIMEOUT);
-        g_source_set_callback (data->timeout_src,
-                               subscription_timeout,
-                               data,
-                               NULL);
-
-        g_source_attach (data->timeout_src,
-                         g_main_context_get_thread_default ());
-
-        g_source_unref (data->timeout_src);
+        if (data->timeout)
+                timer_wheel_rearm (wheel, data->timeout, SUBSCRIPTION_TIMEOUT);
+        else
+                data->timeout = timer_wheel_add (wheel,
+                                                 SUBSCRIPTION_TIMEOUT,
+                                                 subscription_timeout,
+                                                 data);
 
         /* Respond */
         subscription_response (service, msg, sid, SUBSCRIPTION_TIMEOUT);
@@ -926,6 +1256,7 @@ got_introspection (GObject          *source,
         const GList *state_variables, *l;
         GHashTableIter iter;
         gpointer data;
+        GList *shed = NULL;
 
         GUPnPServiceIntrospection *introspection =
                 gupnp_service_info_introspect_finish (
@@ -980,13 +1311,33 @@ got_introspection (GObject          *source,
 
         g_object_unref (introspection);
 
+        /* The set of evented variables might have changed */
+        g_clear_pointer (&priv->initial_state, property_set_unref);
+
         g_hash_table_iter_init (&iter, priv->subscriptions);
 
         while (g_hash_table_iter_next (&iter, NULL, &data)) {
-                send_initial_state ((SubscriptionData *) data);
-                if (subscription_data_can_delete ((SubscriptionData *) data))
+                SubscriptionData *subscription = data;
+
+                if (!send_initial_state (subscription)) {
+                        shed = g_list_prepend (
+                                shed,
+                                subscription_data_copy_callbacks (
+                                        subscription));
+
+                        if (priv->notify_overflow_policy ==
+                            GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE) {
+                                g_hash_table_iter_remove (&iter);
+
+                                continue;
+                        }
+                }
+
+                if (subscription_data_can_delete (subscription))
                         g_hash_table_iter_remove (&iter);
         }
+
+        emit_subscriber_shed (GUPNP_SERVICE (source), shed);
 }
 
 static char *
@@ -1109,6 +1460,36 @@ gupnp_service_set_property (GObject      *object,
 
                 break;
         }
+        case PROP_NOTIFY_KEEP_ALIVE:
+                gupnp_service_set_notify_keep_alive (
+                        service,
+                        g_value_get_boolean (value));
+                break;
+        case PROP_MAX_NOTIFY_IN_FLIGHT:
+                gupnp_service_set_max_notify_in_flight (
+                        service,
+                        g_value_get_uint (value));
+                break;
+        case PROP_MAX_PENDING_NOTIFICATIONS:
+                gupnp_service_set_max_pending_notifications (
+                        service,
+                        g_value_get_uint (value));
+                break;
+        case PROP_NOTIFY_OVERFLOW_POLICY:
+                gupnp_service_set_notify_overflow_policy (
+                        service,
+                        g_value_get_enum (value));
+                break;
+        case PROP_USE_STATE_STORE:
+                gupnp_service_set_use_state_store (
+                        service,
+                        g_value_get_boolean (value));
+                break;
+        case PROP_LAST_CHANGE_INTERVAL:
+                gupnp_service_set_last_change_interval (
+                        service,
+                        g_value_get_uint (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -1131,6 +1512,24 @@ gupnp_service_get_property (GObject    *object,
         case PROP_ROOT_DEVICE:
                 g_value_set_object (value, priv->root_device);
                 break;
+        case PROP_NOTIFY_KEEP_ALIVE:
+                g_value_set_boolean (value, priv->notify_keep_alive);
+                break;
+        case PROP_MAX_NOTIFY_IN_FLIGHT:
+                g_value_set_uint (value, priv->max_notify_in_flight);
+                break;
+        case PROP_MAX_PENDING_NOTIFICATIONS:
+                g_value_set_uint (value, priv->max_pending_notifications);
+                break;
+        case PROP_NOTIFY_OVERFLOW_POLICY:
+                g_value_set_enum (value, priv->notify_overflow_policy);
+                break;
+        case PROP_USE_STATE_STORE:
+                g_value_set_boolean (value, priv->state_store != NULL);
+                break;
+        case PROP_LAST_CHANGE_INTERVAL:
+                g_value_set_uint (value, priv->last_change_interval);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
                 break;
@@ -1189,6 +1588,18 @@ gupnp_service_dispose (GObject *object)
         /* Cancel pending messages */
         g_hash_table_remove_all (priv->subscriptions);
 
+        /* Stop trailing-edge flushes */
+        g_hash_table_remove_all (priv->moderations);
+
+        if (priv->last_change_src != NULL) {
+                g_source_destroy (priv->last_change_src);
+                priv->last_change_src = NULL;
+        }
+        g_clear_pointer (&priv->last_change, g_ptr_array_unref);
+
+        /* Handler data might hold references to the service */
+        g_hash_table_remove_all (priv->action_handlers);
+
         /* Call super */
         object_class = G_OBJECT_CLASS (gupnp_service_parent_class);
         object_class->dispose (object);
@@ -1207,6 +1618,19 @@ gupnp_service_finalize (GObject *object)
         /* Free subscription hash */
         g_hash_table_destroy (priv->subscriptions);
 
+        g_hash_table_destroy (priv->moderations);
+
+        g_hash_table_destroy (priv->action_handlers);
+
+        g_hash_table_destroy (priv->offloaded_actions);
+
+        /* Every queued action holds a reference, so the pool is idle */
+        if (priv->action_pool != NULL)
+                g_thread_pool_free (priv->action_pool, TRUE, TRUE);
+
+        g_clear_pointer (&priv->state_store, g_hash_table_destroy);
+        g_clear_pointer (&priv->initial_state, property_set_unref);
+
         /* Free state variable list */
         g_list_free_full (priv->state_variables, g_free);
 
@@ -1253,20 +1677,171 @@ gupnp_service_class_init (GUPnPServiceClass *klass)
                                       G_PARAM_STATIC_BLURB));
 
         /**
-         * GUPnPService::action-invoked:
-         * @service: the #GUPnPService that received the signal
-         * @action: the invoked #GUPnPServiceAction
+         * GUPnPService:notify-keep-alive:
          *
-         * Emitted whenever an action is invoked. Handler should process
-         * @action and must call either [method@GUPnP.ServiceAction.return_success] or
-         * [method@GUPnP.ServiceAction.return_error].
+         * Whether to keep the connection to a subscriber open between
+         * event notifications.
+         *
+         * By default, every NOTIFY is sent with a `Connection: close` header.
+         * When enabled, the connection to each subscriber callback is reused
+         * for subsequent notifications.
+         *
+         * Since: 1.6.10
          **/
-        signals[ACTION_INVOKED] =
-                g_signal_new ("action-invoked",
-                              GUPNP_TYPE_SERVICE,
-                              G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
-                              G_STRUCT_OFFSET (GUPnPServiceClass,
-                                               action_invoked),
+        g_object_class_install_property
+                (object_class,
+                 PROP_NOTIFY_KEEP_ALIVE,
+                 g_param_spec_boolean ("notify-keep-alive",
+                                       "Keep-alive notifications",
+                                       "Reuse connections to subscribers",
+                                       FALSE,
+                                       G_PARAM_READWRITE |
+                                       G_PARAM_EXPLICIT_NOTIFY |
+                                       G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPService:max-notify-in-flight:
+         *
+         * The maximum number of event notifications that may be in flight
+         * to a single subscriber at the same time.
+         *
+         * Notifications are always sent in the order of their SEQ number. The
+         * default of 1 guarantees that they also arrive in that order.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_MAX_NOTIFY_IN_FLIGHT,
+                 g_param_spec_uint ("max-notify-in-flight",
+                                    "Maximum notifications in flight",
+                                    "Maximum number of concurrent "
+                                    "notifications per subscriber",
+                                    1,
+                                    G_MAXUINT,
+                                    DEFAULT_MAX_NOTIFY_IN_FLIGHT,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_EXPLICIT_NOTIFY |
+                                    G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPService:max-pending-notifications:
+         *
+         * The maximum number of event notifications queued for a single
+         * subscriber, including the ones in flight, or 0 for no limit.
+         *
+         * Notifications in flight are never dropped or merged. If all of the
+         * queue is in flight, the latest notification is still kept behind
+         * them, so the queue never grows beyond the larger of this limit and
+         * [property@GUPnP.Service:max-notify-in-flight] + 1.
+         *
+         * A subscriber that stops answering will otherwise make its queue
+         * grow until the notifications time out. What happens when the limit
+         * is hit is decided by [property@GUPnP.Service:notify-overflow-policy].
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_MAX_PENDING_NOTIFICATIONS,
+                 g_param_spec_uint ("max-pending-notifications",
+                                    "Maximum pending notifications",
+                                    "Maximum number of queued "
+                                    "notifications per subscriber",
+                                    0,
+                                    G_MAXUINT,
+                                    0,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_EXPLICIT_NOTIFY |
+                                    G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPService:notify-overflow-policy:
+         *
+         * What to do with a subscriber whose notification queue has
+         * reached [property@GUPnP.Service:max-pending-notifications].
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_NOTIFY_OVERFLOW_POLICY,
+                 g_param_spec_enum ("notify-overflow-policy",
+                                    "Notification overflow policy",
+                                    "Policy for full notification queues",
+                                    GUPNP_TYPE_SERVICE_NOTIFY_OVERFLOW_POLICY,
+                                    GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_MERGE,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_EXPLICIT_NOTIFY |
+                                    G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPService:use-state-store:
+         *
+         * Whether the service keeps the values of its state variables.
+         *
+         * When enabled, every value passed to
+         * [method@GUPnP.Service.notify_value] is stored. Initial event
+         * messages and QueryStateVariable actions are answered from the
+         * store, and [signal@GUPnP.Service::query-variable] is only emitted
+         * for variables that have no stored value yet. Values returned by
+         * the signal handlers are not stored. Once all evented variables
+         * have a stored value, the initial event message is built once and
+         * shared by all new subscribers until a variable changes.
+         *
+         * The application must then notify every change of an evented
+         * variable.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_USE_STATE_STORE,
+                 g_param_spec_boolean ("use-state-store",
+                                       "Use state store",
+                                       "Keep the values of state variables",
+                                       FALSE,
+                                       G_PARAM_READWRITE |
+                                       G_PARAM_EXPLICIT_NOTIFY |
+                                       G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPService:last-change-interval:
+         *
+         * The minimum time between two LastChange events produced by
+         * [method@GUPnP.Service.add_last_change], in milliseconds. Changes
+         * made in between are merged into the next event.
+         *
+         * Since: 1.6.10
+         **/
+        g_object_class_install_property
+                (object_class,
+                 PROP_LAST_CHANGE_INTERVAL,
+                 g_param_spec_uint ("last-change-interval",
+                                    "LastChange interval",
+                                    "Minimum time between LastChange events",
+                                    0,
+                                    G_MAXUINT,
+                                    DEFAULT_LAST_CHANGE_INTERVAL,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_EXPLICIT_NOTIFY |
+                                    G_PARAM_STATIC_STRINGS));
+
+        /**
+         * GUPnPService::action-invoked:
+         * @service: the #GUPnPService that received the signal
+         * @action: the invoked #GUPnPServiceAction
+         *
+         * Emitted whenever an action is invoked. Handler should process
+         * @action and must call either [method@GUPnP.ServiceAction.return_success] or
+         * [method@GUPnP.ServiceAction.return_error].
+         **/
+        signals[ACTION_INVOKED] =
+                g_signal_new ("action-invoked",
+                              GUPNP_TYPE_SERVICE,
+                              G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                              G_STRUCT_OFFSET (GUPnPServiceClass,
+                                               action_invoked),
                               NULL,
                               NULL,
                               NULL,
@@ -1319,6 +1894,31 @@ gupnp_service_class_init (GUPnPServiceClass *klass)
                               2,
                               G_TYPE_POINTER,
                               G_TYPE_POINTER);
+
+        /**
+         * GUPnPService::subscriber-shed:
+         * @service: the #GUPnPService that received the signal
+         * @callback_url: (type GList)(element-type GUri):a #GList of callback URLs
+         * @policy: the [enum@GUPnP.ServiceNotifyOverflowPolicy] that was applied
+         *
+         * Emitted whenever the notification queue of a subscriber overflowed
+         * and notifications were merged or dropped, or the subscription was
+         * cancelled, according to @policy.
+         *
+         * Since: 1.6.10
+         **/
+        signals[SUBSCRIBER_SHED] =
+                g_signal_new ("subscriber-shed",
+                              GUPNP_TYPE_SERVICE,
+                              G_SIGNAL_RUN_LAST,
+                              0,
+                              NULL,
+                              NULL,
+                              NULL,
+                              G_TYPE_NONE,
+                              2,
+                              G_TYPE_POINTER,
+                              GUPNP_TYPE_SERVICE_NOTIFY_OVERFLOW_POLICY);
 }
 
 /**
@@ -1380,6 +1980,9 @@ gupnp_service_notify (GUPnPService *service,
 }
 
 
+static void
+subscription_data_send_pending (SubscriptionData *data);
+
 /* Received notify response. */
 static void
 notify_got_response (GObject *source, GAsyncResult *res, gpointer user_data)
@@ -1388,6 +1991,7 @@ notify_got_response (GObject *source, GAsyncResult *res, gpointer user_data)
         GBytes *body;
         GError *error = NULL;
         NotifySubscriberData *data = user_data;
+        SubscriptionData *subscription;
 
         body = soup_session_send_and_read_finish (SOUP_SESSION (source),
                                                   res,
@@ -1406,84 +2010,79 @@ notify_got_response (GObject *source, GAsyncResult *res, gpointer user_data)
 
         SoupStatus status = soup_message_get_status (data->msg);
 
-        /* Remove from pending messages list */
-        data->data->pending_messages =
-                g_list_remove (data->data->pending_messages, data);
+        subscription = data->data;
+        subscription->in_flight--;
+        data->in_flight = FALSE;
 
         if (SOUP_STATUS_IS_SUCCESSFUL (status)) {
-                data->data->initial_state_sent = TRUE;
+                subscription->initial_state_sent = TRUE;
 
                 /* Success: reset callbacks pointer */
-                data->data->callbacks = g_list_first (data->data->callbacks);
+                subscription->callbacks = g_list_first (subscription->callbacks);
+
+                /* Remove from pending messages list */
+                g_queue_remove (subscription->pending_messages, data);
+                notify_subscriber_data_free (data);
 
         } else if (status == SOUP_STATUS_PRECONDITION_FAILED) {
-                /* Precondition failed: Cancel subscription */
-                gupnp_service_remove_subscription (data->data->service,
-                                                   data->data->sid);
+                /* Precondition failed: Cancel subscription. This also frees
+                 * @data */
+                gupnp_service_remove_subscription (subscription->service,
+                                                   subscription->sid);
+                g_clear_error (&error);
 
+                return;
+        } else if (subscription->callbacks->next) {
+                /* Other failure: Try next callback. The message stays at its
+                 * place in the queue and is resent with the same SEQ */
+                subscription->callbacks = subscription->callbacks->next;
         } else {
-                /* Other failure: Try next callback or signal failure. */
-                if (data->data->callbacks->next) {
-                        /* Call next callback */
-                        data->data->callbacks = data->data->callbacks->next;
-
-                        notify_subscriber (NULL,
-                                           data->data,
-                                           g_bytes_ref (data->property_set));
+                /* Emit 'notify-failed' signal */
+                GError *inner_error = NULL;
+
+                // We have an error, so just propagate that
+                if (error != NULL) {
+                        g_propagate_error (&inner_error,
+                                           g_steal_pointer (&error));
                 } else {
-                        /* Emit 'notify-failed' signal */
-                        GError *inner_error = NULL;
+                        inner_error = g_error_new_literal (
+                                GUPNP_EVENTING_ERROR,
+                                GUPNP_EVENTING_ERROR_NOTIFY_FAILED,
+                                soup_message_get_reason_phrase (data->msg));
+                }
 
-                        // We have an error, so just propagate that
-                        if (error != NULL) {
-                                g_propagate_error (&inner_error,
-                                                   g_steal_pointer (&error));
-                        } else {
-                                inner_error = g_error_new_literal (
-                                        GUPNP_EVENTING_ERROR,
-                                        GUPNP_EVENTING_ERROR_NOTIFY_FAILED,
-                                        soup_message_get_reason_phrase (
-                                                data->msg));
-                        }
+                /* Remove from pending messages list */
+                g_queue_remove (subscription->pending_messages, data);
+                notify_subscriber_data_free (data);
 
-                        g_signal_emit (data->data->service,
-                                       signals[NOTIFY_FAILED],
-                                       0,
-                                       data->data->callbacks,
-                                       inner_error);
+                g_signal_emit (subscription->service,
+                               signals[NOTIFY_FAILED],
+                               0,
+                               subscription->callbacks,
+                               inner_error);
 
-                        g_error_free (inner_error);
+                g_error_free (inner_error);
 
-                        /* Reset callbacks pointer */
-                        data->data->callbacks =
-                                g_list_first (data->data->callbacks);
-                }
+                /* Reset callbacks pointer */
+                subscription->callbacks =
+                        g_list_first (subscription->callbacks);
         }
         g_clear_error (&error);
-        g_bytes_unref (data->property_set);
-        g_object_unref (data->msg);
-        g_free (data);
+
+        subscription_data_send_pending (subscription);
 }
 
-/* Send notification @user_data to subscriber @value */
+/* Create the NOTIFY message for @data, addressed to the current callback of
+ * the subscription */
 static void
-notify_subscriber (G_GNUC_UNUSED gpointer key,
-                   gpointer value,
-                   gpointer user_data)
+notify_subscriber_data_prepare_message (NotifySubscriberData *data)
 {
+        GUPnPServicePrivate *priv;
         char *tmp;
-        SoupSession *session;
-
-        /* Subscriber called unsubscribe */
-        if (subscription_data_can_delete ((SubscriptionData *) value))
-                return;
-
-        NotifySubscriberData *data = g_new0 (NotifySubscriberData, 1);
 
-        data->data = value;
-        data->property_set = g_bytes_ref ((GBytes *) user_data);
+        priv = gupnp_service_get_instance_private (data->data->service);
 
-        /* Create message */
+        g_clear_object (&data->msg);
         data->msg = soup_message_new_from_uri (GENA_METHOD_NOTIFY,
                                                data->data->callbacks->data);
 
@@ -1494,43 +2093,242 @@ notify_subscriber (G_GNUC_UNUSED gpointer key,
         soup_message_headers_append (request_headers, "NTS", "upnp:propchange");
         soup_message_headers_append (request_headers, "SID", data->data->sid);
 
-        tmp = g_strdup_printf ("%d", data->data->seq);
+        tmp = g_strdup_printf ("%d", data->seq);
         soup_message_headers_append (request_headers, "SEQ", tmp);
         g_free (tmp);
 
-        /* Handle overflow */
-        if (data->data->seq < G_MAXINT32)
-                data->data->seq++;
-        else
-                data->data->seq = 1;
-
         /* Add body */
         soup_message_set_request_body_from_bytes (data->msg,
                                                   "text/xml; charset=\"utf-8\"",
-                                                  data->property_set);
+                                                  data->property_set->body);
+
+        if (!priv->notify_keep_alive)
+                soup_message_headers_append (request_headers,
+                                             "Connection",
+                                             "close");
+}
+
+/* Send as many queued notifications of @data as the in-flight limit allows,
+ * in queue (and thus SEQ) order */
+static void
+subscription_data_send_pending (SubscriptionData *data)
+{
+        GUPnPServicePrivate *priv;
+        SoupSession *session;
+        GList *l;
+
+        priv = gupnp_service_get_instance_private (data->service);
+        session = gupnp_service_get_session (data->service);
+
+        for (l = data->pending_messages->head;
+             l != NULL && data->in_flight < priv->max_notify_in_flight;
+             l = l->next) {
+                NotifySubscriberData *notify_data = l->data;
+
+                if (notify_data->in_flight)
+                        continue;
+
+                /* Assign the SEQ on first send; a retry on another callback
+                 * URL keeps it */
+                if (notify_data->seq < 0) {
+                        notify_data->seq = data->seq;
+
+                        /* Handle overflow */
+                        if (data->seq < G_MAXINT32)
+                                data->seq++;
+                        else
+                                data->seq = 1;
+                }
+
+                notify_subscriber_data_prepare_message (notify_data);
+
+                notify_data->in_flight = TRUE;
+                data->in_flight++;
+
+                soup_session_send_and_read_async (
+                        session,
+                        notify_data->msg,
+                        G_PRIORITY_DEFAULT,
+                        data->cancellable,
+                        (GAsyncReadyCallback) notify_got_response,
+                        notify_data);
+        }
+}
+
+/* Drop the oldest notifications of @data that have not been sent yet until
+ * at most @keep are queued. Notifications in flight count against @keep, but
+ * cannot be dropped */
+static void
+subscription_data_drop_oldest (SubscriptionData *data, guint keep)
+{
+        GList *l;
+
+        l = data->pending_messages->head;
+        while (l != NULL && data->pending_messages->length > keep) {
+                NotifySubscriberData *notify_data = l->data;
+                GList *next = l->next;
+
+                if (!notify_data->in_flight) {
+                        g_queue_delete_link (data->pending_messages, l);
+                        notify_subscriber_data_free (notify_data);
+                }
+
+                l = next;
+        }
+}
+
+/* Replace all notifications of @data that have not been sent yet by a single
+ * one carrying the latest value of every variable they contain. SEQs are only
+ * assigned on send, so the subscriber does not see a gap */
+static void
+subscription_data_merge_pending (SubscriptionData *data)
+{
+        GQueue *queue;
+        GHashTable *merged;
+        GList *l;
+        PropertySet *set;
+
+        queue = g_queue_new ();
+        merged = g_hash_table_new (g_str_hash, g_str_equal);
+
+        l = data->pending_messages->head;
+        while (l != NULL) {
+                NotifySubscriberData *notify_data = l->data;
+                GList *next = l->next;
+                guint i;
+
+                if (notify_data->in_flight) {
+                        l = next;
+
+                        continue;
+                }
+
+                for (i = 0; i < notify_data->property_set->values->len; i++) {
+                        NotifyData *value;
+                        NotifyData *ndata;
+
+                        value = g_ptr_array_index (
+                                notify_data->property_set->values,
+                                i);
+                        ndata = g_hash_table_lookup (merged, value->variable);
+                        if (ndata == NULL) {
+                                ndata = g_slice_new0 (NotifyData);
+                                ndata->variable = g_strdup (value->variable);
+
+                                g_queue_push_tail (queue, ndata);
+                                g_hash_table_insert (merged,
+                                                     ndata->variable,
+                                                     ndata);
+                        } else {
+                                g_value_unset (&ndata->value);
+                        }
+
+                        g_value_init (&ndata->value,
+                                      G_VALUE_TYPE (&value->value));
+                        g_value_copy (&value->value, &ndata->value);
+                }
+
+                g_queue_delete_link (data->pending_messages, l);
+                notify_subscriber_data_free (notify_data);
+
+                l = next;
+        }
+
+        g_hash_table_destroy (merged);
+
+        set = create_property_set (queue);
+        g_queue_push_tail (data->pending_messages,
+                           notify_subscriber_data_new (data, set));
+
+        /* Cleanup */
+        property_set_unref (set);
+        g_queue_free (queue);
+}
+
+/* Queue notification @set for @subscription and send it if possible. Returns
+ * %FALSE if the queue of @subscription overflowed. In that case, the
+ * overflow policy has already been applied, except for
+ * %GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE where removing the
+ * subscription is left to the caller */
+static gboolean
+notify_subscriber (SubscriptionData *subscription, PropertySet *set)
+{
+        GUPnPServicePrivate *priv;
+        gboolean overflow = FALSE;
+
+        priv = gupnp_service_get_instance_private (subscription->service);
+
+        /* Subscriber called unsubscribe */
+        if (subscription_data_can_delete (subscription))
+                return TRUE;
+
+        if (priv->max_pending_notifications > 0 &&
+            subscription->pending_messages->length >=
+                    priv->max_pending_notifications) {
+                overflow = TRUE;
+
+                switch (priv->notify_overflow_policy) {
+                case GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE:
+                        return FALSE;
+                case GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_DROP_OLDEST:
+                        /* Make room for @set */
+                        subscription_data_drop_oldest (
+                                subscription,
+                                priv->max_pending_notifications - 1);
+                        break;
+                case GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_MERGE:
+                default:
+                        break;
+                }
+        }
 
         /* Queue */
-        data->data->pending_messages =
-                g_list_prepend (data->data->pending_messages, data);
-        soup_message_headers_append (request_headers, "Connection", "close");
+        g_queue_push_tail (subscription->pending_messages,
+                           notify_subscriber_data_new (subscription, set));
+
+        if (overflow && priv->notify_overflow_policy ==
+                                GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_MERGE)
+                subscription_data_merge_pending (subscription);
+
+        subscription_data_send_pending (subscription);
+
+        return !overflow;
+}
+
+/* Emit 'subscriber-shed' for each list of callback URLs in @shed and free
+ * it */
+static void
+emit_subscriber_shed (GUPnPService *service, GList *shed)
+{
+        GUPnPServicePrivate *priv;
+        GList *l;
+
+        priv = gupnp_service_get_instance_private (service);
+
+        for (l = shed; l != NULL; l = l->next) {
+                g_signal_emit (service,
+                               signals[SUBSCRIBER_SHED],
+                               0,
+                               l->data,
+                               priv->notify_overflow_policy);
 
-        session = gupnp_service_get_session (data->data->service);
+                g_list_free_full (l->data, (GDestroyNotify) g_uri_unref);
+        }
 
-        soup_session_send_and_read_async (
-                session,
-                data->msg,
-                G_PRIORITY_DEFAULT,
-                data->data->cancellable,
-                (GAsyncReadyCallback) notify_got_response,
-                data);
+        g_list_free (shed);
 }
 
 /* Create a property set from @queue */
-static GBytes *
+static PropertySet *
 create_property_set (GQueue *queue)
 {
         NotifyData *data;
         GString *str;
+        PropertySet *set;
+
+        set = g_atomic_rc_box_new0 (PropertySet);
+        set->values = g_ptr_array_new_with_free_func (
+                (GDestroyNotify) notify_data_free);
 
         /* Compose property set */
         str = xml_util_new_string ();
@@ -1548,14 +2346,14 @@ create_property_set (GQueue *queue)
                 xml_util_end_element (str, data->variable);
                 xml_util_end_element (str, "e:property");
 
-                /* Cleanup */
-                notify_data_free (data);
+                g_ptr_array_add (set->values, data);
         }
 
         g_string_append (str, "</e:propertyset>");
 
-        /* Cleanup & return */
-        return g_string_free_to_bytes (str);
+        set->body = g_string_free_to_bytes (str);
+
+        return set;
 }
 
 /* Flush all queued notifications */
@@ -1563,41 +2361,47 @@ static void
 flush_notifications (GUPnPService *service)
 {
         GUPnPServicePrivate *priv;
+        GHashTableIter iter;
+        gpointer value;
+        GList *shed = NULL;
 
         priv = gupnp_service_get_instance_private (service);
 
         /* Create property set */
-        GBytes *property_set = create_property_set (priv->notify_queue);
+        PropertySet *property_set = create_property_set (priv->notify_queue);
 
         /* And send it off */
-        g_hash_table_foreach (priv->subscriptions,
-                              notify_subscriber,
-                              property_set);
+        g_hash_table_iter_init (&iter, priv->subscriptions);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                SubscriptionData *subscription = value;
+
+                if (notify_subscriber (subscription, property_set))
+                        continue;
+
+                shed = g_list_prepend (
+                        shed,
+                        subscription_data_copy_callbacks (subscription));
+
+                if (priv->notify_overflow_policy ==
+                    GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE)
+                        g_hash_table_iter_remove (&iter);
+        }
 
         /* Cleanup */
-        g_bytes_unref (property_set);
+        property_set_unref (property_set);
+
+        emit_subscriber_shed (service, shed);
 }
 
-/**
- * gupnp_service_notify_value:
- * @service: a #GUPnPService
- * @variable: the name of the variable to notify
- * @value: the value of the variable
- *
- * Notifies remote clients that @variable has changed to @value.
- **/
-void
-gupnp_service_notify_value (GUPnPService *service,
-                            const char   *variable,
-                            const GValue *value)
+/* Queue @value of @variable for the next property set */
+static void
+queue_notification (GUPnPService *service,
+                    const char   *variable,
+                    const GValue *value)
 {
         NotifyData *data;
         GUPnPServicePrivate *priv;
 
-        g_return_if_fail (GUPNP_IS_SERVICE (service));
-        g_return_if_fail (variable != NULL);
-        g_return_if_fail (G_IS_VALUE (value));
-
         priv = gupnp_service_get_instance_private (service);
 
         /* Queue */
@@ -1615,47 +2419,972 @@ gupnp_service_notify_value (GUPnPService *service,
                 flush_notifications (service);
 }
 
-/**
- * gupnp_service_freeze_notify:
- * @service: a #GUPnPService
- *
- * Stops sending out notifications to remote clients.
- *
- * It causes new notifications to be queued up until [method@GUPnP.Service.thaw_notify] is called.
- **/
-void
-gupnp_service_freeze_notify (GUPnPService *service)
+static gboolean
+value_get_double (const GValue *value, double *result)
 {
-        GUPnPServicePrivate *priv;
+        GValue tmp = G_VALUE_INIT;
 
-        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        if (!g_value_type_transformable (G_VALUE_TYPE (value), G_TYPE_DOUBLE))
+                return FALSE;
 
-        priv = gupnp_service_get_instance_private (service);
+        g_value_init (&tmp, G_TYPE_DOUBLE);
+        if (!g_value_transform (value, &tmp))
+                return FALSE;
 
-        priv->notify_frozen = TRUE;
+        *result = g_value_get_double (&tmp);
+
+        return TRUE;
 }
 
-/**
- * gupnp_service_thaw_notify:
- * @service: a #GUPnPService
- *
- * Sends out any pending notifications, and stops queuing of new ones.
- **/
-void
-gupnp_service_thaw_notify (GUPnPService *service)
+static void
+moderation_data_set_last_value (ModerationData *data,
+                                const GValue   *value)
 {
-        GUPnPServicePrivate *priv;
+        if (G_IS_VALUE (&data->last_value))
+                g_value_unset (&data->last_value);
 
-        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_value_init (&data->last_value, G_VALUE_TYPE (value));
+        g_value_copy (value, &data->last_value);
 
-        priv = gupnp_service_get_instance_private (service);
+        data->last_sent = g_get_monotonic_time ();
+}
 
-        priv->notify_frozen = FALSE;
+/* Trailing edge of the rate window: Send the value that was held back */
+static gboolean
+moderation_flush_timeout (gpointer user_data)
+{
+        ModerationData *data = user_data;
 
-        if (g_queue_get_length (priv->notify_queue) == 0)
-                return; /* Empty notify queue */
+        data->flush_src = NULL;
 
-        flush_notifications (service);
+        if (!G_IS_VALUE (&data->pending_value))
+                return G_SOURCE_REMOVE;
+
+        moderation_data_set_last_value (data, &data->pending_value);
+        g_value_unset (&data->pending_value);
+
+        queue_notification (data->service,
+                            data->variable,
+                            &data->last_value);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Returns %TRUE if @value may be evented right away. Otherwise it is kept as
+ * the pending value of @data, replacing any previously held value */
+static gboolean
+moderation_data_accept (ModerationData *data, const GValue *value)
+{
+        gint64 now;
+        gint64 window_end;
+        gboolean hold = FALSE;
+
+        now = g_get_monotonic_time ();
+        window_end = data->last_sent + (gint64) data->max_rate * 1000;
+
+        if (G_IS_VALUE (&data->last_value)) {
+                double last, current;
+
+                if (data->max_rate > 0 && now < window_end)
+                        hold = TRUE;
+                else if (data->min_delta > 0.0 &&
+                         value_get_double (&data->last_value, &last) &&
+                         value_get_double (value, &current) &&
+                         ABS (current - last) < data->min_delta)
+                        hold = TRUE;
+        }
+
+        if (!hold) {
+                moderation_data_set_last_value (data, value);
+
+                if (G_IS_VALUE (&data->pending_value))
+                        g_value_unset (&data->pending_value);
+
+                if (data->flush_src != NULL) {
+                        g_source_destroy (data->flush_src);
+                        data->flush_src = NULL;
+                }
+
+                return TRUE;
+        }
+
+        /* Coalesce into the latest value */
+        if (G_IS_VALUE (&data->pending_value))
+                g_value_unset (&data->pending_value);
+
+        g_value_init (&data->pending_value, G_VALUE_TYPE (value));
+        g_value_copy (value, &data->pending_value);
+
+        if (data->flush_trailing && data->flush_src == NULL) {
+                guint delay;
+
+                if (data->max_rate == 0)
+                        delay = MODERATION_SETTLE_TIME;
+                else if (now < window_end)
+                        delay = (guint) ((window_end - now + 999) / 1000);
+                else
+                        delay = data->max_rate;
+
+                data->flush_src = g_timeout_source_new (delay);
+                g_source_set_callback (data->flush_src,
+                                       moderation_flush_timeout,
+                                       data,
+                                       NULL);
+                g_source_attach (data->flush_src,
+                                 g_main_context_get_thread_default ());
+                g_source_unref (data->flush_src);
+        }
+
+        return FALSE;
+}
+
+/**
+ * gupnp_service_notify_value:
+ * @service: a #GUPnPService
+ * @variable: the name of the variable to notify
+ * @value: the value of the variable
+ *
+ * Notifies remote clients that @variable has changed to @value.
+ *
+ * If an event moderation policy is set for @variable using
+ * [method@GUPnP.Service.set_event_moderation], the change might be held back
+ * and merged with later changes.
+ *
+ * If [property@GUPnP.Service:use-state-store] is enabled, @value also becomes
+ * the stored value of @variable.
+ **/
+void
+gupnp_service_notify_value (GUPnPService *service,
+                            const char   *variable,
+                            const GValue *value)
+{
+        GUPnPServicePrivate *priv;
+        ModerationData *moderation;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_return_if_fail (variable != NULL);
+        g_return_if_fail (G_IS_VALUE (value));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (priv->state_store != NULL) {
+                state_store_set (service, variable, value);
+                g_clear_pointer (&priv->initial_state, property_set_unref);
+        }
+
+        moderation = g_hash_table_lookup (priv->moderations, variable);
+        if (moderation != NULL && !moderation_data_accept (moderation, value))
+                return;
+
+        queue_notification (service, variable, value);
+}
+
+/**
+ * gupnp_service_set_event_moderation:
+ * @service: a #GUPnPService
+ * @variable: the name of an evented state variable
+ * @max_rate: the minimum time between two events for @variable in
+ * milliseconds, or 0
+ * @min_delta: the minimum change of a numeric @variable that causes an event,
+ * or 0
+ * @flush_trailing: whether to send a held-back value on its own once
+ * @max_rate has passed
+ *
+ * Sets up moderated eventing for @variable, as described in the UPnP Device
+ * Architecture.
+ *
+ * Changes passed to [method@GUPnP.Service.notify_value] that arrive less than
+ * @max_rate milliseconds after the last event for @variable, or that differ
+ * less than @min_delta from the last evented value, are not sent
+ * immediately. Instead, they are merged so that only the latest value is
+ * kept. It is sent with the next change that passes the policy or, if
+ * @flush_trailing is %TRUE, at the end of the current rate window. If
+ * @max_rate is 0, a value held back by @min_delta is then sent at most 200
+ * milliseconds later.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_event_moderation (GUPnPService *service,
+                                    const char   *variable,
+                                    guint         max_rate,
+                                    double        min_delta,
+                                    gboolean      flush_trailing)
+{
+        GUPnPServicePrivate *priv;
+        GUPnPServiceIntrospection *introspection;
+        ModerationData *data;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_return_if_fail (variable != NULL);
+        g_return_if_fail (min_delta >= 0.0);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        introspection = gupnp_service_info_get_introspection (
+                GUPNP_SERVICE_INFO (service));
+        if (introspection != NULL) {
+                const GUPnPServiceStateVariableInfo *info;
+
+                info = gupnp_service_introspection_get_state_variable (
+                        introspection,
+                        variable);
+                if (info != NULL && !info->send_events)
+                        g_warning ("State variable %s is not evented",
+                                   variable);
+                else if (info != NULL && !info->is_numeric &&
+                         min_delta > 0.0)
+                        g_warning ("State variable %s is not numeric, "
+                                   "ignoring minimum delta",
+                                   variable);
+        }
+
+        data = g_slice_new0 (ModerationData);
+        data->service = service;
+        data->variable = g_strdup (variable);
+        data->max_rate = max_rate;
+        data->min_delta = min_delta;
+        data->flush_trailing = flush_trailing;
+
+        /* Keep what was sent last under the old policy */
+        ModerationData *old = g_hash_table_lookup (priv->moderations,
+                                                   variable);
+        if (old != NULL && G_IS_VALUE (&old->last_value)) {
+                moderation_data_set_last_value (data, &old->last_value);
+                data->last_sent = old->last_sent;
+        }
+
+        /* A value held back by the old policy is sent right away */
+        if (old != NULL && G_IS_VALUE (&old->pending_value)) {
+                moderation_data_set_last_value (data, &old->pending_value);
+                queue_notification (service, variable, &old->pending_value);
+        }
+
+        g_hash_table_replace (priv->moderations, data->variable, data);
+}
+
+/**
+ * gupnp_service_unset_event_moderation:
+ * @service: a #GUPnPService
+ * @variable: the name of an evented state variable
+ *
+ * Removes the event moderation policy of @variable, if any. A value that was
+ * held back by the policy is sent out immediately.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_unset_event_moderation (GUPnPService *service,
+                                      const char   *variable)
+{
+        GUPnPServicePrivate *priv;
+        ModerationData *data;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_return_if_fail (variable != NULL);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        data = g_hash_table_lookup (priv->moderations, variable);
+        if (data == NULL)
+                return;
+
+        g_hash_table_steal (priv->moderations, variable);
+
+        if (G_IS_VALUE (&data->pending_value))
+                queue_notification (service, variable, &data->pending_value);
+
+        moderation_data_free (data);
+}
+
+/* A change of a variable of one instance, waiting in the LastChange
+ * accumulator */
+typedef struct {
+        char *variable;
+        char *channel; /* Or NULL */
+        char *value;   /* Escaped for use as attribute value */
+} LastChangeEntry;
+
+typedef struct {
+        guint      instance_id;
+        GPtrArray *entries; /* LastChangeEntry, in order of first change */
+} LastChangeInstance;
+
+static void
+last_change_entry_free (LastChangeEntry *entry)
+{
+        g_free (entry->variable);
+        g_free (entry->channel);
+        g_free (entry->value);
+
+        g_slice_free (LastChangeEntry, entry);
+}
+
+static void
+last_change_instance_free (LastChangeInstance *instance)
+{
+        g_ptr_array_unref (instance->entries);
+
+        g_slice_free (LastChangeInstance, instance);
+}
+
+static const char *
+last_change_namespace (GUPnPService *service)
+{
+        const char *type;
+
+        type = gupnp_service_info_get_service_type (GUPNP_SERVICE_INFO (service));
+        if (type != NULL && strstr (type, ":RenderingControl:") != NULL)
+                return "urn:schemas-upnp-org:metadata-1-0/RCS/";
+
+        return "urn:schemas-upnp-org:metadata-1-0/AVT/";
+}
+
+/* Send everything accumulated so far as one LastChange event */
+static void
+last_change_flush (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+        GValue value = G_VALUE_INIT;
+        GString *doc;
+        guint i, j;
+
+        priv = gupnp_service_get_instance_private (service);
+        if (priv->last_change == NULL || priv->last_change->len == 0)
+                return;
+
+        doc = g_string_new ("<Event xmlns=\"");
+        g_string_append (doc, last_change_namespace (service));
+        g_string_append (doc, "\">");
+
+        for (i = 0; i < priv->last_change->len; i++) {
+                LastChangeInstance *instance =
+                        g_ptr_array_index (priv->last_change, i);
+
+                g_string_append_printf (doc,
+                                        "<InstanceID val=\"%u\">",
+                                        instance->instance_id);
+
+                for (j = 0; j < instance->entries->len; j++) {
+                        LastChangeEntry *entry =
+                                g_ptr_array_index (instance->entries, j);
+
+                        g_string_append_c (doc, '<');
+                        g_string_append (doc, entry->variable);
+                        if (entry->channel != NULL) {
+                                g_string_append (doc, " channel=\"");
+                                xml_util_add_content (doc, entry->channel);
+                                g_string_append_c (doc, '"');
+                        }
+                        g_string_append (doc, " val=\"");
+                        g_string_append (doc, entry->value);
+                        g_string_append (doc, "\"/>");
+                }
+
+                g_string_append (doc, "</InstanceID>");
+        }
+
+        g_string_append (doc, "</Event>");
+        g_ptr_array_set_size (priv->last_change, 0);
+
+        priv->last_change_sent = g_get_monotonic_time ();
+
+        g_value_init (&value, G_TYPE_STRING);
+        g_value_take_string (&value, g_string_free (doc, FALSE));
+        gupnp_service_notify_value (service, "LastChange", &value);
+        g_value_unset (&value);
+}
+
+static gboolean
+last_change_timeout (gpointer user_data)
+{
+        GUPnPService *service = GUPNP_SERVICE (user_data);
+        GUPnPServicePrivate *priv;
+
+        priv = gupnp_service_get_instance_private (service);
+        priv->last_change_src = NULL;
+
+        last_change_flush (service);
+
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * gupnp_service_add_last_change:
+ * @service: a #GUPnPService
+ * @instance_id: the InstanceID the change belongs to
+ * @variable: the name of the changed variable
+ * @channel: (nullable): the channel of @variable, such as "Master" for
+ * `Volume`, or %NULL
+ * @value: the new value of @variable
+ *
+ * Records a change for the `LastChange` state variable used by
+ * AVTransport and RenderingControl services.
+ *
+ * Changes are merged per @instance_id, @variable and @channel, keeping the
+ * latest @value, and sent as a single `LastChange` event at most once every
+ * [property@GUPnP.Service:last-change-interval] milliseconds. Changes made
+ * during one main loop iteration always end up in the same event.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_add_last_change (GUPnPService *service,
+                               guint         instance_id,
+                               const char   *variable,
+                               const char   *channel,
+                               const GValue *value)
+{
+        GUPnPServicePrivate *priv;
+        LastChangeInstance *instance = NULL;
+        LastChangeEntry *entry = NULL;
+        GString *str;
+        guint i;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_return_if_fail (variable != NULL);
+        g_return_if_fail (G_IS_VALUE (value));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        str = g_string_new (NULL);
+        if (!gvalue_util_value_append_to_xml_string (value, str)) {
+                g_warning ("Failed to convert value of %s for LastChange",
+                           variable);
+                g_string_free (str, TRUE);
+
+                return;
+        }
+
+        if (priv->last_change == NULL)
+                priv->last_change = g_ptr_array_new_with_free_func (
+                        (GDestroyNotify) last_change_instance_free);
+
+        /* Devices rarely have more than a handful of instances and
+         * variables, so a linear search is fine */
+        for (i = 0; i < priv->last_change->len; i++) {
+                LastChangeInstance *tmp =
+                        g_ptr_array_index (priv->last_change, i);
+
+                if (tmp->instance_id == instance_id) {
+                        instance = tmp;
+
+                        break;
+                }
+        }
+
+        if (instance == NULL) {
+                instance = g_slice_new (LastChangeInstance);
+                instance->instance_id = instance_id;
+                instance->entries = g_ptr_array_new_with_free_func (
+                        (GDestroyNotify) last_change_entry_free);
+                g_ptr_array_add (priv->last_change, instance);
+        }
+
+        for (i = 0; i < instance->entries->len; i++) {
+                LastChangeEntry *tmp = g_ptr_array_index (instance->entries, i);
+
+                if (g_str_equal (tmp->variable, variable) &&
+                    g_strcmp0 (tmp->channel, channel) == 0) {
+                        entry = tmp;
+
+                        break;
+                }
+        }
+
+        if (entry == NULL) {
+                entry = g_slice_new (LastChangeEntry);
+                entry->variable = g_strdup (variable);
+                entry->channel = g_strdup (channel);
+                g_ptr_array_add (instance->entries, entry);
+        } else {
+                g_free (entry->value);
+        }
+
+        entry->value = g_string_free (str, FALSE);
+
+        if (priv->last_change_src == NULL) {
+                gint64 window_end;
+                gint64 now;
+                guint delay = 0;
+
+                now = g_get_monotonic_time ();
+                window_end = priv->last_change_sent +
+                             (gint64) priv->last_change_interval * 1000;
+                if (priv->last_change_sent != 0 && now < window_end)
+                        delay = (guint) ((window_end - now + 999) / 1000);
+
+                priv->last_change_src = g_timeout_source_new (delay);
+                g_source_set_callback (priv->last_change_src,
+                                       last_change_timeout,
+                                       service,
+                                       NULL);
+                g_source_attach (priv->last_change_src,
+                                 g_main_context_get_thread_default ());
+                g_source_unref (priv->last_change_src);
+        }
+}
+
+/**
+ * gupnp_service_set_last_change_interval:
+ * @service: a #GUPnPService
+ * @interval: the minimum time between two LastChange events in
+ * milliseconds
+ *
+ * Sets the rate of LastChange events. See
+ * [property@GUPnP.Service:last-change-interval].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_last_change_interval (GUPnPService *service,
+                                        guint         interval)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (priv->last_change_interval == interval)
+                return;
+
+        priv->last_change_interval = interval;
+        g_object_notify (G_OBJECT (service), "last-change-interval");
+}
+
+/**
+ * gupnp_service_get_last_change_interval:
+ * @service: a #GUPnPService
+ *
+ * Get the minimum time between two LastChange events.
+ *
+ * Returns: The interval in milliseconds
+ *
+ * Since: 1.6.10
+ **/
+guint
+gupnp_service_get_last_change_interval (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE (service),
+                              DEFAULT_LAST_CHANGE_INTERVAL);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        return priv->last_change_interval;
+}
+
+/**
+ * gupnp_service_freeze_notify:
+ * @service: a #GUPnPService
+ *
+ * Stops sending out notifications to remote clients.
+ *
+ * It causes new notifications to be queued up until [method@GUPnP.Service.thaw_notify] is called.
+ **/
+void
+gupnp_service_freeze_notify (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        priv->notify_frozen = TRUE;
+}
+
+/**
+ * gupnp_service_thaw_notify:
+ * @service: a #GUPnPService
+ *
+ * Sends out any pending notifications, and stops queuing of new ones.
+ **/
+void
+gupnp_service_thaw_notify (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        priv->notify_frozen = FALSE;
+
+        if (g_queue_get_length (priv->notify_queue) == 0)
+                return; /* Empty notify queue */
+
+        flush_notifications (service);
+}
+
+/**
+ * gupnp_service_set_notify_keep_alive:
+ * @service: a #GUPnPService
+ * @keep_alive: %TRUE to reuse connections to subscribers
+ *
+ * Sets whether the connection to a subscriber is kept open between event
+ * notifications. See [property@GUPnP.Service:notify-keep-alive].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_notify_keep_alive (GUPnPService *service,
+                                     gboolean      keep_alive)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        keep_alive = !!keep_alive;
+        if (priv->notify_keep_alive == keep_alive)
+                return;
+
+        priv->notify_keep_alive = keep_alive;
+        g_object_notify (G_OBJECT (service), "notify-keep-alive");
+}
+
+/**
+ * gupnp_service_get_notify_keep_alive:
+ * @service: a #GUPnPService
+ *
+ * Get whether connections to subscribers are kept open between
+ * notifications.
+ *
+ * Returns: %TRUE if connections to subscribers are reused
+ *
+ * Since: 1.6.10
+ **/
+gboolean
+gupnp_service_get_notify_keep_alive (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE (service), FALSE);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        return priv->notify_keep_alive;
+}
+
+/**
+ * gupnp_service_set_max_notify_in_flight:
+ * @service: a #GUPnPService
+ * @max_in_flight: the maximum number of concurrent notifications per
+ * subscriber, at least 1
+ *
+ * Limits how many event notifications are sent to a single subscriber at
+ * the same time. See [property@GUPnP.Service:max-notify-in-flight].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_max_notify_in_flight (GUPnPService *service,
+                                        guint         max_in_flight)
+{
+        GUPnPServicePrivate *priv;
+        GHashTableIter iter;
+        gpointer data;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_return_if_fail (max_in_flight > 0);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (priv->max_notify_in_flight == max_in_flight)
+                return;
+
+        priv->max_notify_in_flight = max_in_flight;
+
+        /* Raising the limit may allow more queued messages to go out */
+        g_hash_table_iter_init (&iter, priv->subscriptions);
+        while (g_hash_table_iter_next (&iter, NULL, &data))
+                subscription_data_send_pending ((SubscriptionData *) data);
+
+        g_object_notify (G_OBJECT (service), "max-notify-in-flight");
+}
+
+/**
+ * gupnp_service_get_max_notify_in_flight:
+ * @service: a #GUPnPService
+ *
+ * Get the maximum number of concurrent event notifications per subscriber.
+ *
+ * Returns: The in-flight limit for notifications
+ *
+ * Since: 1.6.10
+ **/
+guint
+gupnp_service_get_max_notify_in_flight (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE (service),
+                              DEFAULT_MAX_NOTIFY_IN_FLIGHT);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        return priv->max_notify_in_flight;
+}
+
+/**
+ * gupnp_service_set_max_pending_notifications:
+ * @service: a #GUPnPService
+ * @max_pending: the maximum number of queued notifications per subscriber,
+ * or 0 for no limit
+ *
+ * Bounds the notification queue of each subscriber. See
+ * [property@GUPnP.Service:max-pending-notifications].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_max_pending_notifications (GUPnPService *service,
+                                             guint         max_pending)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (priv->max_pending_notifications == max_pending)
+                return;
+
+        priv->max_pending_notifications = max_pending;
+        g_object_notify (G_OBJECT (service), "max-pending-notifications");
+}
+
+/**
+ * gupnp_service_get_max_pending_notifications:
+ * @service: a #GUPnPService
+ *
+ * Get the maximum number of queued notifications per subscriber.
+ *
+ * Returns: The queue limit, or 0 if the queue is not bounded
+ *
+ * Since: 1.6.10
+ **/
+guint
+gupnp_service_get_max_pending_notifications (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE (service), 0);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        return priv->max_pending_notifications;
+}
+
+/**
+ * gupnp_service_set_notify_overflow_policy:
+ * @service: a #GUPnPService
+ * @policy: a #GUPnPServiceNotifyOverflowPolicy
+ *
+ * Set what to do when the notification queue of a subscriber is full. See
+ * [property@GUPnP.Service:notify-overflow-policy].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_notify_overflow_policy (
+        GUPnPService                    *service,
+        GUPnPServiceNotifyOverflowPolicy policy)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (priv->notify_overflow_policy == policy)
+                return;
+
+        priv->notify_overflow_policy = policy;
+        g_object_notify (G_OBJECT (service), "notify-overflow-policy");
+}
+
+/**
+ * gupnp_service_get_notify_overflow_policy:
+ * @service: a #GUPnPService
+ *
+ * Get what is done when the notification queue of a subscriber is full.
+ *
+ * Returns: The overflow policy
+ *
+ * Since: 1.6.10
+ **/
+GUPnPServiceNotifyOverflowPolicy
+gupnp_service_get_notify_overflow_policy (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE (service),
+                              GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_MERGE);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        return priv->notify_overflow_policy;
+}
+
+/**
+ * gupnp_service_set_use_state_store:
+ * @service: a #GUPnPService
+ * @use_state_store: whether to keep the values of state variables
+ *
+ * Enable or disable the state store of @service. Disabling it drops all
+ * stored values. See [property@GUPnP.Service:use-state-store].
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_use_state_store (GUPnPService *service,
+                                   gboolean      use_state_store)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if ((priv->state_store != NULL) == !!use_state_store)
+                return;
+
+        if (use_state_store)
+                priv->state_store = g_hash_table_new_full (g_str_hash,
+                                                           g_str_equal,
+                                                           g_free,
+                                                           gvalue_free);
+        else
+                g_clear_pointer (&priv->state_store, g_hash_table_destroy);
+
+        g_clear_pointer (&priv->initial_state, property_set_unref);
+
+        g_object_notify (G_OBJECT (service), "use-state-store");
+}
+
+/**
+ * gupnp_service_get_use_state_store:
+ * @service: a #GUPnPService
+ *
+ * Get whether @service keeps the values of its state variables.
+ *
+ * Returns: %TRUE if the state store is enabled
+ *
+ * Since: 1.6.10
+ **/
+gboolean
+gupnp_service_get_use_state_store (GUPnPService *service)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_val_if_fail (GUPNP_IS_SERVICE (service), FALSE);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        return priv->state_store != NULL;
+}
+
+/**
+ * gupnp_service_set_action_handler:
+ * @service: a #GUPnPService
+ * @action_name: the name of the action
+ * @handler: (nullable) (scope notified) (closure user_data) (destroy destroy):
+ * the function to call when @action_name is invoked, or %NULL
+ * @user_data: user data for @handler
+ * @destroy: (nullable): a function to free @user_data
+ *
+ * Directly handle invocations of @action_name with @handler.
+ *
+ * Invocations of actions that have a handler are dispatched with a single
+ * lookup and do not emit [signal@GUPnP.Service::action-invoked]. Like a
+ * signal handler, @handler must call either
+ * [method@GUPnP.ServiceAction.return_success] or
+ * [method@GUPnP.ServiceAction.return_error].
+ *
+ * Setting a new handler replaces the previous one. Passing %NULL as @handler
+ * removes it, so the signal is emitted again.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_action_handler (GUPnPService             *service,
+                                  const char               *action_name,
+                                  GUPnPServiceActionHandler handler,
+                                  gpointer                  user_data,
+                                  GDestroyNotify            destroy)
+{
+        GUPnPServicePrivate *priv;
+        ActionHandlerData *data;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_return_if_fail (action_name != NULL);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (handler == NULL) {
+                g_hash_table_remove (priv->action_handlers, action_name);
+
+                if (destroy != NULL)
+                        destroy (user_data);
+
+                return;
+        }
+
+        data = g_slice_new0 (ActionHandlerData);
+        data->handler = handler;
+        data->user_data = user_data;
+        data->destroy = destroy;
+
+        g_hash_table_replace (priv->action_handlers,
+                              g_strdup (action_name),
+                              data);
+}
+
+/**
+ * gupnp_service_set_action_offload:
+ * @service: a #GUPnPService
+ * @action_name: the name of the action
+ * @offload: whether to invoke @action_name in a worker thread
+ *
+ * Invoke @action_name in a worker thread instead of the main context that
+ * received it, so long-running actions do not block discovery, eventing and
+ * other actions.
+ *
+ * The handler set with [method@GUPnP.Service.set_action_handler], or the
+ * handlers of [signal@GUPnP.Service::action-invoked], are then called in a
+ * worker thread and must be thread-safe. Calling
+ * [method@GUPnP.ServiceAction.return_success] or
+ * [method@GUPnP.ServiceAction.return_error] from there is allowed; the
+ * response is sent from the main context that received the action. The
+ * #SoupServerMessage of the action is only used on that context, so the
+ * message returned by [method@GUPnP.ServiceAction.get_message] must not be
+ * used in the worker. Do not change the handler of @action_name while
+ * invocations are running.
+ *
+ * Since: 1.6.10
+ **/
+void
+gupnp_service_set_action_offload (GUPnPService *service,
+                                  const char   *action_name,
+                                  gboolean      offload)
+{
+        GUPnPServicePrivate *priv;
+
+        g_return_if_fail (GUPNP_IS_SERVICE (service));
+        g_return_if_fail (action_name != NULL);
+
+        priv = gupnp_service_get_instance_private (service);
+
+        if (offload)
+                g_hash_table_add (priv->offloaded_actions,
+                                  g_strdup (action_name));
+        else
+                g_hash_table_remove (priv->offloaded_actions, action_name);
 }
 
 /* Convert a CamelCase string to a lowercase string with underscores */
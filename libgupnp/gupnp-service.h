@@ -34,6 +34,41 @@ gupnp_service_action_get_type (void) G_GNUC_CONST;
 
 #define GUPNP_TYPE_SERVICE_ACTION (gupnp_service_action_get_type ())
 
+/**
+ * GUPnPServiceNotifyOverflowPolicy:
+ * @GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_MERGE: Merge all notifications that
+ * have not been sent yet into a single one carrying the latest value of
+ * each variable.
+ * @GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_DROP_OLDEST: Drop the oldest
+ * notification that has not been sent yet.
+ * @GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE: Cancel the subscription.
+ *
+ * What to do when the notification queue of a subscriber is full.
+ *
+ * Since: 1.6.10
+ **/
+typedef enum
+{
+        GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_MERGE,
+        GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_DROP_OLDEST,
+        GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE
+} GUPnPServiceNotifyOverflowPolicy;
+
+/**
+ * GUPnPServiceActionHandler:
+ * @service: the #GUPnPService the action was invoked on
+ * @action: the invoked #GUPnPServiceAction
+ * @user_data: user data passed to [method@GUPnP.Service.set_action_handler]
+ *
+ * Handles an invocation of an action. See
+ * [method@GUPnP.Service.set_action_handler].
+ *
+ * Since: 1.6.10
+ **/
+typedef void (* GUPnPServiceActionHandler) (GUPnPService       *service,
+                                            GUPnPServiceAction *action,
+                                            gpointer            user_data);
+
 struct _GUPnPServiceClass {
         GUPnPServiceInfoClass parent_class;
 
@@ -96,6 +131,18 @@ gupnp_service_action_set_value    (GUPnPServiceAction *action,
                                    const char         *argument,
                                    const GValue       *value);
 
+void
+gupnp_service_action_stream_begin (GUPnPServiceAction *action,
+                                   const char         *argument);
+
+void
+gupnp_service_action_stream_write (GUPnPServiceAction *action,
+                                   const char         *data,
+                                   gssize              length);
+
+void
+gupnp_service_action_stream_end   (GUPnPServiceAction *action);
+
 void
 gupnp_service_action_return_success (GUPnPServiceAction *action);
 
@@ -120,12 +167,85 @@ gupnp_service_notify_value        (GUPnPService *service,
                                    const char   *variable,
                                    const GValue *value);
 
+void
+gupnp_service_set_event_moderation (GUPnPService *service,
+                                    const char   *variable,
+                                    guint         max_rate,
+                                    double        min_delta,
+                                    gboolean      flush_trailing);
+
+void
+gupnp_service_unset_event_moderation (GUPnPService *service,
+                                      const char   *variable);
+
+void
+gupnp_service_add_last_change     (GUPnPService *service,
+                                   guint         instance_id,
+                                   const char   *variable,
+                                   const char   *channel,
+                                   const GValue *value);
+
+void
+gupnp_service_set_last_change_interval (GUPnPService *service,
+                                        guint         interval);
+
+guint
+gupnp_service_get_last_change_interval (GUPnPService *service);
+
 void
 gupnp_service_freeze_notify       (GUPnPService *service);
 
 void
 gupnp_service_thaw_notify         (GUPnPService *service);
 
+void
+gupnp_service_set_notify_keep_alive (GUPnPService *service,
+                                     gboolean      keep_alive);
+
+gboolean
+gupnp_service_get_notify_keep_alive (GUPnPService *service);
+
+void
+gupnp_service_set_max_notify_in_flight (GUPnPService *service,
+                                        guint         max_in_flight);
+
+guint
+gupnp_service_get_max_notify_in_flight (GUPnPService *service);
+
+void
+gupnp_service_set_max_pending_notifications (GUPnPService *service,
+                                             guint         max_pending);
+
+guint
+gupnp_service_get_max_pending_notifications (GUPnPService *service);
+
+void
+gupnp_service_set_notify_overflow_policy (
+        GUPnPService                    *service,
+        GUPnPServiceNotifyOverflowPolicy policy);
+
+GUPnPServiceNotifyOverflowPolicy
+gupnp_service_get_notify_overflow_policy (GUPnPService *service);
+
+void
+gupnp_service_set_use_state_store (GUPnPService *service,
+                                   gboolean      use_state_store);
+
+gboolean
+gupnp_service_get_use_state_store (GUPnPService *service);
+
+void
+gupnp_service_set_action_handler (GUPnPService             *service,
+                                  const char               *action_name,
+                                  GUPnPServiceActionHandler handler,
+                                  gpointer                  user_data,
+                                  GDestroyNotify            destroy);
+
+void
+gupnp_service_set_action_offload (GUPnPService *service,
+                                  const char   *action_name,
+                                  gboolean      offload);
+
 void
 gupnp_service_signals_autoconnect (GUPnPService *service,
                                    gpointer      user_data,
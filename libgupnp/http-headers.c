@@ -271,15 +271,37 @@ http_response_set_content_type (SoupMessageHeaders *response_headers,
         g_free (content_type);
 }
 
+/* Compressors are expensive to set up, so every thread keeps one around
+ * and resets it for the next response */
+static GPrivate gzip_compressor = G_PRIVATE_INIT (g_object_unref);
+
+static GConverter *
+http_get_gzip_compressor (void)
+{
+        GConverter *compressor = g_private_get (&gzip_compressor);
+
+        if (compressor == NULL) {
+                compressor = G_CONVERTER (
+                        g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP,
+                                               -1));
+                g_private_set (&gzip_compressor, compressor);
+        } else {
+                g_converter_reset (compressor);
+        }
+
+        return compressor;
+}
+
 /* Set Content-Encoding header to gzip and append compressed body */
 void
 http_response_set_body_gzip (SoupServerMessage *msg,
                              const char *body,
                              const gsize length)
 {
-        GZlibCompressor *compressor;
+        GConverter *compressor;
         gboolean finished = FALSE;
         gsize converted = 0;
+        gsize chunk_size;
 
         SoupMessageBody *message_body =
                 soup_server_message_get_response_body (msg);
@@ -290,45 +312,116 @@ http_response_set_body_gzip (SoupServerMessage *msg,
                                      "Content-Encoding",
                                      "gzip");
 
-        compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+        compressor = http_get_gzip_compressor ();
+
+        /* XML usually shrinks to well below a quarter, so this is mostly a
+         * single chunk */
+        chunk_size = CLAMP (length / 4, HTTP_GZIP_MIN_CHUNK_SIZE,
+                            HTTP_GZIP_MAX_CHUNK_SIZE);
 
         while (! finished) {
                 GError *error = NULL;
-                char buf[65536];
+                char *buf = g_malloc (chunk_size);
+                gsize written = 0;
+
+                /* Fill the chunk before handing it to libsoup */
+                while (written < chunk_size && ! finished) {
+                        gsize bytes_read = 0;
+                        gsize bytes_written = 0;
+
+                        switch (g_converter_convert (compressor,
+                                                     body + converted,
+                                                     length - converted,
+                                                     buf + written,
+                                                     chunk_size - written,
+                                                     G_CONVERTER_INPUT_AT_END,
+                                                     &bytes_read,
+                                                     &bytes_written,
+                                                     &error)) {
+                        case G_CONVERTER_ERROR:
+                                g_warning ("Error compressing response: %s",
+                                           error->message);
+                                g_error_free (error);
+                                g_free (buf);
+
+                                return;
+                        case G_CONVERTER_FINISHED:
+                                finished = TRUE;
+                                break;
+                        case G_CONVERTER_CONVERTED:
+                        case G_CONVERTER_FLUSHED:
+                        default:
+                                break;
+                        }
+
+                        converted += bytes_read;
+                        written += bytes_written;
+                }
+
+                if (written > 0) {
+                        GBytes *bytes = g_bytes_new_take (buf, written);
+
+                        soup_message_body_append_bytes (message_body, bytes);
+                        g_bytes_unref (bytes);
+                } else {
+                        g_free (buf);
+                }
+        }
+}
+
+/* Feed @length bytes of @data to @compressor and return what it produced,
+ * which might be nothing. With @finish, the stream is terminated */
+GBytes *
+http_gzip_convert (GConverter *compressor,
+                   const char *data,
+                   gsize       length,
+                   gboolean    finish)
+{
+        GByteArray *out;
+        gsize converted = 0;
+        GConverterFlags flags;
+
+        flags = finish ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS;
+        out = g_byte_array_sized_new (length / 2 + 64);
+
+        while (TRUE) {
+                GError *error = NULL;
                 gsize bytes_read = 0;
                 gsize bytes_written = 0;
-
-                switch (g_converter_convert (G_CONVERTER (compressor),
-                                             body + converted,
-                                             length - converted,
-                                             buf, sizeof (buf),
-                                             G_CONVERTER_INPUT_AT_END,
-                                             &bytes_read, &bytes_written,
-                                             &error)) {
-                case G_CONVERTER_ERROR:
-                        g_warning ("Error compressing response: %s",
-                                   error->message);
+                guint offset = out->len;
+                GConverterResult result;
+
+                g_byte_array_set_size (out, offset + MAX (length / 2, 4096));
+                result = g_converter_convert (compressor,
+                                              data + converted,
+                                              length - converted,
+                                              out->data + offset,
+                                              out->len - offset,
+                                              flags,
+                                              &bytes_read,
+                                              &bytes_written,
+                                              &error);
+                g_byte_array_set_size (out, offset + bytes_written);
+                converted += bytes_read;
+
+                if (result == G_CONVERTER_ERROR) {
+                        /* All input consumed, zlib keeps the rest */
+                        if (!g_error_matches (error,
+                                              G_IO_ERROR,
+                                              G_IO_ERROR_PARTIAL_INPUT))
+                                g_warning ("Error compressing response: %s",
+                                           error->message);
                         g_error_free (error);
-                        g_object_unref (compressor);
-                        return;
-                case G_CONVERTER_CONVERTED:
-                        converted += bytes_read;
-                        break;
-                case G_CONVERTER_FINISHED:
-                        finished = TRUE;
-                        break;
-                case G_CONVERTER_FLUSHED:
-                        break;
-                default:
+
                         break;
                 }
 
-                if (bytes_written)
-                        soup_message_body_append (message_body,
-                                                  SOUP_MEMORY_COPY,
-                                                  buf,
-                                                  bytes_written);
+                if (result == G_CONVERTER_FINISHED)
+                        break;
+
+                if (!finish && converted == length && bytes_written == 0)
+                        break;
         }
 
-        g_object_unref (compressor);
+        return g_byte_array_free_to_bytes (out);
 }
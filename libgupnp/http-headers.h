@@ -9,6 +9,7 @@
 #ifndef GUPNP_HTTP_HEADERS_H
 #define GUPNP_HTTP_HEADERS_H
 
+#include <gio/gio.h>
 #include <libsoup/soup-message.h>
 
 G_BEGIN_DECLS
@@ -41,11 +42,24 @@ http_response_set_content_range  (SoupMessage  *message,
                                   gsize         length,
                                   gsize         total);
 
+/* Responses smaller than this are not worth compressing; they fit into a
+ * single packet either way */
+#define HTTP_GZIP_THRESHOLD 1400
+
+#define HTTP_GZIP_MIN_CHUNK_SIZE 4096
+#define HTTP_GZIP_MAX_CHUNK_SIZE 65536
+
 G_GNUC_INTERNAL void
 http_response_set_body_gzip (SoupServerMessage *msg,
                              const char *body,
                              const gsize length);
 
+G_GNUC_INTERNAL GBytes *
+http_gzip_convert (GConverter *compressor,
+                   const char *data,
+                   gsize       length,
+                   gboolean    finish);
+
 G_END_DECLS
 
 #endif /* GUPNP_HTTP_HEADERS_H */
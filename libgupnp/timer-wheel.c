@@ -0,0 +1,290 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* A hierarchical timing wheel with a resolution of one second.
+ *
+ * Timers that expire within the next 256 seconds live in the slots of the
+ * first level, one slot per second. Timers that expire within the next
+ * 65536 seconds live in the second level, one slot per 256 seconds, and are
+ * moved down to the first level when their slot comes up. Anything further
+ * away waits in an overflow list that is re-sorted every 65536 seconds.
+ *
+ * Adding, re-arming and cancelling a timer are O(1), and the whole wheel is
+ * driven by a single one-second GSource that only exists while timers are
+ * pending.
+ */
+
+#include <config.h>
+
+#include "timer-wheel.h"
+
+/* The tests drive the wheel with a clock of their own */
+#ifndef TIMER_WHEEL_GET_TIME
+#define TIMER_WHEEL_GET_TIME() g_get_monotonic_time ()
+#endif
+
+#define WHEEL_BITS 8
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+
+struct _TimerWheelEntry {
+        GList          link; /* Embedded into one of the slot queues */
+        GQueue        *slot;
+        guint64        expires;
+        TimerWheelFunc func;
+        gpointer       user_data;
+};
+
+struct _TimerWheel {
+        GMainContext    *context;
+        GSource         *source;
+
+        gint64           start;
+        guint64          now; /* Last tick that was processed */
+
+        GQueue           near[WHEEL_SIZE];
+        GQueue           far[WHEEL_SIZE];
+        GQueue           overflow;
+
+        guint            n_entries;
+        TimerWheelEntry *current; /* Entry whose callback is running */
+};
+
+static guint64
+timer_wheel_get_tick (TimerWheel *wheel)
+{
+        return (TIMER_WHEEL_GET_TIME () - wheel->start) / G_USEC_PER_SEC;
+}
+
+static void
+timer_wheel_insert (TimerWheel *wheel, TimerWheelEntry *entry)
+{
+        guint64 delta;
+
+        if (entry->expires < wheel->now)
+                entry->expires = wheel->now;
+
+        delta = entry->expires - wheel->now;
+
+        if (delta < WHEEL_SIZE)
+                entry->slot = &wheel->near[entry->expires & WHEEL_MASK];
+        else if (delta < WHEEL_SIZE * WHEEL_SIZE)
+                entry->slot =
+                        &wheel->far[(entry->expires >> WHEEL_BITS) & WHEEL_MASK];
+        else
+                entry->slot = &wheel->overflow;
+
+        entry->link.data = entry;
+        g_queue_push_tail_link (entry->slot, &entry->link);
+}
+
+static void
+timer_wheel_unlink (TimerWheel *wheel, TimerWheelEntry *entry)
+{
+        g_queue_unlink (entry->slot, &entry->link);
+        entry->slot = NULL;
+        wheel->n_entries--;
+}
+
+/* Re-sort all entries of @slot relative to the current tick */
+static void
+timer_wheel_cascade (TimerWheel *wheel, GQueue *slot)
+{
+        GList *link;
+
+        link = slot->head;
+        g_queue_init (slot);
+
+        while (link != NULL) {
+                GList *next = link->next;
+
+                link->next = link->prev = NULL;
+                timer_wheel_insert (wheel, link->data);
+
+                link = next;
+        }
+}
+
+static void
+timer_wheel_advance (TimerWheel *wheel, guint64 target)
+{
+        while (wheel->now < target) {
+                guint64 tick = ++wheel->now;
+                GQueue *slot;
+                GList *link;
+
+                if ((tick & WHEEL_MASK) == 0) {
+                        if (((tick >> WHEEL_BITS) & WHEEL_MASK) == 0)
+                                timer_wheel_cascade (wheel, &wheel->overflow);
+
+                        timer_wheel_cascade (
+                                wheel,
+                                &wheel->far[(tick >> WHEEL_BITS) & WHEEL_MASK]);
+                }
+
+                slot = &wheel->near[tick & WHEEL_MASK];
+
+                /* The callback may cancel or add other entries, so always
+                 * start over at the head */
+                while ((link = g_queue_peek_head_link (slot)) != NULL) {
+                        TimerWheelEntry *entry = link->data;
+
+                        timer_wheel_unlink (wheel, entry);
+
+                        wheel->current = entry;
+                        entry->func (entry->user_data);
+                        wheel->current = NULL;
+
+                        /* Not re-armed from the callback */
+                        if (entry->slot == NULL)
+                                g_free (entry);
+                }
+        }
+}
+
+static gboolean
+timer_wheel_tick (gpointer user_data)
+{
+        TimerWheel *wheel = user_data;
+
+        timer_wheel_advance (wheel, timer_wheel_get_tick (wheel));
+
+        if (wheel->n_entries == 0) {
+                wheel->source = NULL;
+
+                return G_SOURCE_REMOVE;
+        }
+
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+timer_wheel_ensure_source (TimerWheel *wheel)
+{
+        if (wheel->source != NULL)
+                return;
+
+        /* Nothing is pending, so we can just skip the idle ticks */
+        if (wheel->n_entries == 0)
+                wheel->now = timer_wheel_get_tick (wheel);
+
+        wheel->source = g_timeout_source_new_seconds (1);
+        g_source_set_callback (wheel->source, timer_wheel_tick, wheel, NULL);
+        g_source_attach (wheel->source, wheel->context);
+        g_source_unref (wheel->source);
+}
+
+static void
+timer_wheel_arm (TimerWheel *wheel, TimerWheelEntry *entry, guint seconds)
+{
+        timer_wheel_ensure_source (wheel);
+
+        entry->expires = timer_wheel_get_tick (wheel) + MAX (seconds, 1);
+        if (entry->expires <= wheel->now)
+                entry->expires = wheel->now + 1;
+
+        timer_wheel_insert (wheel, entry);
+        wheel->n_entries++;
+}
+
+TimerWheel *
+timer_wheel_new (GMainContext *context)
+{
+        TimerWheel *wheel;
+
+        wheel = g_new0 (TimerWheel, 1);
+        wheel->context = g_main_context_ref (context);
+        wheel->start = TIMER_WHEEL_GET_TIME ();
+
+        return wheel;
+}
+
+static void
+timer_wheel_free_slot (GQueue *slot)
+{
+        GList *link = slot->head;
+
+        while (link != NULL) {
+                GList *next = link->next;
+
+                g_free (link->data);
+                link = next;
+        }
+
+        g_queue_init (slot);
+}
+
+void
+timer_wheel_free (TimerWheel *wheel)
+{
+        int i;
+
+        if (wheel->source != NULL)
+                g_source_destroy (wheel->source);
+
+        if (wheel->n_entries > 0)
+                g_warning ("Freeing timer wheel with %u pending timers",
+                           wheel->n_entries);
+
+        for (i = 0; i < WHEEL_SIZE; i++) {
+                timer_wheel_free_slot (&wheel->near[i]);
+                timer_wheel_free_slot (&wheel->far[i]);
+        }
+        timer_wheel_free_slot (&wheel->overflow);
+
+        g_main_context_unref (wheel->context);
+        g_free (wheel);
+}
+
+/* Call @func with @user_data in @seconds seconds. The returned entry stays
+ * valid until it is cancelled or until the callback has returned. */
+TimerWheelEntry *
+timer_wheel_add (TimerWheel    *wheel,
+                 guint          seconds,
+                 TimerWheelFunc func,
+                 gpointer       user_data)
+{
+        TimerWheelEntry *entry;
+
+        g_return_val_if_fail (wheel != NULL, NULL);
+        g_return_val_if_fail (func != NULL, NULL);
+
+        entry = g_new0 (TimerWheelEntry, 1);
+        entry->func = func;
+        entry->user_data = user_data;
+
+        timer_wheel_arm (wheel, entry, seconds);
+
+        return entry;
+}
+
+/* Move @entry to expire @seconds from now. This may also be called from
+ * within the entry's own callback to make it fire again. */
+void
+timer_wheel_rearm (TimerWheel      *wheel,
+                   TimerWheelEntry *entry,
+                   guint            seconds)
+{
+        g_return_if_fail (wheel != NULL);
+        g_return_if_fail (entry != NULL);
+
+        if (entry->slot != NULL)
+                timer_wheel_unlink (wheel, entry);
+
+        timer_wheel_arm (wheel, entry, seconds);
+}
+
+void
+timer_wheel_cancel (TimerWheel *wheel, TimerWheelEntry *entry)
+{
+        g_return_if_fail (wheel != NULL);
+        g_return_if_fail (entry != NULL);
+
+        if (entry->slot != NULL)
+                timer_wheel_unlink (wheel, entry);
+
+        /* The entry of a running callback is freed once it returns */
+        if (entry != wheel->current)
+                g_free (entry);
+}
@@ -0,0 +1,42 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef GUPNP_TIMER_WHEEL_H
+#define GUPNP_TIMER_WHEEL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TimerWheel TimerWheel;
+typedef struct _TimerWheelEntry TimerWheelEntry;
+
+/* Called when a timer expires. The entry is freed after the call returns,
+ * unless it was re-armed from within the callback. */
+typedef void (*TimerWheelFunc) (gpointer user_data);
+
+G_GNUC_INTERNAL TimerWheel *
+timer_wheel_new    (GMainContext    *context);
+
+G_GNUC_INTERNAL void
+timer_wheel_free   (TimerWheel      *wheel);
+
+G_GNUC_INTERNAL TimerWheelEntry *
+timer_wheel_add    (TimerWheel      *wheel,
+                    guint            seconds,
+                    TimerWheelFunc   func,
+                    gpointer         user_data);
+
+G_GNUC_INTERNAL void
+timer_wheel_rearm  (TimerWheel      *wheel,
+                    TimerWheelEntry *entry,
+                    guint            seconds);
+
+G_GNUC_INTERNAL void
+timer_wheel_cancel (TimerWheel      *wheel,
+                    TimerWheelEntry *entry);
+
+G_END_DECLS
+
+#endif /* GUPNP_TIMER_WHEEL_H */
@@ -205,41 +205,53 @@ xml_util_end_element (GString    *xml_str,
         g_string_append_c (xml_str, '>');
 }
 
+/* Append @length bytes of @content to @xml_str, escaped, or up to the
+ * terminating nul if @length is negative. The characters that need escaping
+ * are ASCII, so @content may be split at any byte. Modified from GLib
+ * gmarkup.c */
 void
-xml_util_add_content (GString    *xml_str,
-                      const char *content)
+xml_util_add_content_len (GString    *xml_str,
+                          const char *content,
+                          gssize      length)
 {
-        /* Modified from GLib gmarkup.c */
-        const gchar *p;
+        const char *p, *end, *run;
 
-        p = content;
+        if (length < 0)
+                length = strlen (content);
 
-        while (*p) {
-                const gchar *next;
-                next = g_utf8_next_char (p);
+        end = content + length;
+
+        for (p = run = content; p < end; p++) {
+                const char *entity;
 
                 switch (*p) {
                 case '&':
-                        g_string_append (xml_str, "&amp;");
+                        entity = "&amp;";
                         break;
-
                 case '<':
-                        g_string_append (xml_str, "&lt;");
+                        entity = "&lt;";
                         break;
-
                 case '>':
-                        g_string_append (xml_str, "&gt;");
+                        entity = "&gt;";
                         break;
-
                 case '"':
-                        g_string_append (xml_str, "&quot;");
+                        entity = "&quot;";
                         break;
-
                 default:
-                        g_string_append_len (xml_str, p, next - p);
-                        break;
+                        continue;
                 }
 
-                p = next;
+                g_string_append_len (xml_str, run, p - run);
+                g_string_append (xml_str, entity);
+                run = p + 1;
         }
+
+        g_string_append_len (xml_str, run, p - run);
+}
+
+void
+xml_util_add_content (GString    *xml_str,
+                      const char *content)
+{
+        xml_util_add_content_len (xml_str, content, strlen (content));
 }
@@ -64,4 +64,9 @@ G_GNUC_INTERNAL void
 xml_util_add_content                    (GString    *xml_str,
                                          const char *content);
 
+G_GNUC_INTERNAL void
+xml_util_add_content_len                (GString    *xml_str,
+                                         const char *content,
+                                         gssize      length);
+
 #endif /* GUPNP_XML_UTIL_H */
@@ -66,29 +66,17 @@ test_bgo_696762_on_browse_call (G_GNUC_UNUSED GUPnPService *service,
                                 G_GNUC_UNUSED GUPnPServiceAction *action,
                                 G_GNUC_UNUSED gpointer user_data)
 {
-    xmlNode *node = action->node->children;
-    g_assert (node != NULL);
-    g_assert_cmpstr ((const char *) node->name, ==, "ObjectID");
-    node = node->next;
+    GUPnPServiceActionArgument *arguments;
 
-    g_assert (node != NULL);
-    g_assert_cmpstr ((const char *) node->name, ==, "BrowseFlag");
-    node = node->next;
+    g_assert_cmpuint (action->arguments->len, ==, 6);
+    arguments = (GUPnPServiceActionArgument *) action->arguments->data;
 
-    g_assert (node != NULL);
-    g_assert_cmpstr ((const char *) node->name, ==, "Filter");
-    node = node->next;
-
-    g_assert (node != NULL);
-    g_assert_cmpstr ((const char *) node->name, ==, "StartingIndex");
-    node = node->next;
-
-    g_assert (node != NULL);
-    g_assert_cmpstr ((const char *) node->name, ==, "RequestedCount");
-    node = node->next;
-
-    g_assert (node != NULL);
-    g_assert_cmpstr ((const char *) node->name, ==, "SortCriteria");
+    g_assert_cmpstr (arguments[0].name, ==, "ObjectID");
+    g_assert_cmpstr (arguments[1].name, ==, "BrowseFlag");
+    g_assert_cmpstr (arguments[2].name, ==, "Filter");
+    g_assert_cmpstr (arguments[3].name, ==, "StartingIndex");
+    g_assert_cmpstr (arguments[4].name, ==, "RequestedCount");
+    g_assert_cmpstr (arguments[5].name, ==, "SortCriteria");
     gupnp_service_action_return_success (action);
 }
 
@@ -0,0 +1,833 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include <config.h>
+
+#include <libgupnp/gupnp.h>
+
+#include <libsoup/soup.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_DEVICE_TYPE "urn:test-gupnp-org:device:TestDevice:1"
+#define TEST_SERVICE_TYPE "urn:test-gupnp-org:service:TestService:1"
+#define OTHER_SERVICE_TYPE "urn:test-gupnp-org:service:OtherService:1"
+
+// Two services on the root device and one on the embedded device, all
+// described by the same document
+static const char *multi_service_description =
+        "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+        "<specVersion><major>1</major><minor>0</minor></specVersion>"
+        "<device>"
+        "<deviceType>" TEST_DEVICE_TYPE "</deviceType>"
+        "<friendlyName>Multi-service device</friendlyName>"
+        "<UDN>uuid:1234</UDN>"
+        "<serviceList>"
+        "<service>"
+        "<serviceType>" TEST_SERVICE_TYPE "</serviceType>"
+        "<serviceId>urn:test-gupnp-org:serviceId:TestService:1</serviceId>"
+        "<SCPDURL>/TestService.xml</SCPDURL>"
+        "<controlURL>/TestService/Control</controlURL>"
+        "<eventSubURL>/TestService/Event</eventSubURL>"
+        "</service>"
+        "<service>"
+        "<serviceType>" OTHER_SERVICE_TYPE "</serviceType>"
+        "<serviceId>urn:test-gupnp-org:serviceId:OtherService:1</serviceId>"
+        "<SCPDURL>/OtherService.xml</SCPDURL>"
+        "<controlURL>/OtherService/Control</controlURL>"
+        "<eventSubURL>/OtherService/Event</eventSubURL>"
+        "</service>"
+        "</serviceList>"
+        "<deviceList>"
+        "<device>"
+        "<deviceType>urn:test-gupnp-org:device:TestSubDevice:1</deviceType>"
+        "<friendlyName>Embedded device</friendlyName>"
+        "<UDN>uuid:5678</UDN>"
+        "<serviceList>"
+        "<service>"
+        "<serviceType>" TEST_SERVICE_TYPE "</serviceType>"
+        "<serviceId>urn:test-gupnp-org:serviceId:TestService:2</serviceId>"
+        "<SCPDURL>/Sub/TestService.xml</SCPDURL>"
+        "<controlURL>/Sub/TestService/Control</controlURL>"
+        "<eventSubURL>/Sub/TestService/Event</eventSubURL>"
+        "</service>"
+        "</serviceList>"
+        "</device>"
+        "</deviceList>"
+        "</device>"
+        "</root>";
+
+// The devices are announced to the control point directly, and their
+// descriptions are served by a plain SoupServer. Every description is
+// TestDevice.xml with the UDN taken from its path, /desc/<udn>.xml, and
+// the SCPD of every service is TestService.xml
+typedef struct {
+        GMainLoop *loop;
+        GUPnPContext *context;
+        GUPnPControlPoint *cp;
+
+        SoupServer *server;
+        guint port;
+        char *description;
+        char *scpd;
+
+        GPtrArray *requests;      // Paths of the description requests
+        GPtrArray *held;          // SoupServerMessage not answered yet
+        gboolean hold;            // Do not answer until told to
+        GHashTable *host_running; // Host header -> held requests, if any
+        guint max_running;
+        guint wait_requests;
+
+        guint proxies;
+        guint wait_proxies;
+
+        GUPnPServiceIntrospection *introspection;
+} ControlPointFixture;
+
+static gboolean
+test_on_timeout (gpointer user_data)
+{
+        g_print ("Timeout in %s\n", (const char *) user_data);
+        g_assert_not_reached ();
+
+        return FALSE;
+}
+
+static void
+test_run_loop (GMainLoop *loop, const char *name)
+{
+        guint timeout_id = 0;
+        int timeout = 2;
+
+        const char *timeout_str = g_getenv ("GUPNP_TEST_TIMEOUT");
+        if (timeout_str != NULL) {
+                long t = atol (timeout_str);
+                if (t != 0)
+                        timeout = t;
+        }
+
+        timeout_id = g_timeout_add_seconds (timeout,
+                                            test_on_timeout,
+                                            (gpointer) name);
+        g_main_loop_run (loop);
+        g_source_remove (timeout_id);
+}
+
+static gboolean
+delayed_loop_quitter (gpointer user_data)
+{
+        g_main_loop_quit (user_data);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+spin_loop (GMainLoop *loop, guint ms)
+{
+        g_timeout_add (ms, delayed_loop_quitter, loop);
+        g_main_loop_run (loop);
+}
+
+static char *
+replace (const char *str, const char *old, const char *new)
+{
+        char **parts = g_strsplit (str, old, -1);
+        char *result = g_strjoinv (new, parts);
+
+        g_strfreev (parts);
+
+        return result;
+}
+
+static guint
+host_running (ControlPointFixture *tf, const char *host)
+{
+        return GPOINTER_TO_UINT (g_hash_table_lookup (tf->host_running, host));
+}
+
+static void
+answer_description (ControlPointFixture *tf, SoupServerMessage *msg)
+{
+        const char *path = g_uri_get_path (soup_server_message_get_uri (msg));
+        const char *host = soup_message_headers_get_one (
+                soup_server_message_get_request_headers (msg),
+                "Host");
+        char *body;
+
+        if (g_str_has_prefix (path, "/desc/")) {
+                char *udn;
+                char *new_udn;
+                char *tmp;
+
+                udn = g_strndup (path + strlen ("/desc/"),
+                                 strlen (path) - strlen ("/desc/") -
+                                         strlen (".xml"));
+
+                new_udn = g_strconcat ("uuid:", udn, "-sub", NULL);
+                tmp = replace (tf->description, "uuid:5678", new_udn);
+                g_free (new_udn);
+
+                new_udn = g_strconcat ("uuid:", udn, NULL);
+                body = replace (tmp, "uuid:1234", new_udn);
+                g_free (new_udn);
+                g_free (tmp);
+                g_free (udn);
+        } else {
+                body = g_strdup (tf->scpd);
+        }
+
+        if (host_running (tf, host) > 1)
+                g_hash_table_insert (
+                        tf->host_running,
+                        g_strdup (host),
+                        GUINT_TO_POINTER (host_running (tf, host) - 1));
+        else
+                g_hash_table_remove (tf->host_running, host);
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+        soup_server_message_set_response (msg,
+                                          "text/xml",
+                                          SOUP_MEMORY_TAKE,
+                                          body,
+                                          strlen (body));
+#if SOUP_CHECK_VERSION(3,1,2)
+        soup_server_message_unpause (msg);
+#else
+        soup_server_unpause_message (tf->server, msg);
+#endif
+}
+
+// Answer the oldest request that is being held
+static gboolean
+release_held (gpointer user_data)
+{
+        ControlPointFixture *tf = user_data;
+        SoupServerMessage *msg;
+
+        if (tf->held->len == 0)
+                return G_SOURCE_REMOVE;
+
+        msg = g_ptr_array_steal_index (tf->held, 0);
+        answer_description (tf, msg);
+        g_object_unref (msg);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+on_description_request (G_GNUC_UNUSED SoupServer *server,
+                        SoupServerMessage *msg,
+                        const char *path,
+                        G_GNUC_UNUSED GHashTable *query,
+                        gpointer user_data)
+{
+        ControlPointFixture *tf = user_data;
+        const char *host = soup_message_headers_get_one (
+                soup_server_message_get_request_headers (msg),
+                "Host");
+        guint running;
+
+        g_ptr_array_add (tf->requests, g_strdup (path));
+
+        g_hash_table_insert (tf->host_running,
+                             g_strdup (host),
+                             GUINT_TO_POINTER (host_running (tf, host) + 1));
+        g_ptr_array_add (tf->held, g_object_ref (msg));
+        running = tf->held->len;
+        tf->max_running = MAX (tf->max_running, running);
+
+#if SOUP_CHECK_VERSION(3,1,2)
+        soup_server_message_pause (msg);
+#else
+        soup_server_pause_message (tf->server, msg);
+#endif
+
+        if (!tf->hold)
+                g_timeout_add (100, release_held, tf);
+
+        if (tf->wait_requests != 0 && tf->requests->len >= tf->wait_requests)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+on_service_proxy_available (G_GNUC_UNUSED GUPnPControlPoint *cp,
+                            G_GNUC_UNUSED GUPnPServiceProxy *proxy,
+                            gpointer user_data)
+{
+        ControlPointFixture *tf = user_data;
+
+        tf->proxies++;
+        if (tf->wait_proxies != 0 && tf->proxies >= tf->wait_proxies)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+wait_for_requests (ControlPointFixture *tf, guint n)
+{
+        tf->wait_requests = n;
+        if (tf->requests->len < n)
+                test_run_loop (tf->loop, g_test_get_path ());
+        tf->wait_requests = 0;
+}
+
+static void
+wait_for_proxies (ControlPointFixture *tf, guint n)
+{
+        tf->wait_proxies = n;
+        if (tf->proxies < n)
+                test_run_loop (tf->loop, g_test_get_path ());
+        tf->wait_proxies = 0;
+}
+
+static char *
+description_location (ControlPointFixture *tf,
+                      const char *host,
+                      const char *udn)
+{
+        return g_strdup_printf ("http://%s:%u/desc/%s.xml",
+                                host,
+                                tf->port,
+                                udn);
+}
+
+// Pretend @usn was announced by @host, with the description of @udn
+static void
+announce (ControlPointFixture *tf,
+          const char *host,
+          const char *udn,
+          const char *usn)
+{
+        GList *locations;
+
+        locations = g_list_append (NULL, description_location (tf, host, udn));
+        g_signal_emit_by_name (tf->cp, "resource-available", usn, locations);
+        g_list_free_full (locations, g_free);
+}
+
+static void
+announce_service (ControlPointFixture *tf, const char *host, const char *udn)
+{
+        char *usn;
+
+        usn = g_strconcat ("uuid:", udn, "::" TEST_SERVICE_TYPE, NULL);
+        announce (tf, host, udn, usn);
+        g_free (usn);
+}
+
+static void
+byebye (ControlPointFixture *tf, const char *usn)
+{
+        g_signal_emit_by_name (tf->cp, "resource-unavailable", usn);
+}
+
+static void
+byebye_service (ControlPointFixture *tf, const char *udn)
+{
+        char *usn;
+
+        usn = g_strconcat ("uuid:", udn, "::" TEST_SERVICE_TYPE, NULL);
+        byebye (tf, usn);
+        g_free (usn);
+}
+
+static void
+test_fixture_setup (ControlPointFixture *tf,
+                    G_GNUC_UNUSED gconstpointer user_data)
+{
+        GError *error = NULL;
+        GSList *uris;
+
+        tf->loop = g_main_loop_new (NULL, FALSE);
+
+        tf->context = GUPNP_CONTEXT (g_initable_new (GUPNP_TYPE_CONTEXT,
+                                                     NULL,
+                                                     &error,
+                                                     "host-ip",
+                                                     "127.0.0.1",
+                                                     "port",
+                                                     0,
+                                                     NULL));
+        g_assert_no_error (error);
+        g_assert_nonnull (tf->context);
+
+        tf->cp = gupnp_control_point_new (tf->context, TEST_SERVICE_TYPE);
+        g_signal_connect (tf->cp,
+                          "service-proxy-available",
+                          G_CALLBACK (on_service_proxy_available),
+                          tf);
+
+        g_assert_true (g_file_get_contents (DATA_PATH "/TestDevice.xml",
+                                            &tf->description,
+                                            NULL,
+                                            &error));
+        g_assert_no_error (error);
+
+        g_assert_true (g_file_get_contents (DATA_PATH "/TestService.xml",
+                                            &tf->scpd,
+                                            NULL,
+                                            &error));
+        g_assert_no_error (error);
+
+        tf->requests = g_ptr_array_new_with_free_func (g_free);
+        tf->held = g_ptr_array_new_with_free_func (g_object_unref);
+        tf->host_running =
+                g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        tf->server = soup_server_new (NULL, NULL);
+        soup_server_add_handler (tf->server,
+                                 "/desc",
+                                 on_description_request,
+                                 tf,
+                                 NULL);
+        soup_server_add_handler (tf->server,
+                                 "/TestService.xml",
+                                 on_description_request,
+                                 tf,
+                                 NULL);
+        soup_server_listen_local (tf->server,
+                                  0,
+                                  SOUP_SERVER_LISTEN_IPV4_ONLY,
+                                  &error);
+        g_assert_no_error (error);
+
+        uris = soup_server_get_uris (tf->server);
+        tf->port = g_uri_get_port (uris->data);
+        g_slist_free_full (uris, (GDestroyNotify) g_uri_unref);
+}
+
+static void
+test_fixture_teardown (ControlPointFixture *tf,
+                       G_GNUC_UNUSED gconstpointer user_data)
+{
+        g_object_unref (tf->cp);
+        g_object_unref (tf->context);
+
+        soup_server_disconnect (tf->server);
+        g_object_unref (tf->server);
+        g_ptr_array_unref (tf->held);
+        g_ptr_array_unref (tf->requests);
+        g_hash_table_destroy (tf->host_running);
+        g_free (tf->description);
+        g_free (tf->scpd);
+
+        // Let the cancelled downloads report back
+        spin_loop (tf->loop, 100);
+        g_main_loop_unref (tf->loop);
+}
+
+static void
+test_fetch_shared (ControlPointFixture *tf,
+                   G_GNUC_UNUSED gconstpointer user_data)
+{
+        tf->hold = TRUE;
+
+        // Everything a device announces points to the same description
+        announce (tf, "127.0.0.1", "1001", "uuid:1001::upnp:rootdevice");
+        announce (tf, "127.0.0.1", "1001", "uuid:1001");
+        announce_service (tf, "127.0.0.1", "1001");
+        wait_for_requests (tf, 1);
+
+        // Give further requests the chance to show up
+        spin_loop (tf->loop, 100);
+        g_assert_cmpuint (tf->requests->len, ==, 1);
+
+        release_held (tf);
+        wait_for_proxies (tf, 1);
+
+        // All waiters were served from the one download
+        g_assert_cmpuint (tf->requests->len, ==, 1);
+        g_assert_nonnull (gupnp_control_point_find_device_proxy (tf->cp,
+                                                                 "uuid:1001"));
+        g_assert_nonnull (
+                gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:1001",
+                                                        TEST_SERVICE_TYPE));
+}
+
+static void
+test_fetch_max (ControlPointFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        const char *udns[] = { "2001", "2002", "2003" };
+        guint i;
+
+        gupnp_control_point_set_max_description_fetches (tf->cp, 2);
+        g_assert_cmpuint (
+                gupnp_control_point_get_max_description_fetches (tf->cp),
+                ==,
+                2);
+
+        tf->hold = TRUE;
+        for (i = 0; i < G_N_ELEMENTS (udns); i++)
+                announce_service (tf, "127.0.0.1", udns[i]);
+
+        wait_for_requests (tf, 2);
+        spin_loop (tf->loop, 100);
+        g_assert_cmpuint (tf->held->len, ==, 2);
+
+        // A finished download makes room for the waiting one
+        release_held (tf);
+        wait_for_requests (tf, 3);
+        g_assert_cmpuint (tf->held->len, ==, 2);
+
+        release_held (tf);
+        release_held (tf);
+        wait_for_proxies (tf, 3);
+
+        g_assert_cmpuint (tf->requests->len, ==, 3);
+        g_assert_cmpuint (tf->max_running, ==, 2);
+}
+
+static void
+test_fetch_max_per_host (ControlPointFixture *tf,
+                         G_GNUC_UNUSED gconstpointer user_data)
+{
+        gupnp_control_point_set_max_description_fetches_per_host (tf->cp, 1);
+        g_assert_cmpuint (
+                gupnp_control_point_get_max_description_fetches_per_host (
+                        tf->cp),
+                ==,
+                1);
+
+        // Two hosts, as far as the control point can tell
+        tf->hold = TRUE;
+        announce_service (tf, "127.0.0.1", "2101");
+        announce_service (tf, "127.0.0.1", "2102");
+        announce_service (tf, "localhost", "2103");
+
+        wait_for_requests (tf, 2);
+        spin_loop (tf->loop, 100);
+
+        // The second host does not wait for the first one
+        g_assert_cmpuint (tf->held->len, ==, 2);
+        g_assert_cmpuint (g_hash_table_size (tf->host_running), ==, 2);
+
+        tf->hold = FALSE;
+        release_held (tf);
+        release_held (tf);
+        wait_for_proxies (tf, 3);
+
+        g_assert_cmpuint (tf->requests->len, ==, 3);
+        g_assert_cmpuint (tf->max_running, ==, 2);
+}
+
+static void
+test_fetch_byebye (ControlPointFixture *tf,
+                   G_GNUC_UNUSED gconstpointer user_data)
+{
+        tf->hold = TRUE;
+
+        announce_service (tf, "127.0.0.1", "3001");
+        wait_for_requests (tf, 1);
+
+        // The only waiter leaves, so the download is cancelled
+        byebye_service (tf, "3001");
+        g_ptr_array_remove_index (tf->held, 0);
+
+        // Otherwise, this would wait for the download that is still running
+        announce_service (tf, "127.0.0.1", "3001");
+        wait_for_requests (tf, 2);
+
+        release_held (tf);
+        wait_for_proxies (tf, 1);
+
+        g_assert_cmpuint (tf->proxies, ==, 1);
+}
+
+static guint
+list_length_and_free (GList *list)
+{
+        guint length = g_list_length (list);
+
+        g_list_free (list);
+
+        return length;
+}
+
+static guint
+services_by_type (ControlPointFixture *tf, const char *service_type)
+{
+        return list_length_and_free (
+                gupnp_control_point_list_service_proxies_by_type (
+                        tf->cp,
+                        service_type));
+}
+
+static guint
+services_by_location (ControlPointFixture *tf, const char *location)
+{
+        return list_length_and_free (
+                gupnp_control_point_list_service_proxies_by_location (
+                        tf->cp,
+                        location));
+}
+
+static guint
+devices_by_location (ControlPointFixture *tf, const char *location)
+{
+        return list_length_and_free (
+                gupnp_control_point_list_device_proxies_by_location (
+                        tf->cp,
+                        location));
+}
+
+static void
+test_index (ControlPointFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        GUPnPServiceProxy *proxy;
+        GList *proxies;
+        char *location;
+
+        g_free (tf->description);
+        tf->description = g_strdup (multi_service_description);
+        location = description_location (tf, "127.0.0.1", "4001");
+
+        announce (tf, "127.0.0.1", "4001", "uuid:4001");
+        announce (tf,
+                  "127.0.0.1",
+                  "4001",
+                  "uuid:4001::" TEST_SERVICE_TYPE);
+        announce (tf,
+                  "127.0.0.1",
+                  "4001",
+                  "uuid:4001::" OTHER_SERVICE_TYPE);
+        announce (tf,
+                  "127.0.0.1",
+                  "4001",
+                  "uuid:4001-sub::" TEST_SERVICE_TYPE);
+        announce_service (tf, "127.0.0.1", "4002");
+        wait_for_proxies (tf, 4);
+
+        g_assert_nonnull (gupnp_control_point_find_device_proxy (tf->cp,
+                                                                 "uuid:4001"));
+        proxy = gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:4001",
+                                                        TEST_SERVICE_TYPE);
+        g_assert_nonnull (proxy);
+        g_assert_cmpstr (
+                gupnp_service_info_get_location (GUPNP_SERVICE_INFO (proxy)),
+                ==,
+                location);
+        g_assert_nonnull (
+                gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:4001",
+                                                        OTHER_SERVICE_TYPE));
+        g_assert_nonnull (
+                gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:4001-sub",
+                                                        TEST_SERVICE_TYPE));
+
+        g_assert_cmpuint (services_by_type (tf, TEST_SERVICE_TYPE), ==, 3);
+        g_assert_cmpuint (services_by_type (tf, OTHER_SERVICE_TYPE), ==, 1);
+        g_assert_cmpuint (services_by_location (tf, location), ==, 3);
+        g_assert_cmpuint (devices_by_location (tf, location), ==, 1);
+        g_assert_cmpuint (
+                list_length_and_free (
+                        gupnp_control_point_list_device_proxies_by_type (
+                                tf->cp,
+                                TEST_DEVICE_TYPE)),
+                ==,
+                1);
+
+        // Losing one service of the document leaves the others indexed
+        byebye (tf, "uuid:4001::" TEST_SERVICE_TYPE);
+        g_assert_null (
+                gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:4001",
+                                                        TEST_SERVICE_TYPE));
+        g_assert_cmpuint (services_by_type (tf, TEST_SERVICE_TYPE), ==, 2);
+        g_assert_cmpuint (services_by_location (tf, location), ==, 2);
+
+        proxies = gupnp_control_point_list_service_proxies_by_location (
+                tf->cp,
+                location);
+        g_assert_null (g_list_find (proxies, proxy));
+        g_list_free (proxies);
+
+        byebye (tf, "uuid:4001::" OTHER_SERVICE_TYPE);
+        g_assert_cmpuint (services_by_type (tf, OTHER_SERVICE_TYPE), ==, 0);
+        g_assert_cmpuint (services_by_location (tf, location), ==, 1);
+
+        byebye (tf, "uuid:4001-sub::" TEST_SERVICE_TYPE);
+        g_assert_cmpuint (services_by_location (tf, location), ==, 0);
+        g_assert_cmpuint (services_by_type (tf, TEST_SERVICE_TYPE), ==, 1);
+
+        byebye (tf, "uuid:4001");
+        g_assert_null (gupnp_control_point_find_device_proxy (tf->cp,
+                                                              "uuid:4001"));
+        g_assert_cmpuint (devices_by_location (tf, location), ==, 0);
+
+        // The other device was not affected
+        g_assert_nonnull (
+                gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:4002",
+                                                        TEST_SERVICE_TYPE));
+
+        // Coming back puts the service into the indexes again
+        announce (tf,
+                  "127.0.0.1",
+                  "4001",
+                  "uuid:4001::" TEST_SERVICE_TYPE);
+        wait_for_proxies (tf, 5);
+        g_assert_nonnull (
+                gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:4001",
+                                                        TEST_SERVICE_TYPE));
+        g_assert_cmpuint (services_by_type (tf, TEST_SERVICE_TYPE), ==, 2);
+        g_assert_cmpuint (services_by_location (tf, location), ==, 1);
+
+        g_free (location);
+}
+
+static void
+on_introspected (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        ControlPointFixture *tf = user_data;
+        GError *error = NULL;
+
+        tf->introspection = gupnp_service_info_introspect_finish (
+                GUPNP_SERVICE_INFO (source),
+                res,
+                &error);
+        g_assert_no_error (error);
+
+        g_main_loop_quit (tf->loop);
+}
+
+static void
+test_prefetch (ControlPointFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        const char *types[] = { TEST_SERVICE_TYPE, NULL };
+        GUPnPServiceProxy *proxy;
+
+        gupnp_control_point_set_introspection_prefetch (tf->cp, types);
+        g_assert_cmpstr (
+                gupnp_control_point_get_introspection_prefetch (tf->cp)[0],
+                ==,
+                TEST_SERVICE_TYPE);
+
+        tf->hold = TRUE;
+        announce_service (tf, "127.0.0.1", "5001");
+        wait_for_requests (tf, 1);
+        release_held (tf);
+
+        // The proxy is not announced before its SCPD is downloaded
+        wait_for_requests (tf, 2);
+        g_assert_cmpstr (g_ptr_array_index (tf->requests, 1),
+                         ==,
+                         "/TestService.xml");
+        g_assert_cmpuint (tf->proxies, ==, 0);
+        g_assert_null (gupnp_control_point_find_service_proxy (tf->cp,
+                                                               "uuid:5001",
+                                                               TEST_SERVICE_TYPE));
+
+        release_held (tf);
+        wait_for_proxies (tf, 1);
+
+        proxy = gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:5001",
+                                                        TEST_SERVICE_TYPE);
+        g_assert_nonnull (proxy);
+
+        // Introspecting it does not download the SCPD again
+        gupnp_service_info_introspect_async (GUPNP_SERVICE_INFO (proxy),
+                                             NULL,
+                                             on_introspected,
+                                             tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+        g_assert_nonnull (tf->introspection);
+        g_assert_cmpuint (tf->requests->len, ==, 2);
+
+        g_object_unref (tf->introspection);
+}
+
+static void
+test_prefetch_byebye (ControlPointFixture *tf,
+                      G_GNUC_UNUSED gconstpointer user_data)
+{
+        const char *types[] = { TEST_SERVICE_TYPE, NULL };
+
+        gupnp_control_point_set_introspection_prefetch (tf->cp, types);
+
+        tf->hold = TRUE;
+        announce_service (tf, "127.0.0.1", "5002");
+        wait_for_requests (tf, 1);
+        release_held (tf);
+        wait_for_requests (tf, 2);
+
+        // The service leaves while its SCPD is downloaded, so the proxy is
+        // dropped without being announced
+        byebye_service (tf, "5002");
+        g_ptr_array_remove_index (tf->held, 0);
+        spin_loop (tf->loop, 100);
+        g_assert_cmpuint (tf->proxies, ==, 0);
+        g_assert_null (gupnp_control_point_find_service_proxy (tf->cp,
+                                                               "uuid:5002",
+                                                               TEST_SERVICE_TYPE));
+
+        // Otherwise, the service would still be taken for being prefetched
+        tf->hold = FALSE;
+        announce_service (tf, "127.0.0.1", "5002");
+        wait_for_proxies (tf, 1);
+
+        g_assert_nonnull (
+                gupnp_control_point_find_service_proxy (tf->cp,
+                                                        "uuid:5002",
+                                                        TEST_SERVICE_TYPE));
+}
+
+int
+main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add ("/control-point/fetch/shared",
+                    ControlPointFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_fetch_shared,
+                    test_fixture_teardown);
+
+        g_test_add ("/control-point/fetch/max",
+                    ControlPointFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_fetch_max,
+                    test_fixture_teardown);
+
+        g_test_add ("/control-point/fetch/max-per-host",
+                    ControlPointFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_fetch_max_per_host,
+                    test_fixture_teardown);
+
+        g_test_add ("/control-point/fetch/byebye",
+                    ControlPointFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_fetch_byebye,
+                    test_fixture_teardown);
+
+        g_test_add ("/control-point/index",
+                    ControlPointFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_index,
+                    test_fixture_teardown);
+
+        g_test_add ("/control-point/prefetch",
+                    ControlPointFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_prefetch,
+                    test_fixture_teardown);
+
+        g_test_add ("/control-point/prefetch/byebye",
+                    ControlPointFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_prefetch_byebye,
+                    test_fixture_teardown);
+
+        return g_test_run ();
+}
@@ -16,6 +16,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 static GUPnPContext *
@@ -293,6 +294,272 @@ test_async_call (ProxyTestFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
         g_main_loop_run (tf->loop);
 }
 
+void
+on_test_action_handler_ping_signal (G_GNUC_UNUSED GUPnPService *service,
+                                    G_GNUC_UNUSED GUPnPServiceAction *action,
+                                    G_GNUC_UNUSED gpointer user_data)
+{
+        // The registered handler takes precedence over the signal
+        g_assert_not_reached ();
+}
+
+void
+on_test_action_handler_ping (G_GNUC_UNUSED GUPnPService *service,
+                             GUPnPServiceAction *action,
+                             gpointer user_data)
+{
+        guint *calls = user_data;
+
+        (*calls)++;
+        gupnp_service_action_return_success (action);
+}
+
+void
+test_action_handler (ProxyTestFixture *tf,
+                     G_GNUC_UNUSED gconstpointer user_data)
+{
+        guint calls = 0;
+        gulong id;
+
+        id = g_signal_connect (tf->service,
+                               "action-invoked::Ping",
+                               G_CALLBACK (on_test_action_handler_ping_signal),
+                               tf);
+        gupnp_service_set_action_handler (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          on_test_action_handler_ping,
+                                          &calls,
+                                          NULL);
+
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Ping", NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        gupnp_service_proxy_action_unref (action);
+        test_run_loop (tf->loop, g_test_get_path ());
+        g_assert_cmpuint (calls, ==, 1);
+
+        // Removing the handler falls back to the signal
+        g_signal_handler_disconnect (tf->service, id);
+        g_signal_connect (tf->service,
+                          "action-invoked::Ping",
+                          G_CALLBACK (on_test_async_call_ping_success),
+                          tf);
+        gupnp_service_set_action_handler (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          NULL,
+                                          NULL,
+                                          NULL);
+
+        action = gupnp_service_proxy_action_new ("Ping", NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        gupnp_service_proxy_action_unref (action);
+        test_run_loop (tf->loop, g_test_get_path ());
+        g_assert_cmpuint (calls, ==, 1);
+}
+
+void
+on_test_offloaded_ping (G_GNUC_UNUSED GUPnPService *service,
+                        GUPnPServiceAction *action,
+                        gpointer user_data)
+{
+        GThread **thread = user_data;
+
+        *thread = g_thread_self ();
+        gupnp_service_action_return_success (action);
+}
+
+void
+test_action_offload (ProxyTestFixture *tf,
+                     G_GNUC_UNUSED gconstpointer user_data)
+{
+        GThread *thread = NULL;
+
+        gupnp_service_set_action_handler (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          on_test_offloaded_ping,
+                                          &thread,
+                                          NULL);
+        gupnp_service_set_action_offload (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          TRUE);
+
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Ping", NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        gupnp_service_proxy_action_unref (action);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        // The handler ran in a worker, the response was still sent
+        g_assert_nonnull (thread);
+        g_assert_true (thread != g_thread_self ());
+}
+
+#define TEST_STREAM_ITEMS 10000
+#define TEST_STREAM_ITEM "<item id=\"1\">a&b</item>"
+
+void
+on_test_streamed_ping (G_GNUC_UNUSED GUPnPService *service,
+                       GUPnPServiceAction *action,
+                       G_GNUC_UNUSED gpointer user_data)
+{
+        guint i;
+
+        gupnp_service_action_set (action, "Before", G_TYPE_UINT, 23, NULL);
+        gupnp_service_action_stream_begin (action, "Result");
+        for (i = 0; i < TEST_STREAM_ITEMS; i++)
+                gupnp_service_action_stream_write (action, TEST_STREAM_ITEM, -1);
+        gupnp_service_action_stream_end (action);
+        gupnp_service_action_set (action, "After", G_TYPE_UINT, 42, NULL);
+        gupnp_service_action_return_success (action);
+}
+
+static void
+run_action_stream (ProxyTestFixture *tf, gboolean offload)
+{
+        GError *error = NULL;
+        char *result = NULL;
+        guint before = 0;
+        guint after = 0;
+        GString *expected;
+        guint i;
+
+        gupnp_service_set_action_handler (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          on_test_streamed_ping,
+                                          NULL,
+                                          NULL);
+        gupnp_service_set_action_offload (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          offload);
+
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Ping", NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        gupnp_service_proxy_action_get_result (action,
+                                               &error,
+                                               "Before",
+                                               G_TYPE_UINT,
+                                               &before,
+                                               "Result",
+                                               G_TYPE_STRING,
+                                               &result,
+                                               "After",
+                                               G_TYPE_UINT,
+                                               &after,
+                                               NULL);
+        g_assert_no_error (error);
+
+        expected = g_string_new (NULL);
+        for (i = 0; i < TEST_STREAM_ITEMS; i++)
+                g_string_append (expected, TEST_STREAM_ITEM);
+
+        g_assert_cmpuint (before, ==, 23);
+        g_assert_cmpstr (result, ==, expected->str);
+        g_assert_cmpuint (after, ==, 42);
+
+        g_string_free (expected, TRUE);
+        g_free (result);
+        gupnp_service_proxy_action_unref (action);
+}
+
+void
+test_action_stream (ProxyTestFixture *tf,
+                    G_GNUC_UNUSED gconstpointer user_data)
+{
+        run_action_stream (tf, FALSE);
+}
+
+void
+test_action_stream_offloaded (ProxyTestFixture *tf,
+                              G_GNUC_UNUSED gconstpointer user_data)
+{
+        run_action_stream (tf, TRUE);
+}
+
+void
+on_test_streamed_ping_error (G_GNUC_UNUSED GUPnPService *service,
+                             GUPnPServiceAction *action,
+                             G_GNUC_UNUSED gpointer user_data)
+{
+        guint i;
+
+        gupnp_service_action_stream_begin (action, "Result");
+        for (i = 0; i < TEST_STREAM_ITEMS; i++)
+                gupnp_service_action_stream_write (action, TEST_STREAM_ITEM, -1);
+
+        // Too late for a SOAP fault, the call must fail anyway
+        gupnp_service_action_return_error (action,
+                                           GUPNP_CONTROL_ERROR_ACTION_FAILED,
+                                           NULL);
+}
+
+void
+on_test_async_call_failed (GObject *source,
+                           GAsyncResult *res,
+                           gpointer user_data)
+{
+        ProxyTestFixture *tf = user_data;
+        GError *error = NULL;
+
+        gupnp_service_proxy_call_action_finish (GUPNP_SERVICE_PROXY (source),
+                                                res,
+                                                &error);
+        g_assert_nonnull (error);
+        g_clear_error (&error);
+
+        g_main_loop_quit (tf->loop);
+}
+
+static void
+run_action_stream_error (ProxyTestFixture *tf, gboolean offload)
+{
+        gupnp_service_set_action_handler (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          on_test_streamed_ping_error,
+                                          NULL,
+                                          NULL);
+        gupnp_service_set_action_offload (GUPNP_SERVICE (tf->service),
+                                          "Ping",
+                                          offload);
+
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Ping", NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call_failed,
+                                               tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        gupnp_service_proxy_action_unref (action);
+}
+
+void
+test_action_stream_error (ProxyTestFixture *tf,
+                          G_GNUC_UNUSED gconstpointer user_data)
+{
+        run_action_stream_error (tf, FALSE);
+        run_action_stream_error (tf, TRUE);
+}
+
 void
 on_test_async_call_ping_delay (G_GNUC_UNUSED GUPnPService *service,
                                G_GNUC_UNUSED GUPnPServiceAction *action,
@@ -1060,101 +1327,2733 @@ test_action_iter_introspected (ProxyTestFixture *tf, gconstpointer user_data)
         g_object_unref (iter);
 }
 
-int
-main (int argc, char *argv[])
+typedef struct {
+        ProxyTestFixture *tf;
+        GPtrArray *order;
+        GUPnPServiceAction *held;
+        guint finished;
+} ActionQueueData;
+
+static gboolean
+release_held_action (gpointer user_data)
 {
-        g_test_init (&argc, &argv, NULL);
+        ActionQueueData *data = user_data;
 
-        g_test_add ("/service-proxy/async/fire-and-forget",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_fire_and_forget,
-                    test_fixture_teardown);
+        gupnp_service_action_return_success (data->held);
+        data->held = NULL;
 
-        g_test_add ("/service-proxy/async/call",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_async_call,
-                    test_fixture_teardown);
+        return G_SOURCE_REMOVE;
+}
 
-        g_test_add ("/service-proxy/async/cancel",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_async_cancel_call,
-                    test_fixture_teardown);
+void
+on_test_action_queue_browse (G_GNUC_UNUSED GUPnPService *service,
+                             GUPnPServiceAction *action,
+                             gpointer user_data)
+{
+        ActionQueueData *data = user_data;
+        char *id = NULL;
 
-        g_test_add ("/service-proxy/async/destroy-with-pending",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_async_call_destroy_with_pending,
-                    test_fixture_teardown);
+        gupnp_service_action_get (action, "ObjectID", G_TYPE_STRING, &id, NULL);
+        g_ptr_array_add (data->order, id);
 
-        g_test_add ("/service-proxy/async/soap-error-in-finish",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_finish_soap_error,
-                    test_fixture_teardown);
+        // Keep the first call busy until the others have been queued
+        if (data->order->len == 1) {
+                data->held = action;
+                g_timeout_add (200, release_held_action, data);
 
-        g_test_add ("/service-proxy/sync/call",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_sync_call,
-                    test_fixture_teardown);
+                return;
+        }
 
-        g_test_add ("/service-proxy/sync/cancel-call",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_cancel_sync_call,
-                    test_fixture_teardown);
+        gupnp_service_action_return_success (action);
+}
 
-        g_test_add ("/service-proxy/sync/soap-error-in-finish",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_finish_soap_error_sync,
-                    test_fixture_teardown);
+void
+on_test_action_queue_finished (GObject *source,
+                               GAsyncResult *res,
+                               gpointer user_data)
+{
+        ActionQueueData *data = user_data;
+        GError *error = NULL;
 
-        g_test_add ("/service-proxy/authentication/no-credentials",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_finish_soap_authentication_no_credentials,
-                    test_fixture_teardown);
+        gupnp_service_proxy_call_action_finish (GUPNP_SERVICE_PROXY (source),
+                                                res,
+                                                &error);
+        g_assert_no_error (error);
 
-        g_test_add ("/service-proxy/authentication/wrong-credentials",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_finish_soap_authentication_wrong_credentials,
-                    test_fixture_teardown);
+        if (++data->finished == 3)
+                g_main_loop_quit (data->tf->loop);
+}
 
-        g_test_add ("/service-proxy/authentication/valid-credentials",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_finish_soap_authentication_valid_credentials,
-                    test_fixture_teardown);
+static void
+queue_browse (ActionQueueData *data, const char *id, int priority)
+{
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Browse",
+                                                "ObjectID",
+                                                G_TYPE_STRING,
+                                                id,
+                                                NULL);
+
+        gupnp_service_proxy_action_set_priority (action, priority);
+        gupnp_service_proxy_call_action_async (data->tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_action_queue_finished,
+                                               data);
+        gupnp_service_proxy_action_unref (action);
+}
 
-        g_test_add ("/service-proxy/action/iter",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_action_iter,
-                    test_fixture_teardown);
+void
+test_action_queue (ProxyTestFixture *tf, gconstpointer user_data)
+{
+        ActionQueueData data = { tf, g_ptr_array_new_with_free_func (g_free) };
+        guint in_flight = 0;
+        guint queued = 0;
+        guint max_queued = 0;
+        char *host;
 
-        g_test_add ("/service-proxy/action/iter_introspected",
-                    ProxyTestFixture,
-                    "127.0.0.1",
-                    test_fixture_setup,
-                    test_action_iter_introspected,
-                    test_fixture_teardown);
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_action_queue_browse),
+                          &data);
+
+        gupnp_context_set_max_actions_per_host (tf->client_context, 1);
+        g_assert_cmpuint (
+                gupnp_context_get_max_actions_per_host (tf->client_context),
+                ==,
+                1);
+
+        queue_browse (&data, "first", G_PRIORITY_DEFAULT);
+        queue_browse (&data, "default", G_PRIORITY_DEFAULT);
+        queue_browse (&data, "high", G_PRIORITY_HIGH);
+
+        host = g_strdup_printf ("%s:%u",
+                                (const char *) user_data,
+                                gupnp_context_get_port (tf->server_context));
+        g_assert_true (gupnp_context_get_action_stats (tf->client_context,
+                                                       host,
+                                                       &in_flight,
+                                                       &queued,
+                                                       &max_queued,
+                                                       NULL,
+                                                       NULL,
+                                                       NULL));
+        g_assert_cmpuint (in_flight, ==, 1);
+        g_assert_cmpuint (queued, ==, 2);
+        g_assert_cmpuint (max_queued, ==, 2);
+
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        // The waiting call with the higher priority overtakes the other one
+        g_assert_cmpuint (data.order->len, ==, 3);
+        g_assert_cmpstr (g_ptr_array_index (data.order, 0), ==, "first");
+        g_assert_cmpstr (g_ptr_array_index (data.order, 1), ==, "high");
+        g_assert_cmpstr (g_ptr_array_index (data.order, 2), ==, "default");
+
+        // Nothing is left for the host, so its statistics are gone
+        g_assert_false (gupnp_context_get_action_stats (tf->client_context,
+                                                        host,
+                                                        NULL,
+                                                        NULL,
+                                                        NULL,
+                                                        NULL,
+                                                        NULL,
+                                                        NULL));
+
+        g_free (host);
+        g_ptr_array_unref (data.order);
+}
+
+void
+on_test_action_queue_cancel_first (GObject *source,
+                                   GAsyncResult *res,
+                                   gpointer user_data)
+{
+        ActionQueueData *data = user_data;
+        GError *error = NULL;
+
+        gupnp_service_proxy_call_action_finish (GUPNP_SERVICE_PROXY (source),
+                                                res,
+                                                &error);
+        g_assert_no_error (error);
+
+        // The cancelled call did not wait for this one
+        g_assert_cmpuint (data->finished, ==, 1);
+        data->finished++;
+        g_main_loop_quit (data->tf->loop);
+}
+
+void
+on_test_action_queue_cancel_cancelled (GObject *source,
+                                       GAsyncResult *res,
+                                       gpointer user_data)
+{
+        ActionQueueData *data = user_data;
+        GError *error = NULL;
+
+        gupnp_service_proxy_call_action_finish (GUPNP_SERVICE_PROXY (source),
+                                                res,
+                                                &error);
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+        g_error_free (error);
+
+        g_assert_cmpuint (data->finished, ==, 0);
+        data->finished++;
+}
+
+void
+test_action_queue_cancel (ProxyTestFixture *tf, gconstpointer user_data)
+{
+        ActionQueueData data = { tf, g_ptr_array_new_with_free_func (g_free) };
+        GCancellable *cancellable = g_cancellable_new ();
+        GUPnPServiceProxyAction *action;
+        guint queued = 0;
+        char *host;
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_action_queue_browse),
+                          &data);
+
+        gupnp_context_set_max_actions_per_host (tf->client_context, 1);
+
+        action = gupnp_service_proxy_action_new ("Browse",
+                                                 "ObjectID",
+                                                 G_TYPE_STRING,
+                                                 "first",
+                                                 NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_action_queue_cancel_first,
+                                               &data);
+        gupnp_service_proxy_action_unref (action);
+
+        action = gupnp_service_proxy_action_new ("Browse",
+                                                 "ObjectID",
+                                                 G_TYPE_STRING,
+                                                 "cancelled",
+                                                 NULL);
+        gupnp_service_proxy_call_action_async (
+                tf->proxy,
+                action,
+                cancellable,
+                on_test_action_queue_cancel_cancelled,
+                &data);
+        gupnp_service_proxy_action_unref (action);
+
+        host = g_strdup_printf ("%s:%u",
+                                (const char *) user_data,
+                                gupnp_context_get_port (tf->server_context));
+        g_assert_true (gupnp_context_get_action_stats (tf->client_context,
+                                                       host,
+                                                       NULL,
+                                                       &queued,
+                                                       NULL,
+                                                       NULL,
+                                                       NULL,
+                                                       NULL));
+        g_assert_cmpuint (queued, ==, 1);
+
+        // Completes while the first call is still being held by the server
+        g_cancellable_cancel (cancellable);
+
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        // The cancelled call never reached the server
+        g_assert_cmpuint (data.finished, ==, 2);
+        g_assert_cmpuint (data.order->len, ==, 1);
+        g_assert_cmpstr (g_ptr_array_index (data.order, 0), ==, "first");
+
+        g_free (host);
+        g_object_unref (cancellable);
+        g_ptr_array_unref (data.order);
+}
+
+void
+on_test_action_reuse_browse (G_GNUC_UNUSED GUPnPService *service,
+                             GUPnPServiceAction *action,
+                             gpointer user_data)
+{
+        GPtrArray *ids = user_data;
+        char *id = NULL;
+
+        gupnp_service_action_get (action, "ObjectID", G_TYPE_STRING, &id, NULL);
+        g_ptr_array_add (ids, id);
+
+        gupnp_service_action_return_success (action);
+}
+
+void
+test_action_reuse (ProxyTestFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        GPtrArray *ids = g_ptr_array_new_with_free_func (g_free);
+        GValue value = G_VALUE_INIT;
+        GError *error = NULL;
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_action_reuse_browse),
+                          ids);
+
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Browse",
+                                                "ObjectID",
+                                                G_TYPE_STRING,
+                                                "first",
+                                                "BrowseFlag",
+                                                G_TYPE_STRING,
+                                                "BrowseDirectChildren",
+                                                NULL);
+
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        // Sending the same action again re-uses the request
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        // A changed argument has to show up in the next call
+        g_value_init (&value, G_TYPE_STRING);
+        g_value_set_string (&value, "second");
+        g_assert_true (gupnp_service_proxy_action_set (action,
+                                                       "ObjectID",
+                                                       &value,
+                                                       &error));
+        g_assert_no_error (error);
+        g_value_unset (&value);
+
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        g_assert_cmpuint (ids->len, ==, 3);
+        g_assert_cmpstr (g_ptr_array_index (ids, 0), ==, "first");
+        g_assert_cmpstr (g_ptr_array_index (ids, 1), ==, "first");
+        g_assert_cmpstr (g_ptr_array_index (ids, 2), ==, "second");
+
+        gupnp_service_proxy_action_unref (action);
+        g_ptr_array_unref (ids);
+}
+
+typedef struct {
+        ProxyTestFixture *tf;
+        gboolean refuse_post;
+        gboolean refuse_m_post;
+        GPtrArray *methods;
+        GError *error;
+} MethodTestData;
+
+#define PING_RESPONSE                                                        \
+        "<?xml version=\"1.0\"?>"                                            \
+        "<s:Envelope "                                                       \
+        "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "             \
+        "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"     \
+        "<s:Body>"                                                           \
+        "<u:PingResponse "                                                   \
+        "xmlns:u=\"urn:test-gupnp-org:service:TestService:1\">"              \
+        "</u:PingResponse>"                                                  \
+        "</s:Body>"                                                          \
+        "</s:Envelope>"
+
+// Stands in for the control handler of the service, refusing the methods
+// the test asks for
+void
+on_method_control (G_GNUC_UNUSED SoupServer *server,
+                   SoupServerMessage *msg,
+                   G_GNUC_UNUSED const char *path,
+                   G_GNUC_UNUSED GHashTable *query,
+                   gpointer user_data)
+{
+        MethodTestData *data = user_data;
+        const char *method = soup_server_message_get_method (msg);
+        gboolean refuse;
+
+        g_ptr_array_add (data->methods, g_strdup (method));
+
+        if (g_str_equal (method, SOUP_METHOD_POST))
+                refuse = data->refuse_post;
+        else
+                refuse = data->refuse_m_post;
+
+        if (refuse) {
+                soup_server_message_set_status (msg,
+                                                SOUP_STATUS_METHOD_NOT_ALLOWED,
+                                                NULL);
+
+                return;
+        }
+
+        soup_server_message_set_response (msg,
+                                          "text/xml; charset=\"utf-8\"",
+                                          SOUP_MEMORY_STATIC,
+                                          PING_RESPONSE,
+                                          strlen (PING_RESPONSE));
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+}
+
+void
+on_method_ping (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        MethodTestData *data = user_data;
+        GUPnPServiceProxyAction *action;
+
+        action = gupnp_service_proxy_call_action_finish (
+                GUPNP_SERVICE_PROXY (source),
+                res,
+                &data->error);
+        g_clear_pointer (&action, gupnp_service_proxy_action_unref);
+
+        g_main_loop_quit (data->tf->loop);
+}
+
+// Call Ping and return the methods the call sent, in order
+static char *
+method_ping (MethodTestData *data)
+{
+        GUPnPServiceProxyAction *action;
+        char *methods;
+        guint start = data->methods->len;
+
+        g_clear_error (&data->error);
+
+        action = gupnp_service_proxy_action_new ("Ping", NULL);
+        gupnp_service_proxy_call_action_async (data->tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_method_ping,
+                                               data);
+        gupnp_service_proxy_action_unref (action);
+        test_run_loop (data->tf->loop, g_test_get_path ());
+
+        g_ptr_array_add (data->methods, NULL);
+        methods = g_strjoinv (",", (char **) data->methods->pdata + start);
+        g_ptr_array_remove_index (data->methods, data->methods->len - 1);
+
+        return methods;
+}
+
+static void
+method_test_data_init (ProxyTestFixture *tf, MethodTestData *data)
+{
+        data->tf = tf;
+        data->methods = g_ptr_array_new_with_free_func (g_free);
+
+        soup_server_add_handler (gupnp_context_get_server (tf->server_context),
+                                 "/TestService/Control",
+                                 on_method_control,
+                                 data,
+                                 NULL);
+}
+
+static void
+method_test_data_clear (MethodTestData *data)
+{
+        soup_server_remove_handler (
+                gupnp_context_get_server (data->tf->server_context),
+                "/TestService/Control");
+        g_ptr_array_unref (data->methods);
+        g_clear_error (&data->error);
+}
+
+void
+test_action_method_memo (ProxyTestFixture *tf,
+                         G_GNUC_UNUSED gconstpointer user_data)
+{
+        MethodTestData data = { 0 };
+        char *methods;
+
+        method_test_data_init (tf, &data);
+
+        // A device that only talks M-POST costs one refused POST...
+        data.refuse_post = TRUE;
+        methods = method_ping (&data);
+        g_assert_no_error (data.error);
+        g_assert_cmpstr (methods, ==, "POST,M-POST");
+        g_free (methods);
+
+        // ...and the next call goes there directly
+        methods = method_ping (&data);
+        g_assert_no_error (data.error);
+        g_assert_cmpstr (methods, ==, "M-POST");
+        g_free (methods);
+
+        // If the device changes its mind, the memo is switched back
+        data.refuse_post = FALSE;
+        data.refuse_m_post = TRUE;
+        methods = method_ping (&data);
+        g_assert_no_error (data.error);
+        g_assert_cmpstr (methods, ==, "M-POST,POST");
+        g_free (methods);
+
+        methods = method_ping (&data);
+        g_assert_no_error (data.error);
+        g_assert_cmpstr (methods, ==, "POST");
+        g_free (methods);
+
+        method_test_data_clear (&data);
+}
+
+void
+test_action_method_retry_once (ProxyTestFixture *tf,
+                               G_GNUC_UNUSED gconstpointer user_data)
+{
+        MethodTestData data = { 0 };
+        char *methods;
+
+        method_test_data_init (tf, &data);
+
+        // Learn M-POST first
+        data.refuse_post = TRUE;
+        methods = method_ping (&data);
+        g_assert_no_error (data.error);
+        g_assert_cmpstr (methods, ==, "POST,M-POST");
+        g_free (methods);
+
+        // Refusing both only gets the one retry
+        data.refuse_m_post = TRUE;
+        methods = method_ping (&data);
+        g_assert_error (data.error,
+                        GUPNP_SERVER_ERROR,
+                        GUPNP_SERVER_ERROR_OTHER);
+        g_assert_cmpstr (methods, ==, "M-POST,POST");
+        g_free (methods);
+
+        // A failed call does not change what is remembered, and the next one
+        // gets its own retry again
+        methods = method_ping (&data);
+        g_assert_error (data.error,
+                        GUPNP_SERVER_ERROR,
+                        GUPNP_SERVER_ERROR_OTHER);
+        g_assert_cmpstr (methods, ==, "M-POST,POST");
+        g_free (methods);
+
+        method_test_data_clear (&data);
+}
+
+typedef struct {
+        char *result;
+        guint number_returned;
+        gint64 total_matches;
+        guint update_id;
+} BrowseResult;
+
+void
+test_action_read_result (ProxyTestFixture *tf, gconstpointer user_data)
+{
+        GError *error = NULL;
+        BrowseResult result = { NULL, 0, 0, 0 };
+
+        gupnp_service_info_introspect_async (GUPNP_SERVICE_INFO (tf->proxy),
+                                             NULL,
+                                             on_introspection,
+                                             tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_action_iter_call_browse),
+                          tf);
+
+        g_autoptr (GUPnPServiceProxyResultReader) reader =
+                gupnp_service_proxy_result_reader_new ();
+
+        g_assert_true (gupnp_service_proxy_result_reader_add (
+                reader,
+                "Result",
+                G_TYPE_STRING,
+                G_STRUCT_OFFSET (BrowseResult, result),
+                &error));
+        g_assert_no_error (error);
+
+        g_assert_true (gupnp_service_proxy_result_reader_add (
+                reader,
+                "NumberReturned",
+                G_TYPE_UINT,
+                G_STRUCT_OFFSET (BrowseResult, number_returned),
+                &error));
+        g_assert_no_error (error);
+
+        // The member type does not need to match the argument's type
+        g_assert_true (gupnp_service_proxy_result_reader_add (
+                reader,
+                "TotalMatches",
+                G_TYPE_INT64,
+                G_STRUCT_OFFSET (BrowseResult, total_matches),
+                &error));
+        g_assert_no_error (error);
+
+        GUPnPServiceIntrospection *introspection =
+                gupnp_service_info_get_introspection (
+                        GUPNP_SERVICE_INFO (tf->proxy));
+        g_assert_nonnull (introspection);
+
+        g_assert_true (gupnp_service_proxy_result_reader_add_from_introspection (
+                reader,
+                introspection,
+                "Browse",
+                "UpdateID",
+                G_STRUCT_OFFSET (BrowseResult, update_id),
+                &error));
+        g_assert_no_error (error);
+
+        // In arguments cannot be read
+        g_assert_false (gupnp_service_proxy_result_reader_add_from_introspection (
+                reader,
+                introspection,
+                "Browse",
+                "ObjectID",
+                0,
+                &error));
+        g_assert_error (error, GUPNP_SERVER_ERROR, GUPNP_SERVER_ERROR_OTHER);
+        g_clear_error (&error);
+
+        // Neither can arguments be added twice
+        g_assert_false (gupnp_service_proxy_result_reader_add (reader,
+                                                               "Result",
+                                                               G_TYPE_STRING,
+                                                               0,
+                                                               &error));
+        g_assert_error (error, GUPNP_SERVER_ERROR, GUPNP_SERVER_ERROR_OTHER);
+        g_clear_error (&error);
+
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Browse",
+                                                "ObjectID",
+                                                G_TYPE_STRING,
+                                                "0",
+                                                "BrowseFlag",
+                                                G_TYPE_STRING,
+                                                "BrowseDirectChildren",
+                                                NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        g_assert_true (gupnp_service_proxy_action_read_result (action,
+                                                               reader,
+                                                               &result,
+                                                               &error));
+        g_assert_no_error (error);
+
+        g_assert_cmpstr (result.result, ==, "FAKE_RESULT");
+        g_assert_cmpuint (result.number_returned, ==, 10);
+        g_assert_cmpint (result.total_matches, ==, 10);
+        g_assert_cmpuint (result.update_id, ==, 12345);
+
+        g_free (result.result);
+        gupnp_service_proxy_action_unref (action);
+}
+
+void
+on_test_read_result_repeated_browse (G_GNUC_UNUSED GUPnPService *service,
+                                     GUPnPServiceAction *action,
+                                     G_GNUC_UNUSED gpointer user_data)
+{
+        gupnp_service_action_set (action,
+                                  "Result",
+                                  G_TYPE_STRING,
+                                  "first",
+                                  "Result",
+                                  G_TYPE_STRING,
+                                  "second",
+                                  "TotalMatches",
+                                  G_TYPE_UINT,
+                                  3,
+                                  NULL);
+        gupnp_service_action_return_success (action);
+}
+
+void
+test_action_read_result_repeated (ProxyTestFixture *tf,
+                                  G_GNUC_UNUSED gconstpointer user_data)
+{
+        GError *error = NULL;
+        BrowseResult result = { NULL, 0, 0, 0 };
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_read_result_repeated_browse),
+                          tf);
+
+        g_autoptr (GUPnPServiceProxyResultReader) reader =
+                gupnp_service_proxy_result_reader_new ();
+
+        g_assert_true (gupnp_service_proxy_result_reader_add (
+                reader,
+                "Result",
+                G_TYPE_STRING,
+                G_STRUCT_OFFSET (BrowseResult, result),
+                &error));
+        g_assert_true (gupnp_service_proxy_result_reader_add (
+                reader,
+                "NumberReturned",
+                G_TYPE_UINT,
+                G_STRUCT_OFFSET (BrowseResult, number_returned),
+                &error));
+        g_assert_true (gupnp_service_proxy_result_reader_add (
+                reader,
+                "TotalMatches",
+                G_TYPE_INT64,
+                G_STRUCT_OFFSET (BrowseResult, total_matches),
+                &error));
+        g_assert_no_error (error);
+
+        GUPnPServiceProxyAction *action =
+                gupnp_service_proxy_action_new ("Browse",
+                                                "ObjectID",
+                                                G_TYPE_STRING,
+                                                "0",
+                                                NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_async_call,
+                                               tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        // The repeated argument does not make up for the missing one
+        g_test_expect_message (NULL,
+                               G_LOG_LEVEL_WARNING,
+                               "*\"NumberReturned\"*");
+        g_assert_true (gupnp_service_proxy_action_read_result (action,
+                                                               reader,
+                                                               &result,
+                                                               &error));
+        g_test_assert_expected_messages ();
+        g_assert_no_error (error);
+
+        g_assert_cmpstr (result.result, ==, "second");
+        g_assert_cmpuint (result.number_returned, ==, 0);
+        g_assert_cmpint (result.total_matches, ==, 3);
+
+        g_free (result.result);
+        gupnp_service_proxy_action_unref (action);
+}
+
+typedef struct {
+        char *body;
+        gsize length;
+        GPtrArray *conditions; // If-None-Match of every request, "" if none
+} DescriptionServerData;
+
+static void
+on_cached_description_request (G_GNUC_UNUSED SoupServer *server,
+                               SoupServerMessage *msg,
+                               G_GNUC_UNUSED const char *path,
+                               G_GNUC_UNUSED GHashTable *query,
+                               gpointer user_data)
+{
+        DescriptionServerData *data = user_data;
+        const char *condition;
+
+        condition = soup_message_headers_get_one (
+                soup_server_message_get_request_headers (msg),
+                "If-None-Match");
+        g_ptr_array_add (data->conditions,
+                         g_strdup (condition != NULL ? condition : ""));
+
+        soup_message_headers_replace (
+                soup_server_message_get_response_headers (msg),
+                "ETag",
+                "\"v1\"");
+
+        if (g_strcmp0 (condition, "\"v1\"") == 0) {
+                soup_server_message_set_status (msg,
+                                                SOUP_STATUS_NOT_MODIFIED,
+                                                NULL);
+
+                return;
+        }
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+        soup_server_message_set_response (msg,
+                                          "text/xml",
+                                          SOUP_MEMORY_STATIC,
+                                          data->body,
+                                          data->length);
+}
+
+static void
+on_cached_description_proxy (G_GNUC_UNUSED GUPnPControlPoint *cp,
+                             G_GNUC_UNUSED GUPnPServiceProxy *proxy,
+                             gpointer user_data)
+{
+        g_main_loop_quit (user_data);
+}
+
+// A new control point does not share the parsed descriptions of the others
+static void
+find_proxy_with_new_control_point (ProxyTestFixture *tf)
+{
+        GUPnPControlPoint *cp;
+
+        cp = gupnp_control_point_new (tf->client_context,
+                                      "urn:test-gupnp-org:service:TestService:1");
+        g_signal_connect (cp,
+                          "service-proxy-available",
+                          G_CALLBACK (on_cached_description_proxy),
+                          tf->loop);
+        gssdp_resource_browser_set_active (GSSDP_RESOURCE_BROWSER (cp), TRUE);
+        test_run_loop (tf->loop, g_test_get_path ());
+        g_object_unref (cp);
+}
+
+static void
+remove_cached_files (const char *path, const char *suffix)
+{
+        GDir *dir = g_dir_open (path, 0, NULL);
+        const char *name;
+
+        g_assert_nonnull (dir);
+        while ((name = g_dir_read_name (dir)) != NULL) {
+                char *file;
+
+                if (!g_str_has_suffix (name, suffix))
+                        continue;
+
+                file = g_build_filename (path, name, NULL);
+                g_assert_cmpint (g_unlink (file), ==, 0);
+                g_free (file);
+        }
+        g_dir_close (dir);
+}
+
+void
+test_description_cache (ProxyTestFixture *tf,
+                        G_GNUC_UNUSED gconstpointer user_data)
+{
+        DescriptionServerData data = { NULL, 0, NULL };
+        GError *error = NULL;
+        GUri *location;
+        char *dir;
+
+        g_assert_true (g_file_get_contents (DATA_PATH "/TestDevice.xml",
+                                            &data.body,
+                                            &data.length,
+                                            &error));
+        g_assert_no_error (error);
+        data.conditions = g_ptr_array_new_with_free_func (g_free);
+
+        // Serve the description with a validator
+        location = g_uri_parse (
+                gupnp_device_info_get_location (GUPNP_DEVICE_INFO (tf->rd)),
+                G_URI_FLAGS_NONE,
+                &error);
+        g_assert_no_error (error);
+        soup_server_add_handler (gupnp_context_get_server (tf->server_context),
+                                 g_uri_get_path (location),
+                                 on_cached_description_request,
+                                 &data,
+                                 NULL);
+        g_uri_unref (location);
+
+        dir = g_dir_make_tmp ("gupnp-description-cache-XXXXXX", &error);
+        g_assert_no_error (error);
+        gupnp_context_set_description_cache_dir (tf->client_context, dir);
+        g_assert_cmpstr (
+                gupnp_context_get_description_cache_dir (tf->client_context),
+                ==,
+                dir);
+
+        // Nothing is stored yet, so the whole document is fetched
+        find_proxy_with_new_control_point (tf);
+        g_assert_cmpuint (data.conditions->len, ==, 1);
+        g_assert_cmpstr (g_ptr_array_index (data.conditions, 0), ==, "");
+
+        // The next download is conditional and uses the stored copy
+        find_proxy_with_new_control_point (tf);
+        g_assert_cmpuint (data.conditions->len, ==, 2);
+        g_assert_cmpstr (g_ptr_array_index (data.conditions, 1),
+                         ==,
+                         "\"v1\"");
+
+        // Without the stored body, the document is asked for again in full
+        remove_cached_files (dir, ".xml");
+        find_proxy_with_new_control_point (tf);
+        g_assert_cmpuint (data.conditions->len, ==, 4);
+        g_assert_cmpstr (g_ptr_array_index (data.conditions, 2),
+                         ==,
+                         "\"v1\"");
+        g_assert_cmpstr (g_ptr_array_index (data.conditions, 3), ==, "");
+
+        // Finishes the pending writes
+        gupnp_context_set_description_cache_dir (tf->client_context, NULL);
+        remove_cached_files (dir, "");
+        g_assert_cmpint (g_rmdir (dir), ==, 0);
+
+        g_free (dir);
+        g_ptr_array_unref (data.conditions);
+        g_free (data.body);
+}
+
+typedef struct {
+        ProxyTestFixture *tf;
+        GPtrArray *result;
+        GUPnPServiceAction *held;
+} BatchTestData;
+
+void
+on_test_batch_browse (G_GNUC_UNUSED GUPnPService *service,
+                      GUPnPServiceAction *action,
+                      gpointer user_data)
+{
+        BatchTestData *data = user_data;
+        char *id = NULL;
+
+        gupnp_service_action_get (action, "ObjectID", G_TYPE_STRING, &id, NULL);
+
+        // Never answer in time to run into the deadline
+        if (g_str_equal (id, "slow")) {
+                data->held = action;
+        } else {
+                gupnp_service_action_set (action,
+                                          "Result",
+                                          G_TYPE_STRING,
+                                          id,
+                                          NULL);
+                gupnp_service_action_return_success (action);
+        }
+
+        g_free (id);
+}
+
+void
+on_test_batch_finished (G_GNUC_UNUSED GObject *source,
+                        GAsyncResult *res,
+                        gpointer user_data)
+{
+        BatchTestData *data = user_data;
+        GError *error = NULL;
+
+        data->result = gupnp_service_proxy_call_batch_finish (res, &error);
+        g_assert_no_error (error);
+        g_assert_nonnull (data->result);
+
+        g_main_loop_quit (data->tf->loop);
+}
+
+void
+test_batch_call (ProxyTestFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        BatchTestData data = { tf, NULL, NULL };
+        GPtrArray *proxies = g_ptr_array_new ();
+        GPtrArray *actions = g_ptr_array_new_with_free_func (
+                (GDestroyNotify) gupnp_service_proxy_action_unref);
+        GError *error = NULL;
+        char *result = NULL;
+        guint i;
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_batch_browse),
+                          &data);
+
+        for (i = 0; i < 3; i++)
+                g_ptr_array_add (proxies, tf->proxy);
+
+        // One action for all proxies
+        g_ptr_array_add (actions,
+                         gupnp_service_proxy_action_new ("Browse",
+                                                         "ObjectID",
+                                                         G_TYPE_STRING,
+                                                         "shared",
+                                                         NULL));
+
+        gupnp_service_proxy_call_batch_async (proxies,
+                                              actions,
+                                              0,
+                                              NULL,
+                                              on_test_batch_finished,
+                                              &data);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        g_assert_cmpuint (data.result->len, ==, 3);
+        for (i = 0; i < data.result->len; i++) {
+                g_assert_true (gupnp_service_proxy_action_get_result (
+                        g_ptr_array_index (data.result, i),
+                        &error,
+                        "Result",
+                        G_TYPE_STRING,
+                        &result,
+                        NULL));
+                g_assert_no_error (error);
+                g_assert_cmpstr (result, ==, "shared");
+                g_clear_pointer (&result, g_free);
+        }
+        g_clear_pointer (&data.result, g_ptr_array_unref);
+
+        // One action per proxy, with one of them missing the deadline
+        g_ptr_array_set_size (actions, 0);
+        g_ptr_array_add (actions,
+                         gupnp_service_proxy_action_new ("Browse",
+                                                         "ObjectID",
+                                                         G_TYPE_STRING,
+                                                         "first",
+                                                         NULL));
+        g_ptr_array_add (actions,
+                         gupnp_service_proxy_action_new ("Browse",
+                                                         "ObjectID",
+                                                         G_TYPE_STRING,
+                                                         "slow",
+                                                         NULL));
+        g_ptr_array_add (actions,
+                         gupnp_service_proxy_action_new ("Browse",
+                                                         "ObjectID",
+                                                         G_TYPE_STRING,
+                                                         "third",
+                                                         NULL));
+
+        gupnp_service_proxy_call_batch_async (proxies,
+                                              actions,
+                                              500,
+                                              NULL,
+                                              on_test_batch_finished,
+                                              &data);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        g_assert_cmpuint (data.result->len, ==, 3);
+        g_assert_true (g_ptr_array_index (data.result, 0) ==
+                       g_ptr_array_index (actions, 0));
+
+        g_assert_true (gupnp_service_proxy_action_get_result (
+                g_ptr_array_index (data.result, 2),
+                &error,
+                "Result",
+                G_TYPE_STRING,
+                &result,
+                NULL));
+        g_assert_no_error (error);
+        g_assert_cmpstr (result, ==, "third");
+        g_clear_pointer (&result, g_free);
+
+        g_assert_false (gupnp_service_proxy_action_get_result (
+                g_ptr_array_index (data.result, 1),
+                &error,
+                "Result",
+                G_TYPE_STRING,
+                &result,
+                NULL));
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+        g_clear_error (&error);
+
+        g_assert_nonnull (data.held);
+        gupnp_service_action_return_success (data.held);
+
+        g_ptr_array_unref (data.result);
+        g_ptr_array_unref (actions);
+        g_ptr_array_unref (proxies);
+}
+
+typedef struct {
+        ProxyTestFixture *tf;
+        guint invoked;
+        guint finished;
+} CoalesceTestData;
+
+void
+on_test_coalesce_browse (G_GNUC_UNUSED GUPnPService *service,
+                         GUPnPServiceAction *action,
+                         gpointer user_data)
+{
+        CoalesceTestData *data = user_data;
+
+        data->invoked++;
+        gupnp_service_action_set (action,
+                                  "TotalMatches",
+                                  G_TYPE_UINT,
+                                  data->invoked,
+                                  NULL);
+        gupnp_service_action_return_success (action);
+}
+
+void
+on_test_coalesce_finished (GObject *source,
+                           GAsyncResult *res,
+                           gpointer user_data)
+{
+        CoalesceTestData *data = user_data;
+        GUPnPServiceProxyAction *action;
+        GError *error = NULL;
+        guint total = 0;
+
+        action = gupnp_service_proxy_call_action_finish (
+                GUPNP_SERVICE_PROXY (source),
+                res,
+                &error);
+        g_assert_no_error (error);
+
+        g_assert_true (gupnp_service_proxy_action_get_result (action,
+                                                              &error,
+                                                              "TotalMatches",
+                                                              G_TYPE_UINT,
+                                                              &total,
+                                                              NULL));
+        g_assert_no_error (error);
+
+        // Everybody got the answer to the first request
+        g_assert_cmpuint (total, ==, 1);
+
+        if (++data->finished == 3)
+                g_main_loop_quit (data->tf->loop);
+}
+
+void
+test_action_coalesce (ProxyTestFixture *tf,
+                      G_GNUC_UNUSED gconstpointer user_data)
+{
+        CoalesceTestData data = { tf, 0, 0 };
+        GUPnPServiceProxyAction *actions[3];
+        guint i;
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_coalesce_browse),
+                          &data);
+
+        for (i = 0; i < G_N_ELEMENTS (actions); i++) {
+                actions[i] = gupnp_service_proxy_action_new ("Browse",
+                                                             "ObjectID",
+                                                             G_TYPE_STRING,
+                                                             "0",
+                                                             NULL);
+                gupnp_service_proxy_action_set_coalesce (actions[i], TRUE);
+                gupnp_service_proxy_call_action_async (
+                        tf->proxy,
+                        actions[i],
+                        NULL,
+                        on_test_coalesce_finished,
+                        &data);
+        }
+
+        test_run_loop (tf->loop, g_test_get_path ());
+        g_assert_cmpuint (data.invoked, ==, 1);
+
+        for (i = 0; i < G_N_ELEMENTS (actions); i++)
+                gupnp_service_proxy_action_unref (actions[i]);
+}
+
+typedef struct {
+        ProxyTestFixture *tf;
+        GUPnPServiceAction *held;
+        guint finished;
+} CoalesceCancelData;
+
+static gboolean
+release_coalesced_action (gpointer user_data)
+{
+        CoalesceCancelData *data = user_data;
+
+        gupnp_service_action_return_success (data->held);
+        data->held = NULL;
+
+        return G_SOURCE_REMOVE;
+}
+
+void
+on_test_coalesce_cancel_browse (G_GNUC_UNUSED GUPnPService *service,
+                                GUPnPServiceAction *action,
+                                gpointer user_data)
+{
+        CoalesceCancelData *data = user_data;
+
+        // Only the first call may reach the server
+        g_assert_null (data->held);
+        data->held = action;
+        g_timeout_add (200, release_coalesced_action, data);
+}
+
+void
+on_test_coalesce_cancel_leader (GObject *source,
+                                GAsyncResult *res,
+                                gpointer user_data)
+{
+        CoalesceCancelData *data = user_data;
+        GError *error = NULL;
+
+        gupnp_service_proxy_call_action_finish (GUPNP_SERVICE_PROXY (source),
+                                                res,
+                                                &error);
+        g_assert_no_error (error);
+
+        // The cancelled call was not kept waiting for this one
+        g_assert_cmpuint (data->finished, ==, 1);
+        data->finished++;
+        g_main_loop_quit (data->tf->loop);
+}
+
+void
+on_test_coalesce_cancel_waiter (GObject *source,
+                                GAsyncResult *res,
+                                gpointer user_data)
+{
+        CoalesceCancelData *data = user_data;
+        GError *error = NULL;
+
+        gupnp_service_proxy_call_action_finish (GUPNP_SERVICE_PROXY (source),
+                                                res,
+                                                &error);
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+        g_error_free (error);
+
+        g_assert_cmpuint (data->finished, ==, 0);
+        data->finished++;
+}
+
+void
+test_action_coalesce_cancel (ProxyTestFixture *tf,
+                             G_GNUC_UNUSED gconstpointer user_data)
+{
+        CoalesceCancelData data = { tf, NULL, 0 };
+        GCancellable *cancellable = g_cancellable_new ();
+        GUPnPServiceProxyAction *leader;
+        GUPnPServiceProxyAction *waiter;
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_coalesce_cancel_browse),
+                          &data);
+
+        leader = gupnp_service_proxy_action_new ("Browse",
+                                                 "ObjectID",
+                                                 G_TYPE_STRING,
+                                                 "0",
+                                                 NULL);
+        gupnp_service_proxy_action_set_coalesce (leader, TRUE);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               leader,
+                                               NULL,
+                                               on_test_coalesce_cancel_leader,
+                                               &data);
+
+        waiter = gupnp_service_proxy_action_new ("Browse",
+                                                 "ObjectID",
+                                                 G_TYPE_STRING,
+                                                 "0",
+                                                 NULL);
+        gupnp_service_proxy_action_set_coalesce (waiter, TRUE);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               waiter,
+                                               cancellable,
+                                               on_test_coalesce_cancel_waiter,
+                                               &data);
+
+        g_cancellable_cancel (cancellable);
+
+        test_run_loop (tf->loop, g_test_get_path ());
+        g_assert_cmpuint (data.finished, ==, 2);
+
+        g_object_unref (cancellable);
+        gupnp_service_proxy_action_unref (leader);
+        gupnp_service_proxy_action_unref (waiter);
+}
+
+void
+on_test_action_cache_finished (GObject *source,
+                               GAsyncResult *res,
+                               gpointer user_data)
+{
+        CoalesceTestData *data = user_data;
+        GUPnPServiceProxyAction *action;
+        GError *error = NULL;
+        guint total = 0;
+
+        action = gupnp_service_proxy_call_action_finish (
+                GUPNP_SERVICE_PROXY (source),
+                res,
+                &error);
+        g_assert_no_error (error);
+
+        g_assert_true (gupnp_service_proxy_action_get_result (action,
+                                                              &error,
+                                                              "TotalMatches",
+                                                              G_TYPE_UINT,
+                                                              &total,
+                                                              NULL));
+        g_assert_no_error (error);
+
+        // The second call is answered with the result of the first
+        g_assert_cmpuint (total, ==, 1);
+
+        if (++data->finished == 2) {
+                g_main_loop_quit (data->tf->loop);
+
+                return;
+        }
+
+        gupnp_service_proxy_call_action_async (GUPNP_SERVICE_PROXY (source),
+                                               action,
+                                               NULL,
+                                               on_test_action_cache_finished,
+                                               data);
+}
+
+void
+test_action_cache (ProxyTestFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        CoalesceTestData data = { tf, 0, 0 };
+        GUPnPServiceProxyAction *action;
+
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_test_coalesce_browse),
+                          &data);
+
+        gupnp_service_proxy_set_action_cache (tf->proxy, "Browse", 0, NULL);
+
+        action = gupnp_service_proxy_action_new ("Browse",
+                                                 "ObjectID",
+                                                 G_TYPE_STRING,
+                                                 "0",
+                                                 NULL);
+        gupnp_service_proxy_call_action_async (tf->proxy,
+                                               action,
+                                               NULL,
+                                               on_test_action_cache_finished,
+                                               &data);
+
+        test_run_loop (tf->loop, g_test_get_path ());
+        g_assert_cmpuint (data.invoked, ==, 1);
+
+        gupnp_service_proxy_unset_action_cache (tf->proxy, "Browse");
+        gupnp_service_proxy_action_unref (action);
+}
+
+typedef struct {
+        ProxyTestFixture *tf;
+        GUPnPServiceIntrospection *introspection;
+        guint finished;
+} SharedIntrospectionData;
+
+void
+on_shared_introspection_cancelled (GObject *source,
+                                   GAsyncResult *res,
+                                   gpointer user_data)
+{
+        SharedIntrospectionData *data = user_data;
+        GError *error = NULL;
+
+        g_assert_null (gupnp_service_info_introspect_finish (
+                GUPNP_SERVICE_INFO (source),
+                res,
+                &error));
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+        g_error_free (error);
+
+        if (++data->finished == 2)
+                g_main_loop_quit (data->tf->loop);
+}
+
+void
+on_shared_introspection (GObject *source,
+                         GAsyncResult *res,
+                         gpointer user_data)
+{
+        SharedIntrospectionData *data = user_data;
+        GError *error = NULL;
+
+        data->introspection = gupnp_service_info_introspect_finish (
+                GUPNP_SERVICE_INFO (source),
+                res,
+                &error);
+        g_assert_no_error (error);
+        g_assert_nonnull (data->introspection);
+
+        if (++data->finished == 2)
+                g_main_loop_quit (data->tf->loop);
+}
+
+void
+test_shared_introspection (ProxyTestFixture *tf,
+                           G_GNUC_UNUSED gconstpointer user_data)
+{
+        SharedIntrospectionData data = { tf, NULL, 0 };
+        GCancellable *cancellable = g_cancellable_new ();
+
+        // Both calls wait for the same download, which must go on when
+        // the first one is cancelled
+        gupnp_service_info_introspect_async (GUPNP_SERVICE_INFO (tf->proxy),
+                                             cancellable,
+                                             on_shared_introspection_cancelled,
+                                             &data);
+        gupnp_service_info_introspect_async (GUPNP_SERVICE_INFO (tf->proxy),
+                                             NULL,
+                                             on_shared_introspection,
+                                             &data);
+        g_cancellable_cancel (cancellable);
+
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        g_assert_true (data.introspection ==
+                       gupnp_service_info_get_introspection (
+                               GUPNP_SERVICE_INFO (tf->proxy)));
+
+        g_object_unref (data.introspection);
+        g_object_unref (cancellable);
+}
+
+static gpointer
+cancel_in_thread (gpointer user_data)
+{
+        g_cancellable_cancel (G_CANCELLABLE (user_data));
+
+        return NULL;
+}
+
+void
+on_introspection_cancelled_in_thread (GObject *source,
+                                      GAsyncResult *res,
+                                      gpointer user_data)
+{
+        // Finished in the thread that started it, not the cancelling one
+        g_assert_true (g_main_context_is_owner (g_main_context_default ()));
+
+        on_shared_introspection_cancelled (source, res, user_data);
+}
+
+void
+test_introspection_cancel_thread (ProxyTestFixture *tf,
+                                  G_GNUC_UNUSED gconstpointer user_data)
+{
+        // A single call, so it counts as the second one to finish
+        SharedIntrospectionData data = { tf, NULL, 1 };
+        GCancellable *cancellable = g_cancellable_new ();
+        GThread *thread;
+
+        gupnp_service_info_introspect_async (
+                GUPNP_SERVICE_INFO (tf->proxy),
+                cancellable,
+                on_introspection_cancelled_in_thread,
+                &data);
+
+        thread = g_thread_new ("cancel", cancel_in_thread, cancellable);
+        g_thread_join (thread);
+
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        g_object_unref (cancellable);
+}
+
+#define SHARED_SCPD_UDN "uuid:shared-scpd"
+
+// Two services of one device. The first format argument holds the
+// configId attribute of the document, the second the SCPD URL of the
+// second service.
+static const char *shared_scpd_description =
+        "<root xmlns=\"urn:schemas-upnp-org:device-1-0\"%s>"
+        "<specVersion><major>1</major><minor>0</minor></specVersion>"
+        "<device>"
+        "<deviceType>urn:test-gupnp-org:device:TestDevice:1</deviceType>"
+        "<friendlyName>Shared SCPD device</friendlyName>"
+        "<UDN>" SHARED_SCPD_UDN "</UDN>"
+        "<serviceList>"
+        "<service>"
+        "<serviceType>urn:test-gupnp-org:service:TestService:1</serviceType>"
+        "<serviceId>urn:test-gupnp-org:serviceId:TestService:1</serviceId>"
+        "<SCPDURL>/Shared/A.xml</SCPDURL>"
+        "<controlURL>/Shared/A/Control</controlURL>"
+        "<eventSubURL>/Shared/A/Event</eventSubURL>"
+        "</service>"
+        "<service>"
+        "<serviceType>urn:test-gupnp-org:service:OtherService:1</serviceType>"
+        "<serviceId>urn:test-gupnp-org:serviceId:OtherService:1</serviceId>"
+        "<SCPDURL>%s</SCPDURL>"
+        "<controlURL>/Shared/B/Control</controlURL>"
+        "<eventSubURL>/Shared/B/Event</eventSubURL>"
+        "</service>"
+        "</serviceList>"
+        "</device>"
+        "</root>";
+
+typedef struct {
+        ProxyTestFixture *tf;
+        char *description;
+        char *scpd;
+        gsize scpd_length;
+        GPtrArray *scpd_requests;
+        GPtrArray *proxies;
+        GUPnPServiceIntrospection *introspection;
+} SharedScpdData;
+
+static void
+on_shared_scpd_request (G_GNUC_UNUSED SoupServer *server,
+                        SoupServerMessage *msg,
+                        const char *path,
+                        G_GNUC_UNUSED GHashTable *query,
+                        gpointer user_data)
+{
+        SharedScpdData *data = user_data;
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+        if (g_str_equal (path, "/Shared/Description.xml")) {
+                soup_server_message_set_response (msg,
+                                                  "text/xml",
+                                                  SOUP_MEMORY_STATIC,
+                                                  data->description,
+                                                  strlen (data->description));
+
+                return;
+        }
+
+        // Every other document is the same SCPD
+        g_ptr_array_add (data->scpd_requests, g_strdup (path));
+        soup_server_message_set_response (msg,
+                                          "text/xml",
+                                          SOUP_MEMORY_STATIC,
+                                          data->scpd,
+                                          data->scpd_length);
+}
+
+static void
+on_shared_scpd_proxy (G_GNUC_UNUSED GUPnPControlPoint *cp,
+                      GUPnPServiceProxy *proxy,
+                      gpointer user_data)
+{
+        SharedScpdData *data = user_data;
+
+        g_ptr_array_add (data->proxies, g_object_ref (proxy));
+        if (data->proxies->len == 2)
+                g_main_loop_quit (data->tf->loop);
+}
+
+static void
+on_shared_scpd_introspected (GObject *source,
+                             GAsyncResult *res,
+                             gpointer user_data)
+{
+        SharedScpdData *data = user_data;
+        GError *error = NULL;
+
+        data->introspection = gupnp_service_info_introspect_finish (
+                GUPNP_SERVICE_INFO (source),
+                res,
+                &error);
+        g_assert_no_error (error);
+        g_assert_nonnull (data->introspection);
+
+        g_main_loop_quit (data->tf->loop);
+}
+
+static GUPnPServiceIntrospection *
+introspect_shared_scpd (SharedScpdData *data, guint index)
+{
+        GUPnPServiceIntrospection *introspection;
+
+        gupnp_service_info_introspect_async (
+                GUPNP_SERVICE_INFO (g_ptr_array_index (data->proxies, index)),
+                NULL,
+                on_shared_scpd_introspected,
+                data);
+        test_run_loop (data->tf->loop, g_test_get_path ());
+
+        introspection = data->introspection;
+        data->introspection = NULL;
+
+        return introspection;
+}
+
+// Serve the device described by @config_id and @second_scpd_url and
+// introspect both of its services, one after the other
+static void
+run_shared_scpd_test (ProxyTestFixture *tf,
+                      const char *config_id,
+                      const char *second_scpd_url,
+                      guint expected_scpd_requests)
+{
+        SharedScpdData data = { tf, NULL, NULL, 0, NULL, NULL, NULL };
+        GUPnPServiceIntrospection *first;
+        GUPnPServiceIntrospection *second;
+        GUPnPControlPoint *cp;
+        GError *error = NULL;
+        GUri *device_location;
+        GList *locations;
+        char *location;
+
+        g_assert_true (g_file_get_contents (DATA_PATH "/TestService.xml",
+                                            &data.scpd,
+                                            &data.scpd_length,
+                                            &error));
+        g_assert_no_error (error);
+        data.description = g_strdup_printf (shared_scpd_description,
+                                            config_id,
+                                            second_scpd_url);
+        data.scpd_requests = g_ptr_array_new_with_free_func (g_free);
+        data.proxies = g_ptr_array_new_with_free_func (g_object_unref);
+
+        soup_server_add_handler (gupnp_context_get_server (tf->server_context),
+                                 "/Shared",
+                                 on_shared_scpd_request,
+                                 &data,
+                                 NULL);
+
+        device_location = g_uri_parse (
+                gupnp_device_info_get_location (GUPNP_DEVICE_INFO (tf->rd)),
+                G_URI_FLAGS_NONE,
+                &error);
+        g_assert_no_error (error);
+        location = g_uri_join (G_URI_FLAGS_NONE,
+                               "http",
+                               NULL,
+                               g_uri_get_host (device_location),
+                               g_uri_get_port (device_location),
+                               "/Shared/Description.xml",
+                               NULL,
+                               NULL);
+        g_uri_unref (device_location);
+
+        // Announce both services by hand, the device is not on the network
+        cp = gupnp_control_point_new (tf->client_context,
+                                      "urn:test-gupnp-org:service:TestService:1");
+        g_signal_connect (cp,
+                          "service-proxy-available",
+                          G_CALLBACK (on_shared_scpd_proxy),
+                          &data);
+        locations = g_list_prepend (NULL, location);
+        g_signal_emit_by_name (
+                cp,
+                "resource-available",
+                SHARED_SCPD_UDN "::urn:test-gupnp-org:service:TestService:1",
+                locations);
+        g_signal_emit_by_name (
+                cp,
+                "resource-available",
+                SHARED_SCPD_UDN "::urn:test-gupnp-org:service:OtherService:1",
+                locations);
+        g_list_free (locations);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        first = introspect_shared_scpd (&data, 0);
+        second = introspect_shared_scpd (&data, 1);
+
+        g_assert_true (first == second);
+        g_assert_cmpuint (data.scpd_requests->len, ==, expected_scpd_requests);
+
+        soup_server_remove_handler (
+                gupnp_context_get_server (tf->server_context),
+                "/Shared");
+
+        g_object_unref (first);
+        g_object_unref (second);
+        g_object_unref (cp);
+        g_free (location);
+        g_ptr_array_unref (data.proxies);
+        g_ptr_array_unref (data.scpd_requests);
+        g_free (data.description);
+        g_free (data.scpd);
+}
+
+// Identical SCPDs at different URLs are only parsed once
+void
+test_shared_introspection_content (ProxyTestFixture *tf,
+                                   G_GNUC_UNUSED gconstpointer user_data)
+{
+        run_shared_scpd_test (tf, "", "/Shared/B.xml", 2);
+}
+
+// With a configId, the second service of the same SCPD URL does not even
+// download it
+void
+test_shared_introspection_config_id (ProxyTestFixture *tf,
+                                     G_GNUC_UNUSED gconstpointer user_data)
+{
+        run_shared_scpd_test (tf, " configId=\"1\"", "/Shared/A.xml", 1);
+}
+
+// A device with two evented services that is announced to a control point
+// by hand. Its event server hands out the SIDs, and the tests send the
+// NOTIFYs themselves.
+#define EVENT_DEVICE_UDN "uuid:event-device"
+
+enum { EVENT_SERVICE_A, EVENT_SERVICE_B, EVENT_SERVICES };
+
+static const char *event_service_types[EVENT_SERVICES] = {
+        "urn:test-gupnp-org:service:TestService:1",
+        "urn:test-gupnp-org:service:OtherService:1",
+};
+
+static const char *event_paths[EVENT_SERVICES] = { "/Event/A", "/Event/B" };
+
+static const char *event_device_description =
+        "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+        "<specVersion><major>1</major><minor>0</minor></specVersion>"
+        "<device>"
+        "<deviceType>urn:test-gupnp-org:device:TestDevice:1</deviceType>"
+        "<friendlyName>Event device</friendlyName>"
+        "<UDN>" EVENT_DEVICE_UDN "</UDN>"
+        "<serviceList>"
+        "<service>"
+        "<serviceType>urn:test-gupnp-org:service:TestService:1</serviceType>"
+        "<serviceId>urn:test-gupnp-org:serviceId:TestService:1</serviceId>"
+        "<SCPDURL>/Event/A.xml</SCPDURL>"
+        "<controlURL>/Event/A/Control</controlURL>"
+        "<eventSubURL>/Event/A</eventSubURL>"
+        "</service>"
+        "<service>"
+        "<serviceType>urn:test-gupnp-org:service:OtherService:1</serviceType>"
+        "<serviceId>urn:test-gupnp-org:serviceId:OtherService:1</serviceId>"
+        "<SCPDURL>/Event/B.xml</SCPDURL>"
+        "<controlURL>/Event/B/Control</controlURL>"
+        "<eventSubURL>/Event/B</eventSubURL>"
+        "</service>"
+        "</serviceList>"
+        "</device>"
+        "</root>";
+
+typedef struct {
+        GMainLoop *loop;
+        GUPnPContext *context;
+        GUPnPControlPoint *cp;
+        GUPnPServiceProxy *proxies[EVENT_SERVICES];
+        guint n_proxies;
+
+        SoupServer *server;
+        SoupSession *session;              // Sends the NOTIFYs
+        char *callbacks[EVENT_SERVICES];   // Delivery URL of the subscriber
+        char *sids[EVENT_SERVICES];        // SID handed out last
+        guint subscriptions;               // SUBSCRIBE requests answered
+        guint wait_subscriptions;
+        gboolean hold;                     // Hold back SUBSCRIBE responses
+        GPtrArray *held;                   // SoupServerMessage held back
+
+        GPtrArray *events;                 // "<A|B|*>:<variable>=<value>"
+        guint wait_events;
+} EventFixture;
+
+static int
+event_service_for_path (const char *path)
+{
+        int i;
+
+        for (i = 0; i < EVENT_SERVICES; i++)
+                if (g_str_equal (path, event_paths[i]))
+                        return i;
+
+        return -1;
+}
+
+static void
+on_event_device_request (G_GNUC_UNUSED SoupServer *server,
+                         SoupServerMessage *msg,
+                         const char *path,
+                         G_GNUC_UNUSED GHashTable *query,
+                         gpointer user_data)
+{
+        EventFixture *tf = user_data;
+        const char *method = soup_server_message_get_method (msg);
+        SoupMessageHeaders *request_headers =
+                soup_server_message_get_request_headers (msg);
+        SoupMessageHeaders *response_headers =
+                soup_server_message_get_response_headers (msg);
+        const char *callback;
+        const char *sid;
+        int service;
+
+        if (g_str_equal (path, "/Description.xml")) {
+                soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+                soup_server_message_set_response (
+                        msg,
+                        "text/xml",
+                        SOUP_MEMORY_STATIC,
+                        event_device_description,
+                        strlen (event_device_description));
+
+                return;
+        }
+
+        service = event_service_for_path (path);
+        if (service < 0) {
+                soup_server_message_set_status (msg,
+                                                SOUP_STATUS_NOT_FOUND,
+                                                NULL);
+
+                return;
+        }
+
+        if (g_str_equal (method, "UNSUBSCRIBE")) {
+                soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+                return;
+        }
+
+        g_assert_cmpstr (method, ==, "SUBSCRIBE");
+
+        // A renewal keeps its SID
+        sid = soup_message_headers_get_one (request_headers, "SID");
+        if (sid == NULL) {
+                callback = soup_message_headers_get_one (request_headers,
+                                                         "Callback");
+                g_assert_nonnull (callback);
+                g_assert_true (g_str_has_prefix (callback, "<"));
+                g_assert_true (g_str_has_suffix (callback, ">"));
+
+                g_free (tf->callbacks[service]);
+                tf->callbacks[service] =
+                        g_strndup (callback + 1, strlen (callback) - 2);
+
+                g_free (tf->sids[service]);
+                tf->sids[service] = g_strdup_printf ("uuid:event-%c-%u",
+                                                     'a' + service,
+                                                     tf->subscriptions + 1);
+                sid = tf->sids[service];
+        }
+
+        soup_message_headers_append (response_headers, "SID", sid);
+        soup_message_headers_append (response_headers,
+                                     "Timeout",
+                                     "Second-1800");
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+        if (tf->hold) {
+                g_ptr_array_add (tf->held, g_object_ref (msg));
+#if SOUP_CHECK_VERSION(3, 1, 2)
+                soup_server_message_pause (msg);
+#else
+                soup_server_pause_message (tf->server, msg);
+#endif
+        }
+
+        tf->subscriptions++;
+        if (tf->wait_subscriptions != 0 &&
+            tf->subscriptions >= tf->wait_subscriptions)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+release_held_subscription (EventFixture *tf)
+{
+        SoupServerMessage *msg = g_ptr_array_steal_index (tf->held, 0);
+
+#if SOUP_CHECK_VERSION(3, 1, 2)
+        soup_server_message_unpause (msg);
+#else
+        soup_server_unpause_message (tf->server, msg);
+#endif
+        g_object_unref (msg);
+}
+
+static void
+on_event_proxy_available (G_GNUC_UNUSED GUPnPControlPoint *cp,
+                          GUPnPServiceProxy *proxy,
+                          gpointer user_data)
+{
+        EventFixture *tf = user_data;
+        const char *type;
+        int i;
+
+        type = gupnp_service_info_get_service_type (GUPNP_SERVICE_INFO (proxy));
+        for (i = 0; i < EVENT_SERVICES; i++)
+                if (g_str_equal (type, event_service_types[i]))
+                        tf->proxies[i] = g_object_ref (proxy);
+
+        if (++tf->n_proxies == EVENT_SERVICES)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+on_event_notify (GUPnPServiceProxy *proxy,
+                 const char *variable,
+                 GValue *value,
+                 gpointer user_data)
+{
+        EventFixture *tf = user_data;
+        char service = proxy == tf->proxies[EVENT_SERVICE_A] ? 'A' : 'B';
+
+        g_ptr_array_add (tf->events,
+                         g_strdup_printf ("%c:%s=%s",
+                                          service,
+                                          variable,
+                                          g_value_get_string (value)));
+
+        if (tf->wait_events != 0 && tf->events->len >= tf->wait_events)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+event_fixture_setup (EventFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        GError *error = NULL;
+        GList *locations;
+        GSList *uris;
+        char *location;
+        char *usn;
+        int i;
+
+        tf->loop = g_main_loop_new (NULL, FALSE);
+        tf->context = create_context ("127.0.0.1", 0, &error);
+        g_assert_no_error (error);
+
+        tf->events = g_ptr_array_new_with_free_func (g_free);
+        tf->held = g_ptr_array_new_with_free_func (g_object_unref);
+        tf->session = soup_session_new ();
+
+        tf->server = soup_server_new (NULL, NULL);
+        soup_server_add_handler (tf->server,
+                                 "/Description.xml",
+                                 on_event_device_request,
+                                 tf,
+                                 NULL);
+        soup_server_add_handler (tf->server,
+                                 "/Event",
+                                 on_event_device_request,
+                                 tf,
+                                 NULL);
+        soup_server_listen_local (tf->server,
+                                  0,
+                                  SOUP_SERVER_LISTEN_IPV4_ONLY,
+                                  &error);
+        g_assert_no_error (error);
+
+        uris = soup_server_get_uris (tf->server);
+        location = g_strdup_printf ("http://127.0.0.1:%d/Description.xml",
+                                    g_uri_get_port (uris->data));
+        g_slist_free_full (uris, (GDestroyNotify) g_uri_unref);
+
+        tf->cp = gupnp_control_point_new (tf->context,
+                                          event_service_types[0]);
+        g_signal_connect (tf->cp,
+                          "service-proxy-available",
+                          G_CALLBACK (on_event_proxy_available),
+                          tf);
+
+        locations = g_list_prepend (NULL, location);
+        for (i = 0; i < EVENT_SERVICES; i++) {
+                usn = g_strconcat (EVENT_DEVICE_UDN "::",
+                                   event_service_types[i],
+                                   NULL);
+                g_signal_emit_by_name (tf->cp,
+                                       "resource-available",
+                                       usn,
+                                       locations);
+                g_free (usn);
+        }
+        g_list_free (locations);
+        g_free (location);
+
+        test_run_loop (tf->loop, "Event fixture setup");
+
+        for (i = 0; i < EVENT_SERVICES; i++)
+                gupnp_service_proxy_add_notify (tf->proxies[i],
+                                                "evented_variable",
+                                                G_TYPE_STRING,
+                                                on_event_notify,
+                                                tf);
+}
+
+static void
+event_fixture_teardown (EventFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        int i;
+
+        for (i = 0; i < EVENT_SERVICES; i++) {
+                g_clear_object (&tf->proxies[i]);
+                g_free (tf->callbacks[i]);
+                g_free (tf->sids[i]);
+        }
+        g_object_unref (tf->cp);
+        g_object_unref (tf->context);
+
+        // Let the UNSUBSCRIBE requests go out
+        g_timeout_add (100, (GSourceFunc) delayed_loop_quitter, tf->loop);
+        g_main_loop_run (tf->loop);
+
+        soup_server_disconnect (tf->server);
+        g_object_unref (tf->server);
+        g_object_unref (tf->session);
+        g_ptr_array_unref (tf->held);
+        g_ptr_array_unref (tf->events);
+        g_main_loop_unref (tf->loop);
+}
+
+static void
+wait_for_subscriptions (EventFixture *tf, guint n)
+{
+        tf->wait_subscriptions = n;
+        if (tf->subscriptions < n)
+                test_run_loop (tf->loop, g_test_get_path ());
+        tf->wait_subscriptions = 0;
+}
+
+static void
+wait_for_events (EventFixture *tf, guint n)
+{
+        tf->wait_events = n;
+        if (tf->events->len < n)
+                test_run_loop (tf->loop, g_test_get_path ());
+        tf->wait_events = 0;
+}
+
+// Give notifications that should not happen a chance to show up
+static void
+expect_no_events (EventFixture *tf)
+{
+        guint events = tf->events->len;
+
+        g_timeout_add (100, (GSourceFunc) delayed_loop_quitter, tf->loop);
+        g_main_loop_run (tf->loop);
+
+        g_assert_cmpuint (tf->events->len, ==, events);
+}
+
+static char *
+property_set (const char *variable, const char *value)
+{
+        return g_strdup_printf (
+                "<?xml version=\"1.0\"?>"
+                "<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">"
+                "<e:property><%s>%s</%s></e:property>"
+                "</e:propertyset>",
+                variable,
+                value,
+                variable);
+}
+
+static void
+on_notify_sent (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        EventFixture *tf = user_data;
+        GError *error = NULL;
+        GBytes *bytes;
+
+        bytes = soup_session_send_and_read_finish (SOUP_SESSION (source),
+                                                   res,
+                                                   &error);
+        g_assert_no_error (error);
+        g_bytes_unref (bytes);
+
+        g_main_loop_quit (tf->loop);
+}
+
+// Send a NOTIFY with @body to the delivery URL of @service, and return the
+// status it was answered with
+static guint
+send_notify_body (EventFixture *tf,
+                  int service,
+                  const char *sid,
+                  guint seq,
+                  const char *body)
+{
+        SoupMessageHeaders *headers;
+        SoupMessage *msg;
+        GBytes *request;
+        char *seq_str;
+        guint status;
+
+        g_assert_nonnull (tf->callbacks[service]);
+        msg = soup_message_new ("NOTIFY", tf->callbacks[service]);
+        headers = soup_message_get_request_headers (msg);
+        soup_message_headers_append (headers, "NT", "upnp:event");
+        soup_message_headers_append (headers, "NTS", "upnp:propchange");
+        soup_message_headers_append (headers, "SID", sid);
+        seq_str = g_strdup_printf ("%u", seq);
+        soup_message_headers_append (headers, "SEQ", seq_str);
+        g_free (seq_str);
+
+        request = g_bytes_new (body, strlen (body));
+        soup_message_set_request_body_from_bytes (msg, "text/xml", request);
+        g_bytes_unref (request);
+
+        soup_session_send_and_read_async (tf->session,
+                                          msg,
+                                          G_PRIORITY_DEFAULT,
+                                          NULL,
+                                          on_notify_sent,
+                                          tf);
+        test_run_loop (tf->loop, g_test_get_path ());
+
+        status = soup_message_get_status (msg);
+        g_object_unref (msg);
+
+        return status;
+}
+
+static guint
+send_notify (EventFixture *tf,
+             int service,
+             const char *sid,
+             guint seq,
+             const char *value)
+{
+        char *body = property_set ("evented_variable", value);
+        guint status;
+
+        status = send_notify_body (tf, service, sid, seq, body);
+        g_free (body);
+
+        return status;
+}
+
+// Subscribe to @service and wait until the proxy knows its SID, which the
+// initial event with SEQ 0 shows
+static void
+subscribe_event_service (EventFixture *tf, int service)
+{
+        gupnp_service_proxy_set_subscribed (tf->proxies[service], TRUE);
+        wait_for_subscriptions (tf, tf->subscriptions + 1);
+
+        g_assert_cmpuint (
+                send_notify (tf, service, tf->sids[service], 0, "initial"),
+                ==,
+                SOUP_STATUS_OK);
+        wait_for_events (tf, tf->events->len + 1);
+        g_ptr_array_set_size (tf->events, 0);
+}
+
+static void
+test_event_route_by_sid (EventFixture *tf,
+                         G_GNUC_UNUSED gconstpointer user_data)
+{
+        subscribe_event_service (tf, EVENT_SERVICE_A);
+        subscribe_event_service (tf, EVENT_SERVICE_B);
+
+        // Both proxies share the handler of the context, so the SID decides
+        // who gets the event, not the URL it was sent to
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       tf->sids[EVENT_SERVICE_B],
+                                       1,
+                                       "to-b"),
+                          ==,
+                          SOUP_STATUS_OK);
+        wait_for_events (tf, 1);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0),
+                         ==,
+                         "B:evented_variable=to-b");
+
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_B,
+                                       tf->sids[EVENT_SERVICE_A],
+                                       1,
+                                       "to-a"),
+                          ==,
+                          SOUP_STATUS_OK);
+        wait_for_events (tf, 2);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 1),
+                         ==,
+                         "A:evented_variable=to-a");
+
+        expect_no_events (tf);
+}
+
+static void
+test_event_early (EventFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        tf->hold = TRUE;
+        gupnp_service_proxy_set_subscribed (tf->proxies[EVENT_SERVICE_A],
+                                            TRUE);
+        wait_for_subscriptions (tf, 1);
+
+        // The events overtake the SUBSCRIBE response, so they can only be
+        // matched by the delivery URL and have to wait for the SID
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       tf->sids[EVENT_SERVICE_A],
+                                       0,
+                                       "first"),
+                          ==,
+                          SOUP_STATUS_OK);
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       tf->sids[EVENT_SERVICE_A],
+                                       1,
+                                       "second"),
+                          ==,
+                          SOUP_STATUS_OK);
+        expect_no_events (tf);
+
+        release_held_subscription (tf);
+        wait_for_events (tf, 2);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0),
+                         ==,
+                         "A:evented_variable=first");
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 1),
+                         ==,
+                         "A:evented_variable=second");
+}
+
+static void
+test_event_unknown_sid (EventFixture *tf,
+                        G_GNUC_UNUSED gconstpointer user_data)
+{
+        subscribe_event_service (tf, EVENT_SERVICE_A);
+
+        // Refused even though it was sent to a known delivery URL
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       "uuid:unknown",
+                                       1,
+                                       "unknown"),
+                          ==,
+                          SOUP_STATUS_PRECONDITION_FAILED);
+        expect_no_events (tf);
+
+        // The subscription itself goes on as before
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       tf->sids[EVENT_SERVICE_A],
+                                       1,
+                                       "known"),
+                          ==,
+                          SOUP_STATUS_OK);
+        wait_for_events (tf, 1);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0),
+                         ==,
+                         "A:evented_variable=known");
+}
+
+static void
+test_event_resubscribe (EventFixture *tf,
+                        G_GNUC_UNUSED gconstpointer user_data)
+{
+        char *old_sid;
+
+        subscribe_event_service (tf, EVENT_SERVICE_A);
+        old_sid = g_strdup (tf->sids[EVENT_SERVICE_A]);
+
+        // A gap in the SEQ numbers makes the proxy subscribe again
+        g_assert_cmpuint (
+                send_notify (tf, EVENT_SERVICE_A, old_sid, 5, "missed"),
+                ==,
+                SOUP_STATUS_OK);
+        wait_for_subscriptions (tf, 2);
+        g_assert_cmpstr (tf->sids[EVENT_SERVICE_A], !=, old_sid);
+
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       tf->sids[EVENT_SERVICE_A],
+                                       0,
+                                       "renewed"),
+                          ==,
+                          SOUP_STATUS_OK);
+        wait_for_events (tf, 1);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0),
+                         ==,
+                         "A:evented_variable=renewed");
+
+        // The new SID replaced the old one
+        g_assert_cmpuint (
+                send_notify (tf, EVENT_SERVICE_A, old_sid, 1, "stale"),
+                ==,
+                SOUP_STATUS_PRECONDITION_FAILED);
+        expect_no_events (tf);
+
+        g_free (old_sid);
+}
+
+// Record every variable of the document a raw listener gets
+static void
+on_event_raw_notify (G_GNUC_UNUSED GUPnPServiceProxy *proxy,
+                     const char *variable,
+                     GValue *value,
+                     gpointer user_data)
+{
+        EventFixture *tf = user_data;
+        xmlDoc *doc = g_value_get_pointer (value);
+        xmlNode *property;
+        xmlNode *node;
+
+        g_assert_cmpstr (variable, ==, "*");
+
+        for (property = xmlDocGetRootElement (doc)->children;
+             property != NULL;
+             property = property->next) {
+                for (node = property->children; node; node = node->next) {
+                        xmlChar *content;
+
+                        if (node->type != XML_ELEMENT_NODE)
+                                continue;
+
+                        content = xmlNodeGetContent (node);
+                        g_ptr_array_add (tf->events,
+                                         g_strdup_printf ("*:%s=%s",
+                                                          node->name,
+                                                          content));
+                        xmlFree (content);
+                }
+        }
+
+        if (tf->wait_events != 0 && tf->events->len >= tf->wait_events)
+                g_main_loop_quit (tf->loop);
+}
+
+static const char *two_variables =
+        "<?xml version=\"1.0\"?>"
+        "<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">"
+        "<e:property><evented_variable>watched</evented_variable></e:property>"
+        "<e:property><other_variable>unwatched</other_variable></e:property>"
+        "</e:propertyset>";
+
+static void
+test_event_watched_only (EventFixture *tf,
+                         G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Hold back the SID, so the event is parsed on arrival but only
+        // emitted after the second listener was added
+        tf->hold = TRUE;
+        gupnp_service_proxy_set_subscribed (tf->proxies[EVENT_SERVICE_A],
+                                            TRUE);
+        wait_for_subscriptions (tf, 1);
+
+        g_assert_cmpuint (send_notify_body (tf,
+                                            EVENT_SERVICE_A,
+                                            tf->sids[EVENT_SERVICE_A],
+                                            0,
+                                            two_variables),
+                          ==,
+                          SOUP_STATUS_OK);
+
+        gupnp_service_proxy_add_notify (tf->proxies[EVENT_SERVICE_A],
+                                        "other_variable",
+                                        G_TYPE_STRING,
+                                        on_event_notify,
+                                        tf);
+        release_held_subscription (tf);
+
+        // Nobody watched other_variable when the event came in, so its
+        // value was never read
+        wait_for_events (tf, 1);
+        expect_no_events (tf);
+        g_assert_cmpuint (tf->events->len, ==, 1);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0),
+                         ==,
+                         "A:evented_variable=watched");
+}
+
+static void
+test_event_raw_listener (EventFixture *tf,
+                         G_GNUC_UNUSED gconstpointer user_data)
+{
+        subscribe_event_service (tf, EVENT_SERVICE_A);
+        gupnp_service_proxy_add_raw_notify (tf->proxies[EVENT_SERVICE_A],
+                                            on_event_raw_notify,
+                                            tf,
+                                            NULL);
+
+        // The raw listener gets the whole document, the other one still
+        // only its variable
+        g_assert_cmpuint (send_notify_body (tf,
+                                            EVENT_SERVICE_A,
+                                            tf->sids[EVENT_SERVICE_A],
+                                            1,
+                                            two_variables),
+                          ==,
+                          SOUP_STATUS_OK);
+        wait_for_events (tf, 3);
+        expect_no_events (tf);
+
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0),
+                         ==,
+                         "A:evented_variable=watched");
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 1),
+                         ==,
+                         "*:evented_variable=watched");
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 2),
+                         ==,
+                         "*:other_variable=unwatched");
+
+        gupnp_service_proxy_remove_raw_notify (tf->proxies[EVENT_SERVICE_A],
+                                               on_event_raw_notify,
+                                               tf);
+}
+
+static void
+test_event_split_value (EventFixture *tf,
+                        G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Entities, CDATA and the length of the text make the parser
+        // report the value in many pieces
+        char *filler = g_strnfill (10000, 'x');
+        char *value = g_strconcat ("a &amp; b <![CDATA[<c> & d]]> ",
+                                   filler,
+                                   " &#65;&lt;end&gt;",
+                                   NULL);
+        char *expected = g_strconcat ("A:evented_variable=a & b <c> & d ",
+                                      filler,
+                                      " A<end>",
+                                      NULL);
+
+        subscribe_event_service (tf, EVENT_SERVICE_A);
+
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       tf->sids[EVENT_SERVICE_A],
+                                       1,
+                                       value),
+                          ==,
+                          SOUP_STATUS_OK);
+        wait_for_events (tf, 1);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0), ==, expected);
+
+        g_free (expected);
+        g_free (value);
+        g_free (filler);
+}
+
+static void
+test_event_malformed (EventFixture *tf,
+                      G_GNUC_UNUSED gconstpointer user_data)
+{
+        static const char *bodies[] = {
+                // Cut off in the second property
+                "<?xml version=\"1.0\"?>"
+                "<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">"
+                "<e:property><evented_variable>one</evented_variable>"
+                "</e:property>"
+                "<e:property><evented_variable>tw",
+                // Mismatched end tag in the second property
+                "<?xml version=\"1.0\"?>"
+                "<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">"
+                "<e:property><evented_variable>one</evented_variable>"
+                "</e:property>"
+                "<e:property><evented_variable>two</other_variable>"
+                "</e:property>"
+                "</e:propertyset>",
+        };
+        guint i;
+
+        subscribe_event_service (tf, EVENT_SERVICE_A);
+
+        // Nothing of a broken event is emitted, not even its intact part
+        for (i = 0; i < G_N_ELEMENTS (bodies); i++) {
+                g_test_expect_message ("gupnp-service-proxy",
+                                       G_LOG_LEVEL_WARNING,
+                                       "Failed to parse NOTIFY message body");
+                g_assert_cmpuint (send_notify_body (tf,
+                                                    EVENT_SERVICE_A,
+                                                    tf->sids[EVENT_SERVICE_A],
+                                                    1,
+                                                    bodies[i]),
+                                  ==,
+                                  SOUP_STATUS_INTERNAL_SERVER_ERROR);
+                g_test_assert_expected_messages ();
+        }
+        expect_no_events (tf);
+
+        // Refused events do not count in the SEQ numbers
+        g_assert_cmpuint (send_notify (tf,
+                                       EVENT_SERVICE_A,
+                                       tf->sids[EVENT_SERVICE_A],
+                                       1,
+                                       "intact"),
+                          ==,
+                          SOUP_STATUS_OK);
+        wait_for_events (tf, 1);
+        g_assert_cmpstr (g_ptr_array_index (tf->events, 0),
+                         ==,
+                         "A:evented_variable=intact");
+}
+
+int
+main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add ("/service-proxy/async/fire-and-forget",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_fire_and_forget,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/call",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_async_call,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/action-handler",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_handler,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/offload",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_offload,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/stream",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_stream,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/stream-offloaded",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_stream_offloaded,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/stream-error",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_stream_error,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/queue",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_queue,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/queue-cancel",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_queue_cancel,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/batch",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_batch_call,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/coalesce",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_coalesce,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/coalesce-cancel",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_coalesce_cancel,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/action-cache",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_cache,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/cancel",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_async_cancel_call,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/destroy-with-pending",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_async_call_destroy_with_pending,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/async/soap-error-in-finish",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_finish_soap_error,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/description-cache",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_description_cache,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/sync/call",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_sync_call,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/sync/cancel-call",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_cancel_sync_call,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/sync/soap-error-in-finish",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_finish_soap_error_sync,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/authentication/no-credentials",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_finish_soap_authentication_no_credentials,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/authentication/wrong-credentials",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_finish_soap_authentication_wrong_credentials,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/authentication/valid-credentials",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_finish_soap_authentication_valid_credentials,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/read-result",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_read_result,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/read-result-repeated",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_read_result_repeated,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/reuse",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_reuse,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/method-memo",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_method_memo,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/method-retry-once",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_method_retry_once,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/iter",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_iter,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/shared-introspection",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_shared_introspection,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/introspection-cancel-thread",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_introspection_cancel_thread,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/shared-introspection-content",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_shared_introspection_content,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/shared-introspection-config-id",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_shared_introspection_config_id,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/action/iter_introspected",
+                    ProxyTestFixture,
+                    "127.0.0.1",
+                    test_fixture_setup,
+                    test_action_iter_introspected,
+                    test_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/route-by-sid",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_route_by_sid,
+                    event_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/early",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_early,
+                    event_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/unknown-sid",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_unknown_sid,
+                    event_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/resubscribe",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_resubscribe,
+                    event_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/watched-only",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_watched_only,
+                    event_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/raw-listener",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_raw_listener,
+                    event_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/split-value",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_split_value,
+                    event_fixture_teardown);
+
+        g_test_add ("/service-proxy/event/malformed",
+                    EventFixture,
+                    NULL,
+                    event_fixture_setup,
+                    test_event_malformed,
+                    event_fixture_teardown);
 
         return g_test_run ();
 }
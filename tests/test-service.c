@@ -7,6 +7,10 @@
 #include <libgupnp/gupnp-context-private.h>
 #include <libgupnp/gupnp-service-private.h>
 #include <libgupnp/gupnp.h>
+#include <libgupnp/http-headers.h>
+
+#include <stdlib.h>
+#include <string.h>
 
 static GUPnPContext *
 create_context (guint16 port, GError **error)
@@ -241,6 +245,958 @@ test_service_notification_remote_disappears (void)
         g_free (url);
 }
 
+typedef struct {
+        GMainLoop *loop;
+        GUPnPContext *context;
+        GUPnPRootDevice *rd;
+        GUPnPServiceInfo *service;
+        SoupServer *server;
+        SoupSession *session;
+        SoupMessage *subscribe;
+        gpointer payload;
+} ServiceTestFixture;
+
+static void
+test_fixture_setup (ServiceTestFixture *tf, gconstpointer user_data)
+{
+        GError *error = NULL;
+
+        tf->loop = g_main_loop_new (NULL, FALSE);
+        g_assert_nonnull (tf->loop);
+
+        tf->context = create_context (0, &error);
+        g_assert_no_error (error);
+        g_assert_nonnull (tf->context);
+
+        tf->rd = gupnp_root_device_new (tf->context,
+                                        "TestDevice.xml",
+                                        DATA_PATH,
+                                        &error);
+        g_assert_no_error (error);
+        g_assert_nonnull (tf->rd);
+        gupnp_root_device_set_available (tf->rd, TRUE);
+
+        tf->service = gupnp_device_info_get_service (
+                GUPNP_DEVICE_INFO (tf->rd),
+                "urn:test-gupnp-org:service:TestService:1");
+        g_assert_nonnull (tf->service);
+
+        // The control point that subscribes to the service
+        tf->server = soup_server_new (NULL, NULL);
+        soup_server_listen_local (tf->server,
+                                  0,
+                                  SOUP_SERVER_LISTEN_IPV4_ONLY,
+                                  &error);
+        g_assert_no_error (error);
+
+        tf->session = soup_session_new ();
+}
+
+static void
+test_fixture_teardown (ServiceTestFixture *tf, gconstpointer user_data)
+{
+        g_clear_object (&tf->subscribe);
+        g_clear_object (&tf->session);
+        g_clear_object (&tf->server);
+        g_clear_object (&tf->service);
+        g_clear_object (&tf->rd);
+        g_clear_object (&tf->context);
+        g_main_loop_unref (tf->loop);
+}
+
+/* Handle the NOTIFYs with @on_notify and subscribe to the service.
+ * @on_subscribed gets the service as user data. */
+static void
+test_fixture_subscribe (ServiceTestFixture *tf,
+                        SoupServerCallback on_notify,
+                        GAsyncReadyCallback on_subscribed)
+{
+        char *url;
+
+        soup_server_add_handler (tf->server, "/Notify", on_notify, tf, NULL);
+
+        url = gupnp_service_info_get_event_subscription_url (tf->service);
+        tf->subscribe = prepare_subscribe_message (url, tf->server);
+        g_free (url);
+
+        soup_session_send_and_read_async (tf->session,
+                                          tf->subscribe,
+                                          G_PRIORITY_DEFAULT,
+                                          NULL,
+                                          on_subscribed,
+                                          tf->service);
+}
+
+typedef struct {
+        GArray *seqs;
+        gboolean connection_close;
+} TestServiceNotificationOrderData;
+
+static void
+on_ordered_notify (G_GNUC_UNUSED SoupServer *server,
+                   SoupServerMessage *msg,
+                   G_GNUC_UNUSED const char *path,
+                   G_GNUC_UNUSED GHashTable *query,
+                   gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+        TestServiceNotificationOrderData *data = tf->payload;
+        SoupMessageHeaders *h = soup_server_message_get_request_headers (msg);
+        SoupMessageBody *body = soup_server_message_get_request_body (msg);
+        const char *connection;
+        int seq;
+
+        seq = atoi (soup_message_headers_get_one (h, "SEQ"));
+        g_array_append_val (data->seqs, seq);
+
+        connection = soup_message_headers_get_one (h, "Connection");
+        if (connection != NULL && g_ascii_strcasecmp (connection, "close") == 0)
+                data->connection_close = TRUE;
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+        if (g_strstr_len (body->data,
+                          body->length,
+                          "<evented_variable>9</evented_variable>") != NULL)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+on_ordered_subscribe (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        GUPnPService *service = GUPNP_SERVICE (user_data);
+        GError *error = NULL;
+        int i;
+
+        GBytes *data = soup_session_send_and_read_finish (SOUP_SESSION (source),
+                                                          res,
+                                                          &error);
+
+        g_assert_no_error (error);
+        g_clear_pointer (&data, g_bytes_unref);
+
+        for (i = 0; i < 10; i++)
+                gupnp_service_notify (service,
+                                      "evented_variable",
+                                      G_TYPE_INT,
+                                      i,
+                                      NULL);
+}
+
+static void
+test_service_notification_ordered (ServiceTestFixture *tf,
+                                   G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that a burst of notifications arrives in SEQ order over a
+        // kept-alive connection
+        TestServiceNotificationOrderData data = { NULL, FALSE };
+        guint i;
+
+        data.seqs = g_array_new (FALSE, FALSE, sizeof (int));
+        tf->payload = &data;
+
+        gupnp_service_set_notify_keep_alive (GUPNP_SERVICE (tf->service),
+                                             TRUE);
+        g_assert_cmpuint (gupnp_service_get_max_notify_in_flight (
+                                  GUPNP_SERVICE (tf->service)),
+                          ==,
+                          1);
+
+        test_fixture_subscribe (tf, on_ordered_notify, on_ordered_subscribe);
+        g_main_loop_run (tf->loop);
+
+        g_assert_false (data.connection_close);
+        g_assert_cmpuint (data.seqs->len, >=, 11);
+        for (i = 0; i < data.seqs->len; i++)
+                g_assert_cmpint (g_array_index (data.seqs, int, i), ==, i);
+
+        g_array_unref (data.seqs);
+}
+
+typedef struct {
+        GPtrArray *bodies;
+        const char *last; /* Quit once this was evented */
+} TestServiceModerationData;
+
+static void
+on_moderated_notify (G_GNUC_UNUSED SoupServer *server,
+                     SoupServerMessage *msg,
+                     G_GNUC_UNUSED const char *path,
+                     G_GNUC_UNUSED GHashTable *query,
+                     gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+        TestServiceModerationData *data = tf->payload;
+        SoupMessageBody *body = soup_server_message_get_request_body (msg);
+        char *content = g_strndup (body->data, body->length);
+
+        g_ptr_array_add (data->bodies, content);
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+        if (strstr (content, data->last) != NULL)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+assert_not_evented (GPtrArray *bodies, int first, int last)
+{
+        guint i;
+        int j;
+
+        for (i = 0; i < bodies->len; i++) {
+                const char *body = g_ptr_array_index (bodies, i);
+
+                for (j = first; j <= last; j++) {
+                        char *needle = g_strdup_printf (
+                                "<evented_variable>%d</evented_variable>",
+                                j);
+                        g_assert_null (strstr (body, needle));
+                        g_free (needle);
+                }
+        }
+}
+
+static void
+test_service_notification_moderated (ServiceTestFixture *tf,
+                                     G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that a burst of changes to a moderated variable only sends
+        // the first and, on the trailing edge, the last value
+        TestServiceModerationData data = {
+                NULL,
+                "<evented_variable>9</evented_variable>"
+        };
+
+        data.bodies = g_ptr_array_new_with_free_func (g_free);
+        tf->payload = &data;
+
+        gupnp_service_set_event_moderation (GUPNP_SERVICE (tf->service),
+                                            "evented_variable",
+                                            200,
+                                            0.0,
+                                            TRUE);
+
+        test_fixture_subscribe (tf, on_moderated_notify, on_ordered_subscribe);
+        g_main_loop_run (tf->loop);
+
+        assert_not_evented (data.bodies, 1, 8);
+
+        g_ptr_array_unref (data.bodies);
+}
+
+static void
+on_min_delta_subscribe (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        GUPnPService *service = GUPNP_SERVICE (user_data);
+        GError *error = NULL;
+        int i;
+
+        GBytes *data = soup_session_send_and_read_finish (SOUP_SESSION (source),
+                                                          res,
+                                                          &error);
+
+        g_assert_no_error (error);
+        g_clear_pointer (&data, g_bytes_unref);
+
+        for (i = 0; i < 4; i++)
+                gupnp_service_notify (service,
+                                      "evented_variable",
+                                      G_TYPE_INT,
+                                      i,
+                                      NULL);
+}
+
+static void
+test_service_notification_moderated_min_delta (
+        ServiceTestFixture *tf,
+        G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that the last change held back only by the minimum delta is
+        // still sent on the trailing edge
+        TestServiceModerationData data = {
+                NULL,
+                "<evented_variable>3</evented_variable>"
+        };
+
+        data.bodies = g_ptr_array_new_with_free_func (g_free);
+        tf->payload = &data;
+
+        gupnp_service_set_event_moderation (GUPNP_SERVICE (tf->service),
+                                            "evented_variable",
+                                            0,
+                                            5.0,
+                                            TRUE);
+
+        test_fixture_subscribe (tf, on_moderated_notify, on_min_delta_subscribe);
+        g_main_loop_run (tf->loop);
+
+        assert_not_evented (data.bodies, 1, 2);
+
+        g_ptr_array_unref (data.bodies);
+}
+
+static void
+on_last_change_notify (G_GNUC_UNUSED SoupServer *server,
+                       SoupServerMessage *msg,
+                       G_GNUC_UNUSED const char *path,
+                       G_GNUC_UNUSED GHashTable *query,
+                       gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+        GPtrArray *bodies = tf->payload;
+        SoupMessageBody *body = soup_server_message_get_request_body (msg);
+        char *content = g_strndup (body->data, body->length);
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+        if (strstr (content, "<LastChange>") != NULL) {
+                g_ptr_array_add (bodies, content);
+                g_main_loop_quit (tf->loop);
+        } else {
+                g_free (content);
+        }
+}
+
+static void
+on_last_change_subscribe (GObject *source,
+                          GAsyncResult *res,
+                          gpointer user_data)
+{
+        GUPnPService *service = GUPNP_SERVICE (user_data);
+        GError *error = NULL;
+        GValue value = G_VALUE_INIT;
+
+        GBytes *data = soup_session_send_and_read_finish (SOUP_SESSION (source),
+                                                          res,
+                                                          &error);
+
+        g_assert_no_error (error);
+        g_clear_pointer (&data, g_bytes_unref);
+
+        g_value_init (&value, G_TYPE_UINT);
+        g_value_set_uint (&value, 10);
+        gupnp_service_add_last_change (service, 0, "Volume", "Master", &value);
+        g_value_set_uint (&value, 20);
+        gupnp_service_add_last_change (service, 0, "Volume", "Master", &value);
+        g_value_unset (&value);
+
+        g_value_init (&value, G_TYPE_STRING);
+        g_value_set_string (&value, "PLAYING");
+        gupnp_service_add_last_change (service,
+                                       0,
+                                       "TransportState",
+                                       NULL,
+                                       &value);
+        g_value_unset (&value);
+}
+
+static void
+test_service_notification_last_change (ServiceTestFixture *tf,
+                                       G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that changes are merged into a single LastChange event
+        GPtrArray *bodies;
+        const char *body;
+
+        bodies = g_ptr_array_new_with_free_func (g_free);
+        tf->payload = bodies;
+
+        test_fixture_subscribe (tf,
+                                on_last_change_notify,
+                                on_last_change_subscribe);
+        g_main_loop_run (tf->loop);
+
+        g_assert_cmpuint (bodies->len, ==, 1);
+        body = g_ptr_array_index (bodies, 0);
+        g_assert_nonnull (strstr (body,
+                                  "&lt;InstanceID val=&quot;0&quot;&gt;"
+                                  "&lt;Volume channel=&quot;Master&quot; "
+                                  "val=&quot;20&quot;/&gt;"
+                                  "&lt;TransportState "
+                                  "val=&quot;PLAYING&quot;/&gt;"
+                                  "&lt;/InstanceID&gt;"));
+
+        g_ptr_array_unref (bodies);
+}
+
+typedef struct {
+        GPtrArray *messages;
+        GUPnPServiceNotifyOverflowPolicy policy;
+        guint shed;
+} TestServiceSheddingData;
+
+static void
+on_stalled_notify (G_GNUC_UNUSED SoupServer *server,
+                   SoupServerMessage *msg,
+                   G_GNUC_UNUSED const char *path,
+                   G_GNUC_UNUSED GHashTable *query,
+                   gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+        TestServiceSheddingData *data = tf->payload;
+
+        // Never answer, like a control point that hangs
+#if SOUP_CHECK_VERSION(3, 1, 2)
+        soup_server_message_pause (msg);
+#else
+        soup_server_pause_message (server, msg);
+#endif
+        g_ptr_array_add (data->messages, msg);
+}
+
+static void
+on_subscriber_shed (G_GNUC_UNUSED GUPnPService *service,
+                    GList *callbacks,
+                    GUPnPServiceNotifyOverflowPolicy policy,
+                    gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+        TestServiceSheddingData *data = tf->payload;
+
+        g_assert_nonnull (callbacks);
+        data->policy = policy;
+        data->shed++;
+
+        g_main_loop_quit (tf->loop);
+}
+
+static void
+unstall_messages (G_GNUC_UNUSED SoupServer *server, GPtrArray *messages)
+{
+        guint i;
+
+        for (i = 0; i < messages->len; i++) {
+                SoupServerMessage *stalled = g_ptr_array_index (messages, i);
+
+                soup_server_message_set_status (stalled, SOUP_STATUS_OK, NULL);
+#if SOUP_CHECK_VERSION(3, 1, 2)
+                soup_server_message_unpause (stalled);
+#else
+                soup_server_unpause_message (server, stalled);
+#endif
+        }
+}
+
+static void
+test_service_notification_shed (ServiceTestFixture *tf,
+                                G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that a subscriber that does not answer is dropped once its
+        // notification queue is full
+        TestServiceSheddingData data = { NULL, 0, 0 };
+
+        data.messages = g_ptr_array_new ();
+        tf->payload = &data;
+
+        gupnp_service_set_max_pending_notifications (
+                GUPNP_SERVICE (tf->service),
+                3);
+        gupnp_service_set_notify_overflow_policy (
+                GUPNP_SERVICE (tf->service),
+                GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE);
+        g_signal_connect (tf->service,
+                          "subscriber-shed",
+                          G_CALLBACK (on_subscriber_shed),
+                          tf);
+
+        test_fixture_subscribe (tf, on_stalled_notify, on_ordered_subscribe);
+        g_main_loop_run (tf->loop);
+
+        g_assert_cmpuint (data.shed, ==, 1);
+        g_assert_cmpint (data.policy,
+                         ==,
+                         GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_UNSUBSCRIBE);
+
+        unstall_messages (tf->server, data.messages);
+        g_ptr_array_unref (data.messages);
+}
+
+typedef struct {
+        GPtrArray *bodies;
+        SoupServerMessage *stalled;
+} TestServiceDropOldestData;
+
+static void
+on_drop_oldest_notify (G_GNUC_UNUSED SoupServer *server,
+                       SoupServerMessage *msg,
+                       G_GNUC_UNUSED const char *path,
+                       G_GNUC_UNUSED GHashTable *query,
+                       gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+        TestServiceDropOldestData *data = tf->payload;
+        SoupMessageBody *body = soup_server_message_get_request_body (msg);
+        char *content = g_strndup (body->data, body->length);
+
+        g_ptr_array_add (data->bodies, content);
+
+        // Hold back the initial event until the queue overflowed
+        if (data->bodies->len == 1) {
+#if SOUP_CHECK_VERSION(3, 1, 2)
+                soup_server_message_pause (msg);
+#else
+                soup_server_pause_message (server, msg);
+#endif
+                data->stalled = msg;
+                g_main_loop_quit (tf->loop);
+
+                return;
+        }
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+        if (strstr (content, "<evented_variable>9</evented_variable>") != NULL)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+test_service_notification_drop_oldest (ServiceTestFixture *tf,
+                                       G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that the notification in flight counts against the queue
+        // limit and that only the latest change is kept behind it
+        TestServiceDropOldestData data = { NULL, NULL };
+        GPtrArray *stalled;
+        int i;
+
+        data.bodies = g_ptr_array_new_with_free_func (g_free);
+        tf->payload = &data;
+
+        gupnp_service_set_max_pending_notifications (
+                GUPNP_SERVICE (tf->service),
+                2);
+        gupnp_service_set_notify_overflow_policy (
+                GUPNP_SERVICE (tf->service),
+                GUPNP_SERVICE_NOTIFY_OVERFLOW_POLICY_DROP_OLDEST);
+
+        test_fixture_subscribe (tf, on_drop_oldest_notify, on_subscribe);
+        g_main_loop_run (tf->loop);
+        g_assert_nonnull (data.stalled);
+
+        for (i = 0; i < 10; i++)
+                gupnp_service_notify (GUPNP_SERVICE (tf->service),
+                                      "evented_variable",
+                                      G_TYPE_INT,
+                                      i,
+                                      NULL);
+
+        stalled = g_ptr_array_new ();
+        g_ptr_array_add (stalled, data.stalled);
+        unstall_messages (tf->server, stalled);
+        g_ptr_array_unref (stalled);
+
+        g_main_loop_run (tf->loop);
+
+        // The initial event and the last change
+        g_assert_cmpuint (data.bodies->len, ==, 2);
+        assert_not_evented (data.bodies, 0, 8);
+
+        g_ptr_array_unref (data.bodies);
+}
+
+static void
+on_state_store_notify (G_GNUC_UNUSED SoupServer *server,
+                       SoupServerMessage *msg,
+                       G_GNUC_UNUSED const char *path,
+                       G_GNUC_UNUSED GHashTable *query,
+                       gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+        const char *needle = tf->payload;
+        SoupMessageBody *body = soup_server_message_get_request_body (msg);
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+        if (g_strstr_len (body->data, body->length, needle) != NULL)
+                g_main_loop_quit (tf->loop);
+}
+
+static void
+on_query_variable (G_GNUC_UNUSED GUPnPService *service,
+                   const char *variable,
+                   G_GNUC_UNUSED GValue *value,
+                   G_GNUC_UNUSED gpointer user_data)
+{
+        // The stored value must be used instead
+        g_assert_cmpstr (variable, !=, "evented_variable");
+}
+
+static void
+test_service_notification_state_store (ServiceTestFixture *tf,
+                                       G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that the initial event is served from the state store
+        tf->payload = "<evented_variable>42</evented_variable>";
+
+        gupnp_service_set_use_state_store (GUPNP_SERVICE (tf->service), TRUE);
+        g_assert_true (
+                gupnp_service_get_use_state_store (GUPNP_SERVICE (tf->service)));
+        g_signal_connect (tf->service,
+                          "query-variable",
+                          G_CALLBACK (on_query_variable),
+                          NULL);
+        gupnp_service_notify (GUPNP_SERVICE (tf->service),
+                              "evented_variable",
+                              G_TYPE_INT,
+                              42,
+                              NULL);
+
+        test_fixture_subscribe (tf, on_state_store_notify, on_subscribe);
+        g_main_loop_run (tf->loop);
+}
+
+typedef struct {
+        GMainLoop *loop;
+        GBytes *response;
+} TestServiceQueryData;
+
+static void
+on_query_state_variable (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+        TestServiceQueryData *data = user_data;
+        GError *error = NULL;
+
+        data->response =
+                soup_session_send_and_read_finish (SOUP_SESSION (source),
+                                                   res,
+                                                   &error);
+        g_assert_no_error (error);
+
+        g_main_loop_quit (data->loop);
+}
+
+/* Send the QueryStateVariable request @body to the service and return the
+ * response */
+static char *
+send_query_state_variable (ServiceTestFixture *tf, const char *body)
+{
+        TestServiceQueryData data = { tf->loop, NULL };
+        GBytes *request;
+        SoupMessage *msg;
+        SoupMessageHeaders *h;
+        char *url;
+        char *content;
+
+        url = gupnp_service_info_get_control_url (tf->service);
+        msg = soup_message_new (SOUP_METHOD_POST, url);
+        g_free (url);
+
+        h = soup_message_get_request_headers (msg);
+        soup_message_headers_append (
+                h,
+                "SOAPAction",
+                "\"urn:schemas-upnp-org:control-1-0#QueryStateVariable\"");
+        request = g_bytes_new_static (body, strlen (body));
+        soup_message_set_request_body_from_bytes (msg, "text/xml", request);
+        g_bytes_unref (request);
+
+        soup_session_send_and_read_async (tf->session,
+                                          msg,
+                                          G_PRIORITY_DEFAULT,
+                                          NULL,
+                                          on_query_state_variable,
+                                          &data);
+        g_main_loop_run (tf->loop);
+
+        g_assert_nonnull (data.response);
+        g_assert_cmpint (soup_message_get_status (msg), ==, SOUP_STATUS_OK);
+
+        content = g_strndup (g_bytes_get_data (data.response, NULL),
+                             g_bytes_get_size (data.response));
+
+        g_bytes_unref (data.response);
+        g_object_unref (msg);
+
+        return content;
+}
+
+static const char *query_evented_variable =
+        "<?xml version=\"1.0\"?>"
+        "<s:Envelope "
+        "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+        "<s:Body>"
+        "<u:QueryStateVariable "
+        "xmlns:u=\"urn:schemas-upnp-org:control-1-0\">"
+        "<u:varName>evented_variable</u:varName>"
+        "</u:QueryStateVariable>"
+        "</s:Body>"
+        "</s:Envelope>";
+
+static void
+on_query_variable_counted (G_GNUC_UNUSED GUPnPService *service,
+                           const char *variable,
+                           GValue *value,
+                           gpointer user_data)
+{
+        guint *queries = user_data;
+
+        if (g_strcmp0 (variable, "evented_variable") != 0)
+                return;
+
+        (*queries)++;
+        g_value_init (value, G_TYPE_UINT);
+        g_value_set_uint (value, *queries);
+}
+
+static void
+test_service_notification_state_store_query (
+        ServiceTestFixture *tf,
+        G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that the answers of query-variable are not kept in the
+        // state store
+        guint queries = 0;
+        char *content;
+
+        tf->payload = "<evented_variable>1</evented_variable>";
+
+        gupnp_service_set_use_state_store (GUPNP_SERVICE (tf->service), TRUE);
+        g_signal_connect (tf->service,
+                          "query-variable",
+                          G_CALLBACK (on_query_variable_counted),
+                          &queries);
+
+        test_fixture_subscribe (tf, on_state_store_notify, on_subscribe);
+        g_main_loop_run (tf->loop);
+        g_assert_cmpuint (queries, ==, 1);
+
+        content = send_query_state_variable (tf, query_evented_variable);
+        g_assert_cmpuint (queries, ==, 2);
+        g_assert_nonnull (strstr (content,
+                                  "<evented_variable>2</evented_variable>"));
+        g_free (content);
+}
+
+static void
+test_service_query_state_variable (ServiceTestFixture *tf,
+                                   G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that the streaming action parser reads escaped and CDATA
+        // content and ignores everything outside of the action
+        static const char *body =
+                "<?xml version=\"1.0\"?>"
+                "<s:Envelope "
+                "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+                "<s:Header><varName>Bogus</varName></s:Header>"
+                "<s:Body>"
+                "<u:QueryStateVariable "
+                "xmlns:u=\"urn:schemas-upnp-org:control-1-0\">"
+                "<u:varName>evented_<![CDATA[variable]]></u:varName>"
+                "</u:QueryStateVariable>"
+                "</s:Body>"
+                "</s:Envelope>";
+        char *content;
+
+        gupnp_service_set_use_state_store (GUPNP_SERVICE (tf->service), TRUE);
+        gupnp_service_notify (GUPNP_SERVICE (tf->service),
+                              "evented_variable",
+                              G_TYPE_STRING,
+                              "a&b",
+                              NULL);
+
+        content = send_query_state_variable (tf, body);
+        g_assert_nonnull (strstr (content,
+                                  "<evented_variable>a&amp;b"
+                                  "</evented_variable>"));
+
+        g_free (content);
+}
+
+static const char *browse_request =
+        "<?xml version=\"1.0\"?>"
+        "<s:Envelope "
+        "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+        "<s:Body>"
+        "<u:Browse xmlns:u=\"urn:test-gupnp-org:service:TestService:1\">"
+        "<ObjectID>0</ObjectID>"
+        "</u:Browse>"
+        "</s:Body>"
+        "</s:Envelope>";
+
+static void
+on_browse_payload (G_GNUC_UNUSED GUPnPService *service,
+                   GUPnPServiceAction *action,
+                   gpointer user_data)
+{
+        ServiceTestFixture *tf = user_data;
+
+        gupnp_service_action_set (action,
+                                  "Result",
+                                  G_TYPE_STRING,
+                                  tf->payload,
+                                  NULL);
+        gupnp_service_action_return_success (action);
+}
+
+/* Call Browse on the service, accepting a gzip-encoded answer. Returns the
+ * body as it was sent and sets @content_encoding to its Content-Encoding,
+ * if any. */
+static GBytes *
+send_browse (ServiceTestFixture *tf, char **content_encoding)
+{
+        TestServiceQueryData data = { tf->loop, NULL };
+        GBytes *request;
+        SoupMessage *msg;
+        SoupMessageHeaders *h;
+        char *url;
+
+        url = gupnp_service_info_get_control_url (tf->service);
+        msg = soup_message_new (SOUP_METHOD_POST, url);
+        g_free (url);
+
+        h = soup_message_get_request_headers (msg);
+        soup_message_headers_append (
+                h,
+                "SOAPAction",
+                "\"urn:test-gupnp-org:service:TestService:1#Browse\"");
+        soup_message_headers_append (h, "Accept-Encoding", "gzip");
+        request = g_bytes_new_static (browse_request, strlen (browse_request));
+        soup_message_set_request_body_from_bytes (msg, "text/xml", request);
+        g_bytes_unref (request);
+
+        soup_session_send_and_read_async (tf->session,
+                                          msg,
+                                          G_PRIORITY_DEFAULT,
+                                          NULL,
+                                          on_query_state_variable,
+                                          &data);
+        g_main_loop_run (tf->loop);
+
+        g_assert_nonnull (data.response);
+        g_assert_cmpint (soup_message_get_status (msg), ==, SOUP_STATUS_OK);
+
+        *content_encoding = g_strdup (soup_message_headers_get_one (
+                soup_message_get_response_headers (msg),
+                "Content-Encoding"));
+        g_object_unref (msg);
+
+        return data.response;
+}
+
+static char *
+gunzip (GBytes *bytes)
+{
+        GInputStream *compressed;
+        GInputStream *in;
+        GOutputStream *out;
+        GConverter *decompressor;
+        GError *error = NULL;
+        GBytes *content;
+        char *result;
+
+        compressed = g_memory_input_stream_new_from_bytes (bytes);
+        decompressor = G_CONVERTER (
+                g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+        in = g_converter_input_stream_new (compressed, decompressor);
+        out = g_memory_output_stream_new_resizable ();
+
+        g_output_stream_splice (out,
+                                in,
+                                G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                        G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                NULL,
+                                &error);
+        g_assert_no_error (error);
+
+        content = g_memory_output_stream_steal_as_bytes (
+                G_MEMORY_OUTPUT_STREAM (out));
+        result = g_strndup (g_bytes_get_data (content, NULL),
+                            g_bytes_get_size (content));
+
+        g_bytes_unref (content);
+        g_object_unref (out);
+        g_object_unref (in);
+        g_object_unref (decompressor);
+        g_object_unref (compressed);
+
+        return result;
+}
+
+static char *
+large_payload (const char *prefix)
+{
+        GString *payload = g_string_new (NULL);
+        guint i;
+
+        for (i = 0; payload->len < 4 * HTTP_GZIP_THRESHOLD; i++)
+                g_string_append_printf (payload, "%s-%u ", prefix, i);
+
+        return g_string_free (payload, FALSE);
+}
+
+static void
+test_service_action_gzip_threshold (ServiceTestFixture *tf,
+                                    G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that a small answer is not compressed even if the client
+        // accepts it
+        char *content_encoding;
+        GBytes *body;
+        char *content;
+
+        // Look at the body as it was sent
+        soup_session_remove_feature_by_type (tf->session,
+                                             SOUP_TYPE_CONTENT_DECODER);
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_browse_payload),
+                          tf);
+
+        tf->payload = "small";
+        body = send_browse (tf, &content_encoding);
+        g_assert_null (content_encoding);
+        g_assert_cmpuint (g_bytes_get_size (body), <, HTTP_GZIP_THRESHOLD);
+
+        content = g_strndup (g_bytes_get_data (body, NULL),
+                             g_bytes_get_size (body));
+        g_assert_nonnull (strstr (content, "<Result>small</Result>"));
+
+        g_free (content);
+        g_bytes_unref (body);
+}
+
+static void
+test_service_action_gzip_reuse (ServiceTestFixture *tf,
+                                G_GNUC_UNUSED gconstpointer user_data)
+{
+        // Check that the compressor that is reused for the second answer
+        // does not carry anything over from the first one
+        const char *prefixes[] = { "first", "second" };
+        guint i;
+
+        soup_session_remove_feature_by_type (tf->session,
+                                             SOUP_TYPE_CONTENT_DECODER);
+        g_signal_connect (tf->service,
+                          "action-invoked::Browse",
+                          G_CALLBACK (on_browse_payload),
+                          tf);
+
+        for (i = 0; i < G_N_ELEMENTS (prefixes); i++) {
+                char *content_encoding;
+                char *payload;
+                char *expected;
+                char *content;
+                GBytes *body;
+
+                payload = large_payload (prefixes[i]);
+                tf->payload = payload;
+
+                body = send_browse (tf, &content_encoding);
+                g_assert_cmpstr (content_encoding, ==, "gzip");
+
+                content = gunzip (body);
+                expected = g_strconcat ("<Result>", payload, "</Result>", NULL);
+                g_assert_nonnull (strstr (content, expected));
+                g_assert_true (g_str_has_suffix (content, "</s:Envelope>"));
+
+                g_free (expected);
+                g_free (content);
+                g_bytes_unref (body);
+                g_free (content_encoding);
+                g_free (payload);
+        }
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -252,5 +1208,82 @@ main (int argc, char *argv[])
         g_test_add_func ("/service/notify/handle-remote-disappering",
                          test_service_notification_remote_disappears);
 
+        g_test_add ("/service/notify/ordered",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_ordered,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/notify/moderated",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_moderated,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/notify/moderated-min-delta",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_moderated_min_delta,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/notify/last-change",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_last_change,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/notify/shed",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_shed,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/notify/drop-oldest",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_drop_oldest,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/notify/state-store",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_state_store,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/notify/state-store-query",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_notification_state_store_query,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/action/query-state-variable",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_query_state_variable,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/action/gzip-threshold",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_action_gzip_threshold,
+                    test_fixture_teardown);
+
+        g_test_add ("/service/action/gzip-reuse",
+                    ServiceTestFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_service_action_gzip_reuse,
+                    test_fixture_teardown);
+
         return g_test_run ();
 }
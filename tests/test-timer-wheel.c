@@ -0,0 +1,259 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include <glib.h>
+
+// The wheel is built into the test with a clock that only moves when told
+// to, so nothing here has to wait for real seconds to pass
+static gint64 test_time;
+#define TIMER_WHEEL_GET_TIME() test_time
+
+#include "libgupnp/timer-wheel.c"
+
+typedef struct {
+        GMainContext *context;
+        TimerWheel *wheel;
+} TimerWheelFixture;
+
+typedef struct _TestTimer TestTimer;
+
+struct _TestTimer {
+        TimerWheelFixture *tf;
+        TimerWheelEntry *entry;
+        guint fired;
+        guint64 fired_at;
+        guint rearm;       // Seconds to re-arm with from the callback, if any
+        TestTimer *cancel; // Timer to cancel from the callback, if any
+};
+
+static void
+on_timer (gpointer user_data)
+{
+        TestTimer *timer = user_data;
+        TimerWheel *wheel = timer->tf->wheel;
+
+        timer->fired++;
+        timer->fired_at = wheel->now;
+
+        if (timer->cancel != NULL)
+                timer_wheel_cancel (wheel, timer->cancel->entry);
+
+        if (timer->rearm != 0) {
+                timer_wheel_rearm (wheel, timer->entry, timer->rearm);
+                timer->rearm = 0;
+        }
+}
+
+static void
+add_timer (TimerWheelFixture *tf, TestTimer *timer, guint seconds)
+{
+        timer->tf = tf;
+        timer->entry = timer_wheel_add (tf->wheel, seconds, on_timer, timer);
+}
+
+// Move the clock to @seconds and run the tick, as the source of the wheel
+// would. Returns whether the source is kept.
+static gboolean
+advance_to (TimerWheelFixture *tf, guint64 seconds)
+{
+        GSource *source = tf->wheel->source;
+        gboolean keep;
+
+        g_assert_nonnull (source);
+
+        test_time = seconds * G_USEC_PER_SEC;
+        keep = timer_wheel_tick (tf->wheel);
+        if (!keep)
+                g_source_destroy (source);
+
+        return keep;
+}
+
+static void
+test_fixture_setup (TimerWheelFixture *tf,
+                    G_GNUC_UNUSED gconstpointer user_data)
+{
+        test_time = 0;
+
+        // Never iterated, the tests run the ticks themselves
+        tf->context = g_main_context_new ();
+        tf->wheel = timer_wheel_new (tf->context);
+}
+
+static void
+test_fixture_teardown (TimerWheelFixture *tf,
+                       G_GNUC_UNUSED gconstpointer user_data)
+{
+        timer_wheel_free (tf->wheel);
+        g_main_context_unref (tf->context);
+}
+
+static void
+test_cascade (TimerWheelFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        TestTimer near = { 0 };
+        TestTimer far = { 0 };
+        TestTimer overflow = { 0 };
+
+        add_timer (tf, &near, 5);
+        add_timer (tf, &far, 300);
+        add_timer (tf, &overflow, 70000);
+
+        g_assert_true (near.entry->slot == &tf->wheel->near[5]);
+        g_assert_true (far.entry->slot == &tf->wheel->far[1]);
+        g_assert_true (overflow.entry->slot == &tf->wheel->overflow);
+
+        g_assert_true (advance_to (tf, 299));
+        g_assert_cmpuint (near.fired, ==, 1);
+        g_assert_cmpuint (near.fired_at, ==, 5);
+        g_assert_cmpuint (far.fired, ==, 0);
+
+        // Moved down to the first level at tick 256
+        g_assert_true (far.entry->slot == &tf->wheel->near[300 & WHEEL_MASK]);
+
+        g_assert_true (advance_to (tf, 300));
+        g_assert_cmpuint (far.fired, ==, 1);
+        g_assert_cmpuint (far.fired_at, ==, 300);
+
+        // Moved out of the overflow list at tick 65536, and down to the first
+        // level at tick 69888
+        g_assert_true (advance_to (tf, 69999));
+        g_assert_cmpuint (overflow.fired, ==, 0);
+        g_assert_true (overflow.entry->slot ==
+                       &tf->wheel->near[70000 & WHEEL_MASK]);
+
+        g_assert_false (advance_to (tf, 70000));
+        g_assert_cmpuint (overflow.fired, ==, 1);
+        g_assert_cmpuint (overflow.fired_at, ==, 70000);
+}
+
+static void
+test_rearm (TimerWheelFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        TestTimer moved = { 0 };
+        TestTimer repeated = { 0 };
+
+        add_timer (tf, &moved, 10);
+        add_timer (tf, &repeated, 20);
+
+        // Re-armed relative to the time of the call
+        g_assert_true (advance_to (tf, 5));
+        timer_wheel_rearm (tf->wheel, moved.entry, 10);
+
+        g_assert_true (advance_to (tf, 14));
+        g_assert_cmpuint (moved.fired, ==, 0);
+
+        g_assert_true (advance_to (tf, 15));
+        g_assert_cmpuint (moved.fired, ==, 1);
+        g_assert_cmpuint (moved.fired_at, ==, 15);
+
+        // Re-armed from its own callback, into the second level
+        repeated.rearm = 300;
+        g_assert_true (advance_to (tf, 20));
+        g_assert_cmpuint (repeated.fired, ==, 1);
+        g_assert_cmpuint (tf->wheel->n_entries, ==, 1);
+
+        g_assert_true (advance_to (tf, 319));
+        g_assert_cmpuint (repeated.fired, ==, 1);
+
+        g_assert_false (advance_to (tf, 320));
+        g_assert_cmpuint (repeated.fired, ==, 2);
+        g_assert_cmpuint (repeated.fired_at, ==, 320);
+}
+
+static void
+test_cancel (TimerWheelFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        TestTimer first = { 0 };
+        TestTimer second = { 0 };
+        TestTimer self = { 0 };
+        TestTimer cancelled = { 0 };
+
+        // All in the same slot
+        add_timer (tf, &first, 10);
+        add_timer (tf, &second, 10);
+        add_timer (tf, &self, 10);
+        first.cancel = &second;
+        self.cancel = &self;
+
+        add_timer (tf, &cancelled, 5);
+        timer_wheel_cancel (tf->wheel, cancelled.entry);
+        g_assert_cmpuint (tf->wheel->n_entries, ==, 3);
+
+        g_assert_false (advance_to (tf, 10));
+        g_assert_cmpuint (first.fired, ==, 1);
+        g_assert_cmpuint (second.fired, ==, 0);
+        g_assert_cmpuint (self.fired, ==, 1);
+        g_assert_cmpuint (cancelled.fired, ==, 0);
+        g_assert_cmpuint (tf->wheel->n_entries, ==, 0);
+}
+
+static void
+test_source (TimerWheelFixture *tf, G_GNUC_UNUSED gconstpointer user_data)
+{
+        TestTimer first = { 0 };
+        TestTimer second = { 0 };
+
+        g_assert_null (tf->wheel->source);
+
+        add_timer (tf, &first, 3);
+        g_assert_nonnull (tf->wheel->source);
+        g_assert_true (g_source_get_context (tf->wheel->source) ==
+                       tf->context);
+
+        // Gone once the wheel is empty
+        g_assert_false (advance_to (tf, 3));
+        g_assert_cmpuint (first.fired, ==, 1);
+        g_assert_null (tf->wheel->source);
+
+        // The time without a source is skipped, not replayed
+        test_time = 1000 * G_USEC_PER_SEC;
+        add_timer (tf, &second, 5);
+        g_assert_nonnull (tf->wheel->source);
+        g_assert_cmpuint (tf->wheel->now, ==, 1000);
+
+        g_assert_true (advance_to (tf, 1004));
+        g_assert_cmpuint (second.fired, ==, 0);
+
+        g_assert_false (advance_to (tf, 1005));
+        g_assert_cmpuint (second.fired, ==, 1);
+        g_assert_cmpuint (second.fired_at, ==, 1005);
+        g_assert_null (tf->wheel->source);
+}
+
+int
+main (int argc, char *argv[])
+{
+        g_test_init (&argc, &argv, NULL);
+
+        g_test_add ("/timer-wheel/cascade",
+                    TimerWheelFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_cascade,
+                    test_fixture_teardown);
+
+        g_test_add ("/timer-wheel/rearm",
+                    TimerWheelFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_rearm,
+                    test_fixture_teardown);
+
+        g_test_add ("/timer-wheel/cancel",
+                    TimerWheelFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_cancel,
+                    test_fixture_teardown);
+
+        g_test_add ("/timer-wheel/source",
+                    TimerWheelFixture,
+                    NULL,
+                    test_fixture_setup,
+                    test_source,
+                    test_fixture_teardown);
+
+        return g_test_run ();
+}